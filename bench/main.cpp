@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "CSR.h"
+#include "Machine.h"
+
+// riscvemu-bench runs a set of guest microbenchmarks on every execution
+// engine and reports their speed, each workload stresses one part of the
+// emulator (dispatch, branches, the memory path, CSR accesses and calls).
+// Workloads are embedded as encoded RV64I instructions so the benchmark
+// doesn't need a RISC-V toolchain, the assembly is given alongside.
+
+/// @brief Workload is a guest program loaded at MemoryBaseAddr, it runs
+/// until it falls off the end of its code.
+struct Workload {
+    const char* name;
+    const char* description;
+    std::vector<uint32_t> code;
+};
+
+/// @brief Return the benchmark workloads.
+static auto workloads() -> std::vector<Workload> {
+    return {
+        {"alu-chain",
+         "dependency chain of ALU operations",
+         {
+            0x008002b7, // lui   t0, 0x800
+            0x00300593, // addi  a1, zero, 3
+            0x00500613, // addi  a2, zero, 5
+            // loop:
+            0x00b50533, // add   a0, a0, a1
+            0x00c54533, // xor   a0, a0, a2
+            0x00151693, // slli  a3, a0, 1
+            0x00d50533, // add   a0, a0, a3
+            0x00355693, // srli  a3, a0, 3
+            0x40d50533, // sub   a0, a0, a3
+            0xfff28293, // addi  t0, t0, -1
+            0xfe0292e3, // bne   t0, zero, loop
+         }},
+        {"branches",
+         "xorshift driven, unpredictable branches",
+         {
+            0x004002b7, // lui   t0, 0x400
+            0x00100513, // addi  a0, zero, 1
+            // loop:
+            0x00d51313, // slli  t1, a0, 13
+            0x00654533, // xor   a0, a0, t1
+            0x00755313, // srli  t1, a0, 7
+            0x00654533, // xor   a0, a0, t1
+            0x01151313, // slli  t1, a0, 17
+            0x00654533, // xor   a0, a0, t1
+            0x00157393, // andi  t2, a0, 1
+            0x00038463, // beq   t2, zero, odd
+            0x00158593, // addi  a1, a1, 1
+            // odd:
+            0x00257393, // andi  t2, a0, 2
+            0x00039463, // bne   t2, zero, even
+            0x00160613, // addi  a2, a2, 1
+            // even:
+            0x00c5e463, // bltu  a1, a2, below
+            0x00168693, // addi  a3, a3, 1
+            // below:
+            0xfff28293, // addi  t0, t0, -1
+            0xfc0292e3, // bne   t0, zero, loop
+         }},
+        {"memory",
+         "64 KiB memcpy 256 times then 4 MiB strided loads 64 times",
+         {
+            0x00000417, // auipc s0, 0
+            0x001002b7, // lui   t0, 0x100
+            0x00540433, // add   s0, s0, t0
+            0x005404b3, // add   s1, s0, t0
+            0x10000e13, // addi  t3, zero, 256
+            // copy:
+            0x00040513, // mv    a0, s0
+            0x00048593, // mv    a1, s1
+            0x00010637, // lui   a2, 0x10
+            0x00a60633, // add   a2, a2, a0
+            // copy_loop:
+            0x00053303, // ld    t1, 0(a0)
+            0x00853383, // ld    t2, 8(a0)
+            0x0065b023, // sd    t1, 0(a1)
+            0x0075b423, // sd    t2, 8(a1)
+            0x01050513, // addi  a0, a0, 16
+            0x01058593, // addi  a1, a1, 16
+            0xfec564e3, // bltu  a0, a2, copy_loop
+            0xfffe0e13, // addi  t3, t3, -1
+            0xfc0e18e3, // bne   t3, zero, copy
+            0x04000e13, // addi  t3, zero, 64
+            // stride:
+            0x00040513, // mv    a0, s0
+            0x00400637, // lui   a2, 0x400
+            0x00a60633, // add   a2, a2, a0
+            // stride_loop:
+            0x00054303, // lbu   t1, 0(a0)
+            0x006686b3, // add   a3, a3, t1
+            0x04050513, // addi  a0, a0, 64
+            0xfec56ae3, // bltu  a0, a2, stride_loop
+            0xfffe0e13, // addi  t3, t3, -1
+            0xfe0e10e3, // bne   t3, zero, stride
+         }},
+        {"csr",
+         "counter reads and mscratch swaps",
+         {
+            0x004002b7, // lui   t0, 0x400
+            // loop:
+            0xc0202573, // csrrs a0, instret, zero
+            0xc00025f3, // csrrs a1, cycle, zero
+            0x34051673, // csrrw a2, mscratch, a0
+            0x340026f3, // csrrs a3, mscratch, zero
+            0x00d70733, // add   a4, a4, a3
+            0xfff28293, // addi  t0, t0, -1
+            0xfe0294e3, // bne   t0, zero, loop
+         }},
+        {"calls",
+         "recursive fib(27) 4 times",
+         {
+            0x00400493, // addi  s1, zero, 4
+            // repeat:
+            0x01b00513, // addi  a0, zero, 27
+            0x014000ef, // jal   ra, fib
+            0x00a90933, // add   s2, s2, a0
+            0xfff48493, // addi  s1, s1, -1
+            0xfe0498e3, // bne   s1, zero, repeat
+            0x0480006f, // jal   zero, end
+            // fib:
+            0x00200293, // addi  t0, zero, 2
+            0x02556e63, // bltu  a0, t0, fib_leaf
+            0xfe010113, // addi  sp, sp, -32
+            0x00113c23, // sd    ra, 24(sp)
+            0x00813823, // sd    s0, 16(sp)
+            0x00a13423, // sd    a0, 8(sp)
+            0xfff50513, // addi  a0, a0, -1
+            0xfe5ff0ef, // jal   ra, fib
+            0x00050413, // mv    s0, a0
+            0x00813503, // ld    a0, 8(sp)
+            0xffe50513, // addi  a0, a0, -2
+            0xfd5ff0ef, // jal   ra, fib
+            0x00850533, // add   a0, a0, s0
+            0x01013403, // ld    s0, 16(sp)
+            0x01813083, // ld    ra, 24(sp)
+            0x02010113, // addi  sp, sp, 32
+            // fib_leaf:
+            0x00008067, // jalr  zero, 0(ra)
+            // end:
+         }},
+    };
+}
+
+/// @brief Host timestamp counter, 0 on hosts without one. On x86-64 this
+/// is the TSC which counts at a constant reference frequency.
+static auto hostCycles() -> uint64_t {
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/// @brief Measurement of a single run.
+struct Measurement {
+    uint64_t instructions = 0;
+    double seconds        = std::numeric_limits<double>::infinity();
+    uint64_t cycles       = 0;
+};
+
+/// @brief Run workload once on engine, the context and hart are created
+/// before the clock starts.
+/// @param workload
+/// @param engine
+/// @return Measurement
+static auto measure(const Workload& workload, riscvemu::Engine engine)
+    -> Measurement {
+    std::vector<uint8_t> image(workload.code.size() * 4);
+    std::memcpy(image.data(), workload.code.data(), image.size());
+    auto cpu = riscvemu::CPU(riscvemu::VMContext(image));
+
+    auto start       = std::chrono::steady_clock::now();
+    auto startCycles = hostCycles();
+    cpu.run(engine);
+    auto cycles  = hostCycles() - startCycles;
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    return {
+        .instructions = cpu.getCSR(riscvemu::MInstRet),
+        .seconds      = std::chrono::duration<double>(elapsed).count(),
+        .cycles       = cycles,
+    };
+}
+
+/// @brief Name of an engine as accepted by --engine.
+static auto engineName(riscvemu::Engine engine) -> const char* {
+    switch (engine) {
+    case riscvemu::Engine::Interpreter:
+        return "interpreter";
+    case riscvemu::Engine::Threaded:
+        return "threaded";
+    case riscvemu::Engine::Jit:
+        return "jit";
+    }
+    return "unknown";
+}
+
+auto main(int argc, char* argv[]) -> int {
+    std::vector<riscvemu::Engine> engines = {riscvemu::Engine::Interpreter,
+                                             riscvemu::Engine::Threaded,
+                                             riscvemu::Engine::Jit};
+    size_t repeat = 3;
+    std::vector<std::string> selected;
+    for (int i = 1; i < argc; i++) {
+        auto option = std::string(argv[i]);
+        if (option == "--engine=interpreter") {
+            engines = {riscvemu::Engine::Interpreter};
+        } else if (option == "--engine=threaded") {
+            engines = {riscvemu::Engine::Threaded};
+        } else if (option == "--engine=jit") {
+            engines = {riscvemu::Engine::Jit};
+        } else if (option.starts_with("--repeat=")) {
+            repeat = std::max<size_t>(std::stoull(option.substr(9)), 1);
+        } else if (option.starts_with("--")) {
+            std::printf("Usage: riscvemu-bench "
+                        "[--engine=interpreter|threaded|jit] [--repeat=N] "
+                        "[workload...]\n");
+            return -1;
+        } else {
+            selected.push_back(option);
+        }
+    }
+
+    std::printf("%-10s %-12s %14s %10s %10s %10s %12s\n", "workload",
+                "engine", "instructions", "seconds", "MIPS", "ns/inst",
+                "cycles/inst");
+    for (const auto& workload : workloads()) {
+        if (!selected.empty() &&
+            std::find(selected.begin(), selected.end(), workload.name) ==
+                selected.end()) {
+            continue;
+        }
+        for (auto engine : engines) {
+            // Report the fastest of repeat runs.
+            auto best = Measurement{};
+            for (size_t run = 0; run < repeat; run++) {
+                auto measured = measure(workload, engine);
+                if (measured.seconds < best.seconds) {
+                    best = measured;
+                }
+            }
+            auto instructions = (double)best.instructions;
+            char cycles[16]   = "n/a";
+            if (best.cycles != 0) {
+                std::snprintf(cycles, sizeof(cycles), "%.2f",
+                              (double)best.cycles / instructions);
+            }
+            std::printf("%-10s %-12s %14llu %10.3f %10.1f %10.2f %12s\n",
+                        workload.name, engineName(engine),
+                        (unsigned long long)best.instructions, best.seconds,
+                        instructions / best.seconds / 1e6,
+                        best.seconds * 1e9 / instructions, cycles);
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "Machine.h"
+#include "Snapshot.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace riscvemu {
+
+/// @brief BatchResult is the state a guest stopped in after a batch run.
+struct BatchResult {
+    // Program counter the guest stopped at.
+    uint64_t pc = 0;
+    // Final register file, the guest returns its result in a0.
+    std::array<uint64_t, 32> registers{};
+    // How the guest stopped, a trap without handler is reported here.
+    RunResult outcome;
+    // Message of the host exception that stopped the run, empty otherwise.
+    std::string error;
+};
+
+/// @brief BatchRunner runs one program against many inputs, every run
+/// starts from a copy-on-write clone of the context the program was loaded
+/// in (see Snapshot) so the image is read and loaded once for the batch.
+/// Runs are spread over a pool of host threads, each worker owns a range
+/// of inputs and steals half of another worker's remaining range when its
+/// own is exhausted, so uneven run times don't leave threads idle.
+///
+/// An input is copied below the initial stack pointer, aligned down to 16
+/// bytes, and the guest starts with a0 holding its address, a1 its length
+/// and sp pointing at it.
+class BatchRunner {
+    public:
+    /// @brief BatchRunner constructor.
+    /// @param ctx Context the program was loaded in.
+    /// @param threads Number of worker threads, 0 uses one per host core.
+    explicit BatchRunner(const VMContext& ctx, size_t threads = 0);
+
+    /// @brief Run the program once per input.
+    /// @param inputs
+    /// @param engine
+    /// @return Results in the order of inputs.
+    auto run(const std::vector<std::vector<uint8_t>>& inputs, Engine engine)
+        -> std::vector<BatchResult>;
+
+    /// @brief Run the program against a single input on the calling thread.
+    /// @param input
+    /// @param engine
+    /// @return BatchResult
+    [[nodiscard]] auto runOne(const std::vector<uint8_t>& input,
+                              Engine engine) const -> BatchResult;
+
+    /// @brief Return the number of worker threads.
+    [[nodiscard]] auto threads() const -> size_t { return this->workers; }
+
+    private:
+    /// @brief Post-load state every run is cloned from.
+    Snapshot snapshot;
+    /// @brief Number of worker threads.
+    size_t workers;
+};
+
+} // namespace riscvemu
+
+#endif
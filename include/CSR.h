@@ -1,11 +1,37 @@
 #ifndef CSR_H
 #define CSR_H
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
 
 namespace riscvemu {
 // Control status registers.
 //
+// Floating point registers (RV64F/D).
+
+// Accrued exception flags, the low 5 bits of fcsr.
+static constexpr uint64_t FFlags = 0x001;
+// Dynamic rounding mode, bits 7-5 of fcsr.
+static constexpr uint64_t Frm = 0x002;
+// Floating point control and status register.
+static constexpr uint64_t Fcsr = 0x003;
+
+static constexpr uint64_t MaskFFlags = 0x1f;
+static constexpr uint64_t MaskFrm    = 0x7 << 5;
+static constexpr uint64_t MaskFcsr   = MaskFrm | MaskFFlags;
+
+// Vector registers (RVV).
+
+// Index of the first element a vector instruction executes.
+static constexpr uint64_t VStart = 0x008;
+// Vector length, number of elements updated by a vector instruction.
+static constexpr uint64_t Vl = 0xC20;
+// Vector data type, the element width and register grouping.
+static constexpr uint64_t VType = 0xC21;
+// Vector register length in bytes.
+static constexpr uint64_t VLenB = 0xC22;
+
 // Machine information registers.
 
 // Hardware thread id.
@@ -56,6 +82,46 @@ static constexpr uint64_t MTInst = 0x34A;
 // Machine bad guest physical address.
 static constexpr uint64_t MTVal2 = 0x34B;
 
+// Machine counter setup registers.
+
+// Machine counter inhibit.
+static constexpr uint64_t MCountInhibit = 0x320;
+
+// Machine performance monitoring event selectors, mhpmevent3 to 31.
+static constexpr uint64_t MHpmEvent3  = 0x323;
+static constexpr uint64_t MHpmEvent31 = 0x33F;
+
+// Machine counters and timers.
+
+// Machine cycle counter.
+static constexpr uint64_t MCycle = 0xB00;
+
+// Machine instructions retired counter.
+static constexpr uint64_t MInstRet = 0xB02;
+
+// Machine performance monitoring counters, mhpmcounter3 to 31.
+static constexpr uint64_t MHpmCounter3  = 0xB03;
+static constexpr uint64_t MHpmCounter31 = 0xB1F;
+
+// Unprivileged counters and timers, read-only shadows of the machine
+// counters enabled by mcounteren and scounteren.
+
+// Cycle counter.
+static constexpr uint64_t Cycle = 0xC00;
+
+// Real time counter, see TimeFrequency.
+static constexpr uint64_t Time = 0xC01;
+
+// Instructions retired counter.
+static constexpr uint64_t InstRet = 0xC02;
+
+// Performance monitoring counters, hpmcounter3 to 31.
+static constexpr uint64_t HpmCounter3  = 0xC03;
+static constexpr uint64_t HpmCounter31 = 0xC1F;
+
+// Frequency of the time counter in Hz.
+static constexpr uint64_t TimeFrequency = 10000000;
+
 // Supervisor registers.
 
 // Supervisor trap setup registers.
@@ -123,46 +189,245 @@ static constexpr uint64_t MaskMTIP    = 1 << 7;
 static constexpr uint64_t MaskSEIP    = 1 << 9;
 static constexpr uint64_t MaskMEIP    = 1 << 11;
 static constexpr uint64_t MaskSSTATUS = MaskSIE | MaskSPIE | MaskUBE | MaskSPP |
-                                        MaskFS | MaskXS | MaskSUM | MaskMXR |
-                                        MaskUXL | MaskSD;
+                                        MaskVS | MaskFS | MaskXS | MaskSUM |
+                                        MaskMXR | MaskUXL | MaskSD;
+
+// MCOUNTINHIBIT field mask, time can't be inhibited.
+static constexpr uint64_t MaskCY = 1 << 0;
+static constexpr uint64_t MaskTM = 1 << 1;
+static constexpr uint64_t MaskIR = 1 << 2;
+
+/// @brief Interrupt bit of mcause and scause, the low bits of an interrupt
+/// cause are the number of its bit in mip.
+static constexpr uint64_t CauseInterrupt = 1ULL << 63;
+
+/// @brief Interrupt numbers in decreasing priority order.
+static constexpr std::array<uint64_t, 6> InterruptPriority = {11, 3, 7,
+                                                              9,  1, 5};
+
+/// @brief TrapCause enumerates the synchronous exception codes written to
+/// mcause when a trap is taken.
+enum class TrapCause : uint64_t {
+    InstructionAddressMisaligned = 0,
+    InstructionAccessFault       = 1,
+    IllegalInstruction           = 2,
+    Breakpoint                   = 3,
+    LoadAddressMisaligned        = 4,
+    LoadAccessFault              = 5,
+    StoreAddressMisaligned       = 6,
+    StoreAccessFault             = 7,
+    ECallFromU                   = 8,
+    ECallFromS                   = 9,
+    ECallFromM                   = 11,
+    InstructionPageFault         = 12,
+    LoadPageFault                = 13,
+    StorePageFault               = 15,
+};
+
+/// @brief Number of CSR addresses, CSR numbers are 12 bits.
+static constexpr size_t CSRAddresses = 4096;
+
+/// @brief CSRKind selects how accesses to a CSR number are carried out.
+enum class CSRKind : uint8_t {
+    // Not implemented, accessing it is an illegal instruction.
+    Unimplemented,
+    // Plain read/write register backed by its storage slot.
+    Register,
+    // Supervisor view of mstatus, restricted to MaskSSTATUS.
+    SStatus,
+    // Supervisor views of mie and mip, restricted to mideleg.
+    Sie,
+    Sip,
+    // Counter computed by the hart on read (see CPU::readCounter).
+    Counter,
+    // Hpm counter, written by the hart and kept in its slot.
+    HpmCounter,
+    // Hardwired to zero, writes are ignored (the hpm event selectors only
+    // implement the "no event" selector).
+    Zero,
+    // fcsr and its views fflags and frm, sharing the slot of fcsr.
+    Fcsr,
+    FFlags,
+    Frm,
+};
+
+/// @brief CSREntry describes an implemented CSR number.
+struct CSREntry {
+    CSRKind kind = CSRKind::Unimplemented;
+    // Index of the CSR in CSR::values.
+    uint8_t slot = 0;
+    // Writes change the address translation of the hart.
+    bool paging = false;
+    // Writes may unmask a pending interrupt.
+    bool interrupts = false;
+    // Floating point CSR, only accessible while mstatus.FS isn't Off.
+    bool fp = false;
+    // Vector CSR, only accessible while mstatus.VS isn't Off.
+    bool vector = false;
+};
+
+/// @brief CSR numbers of the registers given their own storage slot, in
+/// slot order. The machine hpm counters follow them.
+static constexpr std::array<uint16_t, 32> StoredCSRs = {
+    MHartID,  MStatus,    MIsa,       MEDeleg,  MIDeleg, MIE,
+    MTVec,    MCounteren, MScratch,   MEPc,     MCause,  MTVal,
+    MIp,      MTInst,     MTVal2,     MCountInhibit,     SStatus,
+    Sie,      STVec,      SCounteren, SSCratch, Sepc,    SCause,
+    STVal,    Sip,        Satp,       SContext, Fcsr,    VStart,
+    Vl,       VType,      VLenB,
+};
 
+/// @brief CSRTable maps every CSR number to its entry, built at compile
+/// time so an access is a table lookup whatever the CSR.
+static constexpr auto CSRTable = [] {
+    std::array<CSREntry, CSRAddresses> table{};
+    uint8_t slot = 0;
+    for (auto addr : StoredCSRs) {
+        table[addr] = {.kind = CSRKind::Register, .slot = slot++};
+    }
+    for (auto addr = MCycle; addr <= MHpmCounter31; addr++) {
+        table[addr]                  = {.kind = CSRKind::Counter};
+        table[addr - MCycle + Cycle] = {.kind = CSRKind::Counter};
+    }
+    for (auto addr = MHpmCounter3; addr <= MHpmCounter31; addr++) {
+        table[addr] = table[addr - MCycle + Cycle] = {
+            .kind = CSRKind::HpmCounter, .slot = slot++};
+    }
+    for (auto addr = MHpmEvent3; addr <= MHpmEvent31; addr++) {
+        table[addr] = {.kind = CSRKind::Zero};
+    }
+    table[SStatus].kind = CSRKind::SStatus;
+    table[Sie].kind     = CSRKind::Sie;
+    table[Sip].kind     = CSRKind::Sip;
+    table[FFlags]       = table[Frm] = table[Fcsr];
+    table[Fcsr].kind    = CSRKind::Fcsr;
+    table[FFlags].kind  = CSRKind::FFlags;
+    table[Frm].kind     = CSRKind::Frm;
+    for (auto addr : {FFlags, Frm, Fcsr}) {
+        table[addr].fp = true;
+    }
+    for (auto addr : {VStart, Vl, VType, VLenB}) {
+        table[addr].vector = true;
+    }
+    for (auto addr : {MStatus, SStatus, Satp}) {
+        table[addr].paging = true;
+    }
+    for (auto addr : {MStatus, SStatus, MIE, Sie, MIp, Sip, MIDeleg}) {
+        table[addr].interrupts = true;
+    }
+    return table;
+}();
+
+/// @brief Number of CSR storage slots.
+static constexpr size_t CSRSlots =
+    StoredCSRs.size() + (MHpmCounter31 - MHpmCounter3 + 1);
+
+/// @brief CSR holds the control and status registers of a hart, only the
+/// implemented registers are stored (see CSRTable).
 struct CSR {
-    uint64_t csrs[4096]; //NOLINT
+    std::array<uint64_t, CSRSlots> values{};
+
+    /// @brief Return the entry of the CSR number addr.
+    static constexpr auto entry(uint64_t addr) -> CSREntry {
+        return CSRTable[addr & (CSRAddresses - 1)];
+    }
 
     // Load and Store operations on each Control and Status registers.
 
-    /// Return value stored at the register specified in addr.
-    auto load(uint64_t addr) -> uint64_t {
-        if (addr == Sie) {
-            return this->csrs[MIE] & this->csrs[MIDeleg];
-        }
-        if (addr == Sip) {
-            return this->csrs[MIp] & this->csrs[MIDeleg];
-        }
-        if (addr == SStatus) {
-            return this->csrs[MStatus] & MaskSSTATUS;
+    /// Return value of the register specified in addr, the supervisor
+    /// views are computed from the machine registers and the fcsr views
+    /// from fcsr. Counters are read through CPU::readCounter, the hpm
+    /// counters return their slot.
+    [[nodiscard]] auto load(uint64_t addr) const -> uint64_t {
+        auto csr = entry(addr);
+        switch (csr.kind) {
+        case CSRKind::Register:
+        case CSRKind::HpmCounter:
+            return this->values[csr.slot];
+        case CSRKind::SStatus:
+            return value(MStatus) & MaskSSTATUS;
+        case CSRKind::Sie:
+            return value(MIE) & value(MIDeleg);
+        case CSRKind::Sip:
+            return value(MIp) & value(MIDeleg);
+        case CSRKind::Fcsr:
+            return value(Fcsr);
+        case CSRKind::FFlags:
+            return value(Fcsr) & MaskFFlags;
+        case CSRKind::Frm:
+            return (value(Fcsr) & MaskFrm) >> 5;
+        case CSRKind::Unimplemented:
+        case CSRKind::Counter:
+        case CSRKind::Zero:
+            break;
         }
-        return this->csrs[addr];
+        return 0;
     }
 
-    /// Store value at the register specified in addr.
+    /// Store value at the register specified in addr, stores to the
+    /// supervisor views update the machine registers they show and stores
+    /// to the fcsr views update fcsr.
     auto store(uint64_t addr, uint64_t value) -> void {
-        if (addr == Sie) {
-            this->csrs[MIE] =
-                (this->csrs[MIE] & ~this->csrs[MIDeleg]) | //NOLINT
-                (value & this->csrs[MIDeleg]);
+        auto csr = entry(addr);
+        switch (csr.kind) {
+        case CSRKind::SStatus:
+            slot(MStatus) = (slot(MStatus) & ~MaskSSTATUS) | //NOLINT
+                            (value & MaskSSTATUS);
+            break;
+        case CSRKind::Sie:
+            slot(MIE) = (slot(MIE) & ~slot(MIDeleg)) | //NOLINT
+                        (value & slot(MIDeleg));
+            break;
+        case CSRKind::Sip:
+            slot(MIp) = (slot(MIp) & ~slot(MIDeleg)) | //NOLINT
+                        (value & slot(MIDeleg));
+            break;
+        case CSRKind::Fcsr:
+            slot(Fcsr) = value & MaskFcsr;
+            return;
+        case CSRKind::FFlags:
+            slot(Fcsr) = (slot(Fcsr) & ~MaskFFlags) | (value & MaskFFlags);
+            return;
+        case CSRKind::Frm:
+            slot(Fcsr) = (slot(Fcsr) & ~MaskFrm) | ((value << 5) & MaskFrm);
+            return;
+        case CSRKind::Unimplemented:
+        case CSRKind::Counter:
+        case CSRKind::Zero:
+            return;
+        case CSRKind::Register:
+        case CSRKind::HpmCounter:
+            break;
         }
-        if (addr == Sip) {
-            this->csrs[MIp] =
-                (this->csrs[MIE] & ~this->csrs[MIDeleg]) | //NOLINT
-                (value & this->csrs[MIDeleg]);
-        }
-        if (addr == SStatus) {
-            this->csrs[MStatus] =
-                (this->csrs[MStatus] & ~MaskSSTATUS) | //NOLINT
-                (value & MaskSSTATUS);
+        this->values[csr.slot] = value;
+    }
+
+    /// Return the value last stored at addr, the supervisor views keep the
+    /// value written to them and the fcsr views are read from fcsr. CSRs
+    /// without a slot are 0.
+    [[nodiscard]] auto stored(uint64_t addr) const -> uint64_t {
+        switch (entry(addr).kind) {
+        case CSRKind::Unimplemented:
+        case CSRKind::Counter:
+        case CSRKind::Zero:
+            return 0;
+        case CSRKind::FFlags:
+        case CSRKind::Frm:
+            return load(addr);
+        default:
+            return this->values[entry(addr).slot];
         }
-        this->csrs[addr] = value;
+    }
+
+    private:
+    /// Value of the stored register addr.
+    [[nodiscard]] auto value(uint64_t addr) const -> uint64_t {
+        return this->values[CSRTable[addr].slot];
+    }
+
+    /// Slot of the stored register addr.
+    auto slot(uint64_t addr) -> uint64_t& {
+        return this->values[CSRTable[addr].slot];
     }
 };
 
@@ -0,0 +1,69 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "Machine.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace riscvemu {
+
+/// @brief CheckpointError is raised when a checkpoint stream is malformed,
+/// truncated or was written by an incompatible version.
+struct CheckpointError : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+/// @brief Checkpoint saves the state of a hart (registers, pc, CSRs,
+/// privilege and counters), the memory of its context and the state of
+/// its devices (the hart's CLINT registers and mtime, the UART registers
+/// and received input) to a stream and restores it into a new hart.
+/// A stream holds a sequence of records. The first checkpoint of a context
+/// saves every page holding data, the following ones only the pages stored
+/// to since the previous checkpoint, so appending checkpoints to the same
+/// stream keeps a history of the run that can be restored up to any of
+/// its records. Pages are tracked with MMU::CleanFlag, guest stores take
+/// their checked path once per page after a checkpoint and are otherwise
+/// unaffected.
+/// Only single hart contexts are supported. mtime (the time CSR) resumes
+/// from its saved value and counts host time from the restore, so an armed
+/// timer fires after the same guest time as without the checkpoint.
+class Checkpoint {
+    public:
+    /// @brief First bytes of every record, "RVEMCKPT".
+    static constexpr uint64_t Magic = 0x54504b434d455652;
+
+    /// @brief Format version, bumped on any layout change.
+    static constexpr uint32_t Version = 4;
+
+    /// @brief Append a checkpoint of cpu to out.
+    /// @param cpu
+    /// @param out
+    /// @return Number of pages saved, throws CheckpointError if out fails.
+    static auto write(CPU& cpu, std::ostream& out) -> size_t;
+
+    /// @brief Restore a hart from the records of in, records are applied in
+    /// order and the first one must be the first checkpoint of a context.
+    /// @param in
+    /// @param records Number of records applied (at least one), the whole
+    /// stream by default.
+    /// @return CPU in the state of the last record applied, throws
+    /// CheckpointError if the stream is malformed.
+    static auto read(std::istream& in,
+                     size_t records = std::numeric_limits<size_t>::max())
+        -> CPU;
+};
+
+/// @brief Returns true if the file at path starts with a checkpoint record.
+/// @param path
+/// @return bool
+auto isCheckpoint(const std::string& path) -> bool;
+
+} // namespace riscvemu
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef CONFORMANCE_H
+#define CONFORMANCE_H
+
+#include "Machine.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace riscvemu {
+
+/// @brief ConformanceStatus is the outcome of a riscv-tests program.
+enum class ConformanceStatus {
+    // The program wrote 1 to tohost.
+    Pass,
+    // The program wrote the number of its failing test to tohost.
+    Fail,
+    // The hart stopped without writing to tohost.
+    Stopped,
+    // The program ran out of its instruction limit.
+    Timeout,
+    // The program couldn't be loaded or has no tohost symbol.
+    Error,
+};
+
+/// @brief ConformanceOptions configure a ConformanceRunner.
+struct ConformanceOptions {
+    // Number of worker threads, 0 uses one per host core.
+    size_t threads = 0;
+    // Guest memory size of every program.
+    uint64_t memorySize = MemoryMaxSize;
+    // Instructions run between two polls of tohost.
+    uint64_t slice = 1000;
+    // Instructions a program may run before it times out.
+    uint64_t limit = 10000000;
+};
+
+/// @brief ConformanceResult is the outcome of one program on one engine.
+struct ConformanceResult {
+    // Path of the program.
+    std::string path;
+    Engine engine = Engine::Interpreter;
+    ConformanceStatus status = ConformanceStatus::Error;
+    // Number of the failing test, for Fail.
+    uint64_t test = 0;
+    // Instructions retired until tohost was seen written.
+    uint64_t instructions = 0;
+    // Wall time of the run, loading excluded.
+    double seconds = 0;
+    // Message of the host exception for Error.
+    std::string error;
+};
+
+/// @brief ConformanceRunner runs riscv-tests ISA programs (the rv64*-p-*
+/// ELF executables) on a pool of host threads. A program reports its
+/// result by storing to its tohost symbol: 1 when every test passed,
+/// (test << 1) | 1 for the first failing test, then it spins. The runner
+/// runs each program in steps of slice instructions (see CPU::step) and
+/// polls tohost in between, so instruction counts are rounded up to the
+/// slice but are exact and the same on every engine.
+class ConformanceRunner {
+    public:
+    /// @brief ConformanceRunner constructor.
+    /// @param options
+    explicit ConformanceRunner(ConformanceOptions options);
+
+    /// @brief Run every program on every engine.
+    /// @param paths
+    /// @param engines
+    /// @return Results ordered by program, then by engine.
+    auto run(const std::vector<std::string>& paths,
+             const std::vector<Engine>& engines)
+        -> std::vector<ConformanceResult>;
+
+    /// @brief Run a single program on the calling thread.
+    /// @param path
+    /// @param engine
+    /// @return ConformanceResult
+    [[nodiscard]] auto runOne(const std::string& path, Engine engine) const
+        -> ConformanceResult;
+
+    /// @brief Return the number of worker threads.
+    [[nodiscard]] auto threads() const -> size_t {
+        return this->options.threads;
+    }
+
+    private:
+    ConformanceOptions options;
+};
+
+} // namespace riscvemu
+
+#endif
@@ -10,6 +10,16 @@ namespace riscvemu {
 // in the first 7 bits.
 static constexpr uint32_t OPCodeMask = 0x7f;
 
+// Instructions whose two lowest bits aren't both set are 16-bit compressed
+// instructions (RVC), the others are 32 bits long.
+static constexpr uint32_t CompressedMask = 0b11;
+
+/// @brief Returns the size in bytes of the instruction whose low bits are
+/// given.
+static inline auto instructionSize(uint32_t instruction) -> uint8_t {
+    return (instruction & CompressedMask) == CompressedMask ? 4 : 2;
+}
+
 // Sign extend bits in the lower part of value into signed int64_t.
 static inline auto signExtend(uint64_t value, uint64_t bits) -> int64_t {
     return ((int64_t)(value << (64 - bits))) >> (64 - bits);
@@ -131,6 +141,52 @@ struct Utype {
 template <typename T> auto decodeInstruction(const uint32_t instruction) -> T {
     return T(instruction);
 }
+
+class CPU;
+struct DecodedInstruction;
+
+/// @brief Handler executes a single decoded instruction against a CPU, it
+/// returns false if the instruction raised a trap (see CPU::raise) which
+/// the engine running it then takes.
+using Handler = auto (*)(CPU&, const DecodedInstruction&) -> bool;
+
+/// @brief DecodedInstruction holds an instruction with all of its operands
+/// already extracted, so executing it again doesn't need to touch the
+/// encoded bits.
+/// Register operands are stored as indices into the register file, the
+/// immediate is stored sign extended (or zero extended CSR address for the
+/// CSR group). Compressed instructions are decoded as the 32-bit
+/// instruction they expand to, only raw and size tell them apart.
+struct DecodedInstruction {
+    // Handler executing the instruction, nullptr until the entry is filled.
+    Handler handler = nullptr;
+    // Immediate operand, CSR address for the CSR group.
+    int32_t imm = 0;
+    // Encoded instruction bits.
+    uint32_t raw = 0;
+    Mnemonic mnemonic = Mnemonic::ILLEGAL;
+    uint8_t rd        = 0;
+    uint8_t rs1       = 0;
+    uint8_t rs2       = 0;
+    uint8_t funct3    = 0;
+    uint8_t funct7    = 0;
+    // Size of the encoded instruction in bytes, 2 for compressed ones.
+    uint8_t size = 4;
+};
+
+/// @brief Decode an encoded instruction into its mnemonic and operands,
+/// the handler is left for the caller to resolve. Compressed instructions
+/// only use the low 16 bits of instruction.
+/// @param instruction
+/// @return DecodedInstruction with mnemonic and operands.
+auto predecode(uint32_t instruction) -> DecodedInstruction;
+
+/// @brief Expand a compressed instruction to the 32-bit instruction it
+/// stands for.
+/// @param instruction
+/// @return 32-bit encoding, 0 (an illegal instruction) for reserved and
+/// illegal encodings.
+auto expandCompressed(uint16_t instruction) -> uint32_t;
 }; // namespace riscvemu
 
 #endif
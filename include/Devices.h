@@ -0,0 +1,216 @@
+#ifndef DEVICES_H
+#define DEVICES_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace riscvemu {
+
+/// @brief Base address of the 16550 UART, the address QEMU's virt machine
+/// uses so guests built for it find the console.
+static constexpr uint64_t UartBaseAddr = 0x10000000;
+
+/// @brief Size of the UART register window.
+static constexpr uint64_t UartSize = 0x100;
+
+/// @brief Base address of the CLINT.
+static constexpr uint64_t ClintBaseAddr = 0x2000000;
+
+/// @brief Size of the CLINT register window.
+static constexpr uint64_t ClintSize = 0x10000;
+
+/// @brief Device is a memory-mapped device model, it is accessed with the
+/// offset of the access from the base address it is attached at.
+/// Devices may be shared by harts running on different host threads and
+/// synchronize their own state.
+class Device {
+    public:
+    virtual ~Device() = default;
+
+    /// @brief Read size bytes at offset into value.
+    /// @param offset
+    /// @param size 1, 2, 4 or 8.
+    /// @param value
+    /// @return false if the device doesn't support the access.
+    virtual auto read(uint64_t offset, size_t size, uint64_t& value)
+        -> bool = 0;
+
+    /// @brief Write the low size bytes of value at offset.
+    /// @param offset
+    /// @param size 1, 2, 4 or 8.
+    /// @param value
+    /// @return false if the device doesn't support the access.
+    virtual auto write(uint64_t offset, size_t size, uint64_t value)
+        -> bool = 0;
+};
+
+/// @brief Bus dispatches the physical addresses outside of guest memory to
+/// the devices attached to it. Harts only consult it once an access
+/// missed memory, RAM accesses never reach it.
+class Bus {
+    public:
+    /// @brief Attach device to the size bytes starting at base, the range
+    /// must not overlap a device already attached.
+    /// @param base
+    /// @param size
+    /// @param device
+    auto attach(uint64_t base, uint64_t size, std::shared_ptr<Device> device)
+        -> void;
+
+    /// @brief Read size bytes at the physical address addr into value.
+    /// @param addr
+    /// @param size
+    /// @param value
+    /// @return false if no device handles the access.
+    auto read(uint64_t addr, size_t size, uint64_t& value) -> bool;
+
+    /// @brief Write the low size bytes of value at the physical address
+    /// addr.
+    /// @param addr
+    /// @param size
+    /// @param value
+    /// @return false if no device handles the access.
+    auto write(uint64_t addr, size_t size, uint64_t value) -> bool;
+
+    private:
+    /// @brief Range of addresses a device is attached to.
+    struct Mapping {
+        uint64_t base;
+        uint64_t size;
+        std::shared_ptr<Device> device;
+    };
+
+    /// @brief Mapping covering the size bytes at addr, nullptr if none.
+    auto find(uint64_t addr, size_t size) -> Mapping*;
+
+    std::vector<Mapping> mappings;
+};
+
+/// @brief Uart models a 16550 UART used as the guest console: bytes written
+/// to the transmit register are written to the output stream and bytes
+/// queued with receive are read from the receive register. The transmitter
+/// is always ready and the line settings (divisor latch, LCR, MCR) are
+/// stored without effect. Only byte accesses are supported and no
+/// interrupt is raised.
+class Uart : public Device {
+    public:
+    /// @brief Register offsets.
+    static constexpr uint64_t RBR = 0; // Receive buffer (read, DLAB 0).
+    static constexpr uint64_t THR = 0; // Transmit holding (write, DLAB 0).
+    static constexpr uint64_t IER = 1; // Interrupt enable (DLAB 0).
+    static constexpr uint64_t IIR = 2; // Interrupt identification (read).
+    static constexpr uint64_t FCR = 2; // FIFO control (write).
+    static constexpr uint64_t LCR = 3; // Line control.
+    static constexpr uint64_t MCR = 4; // Modem control.
+    static constexpr uint64_t LSR = 5; // Line status.
+    static constexpr uint64_t MSR = 6; // Modem status.
+    static constexpr uint64_t SCR = 7; // Scratch.
+
+    /// @brief Line status bits.
+    static constexpr uint8_t LsrDataReady        = 1 << 0;
+    static constexpr uint8_t LsrTransmitterEmpty = (1 << 5) | (1 << 6);
+
+    /// @brief Line control divisor latch access bit.
+    static constexpr uint8_t LcrDlab = 1 << 7;
+
+    /// @brief Register values and received bytes not read yet, saved and
+    /// restored by checkpoints.
+    struct State {
+        uint8_t ier = 0;
+        uint8_t fcr = 0;
+        uint8_t lcr = 0;
+        uint8_t mcr = 0;
+        uint8_t scr = 0;
+        uint8_t dll = 0;
+        uint8_t dlm = 0;
+        std::vector<uint8_t> input;
+    };
+
+    /// @brief Uart constructor, transmitted bytes are written to out.
+    explicit Uart(std::ostream& out) : out(&out) {}
+
+    /// @brief Write the following transmitted bytes to out.
+    auto setOutput(std::ostream& out) -> void;
+
+    /// @brief Queue byte for the guest to receive.
+    auto receive(uint8_t byte) -> void;
+
+    /// @brief Current register values and received bytes.
+    auto save() -> State;
+
+    /// @brief Replace the register values and received bytes with state.
+    auto restore(const State& state) -> void;
+
+    auto read(uint64_t offset, size_t size, uint64_t& value) -> bool override;
+    auto write(uint64_t offset, size_t size, uint64_t value) -> bool override;
+
+    private:
+    std::mutex lock;
+    std::ostream* out;
+    std::deque<uint8_t> input;
+    // Registers stored as written, the divisor latch is dll and dlm.
+    uint8_t ier = 0;
+    uint8_t fcr = 0;
+    uint8_t lcr = 0;
+    uint8_t mcr = 0;
+    uint8_t scr = 0;
+    uint8_t dll = 0;
+    uint8_t dlm = 0;
+};
+
+/// @brief Clint models the core local interruptor: a msip register per
+/// hart raising its machine software interrupt, a mtimecmp register per
+/// hart and the mtime counter shared by every hart, a hart has a machine
+/// timer interrupt pending while mtime >= its mtimecmp.
+/// mtime counts host time at TimeFrequency from the creation of the
+/// context, writes to it (and advance) move it relative to host time.
+class Clint : public Device {
+    public:
+    /// @brief Number of harts the register layout has room for.
+    static constexpr size_t MaxHarts = 4095;
+
+    /// @brief Register offsets.
+    static constexpr uint64_t MSip     = 0x0;
+    static constexpr uint64_t MTimeCmp = 0x4000;
+    static constexpr uint64_t MTime    = 0xbff8;
+
+    /// @brief Clint constructor, mtime counts from started.
+    explicit Clint(std::chrono::steady_clock::time_point started);
+
+    /// @brief Current value of mtime.
+    [[nodiscard]] auto mtime() const -> uint64_t;
+
+    /// @brief Move mtime forward by ticks.
+    auto advance(uint64_t ticks) -> void;
+
+    /// @brief mtimecmp of hart.
+    [[nodiscard]] auto mtimecmp(uint64_t hart) const -> uint64_t;
+
+    /// @brief Machine interrupts pending for hart: MaskMTIP and MaskMSIP
+    /// bits as found in mip.
+    [[nodiscard]] auto pending(uint64_t hart) const -> uint64_t;
+
+    auto read(uint64_t offset, size_t size, uint64_t& value) -> bool override;
+    auto write(uint64_t offset, size_t size, uint64_t value) -> bool override;
+
+    private:
+    /// @brief Host time ticks since started.
+    [[nodiscard]] auto hostTicks() const -> uint64_t;
+
+    std::chrono::steady_clock::time_point started;
+    // Added to hostTicks to obtain mtime.
+    std::atomic<uint64_t> offset{0};
+    std::unique_ptr<std::atomic<uint32_t>[]> msip;
+    std::unique_ptr<std::atomic<uint64_t>[]> timecmp;
+};
+
+} // namespace riscvemu
+
+#endif
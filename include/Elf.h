@@ -0,0 +1,142 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace riscvemu {
+
+struct MMU;
+
+// ELF64 definitions used by the loader, see the System V ABI.
+
+/// @brief First bytes of every ELF file.
+static constexpr uint8_t ElfMagic[4] = {0x7f, 'E', 'L', 'F'};
+
+// e_ident values.
+static constexpr uint8_t ElfClass64 = 2;
+static constexpr uint8_t ElfDataLSB = 1;
+
+// e_type and e_machine values.
+static constexpr uint16_t ElfTypeExec     = 2;
+static constexpr uint16_t ElfMachineRISCV = 243;
+
+// sh_type values.
+static constexpr uint32_t ElfSectionSymbols = 2;
+
+// p_type and p_flags values.
+static constexpr uint32_t ElfSegmentLoad = 1;
+static constexpr uint32_t ElfSegmentPhdr = 6;
+static constexpr uint32_t ElfSegmentExec = 1;
+
+/// @brief ELF64 file header.
+struct Elf64Header {
+    uint8_t ident[16];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint64_t entry;
+    uint64_t phoff;
+    uint64_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+};
+
+/// @brief ELF64 program header.
+struct Elf64ProgramHeader {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t filesz;
+    uint64_t memsz;
+    uint64_t align;
+};
+
+/// @brief ELF64 section header.
+struct Elf64SectionHeader {
+    uint32_t name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t addr;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t link;
+    uint32_t info;
+    uint64_t addralign;
+    uint64_t entsize;
+};
+
+/// @brief ELF64 symbol table entry.
+struct Elf64Symbol {
+    uint32_t name;
+    uint8_t info;
+    uint8_t other;
+    uint16_t shndx;
+    uint64_t value;
+    uint64_t size;
+};
+
+static_assert(sizeof(Elf64Header) == 64, "unexpected ELF64 header layout");
+static_assert(sizeof(Elf64ProgramHeader) == 56,
+              "unexpected ELF64 program header layout");
+static_assert(sizeof(Elf64SectionHeader) == 64,
+              "unexpected ELF64 section header layout");
+static_assert(sizeof(Elf64Symbol) == 24, "unexpected ELF64 symbol layout");
+
+/// @brief ElfError is raised when an ELF file is malformed or isn't a
+/// RISC-V executable the loader can place in guest memory.
+struct ElfError : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+/// @brief ElfImage describes an executable loaded in guest memory.
+struct ElfImage {
+    // Entry point.
+    uint64_t entry;
+    // End of the highest executable segment.
+    uint64_t codeEnd;
+    // End of the highest file backed segment contents.
+    uint64_t imageEnd;
+    // End of the highest segment, zero initialized data included.
+    uint64_t end;
+    // Address of the program headers, 0 if no segment loads them.
+    uint64_t phdr;
+    uint64_t phnum;
+};
+
+/// @brief Returns true if the file at path starts with the ELF magic.
+/// @param path
+/// @return bool
+auto isElf(const std::string& path) -> bool;
+
+/// @brief Load the PT_LOAD segments of the RISC-V ELF64 executable at path
+/// at their virtual addresses in mmu. File backed pages are mapped
+/// copy-on-write when the segment layout allows it and copied otherwise,
+/// .bss is left to the zeroed memory reservation.
+/// @param mmu
+/// @param path
+/// @return ElfImage, throws ElfError or std::system_error on failure.
+auto loadElf(MMU& mmu, const std::string& path) -> ElfImage;
+
+/// @brief Look the symbol name up in the symbol table of the RISC-V ELF64
+/// executable at path, e.g tohost for riscv-tests programs.
+/// @param path
+/// @param name
+/// @param value Set to the symbol value, its address.
+/// @return false if the file has no such symbol, throws ElfError or
+/// std::system_error if it can't be read.
+auto findElfSymbol(const std::string& path, const std::string& name,
+                   uint64_t& value) -> bool;
+
+} // namespace riscvemu
+
+#endif
@@ -0,0 +1,418 @@
+#ifndef FLOAT_H
+#define FLOAT_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cfenv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <type_traits>
+
+namespace riscvemu {
+
+// Host 128 bit integers holding full 64 bit products.
+__extension__ using Int128  = __int128;
+__extension__ using UInt128 = unsigned __int128;
+
+//==== Floating Point ====//
+// Single and double precision instructions (RV64F/D) execute on the host
+// floating point unit. Guest exception flags accrue in the host flags
+// while a hart runs and are only folded into fflags when fflags or fcsr
+// are accessed and when the run returns (see CPU::syncFloatFlags), the
+// emulator itself does no floating point arithmetic while guest code runs.
+// Round to nearest even is the host default, the directed rounding modes
+// switch the host rounding around the instruction using them. The host has
+// no round to nearest, ties to max magnitude mode: the result rounded to
+// nearest even is only wrong on an exact tie, which is found by comparing
+// the exact result of the operation to the midpoint with integer
+// arithmetic (see nearestMax).
+
+// Exception flags accrued in fflags.
+static constexpr uint64_t FlagInexact   = 1 << 0;
+static constexpr uint64_t FlagUnderflow = 1 << 1;
+static constexpr uint64_t FlagOverflow  = 1 << 2;
+static constexpr uint64_t FlagDivByZero = 1 << 3;
+static constexpr uint64_t FlagInvalid   = 1 << 4;
+
+/// @brief Rounding modes of the rm instruction field and of frm, modes 5
+/// and 6 are reserved.
+enum class Rounding : uint8_t {
+    NearestEven = 0,
+    TowardZero  = 1,
+    Down        = 2,
+    Up          = 3,
+    // Round to nearest, ties to max magnitude.
+    NearestMax = 4,
+    // Use the rounding mode in frm, only valid in instructions.
+    Dynamic = 7,
+};
+
+/// @brief Unsigned integer holding the bits of T, float or double.
+template <typename T>
+using FloatBits =
+    std::conditional_t<std::is_same_v<T, float>, uint32_t, uint64_t>;
+
+/// @brief Bits of the canonical NaN of T, written by every operation
+/// producing a NaN.
+template <typename T>
+static constexpr auto CanonicalNaN =
+    (FloatBits<T>)(sizeof(T) == 4 ? 0x7fc00000ULL : 0x7ff8000000000000ULL);
+
+/// @brief Most significant bit of the significand, set in quiet NaNs.
+template <typename T>
+static constexpr auto QuietBit = (FloatBits<T>)1
+                                 << (std::numeric_limits<T>::digits - 2);
+
+/// @brief Upper half of a NaN-boxed single precision register.
+static constexpr uint64_t NaNBox = 0xffffffff00000000;
+
+/// @brief Register bits holding the bits of a T, single precision values
+/// are NaN-boxed.
+template <typename T> static inline auto boxed(FloatBits<T> bits) -> uint64_t {
+    if constexpr (sizeof(T) == 4) {
+        return NaNBox | bits;
+    } else {
+        return bits;
+    }
+}
+
+/// @brief Bits of the T held in register bits, single precision values
+/// that aren't NaN-boxed read as the canonical NaN.
+template <typename T>
+static inline auto unboxed(uint64_t bits) -> FloatBits<T> {
+    if constexpr (sizeof(T) == 4) {
+        return (bits & NaNBox) == NaNBox ? (uint32_t)bits : CanonicalNaN<T>;
+    } else {
+        return bits;
+    }
+}
+
+/// @brief Returns true if value is a signaling NaN.
+template <typename T> static inline auto isSignaling(T value) -> bool {
+    return std::isnan(value) &&
+           (std::bit_cast<FloatBits<T>>(value) & QuietBit<T>) == 0;
+}
+
+/// @brief value, or the canonical NaN if value is a NaN.
+template <typename T> static inline auto canonical(T value) -> T {
+    return std::isnan(value) ? std::bit_cast<T>(CanonicalNaN<T>) : value;
+}
+
+/// @brief FCLASS mask of value, a single bit set for its class.
+template <typename T> static inline auto classify(T value) -> uint64_t {
+    auto negative = std::signbit(value);
+    switch (std::fpclassify(value)) {
+    case FP_INFINITE:
+        return negative ? 1 << 0 : 1 << 7;
+    case FP_NORMAL:
+        return negative ? 1 << 1 : 1 << 6;
+    case FP_SUBNORMAL:
+        return negative ? 1 << 2 : 1 << 5;
+    case FP_ZERO:
+        return negative ? 1 << 3 : 1 << 4;
+    default:
+        return isSignaling(value) ? 1 << 8 : 1 << 9;
+    }
+}
+
+/// @brief Host rounding mode implementing the directed modes of rm, round
+/// to nearest with ties to max magnitude is computed by nearestMax.
+static inline auto hostRounding(Rounding rm) -> int {
+    switch (rm) {
+    case Rounding::TowardZero:
+        return FE_TOWARDZERO;
+    case Rounding::Down:
+        return FE_DOWNWARD;
+    case Rounding::Up:
+        return FE_UPWARD;
+    default:
+        return FE_TONEAREST;
+    }
+}
+
+/// @brief Dyadic is the exact value (-1)^negative * mantissa * 2^exponent
+/// of a finite floating point number, an integer or the product of two of
+/// them.
+struct Dyadic {
+    bool negative    = false;
+    UInt128 mantissa = 0;
+    int exponent     = 0;
+};
+
+/// @brief Exact value of value, a finite float or double or an integer.
+template <typename T> static inline auto dyadic(T value) -> Dyadic {
+    if constexpr (std::is_integral_v<T>) {
+        auto negative = false;
+        if constexpr (std::is_signed_v<T>) {
+            negative = value < 0;
+        }
+        return {.negative = negative,
+                .mantissa = negative ? 0 - (uint64_t)value : (uint64_t)value,
+                .exponent = 0};
+    } else {
+        constexpr int digits = std::numeric_limits<T>::digits;
+        constexpr int bias   = std::numeric_limits<T>::max_exponent - 1;
+        constexpr auto hidden = (FloatBits<T>)1 << (digits - 1);
+        auto bits   = std::bit_cast<FloatBits<T>>(value);
+        auto biased = (int)((bits >> (digits - 1)) &
+                            ((1 << (sizeof(T) * 8 - digits)) - 1));
+        auto result = Dyadic{.negative = std::signbit(value),
+                             .mantissa = bits & (hidden - 1),
+                             .exponent = 1 - bias - (digits - 1)};
+        // Subnormals have the exponent of the smallest normal numbers.
+        if (biased != 0) {
+            result.mantissa |= hidden;
+            result.exponent = biased - bias - (digits - 1);
+        }
+        return result;
+    }
+}
+
+/// @brief -value.
+static inline auto negated(Dyadic value) -> Dyadic {
+    value.negative = !value.negative;
+    return value;
+}
+
+/// @brief Exact product of a and b, their mantissas have at most 56 bits.
+static inline auto product(const Dyadic& a, const Dyadic& b) -> Dyadic {
+    return {.negative = a.negative != b.negative,
+            .mantissa = a.mantissa * b.mantissa,
+            .exponent = a.exponent + b.exponent};
+}
+
+/// @brief Number of trailing zero bits of value, not 0.
+static inline auto trailingZeros(UInt128 value) -> int {
+    auto low = (uint64_t)value;
+    return low != 0 ? std::countr_zero(low)
+                    : 64 + std::countr_zero((uint64_t)(value >> 64));
+}
+
+/// @brief Number of bits needed to hold value.
+static inline auto bitWidth(UInt128 value) -> int {
+    auto high = (uint64_t)(value >> 64);
+    return high != 0 ? 64 + (int)std::bit_width(high)
+                     : (int)std::bit_width((uint64_t)value);
+}
+
+/// @brief Returns true if the exact sum of at most three terms is zero,
+/// their mantissas have at most 112 bits.
+static inline auto sumIsZero(std::initializer_list<Dyadic> terms) -> bool {
+    // Without trailing zeros the lowest set bit of a term is at its
+    // exponent, the sum can only be zero if the lowest one is shared.
+    std::array<Dyadic, 3> nonzero{};
+    size_t count = 0;
+    for (auto term : terms) {
+        if (term.mantissa != 0) {
+            auto zeros = trailingZeros(term.mantissa);
+            term.mantissa >>= zeros;
+            term.exponent += zeros;
+            nonzero[count++] = term;
+        }
+    }
+    if (count == 0) {
+        return true;
+    }
+    auto lowest = nonzero[0].exponent;
+    for (size_t i = 1; i < count; i++) {
+        lowest = std::min(lowest, nonzero[i].exponent);
+    }
+    size_t atLowest = 0;
+    for (size_t i = 0; i < count; i++) {
+        atLowest += nonzero[i].exponent == lowest ? 1 : 0;
+    }
+    if (atLowest < 2) {
+        return false;
+    }
+    // The terms at the lowest exponent stay below 2^113, a third term
+    // shifted past 2^120 can't be cancelled by them.
+    Int128 sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        auto shift = nonzero[i].exponent - lowest;
+        if (bitWidth(nonzero[i].mantissa) + shift > 120) {
+            return false;
+        }
+        auto value = (Int128)(nonzero[i].mantissa << shift);
+        sum += nonzero[i].negative ? -value : value;
+    }
+    return sum == 0;
+}
+
+/// @brief value, hidden from the optimizer so that computations on it
+/// aren't moved across changes of the host rounding mode.
+template <typename T> static inline auto opaque(T value) -> T {
+    asm volatile("" : "+m"(value));
+    return value;
+}
+
+/// @brief op() rounded to nearest with ties to max magnitude. Rounded to
+/// nearest even the result only differs on an exact tie, where it is the
+/// result rounded toward zero and the exact result is the midpoint between
+/// it and the next value away from zero: exact(m) returns true if the
+/// exact result of op is m. op reads its operands through opaque.
+/// @param op
+/// @param exact
+/// @return T
+template <typename T, typename Op, typename Exact>
+static inline auto nearestMax(Op op, Exact exact) -> T {
+    auto nearest = opaque<T>(op());
+    if (!std::isfinite(nearest)) {
+        return nearest;
+    }
+    // Only the flags of the first run are raised.
+    std::fexcept_t flags;
+    std::fegetexceptflag(&flags, FE_ALL_EXCEPT);
+    std::fesetround(FE_TOWARDZERO);
+    auto truncated = opaque<T>(op());
+    std::fesetround(FE_TONEAREST);
+    std::fesetexceptflag(&flags, FE_ALL_EXCEPT);
+    if (nearest != truncated) {
+        return nearest;
+    }
+    auto midpoint = dyadic(truncated);
+    midpoint.mantissa = midpoint.mantissa * 2 + 1;
+    midpoint.exponent -= 1;
+    if (!exact(midpoint)) {
+        return nearest;
+    }
+    return std::nextafter(
+        truncated,
+        std::copysign(std::numeric_limits<T>::infinity(), truncated));
+}
+
+/// @brief a + b rounded to nearest with ties to max magnitude.
+template <typename T> static inline auto addNearestMax(T a, T b) -> T {
+    return nearestMax<T>([&] { return opaque(a) + opaque(b); },
+                         [&](const Dyadic& m) {
+                             return sumIsZero(
+                                 {dyadic(a), dyadic(b), negated(m)});
+                         });
+}
+
+/// @brief a * b rounded to nearest with ties to max magnitude.
+template <typename T> static inline auto mulNearestMax(T a, T b) -> T {
+    return nearestMax<T>([&] { return opaque(a) * opaque(b); },
+                         [&](const Dyadic& m) {
+                             return sumIsZero({product(dyadic(a), dyadic(b)),
+                                               negated(m)});
+                         });
+}
+
+/// @brief a / b rounded to nearest with ties to max magnitude, the exact
+/// quotient is m if a = m * b.
+template <typename T> static inline auto divNearestMax(T a, T b) -> T {
+    return nearestMax<T>([&] { return opaque(a) / opaque(b); },
+                         [&](const Dyadic& m) {
+                             return std::isfinite(b) &&
+                                    sumIsZero({dyadic(a),
+                                               negated(product(m, dyadic(b)))});
+                         });
+}
+
+/// @brief sqrt(a) rounded to nearest with ties to max magnitude.
+template <typename T> static inline auto sqrtNearestMax(T a) -> T {
+    return nearestMax<T>([&] { return std::sqrt(opaque(a)); },
+                         [&](const Dyadic& m) {
+                             return sumIsZero(
+                                 {dyadic(a), negated(product(m, m))});
+                         });
+}
+
+/// @brief a * b + c with a single rounding to nearest with ties to max
+/// magnitude.
+template <typename T> static inline auto fmaNearestMax(T a, T b, T c) -> T {
+    return nearestMax<T>(
+        [&] { return std::fma(opaque(a), opaque(b), opaque(c)); },
+        [&](const Dyadic& m) {
+            return sumIsZero(
+                {product(dyadic(a), dyadic(b)), dyadic(c), negated(m)});
+        });
+}
+
+/// @brief value, an integer or a floating point number, converted to a T
+/// rounded to nearest with ties to max magnitude.
+template <typename T, typename From>
+static inline auto convertNearestMax(From value) -> T {
+    return nearestMax<T>([&] { return (T)opaque(value); },
+                         [&](const Dyadic& m) {
+                             return sumIsZero({dyadic(value), negated(m)});
+                         });
+}
+
+/// @brief Clear the host exception flags.
+static inline auto clearHostFlags() -> void {
+    std::feclearexcept(FE_ALL_EXCEPT);
+}
+
+/// @brief Host exception flags raised since they were last cleared as
+/// fflags bits, the host flags are cleared.
+static inline auto takeHostFlags() -> uint64_t {
+    auto raised = std::fetestexcept(FE_ALL_EXCEPT);
+    if (raised == 0) [[likely]] {
+        return 0;
+    }
+    clearHostFlags();
+    return ((raised & FE_INEXACT) != 0 ? FlagInexact : 0) |
+           ((raised & FE_UNDERFLOW) != 0 ? FlagUnderflow : 0) |
+           ((raised & FE_OVERFLOW) != 0 ? FlagOverflow : 0) |
+           ((raised & FE_DIVBYZERO) != 0 ? FlagDivByZero : 0) |
+           ((raised & FE_INVALID) != 0 ? FlagInvalid : 0);
+}
+
+/// @brief value rounded to an integral value following rm, no flag is
+/// raised.
+template <typename T>
+static inline auto roundIntegral(T value, Rounding rm) -> T {
+    switch (rm) {
+    case Rounding::TowardZero:
+        return std::trunc(value);
+    case Rounding::Down:
+        return std::floor(value);
+    case Rounding::Up:
+        return std::ceil(value);
+    case Rounding::NearestMax:
+        return std::round(value);
+    default:
+        return std::nearbyint(value);
+    }
+}
+
+/// @brief Convert value to the integer type I as FCVT does: value is
+/// rounded following rm, NaNs and values out of range saturate and raise
+/// the invalid flag, inexact results raise the inexact flag.
+/// @param value
+/// @param rm
+/// @param flags Raised flags are added to it.
+/// @return I
+template <typename I, typename T>
+static inline auto toInteger(T value, Rounding rm, uint64_t& flags) -> I {
+    // Range of I as T, the upper bound 2^digits is exact.
+    constexpr auto lower = (T)std::numeric_limits<I>::min();
+    constexpr auto upper =
+        (T)((uint64_t)1 << (std::numeric_limits<I>::digits - 1)) * 2;
+    if (std::isnan(value)) {
+        flags |= FlagInvalid;
+        return std::numeric_limits<I>::max();
+    }
+    auto integral = roundIntegral(value, rm);
+    if (integral < lower) {
+        flags |= FlagInvalid;
+        return std::numeric_limits<I>::min();
+    }
+    if (integral >= upper) {
+        flags |= FlagInvalid;
+        return std::numeric_limits<I>::max();
+    }
+    if (integral != value) {
+        flags |= FlagInexact;
+    }
+    return (I)integral;
+}
+
+} // namespace riscvemu
+
+#endif
@@ -183,6 +183,26 @@ enum class OPCode {
     // Fence instruction.
     FENCE = 0b0001111,
 
+    // Atomic memory operations (RV64A).
+    AMO = 0b0101111,
+
+    // Floating point operations (RV64F/D).
+
+    // Floating point loads and stores.
+    LOADFP  = 0b0000111,
+    STOREFP = 0b0100111,
+    // Fused multiply-add, multiply-subtract and their negations.
+    FMADD  = 0b1000011,
+    FMSUB  = 0b1000111,
+    FNMSUB = 0b1001011,
+    FNMADD = 0b1001111,
+    // Arithmetic, conversions, moves and comparisons.
+    ARITHF = 0b1010011,
+
+    // Vector operations (RVV), vector loads and stores share LOADFP and
+    // STOREFP with a vector element width in funct3.
+    OPV = 0b1010111,
+
     // Environment calls and breakpoints, system instructions used
     // to access system functionality that might require priviliegd
     // access.
@@ -214,6 +234,293 @@ enum class OPCode {
     CSRRI  = 0b1110011,
 };
 
+/// @brief Mnemonic identifies a single instruction once the opcode group
+/// and the funct3/funct7 fields have been resolved, the decoder uses it to
+/// select the handler that executes the instruction.
+enum class Mnemonic : uint8_t {
+    // Unimplemented or malformed encodings.
+    ILLEGAL = 0,
+
+    // Upper immediates.
+    LUI,
+    AUIPC,
+
+    // Unconditional jumps.
+    JAL,
+    JALR,
+
+    // Conditional branches.
+    BEQ,
+    BNE,
+    BLT,
+    BGE,
+    BLTU,
+    BGEU,
+
+    // Loads.
+    LB,
+    LH,
+    LW,
+    LD,
+    LBU,
+    LHU,
+    LWU,
+
+    // Stores.
+    SB,
+    SH,
+    SW,
+    SD,
+
+    // Arithmetic immediate operations.
+    ADDI,
+    SLTI,
+    SLTIU,
+    XORI,
+    ORI,
+    ANDI,
+    SLLI,
+    SRLI,
+    SRAI,
+
+    // Arithmetic immediate operations for wide registers (RV64I).
+    ADDIW,
+    SLLIW,
+    SRLIW,
+    SRAIW,
+
+    // Arithmetic register to register operations.
+    ADD,
+    SUB,
+    SLL,
+    SLT,
+    SLTU,
+    XOR,
+    SRL,
+    SRA,
+    OR,
+    AND,
+
+    // Arithmetic register to register operations for wide registers (RV64I).
+    ADDW,
+    SUBW,
+    SLLW,
+    SRLW,
+    SRAW,
+
+    // Environment calls and breakpoints.
+    ECALL,
+    EBREAK,
+    // Trap returns and address translation fences.
+    MRET,
+    SRET,
+    SFENCE_VMA,
+    // Wait for interrupt.
+    WFI,
+
+    // Control and Status registers.
+    CSRRW,
+    CSRRS,
+    CSRRC,
+    CSRRWI,
+    CSRRSI,
+    CSRRCI,
+
+    // Memory ordering.
+    FENCE,
+    FENCE_I,
+
+    // Atomic memory operations (RV64A), on words then double words.
+    LR_W,
+    SC_W,
+    AMOSWAP_W,
+    AMOADD_W,
+    AMOXOR_W,
+    AMOAND_W,
+    AMOOR_W,
+    AMOMIN_W,
+    AMOMAX_W,
+    AMOMINU_W,
+    AMOMAXU_W,
+    LR_D,
+    SC_D,
+    AMOSWAP_D,
+    AMOADD_D,
+    AMOXOR_D,
+    AMOAND_D,
+    AMOOR_D,
+    AMOMIN_D,
+    AMOMAX_D,
+    AMOMINU_D,
+    AMOMAXU_D,
+
+    // Integer multiplication and division (RV64M), on double words then
+    // words.
+    MUL,
+    MULH,
+    MULHSU,
+    MULHU,
+    DIV,
+    DIVU,
+    REM,
+    REMU,
+    MULW,
+    DIVW,
+    DIVUW,
+    REMW,
+    REMUW,
+
+    // Floating point operations (RV64F/D). Loads and stores, then the
+    // instructions writing a floating point register in single then double
+    // precision, then the ones writing an integer register. Both precisions
+    // list their instructions in the same order.
+    FSW,
+    FSD,
+    FLW,
+    FLD,
+    FMADD_S,
+    FMSUB_S,
+    FNMSUB_S,
+    FNMADD_S,
+    FADD_S,
+    FSUB_S,
+    FMUL_S,
+    FDIV_S,
+    FSQRT_S,
+    FSGNJ_S,
+    FSGNJN_S,
+    FSGNJX_S,
+    FMIN_S,
+    FMAX_S,
+    FCVT_S_W,
+    FCVT_S_WU,
+    FCVT_S_L,
+    FCVT_S_LU,
+    FMV_W_X,
+    FCVT_S_D,
+    FMADD_D,
+    FMSUB_D,
+    FNMSUB_D,
+    FNMADD_D,
+    FADD_D,
+    FSUB_D,
+    FMUL_D,
+    FDIV_D,
+    FSQRT_D,
+    FSGNJ_D,
+    FSGNJN_D,
+    FSGNJX_D,
+    FMIN_D,
+    FMAX_D,
+    FCVT_D_W,
+    FCVT_D_WU,
+    FCVT_D_L,
+    FCVT_D_LU,
+    FMV_D_X,
+    FCVT_D_S,
+    FCVT_W_S,
+    FCVT_WU_S,
+    FCVT_L_S,
+    FCVT_LU_S,
+    FMV_X_W,
+    FEQ_S,
+    FLT_S,
+    FLE_S,
+    FCLASS_S,
+    FCVT_W_D,
+    FCVT_WU_D,
+    FCVT_L_D,
+    FCVT_LU_D,
+    FMV_X_D,
+    FEQ_D,
+    FLT_D,
+    FLE_D,
+    FCLASS_D,
+
+    // Vector operations (RVV). The configuration and the move writing an
+    // integer register, the move writing a floating point register, then
+    // the loads and stores (rd holds the stored register) and the
+    // instructions writing a vector register. Loads and stores take their
+    // element width from funct3, the other instructions from vtype.
+    VSETVLI,
+    VSETIVLI,
+    VSETVL,
+    VMV_X_S,
+    VFMV_F_S,
+    VLE,
+    VLSE,
+    VSE,
+    VSSE,
+    VADD,
+    VSUB,
+    VRSUB,
+    VMINU,
+    VMIN,
+    VMAXU,
+    VMAX,
+    VAND,
+    VOR,
+    VXOR,
+    VSLL,
+    VSRL,
+    VSRA,
+    VMSEQ,
+    VMSNE,
+    VMSLTU,
+    VMSLT,
+    VMSLEU,
+    VMSLE,
+    VMSGTU,
+    VMSGT,
+    VMERGE,
+    VMUL,
+    VMACC,
+    VREDSUM,
+    VMV_S_X,
+    VFADD,
+    VFSUB,
+    VFMUL,
+    VFDIV,
+    VFMACC,
+    VFREDUSUM,
+    VFMERGE,
+    VFMV_S_F,
+
+    // Number of mnemonics, used to size handler tables.
+    Count,
+};
+
+/// @brief Returns true if mnemonic writes a floating point register.
+/// @param mnemonic
+/// @return bool
+auto writesFloatRegister(Mnemonic mnemonic) -> bool;
+
+/// @brief Returns true if the rd field of mnemonic is an integer register
+/// and not a floating point or vector register.
+/// @param mnemonic
+/// @return bool
+auto writesIntegerRegister(Mnemonic mnemonic) -> bool;
+
+/// @brief VectorOperands is the funct3 field of OPV instructions, the
+/// category of the operation and the kind of its second operand: a vector
+/// register (VV), an integer register (VX), a 5 bit signed immediate (VI)
+/// or a floating point register (VF). CFG are the vsetvl instructions.
+enum class VectorOperands : uint8_t {
+    IVV = 0b000,
+    FVV = 0b001,
+    MVV = 0b010,
+    IVI = 0b011,
+    IVX = 0b100,
+    FVF = 0b101,
+    MVX = 0b110,
+    CFG = 0b111,
+};
+
+/// @brief Returns the assembly name of a mnemonic, e.g "addi".
+/// @param mnemonic
+/// @return const char*
+auto getMnemonicName(Mnemonic mnemonic) -> const char*;
+
 /// @brief Instruction represents RISC-V instructions as described
 /// in the ISA.
 /// Instructions are 32 bits wide and encoded in Little Endian format
@@ -0,0 +1,88 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "Translator.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace riscvemu {
+
+struct MMU;
+
+/// @brief Number of executions after which a block is compiled to native
+/// code.
+static constexpr uint32_t JitThreshold = 64;
+
+/// @brief Size of the executable buffer holding compiled blocks.
+static constexpr size_t JitCodeSize = static_cast<size_t>(16 * 1024 * 1024);
+
+/// @brief JitStatus reports how a compiled block exited.
+enum class JitStatus : uint32_t {
+    // The block ran to completion, continue at the returned address.
+    Continue = 0,
+    // A load or store accessed memory outside of the MMU range, the
+    // returned address is the address of the faulting instruction.
+    AccessFault = 1,
+};
+
+/// @brief JitState is the machine state compiled blocks operate on, the
+/// compiled code keeps the register file and memory pointers pinned in host
+/// registers for the duration of a block.
+struct JitState {
+    // Guest register file.
+    uint64_t* registers;
+    // Host address of MemoryBaseAddr.
+    uint8_t* memory;
+    // Size of the guest memory.
+    uint64_t memorySize;
+    // MMU code page flags, see MMU::codePages.
+    uint8_t* codePages;
+    // MMU invalidated when a store hits a code page.
+    MMU* mmu;
+    // Exit status of the last compiled block.
+    JitStatus status;
+    // Instructions retired by the last compiled block.
+    uint64_t retired;
+};
+
+/// @brief JitCompiler compiles translated blocks to host code, it owns the
+/// executable memory compiled blocks live in. The memory is only mapped
+/// when the first block is compiled so short runs never pay for it.
+/// Only RV64I computational, load, store and control flow instructions and
+/// the RV64M multiplications are compiled, a block stops compiling at the
+/// first instruction that isn't and returns to the threaded engine to
+/// execute it.
+/// The only backend is x86-64, on other hosts available() is false and
+/// blocks are always interpreted.
+class JitCompiler {
+    public:
+    JitCompiler();
+    ~JitCompiler();
+
+    JitCompiler(const JitCompiler&)                    = delete;
+    auto operator=(const JitCompiler&) -> JitCompiler& = delete;
+    JitCompiler(JitCompiler&& other) noexcept;
+    auto operator=(JitCompiler&& other) noexcept -> JitCompiler&;
+
+    /// @brief Returns true if the host is supported and the executable
+    /// buffer is or can still be allocated.
+    [[nodiscard]] auto available() const -> bool;
+
+    /// @brief Compile block to native code.
+    /// @param block
+    /// @return JitFunction or nullptr if the block can't be compiled.
+    auto compile(const TranslatedBlock& block) -> JitFunction;
+
+    private:
+    /// @brief Executable buffer.
+    uint8_t* code = nullptr;
+    /// @brief Bytes of the buffer used by compiled blocks.
+    size_t used = 0;
+    /// @brief Set if the executable buffer couldn't be allocated.
+    bool failed = false;
+};
+
+} // namespace riscvemu
+
+#endif
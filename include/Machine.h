@@ -2,13 +2,31 @@
 #define MACHINE_H
 
 #include "CSR.h"
+#include "Decoder.h"
+#include "Devices.h"
+#include "Float.h"
 #include "Instructions.h"
+#include "Jit.h"
+#include "Memory.h"
+#include "PageCache.h"
+#include "Profiler.h"
+#include "Syscalls.h"
+#include "Tlb.h"
+#include "Trace.h"
+#include "Translator.h"
+#include "Vector.h"
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <memory>
+#include <stdexcept>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -21,16 +39,40 @@ using offset_t = size_t;
 /// to implement the RV64I ISA.
 using VirtualAddress = uint64_t;
 
-/// @brief MMU will have 128 MiB.
-static constexpr uint64_t MemoryMaxSize =
-    (static_cast<const uint64_t>(1024 * 1024 * 1));
+/// @brief Default MMU memory size, 128 MiB. Guest memory is reserved
+/// lazily so the size only bounds the addressable range, see VMContext to
+/// configure it.
+static constexpr uint64_t MemoryMaxSize = static_cast<uint64_t>(128) << 20;
 
 /// @brief MMU Base address.
 static constexpr VirtualAddress MemoryBaseAddr = 0x80000000;
 
-/// @brief MMU End address.
+/// @brief MMU End address for the default memory size.
 static constexpr uint64_t MemoryEndAddr = MemoryMaxSize + MemoryBaseAddr - 1;
 
+/// @brief Stack space reserved for each hart below the top of memory, the
+/// stack pointer of hart n starts n * HartStackSize bytes lower than the
+/// stack pointer of hart 0.
+static constexpr uint64_t HartStackSize = static_cast<uint64_t>(64) << 10;
+
+/// @brief Instructions retired between two checks for pending interrupts,
+/// bounds the latency of interrupts raised by devices and other harts.
+/// Interrupts unmasked by the hart itself are checked right away.
+static constexpr uint64_t InterruptPollInterval = 1024;
+
+/// @brief Host sleep between two checks of a hart idling in WFI for an
+/// interrupt that isn't due to a timer.
+static constexpr auto IdleSleep = std::chrono::microseconds(100);
+
+/// @brief Page granularity used to track which parts of memory hold code.
+static constexpr uint64_t PageShift = 12;
+
+/// @brief Page size in bytes.
+static constexpr uint64_t PageSize = 1 << PageShift;
+
+static_assert(std::endian::native == std::endian::little,
+              "guest memory is accessed with host loads and stores");
+
 /// @brief LoadAccessFault exception used to handle memory access beyond
 /// virtual memory bounds.
 struct LoadAccessFault : public std::exception {
@@ -54,35 +96,152 @@ struct IllegalInstruction : public std::exception {
 /// @brief MMU represents a memory management unit, used to handle address
 /// translations for virtual memory.
 struct MMU {
-    // Raw memory buffer.
-    std::vector<uint8_t> memory; // NOLINT
+    // Raw memory buffer, host pages are committed on first touch.
+    MappedArray<uint8_t> memory; // NOLINT
     // Used memory.
-    size_t used;
+    size_t used = 0;
+    // Per page flags stores must report (see invalidateCode), CodeFlag is
+    // set while a decode cache holds instructions decoded from the page and
+    // CleanFlag while the page is unchanged since the last checkpoint.
+    MappedArray<uint8_t> codePages; // NOLINT
+    // Per page counter bumped by stores to a flagged page, decode caches
+    // compare it against the value they recorded to detect stale entries.
+    MappedArray<uint32_t> codeGenerations; // NOLINT
+
+    /// @brief Page flag of pages holding decoded code.
+    static constexpr uint8_t CodeFlag = 1;
+    /// @brief Page flag of pages saved by the last checkpoint and not
+    /// stored to since, see Checkpoint.
+    static constexpr uint8_t CleanFlag = 2;
 
-    /// @brief Default constructor allocates MemoryMaxSize in the underlying
-    // buffer.
-    MMU() : memory(MemoryMaxSize) {}
+    /// @brief MMU constructor reserves size bytes of guest memory starting
+    // at MemoryBaseAddr, nothing is allocated until it is accessed.
+    explicit MMU(uint64_t size = MemoryMaxSize)
+        : memory(size), codePages((size + PageSize - 1) >> PageShift),
+          codeGenerations((size + PageSize - 1) >> PageShift) {}
 
     /// @brief Checks if a given address is within the virtual memory
     /// accessible range.
     /// @param addr
     /// @return boolean
-    static constexpr auto withinRange(VirtualAddress addr) -> bool {
-        return (addr >= MemoryBaseAddr && addr <= MemoryEndAddr);
+    [[nodiscard]] auto withinRange(VirtualAddress addr) const -> bool {
+        return (addr >= MemoryBaseAddr &&
+                addr - MemoryBaseAddr < this->memory.size());
     }
 
     /// @brief Base address for the MMU, fixed constant see MemoryBaseAddr.
     /// @return constant integer value MemoryBaseAddr.
     static constexpr auto baseAddress() -> uint64_t { return MemoryBaseAddr; }
 
-    /// @brief MMU max available unmapped memory, fixed constant see
-    /// MemoryMaxSize.
-    /// @return constant integer value MemoryMaxSize.
-    static constexpr auto memorySize() -> int { return MemoryMaxSize; }
+    /// @brief MMU max available unmapped memory.
+    /// @return size of the guest memory in bytes.
+    [[nodiscard]] auto memorySize() const -> uint64_t {
+        return this->memory.size();
+    }
 
     /// @brief Dump MMU contents starting from base address.
     auto dumpMemory() -> void;
 
+    /// @brief Flag the page holding addr as containing decoded code.
+    /// @param addr
+    /// @return current code generation of the page.
+    auto watchCode(VirtualAddress addr) -> uint32_t {
+        auto page = (addr - MemoryBaseAddr) >> PageShift;
+        std::atomic_ref(this->codePages[page]).fetch_or(CodeFlag);
+        return std::atomic_ref(this->codeGenerations[page]).load();
+    }
+
+    /// @brief Invalidate decoded code in the pages touched by a store of
+    /// bytes number of bytes at addr, the pages are no longer clean.
+    /// The page tables are shared by every hart running on the MMU, they are
+    /// accessed atomically so a store on one hart is seen by the caches of
+    /// the others.
+    /// @param addr
+    /// @param bytes
+    auto invalidateCode(VirtualAddress addr, size_t bytes) -> void {
+        auto first = (addr - MemoryBaseAddr) >> PageShift;
+        auto last  = (addr - MemoryBaseAddr + bytes - 1) >> PageShift;
+        for (auto page = first; page <= last && page < codePages.size();
+             page++) {
+            auto flag = std::atomic_ref(this->codePages[page]);
+            if (flag.load() != 0 && (flag.exchange(0) & CodeFlag) != 0)
+                [[unlikely]] {
+                std::atomic_ref(this->codeGenerations[page]).fetch_add(1);
+            }
+        }
+    }
+
+    /// @brief Read the value of type T at address addr into value, T is one
+    /// of the fixed width integer types. The access is a single bounds check
+    /// followed by an unaligned little endian host load.
+    /// This is the path guest accesses take, faults are reported instead of
+    /// thrown so the caller can raise them as traps.
+    /// @param addr
+    /// @param value
+    /// @return false if the value isn't within memory.
+    template <typename T> auto read(VirtualAddress addr, T& value) -> bool {
+        auto offset = addr - MemoryBaseAddr;
+        // Addresses below MemoryBaseAddr wrap around and fail the check.
+        if (offset > this->memory.size() - sizeof(T)) [[unlikely]] {
+            return false;
+        }
+        std::memcpy(&value, this->memory.data() + offset, sizeof(T));
+        return true;
+    }
+
+    /// @brief Write value of type T at address addr, see read.
+    /// @param addr
+    /// @param value
+    /// @return false if the value isn't within memory.
+    template <typename T> auto write(VirtualAddress addr, T value) -> bool {
+        auto offset = addr - MemoryBaseAddr;
+        if (offset > this->memory.size() - sizeof(T)) [[unlikely]] {
+            return false;
+        }
+        invalidateCode(addr, sizeof(T));
+        std::memcpy(this->memory.data() + offset, &value, sizeof(T));
+        return true;
+    }
+
+    /// @brief Return the host address of the value of type T at address
+    /// addr, used for accesses that must be done in place like atomics.
+    /// @param addr
+    /// @param write true if the value may be modified through the pointer.
+    /// @return T* or nullptr if the value isn't within memory.
+    template <typename T>
+    auto hostAddress(VirtualAddress addr, bool write) -> T* {
+        auto offset = addr - MemoryBaseAddr;
+        if (offset > this->memory.size() - sizeof(T)) [[unlikely]] {
+            return nullptr;
+        }
+        if (write) {
+            invalidateCode(addr, sizeof(T));
+        }
+        return reinterpret_cast<T*>(this->memory.data() + offset);
+    }
+
+    /// @brief Load a value of type T at address addr, see read.
+    /// @param addr
+    /// @return value of type T stored at address addr.
+    /// @throws LoadAccessFault if the value isn't within memory.
+    template <typename T> auto load(VirtualAddress addr) -> T {
+        T value;
+        if (!read<T>(addr, value)) [[unlikely]] {
+            throw LoadAccessFault();
+        }
+        return value;
+    }
+
+    /// @brief Store value of type T at address addr, see write.
+    /// @param addr
+    /// @param value
+    /// @throws LoadAccessFault if the value isn't within memory.
+    template <typename T> auto store(VirtualAddress addr, T value) -> void {
+        if (!write<T>(addr, value)) [[unlikely]] {
+            throw LoadAccessFault();
+        }
+    }
+
     /// @brief Load size number of bits at address addr, size must be within
     /// addressable range i.e (8, 16, 32, 64).
     /// @param addr
@@ -145,41 +304,347 @@ struct MMU {
 // TODO: get rid of VMContext until we figure out multithreaded
 // execution.
 struct VMContext {
-    std::vector<uint8_t> code;
+    /// @brief Size of the program loaded at MemoryBaseAddr, execution stops
+    /// once the program counter leaves it.
+    uint64_t codeSize = 0;
+
+    /// @brief Address execution starts at.
+    uint64_t entry = MemoryBaseAddr;
+
+    /// @brief Bytes from MemoryBaseAddr covering everything the program was
+    /// loaded into, memory past it is untouched by the loader.
+    uint64_t imageSize = 0;
+
+    /// @brief Bytes from MemoryBaseAddr covering the program including its
+    /// zero initialized data, the heap of SyscallProxy starts past it.
+    uint64_t dataSize = 0;
+
+    /// @brief Guest address and number of the ELF program headers, passed
+    /// to programs started by SyscallProxy. 0 when they aren't loaded.
+    uint64_t phdr  = 0;
+    uint64_t phnum = 0;
 
     /// @brief MMU for CPU execution.
     MMU mmu;
 
-    /// @brief VMContext constructor.
-    VMContext(std::vector<uint8_t> code) : code(std::move(code)) {}
+    /// @brief Number of checkpoints written of the context, every page is
+    /// saved by the first one and only dirty pages by the following ones.
+    uint64_t checkpoints = 0;
+
+    /// @brief Host time the context was created at, the time CSR counts
+    /// from it.
+    std::chrono::steady_clock::time_point started =
+        std::chrono::steady_clock::now();
+
+    /// @brief Devices accessed at the physical addresses outside of guest
+    /// memory.
+    Bus bus;
+
+    /// @brief Console attached to bus at UartBaseAddr, writes to stdout.
+    std::shared_ptr<Uart> uart;
+
+    /// @brief CLINT attached to bus at ClintBaseAddr, its mtime is the time
+    /// CSR of every hart.
+    std::shared_ptr<Clint> clint;
+
+    /// @brief Linux system call emulation, ECALL traps to the guest when
+    /// it is nullptr (the default).
+    std::shared_ptr<SyscallProxy> syscalls;
+
+    /// @brief VMContext constructor, memorySize is the amount of guest
+    /// memory available to code, no program is loaded.
+    explicit VMContext(uint64_t memorySize = MemoryMaxSize)
+        : mmu(memorySize) {
+        attachDevices();
+    }
+
+    /// @brief VMContext constructor, code is copied to MemoryBaseAddr.
+    VMContext(const std::vector<uint8_t>& code,
+              uint64_t memorySize = MemoryMaxSize)
+        : codeSize(code.size()), imageSize(code.size()),
+          dataSize(code.size()), mmu(memorySize) {
+        if (code.size() > memorySize) {
+            throw std::length_error("program doesn't fit in guest memory");
+        }
+        std::memcpy(this->mmu.memory.data(), code.data(), code.size());
+        attachDevices();
+    }
+
+    /// @brief Create a context running the raw binary image at path, the
+    /// image is mapped copy-on-write at MemoryBaseAddr instead of read and
+    /// copied, see mapImage.
+    /// @param path
+    /// @param memorySize
+    /// @return VMContext
+    static auto fromImage(const std::string& path,
+                          uint64_t memorySize = MemoryMaxSize) -> VMContext;
+
+    /// @brief Create a context running the RISC-V ELF64 executable at path,
+    /// segments are loaded at their virtual addresses and execution starts
+    /// at the ELF entry point, see loadElf.
+    /// @param path
+    /// @param memorySize
+    /// @return VMContext
+    static auto fromElf(const std::string& path,
+                        uint64_t memorySize = MemoryMaxSize) -> VMContext;
+
+    private:
+    /// @brief Create the UART and the CLINT and attach them to bus.
+    auto attachDevices() -> void;
 };
 
+/// @brief DecodeCache memoizes decoded instructions by program counter so
+/// hot code is fetched and decoded once.
+/// Entries are grouped in pages mirroring the MMU pages, a page is filled
+/// lazily on first execution and discarded once the MMU reports a store
+/// to it (see MMU::invalidateCode).
+/// Compressed instructions may start at any even address so a page has a
+/// slot per half word. A 32-bit instruction starting in the last half
+/// word of a page is only partially cached, see decode.
+class DecodeCache {
+    public:
+    /// @brief Number of instruction slots in a page.
+    static constexpr uint64_t SlotsPerPage = PageSize / 2;
+
+    /// @brief DecodeCache constructor, mmu is the memory the code is
+    /// fetched from.
+    DecodeCache(MMU& mmu) : mmu(&mmu) {}
+
+    /// @brief Return the decoded instruction at pc, decoding it on a miss.
+    /// @param pc
+    /// @return DecodedInstruction with its handler resolved.
+    auto lookup(VirtualAddress pc) -> const DecodedInstruction& {
+        auto index = (pc - MemoryBaseAddr) >> PageShift;
+        if ((pc & 1) != 0 || index >= pages.size()) [[unlikely]] {
+            if ((pc & 1) != 0 || !grow(index)) {
+                return decodeUncached(pc);
+            }
+        }
+        auto& page = this->pages[index];
+        if (page == nullptr ||
+            page->generation != this->mmu->codeGenerations[index])
+            [[unlikely]] {
+            resetPage(pc);
+        }
+        auto& slot = page->slots[(pc & (PageSize - 1)) >> 1];
+        if (slot.handler == nullptr) [[unlikely]] {
+            fill(slot, pc);
+        }
+        return slot;
+    }
+
+    /// @brief Drop every decoded instruction.
+    auto flush() -> void;
+
+    /// @brief Fetch and decode the instruction at the physical address pc
+    /// and resolve its handler. The upper half of a 32-bit instruction
+    /// crossing into the next page is fetched whenever it executes (see
+    /// Semantics::crossPage), the page is neither contiguous nor watched.
+    /// @param mmu
+    /// @param pc
+    /// @return DecodedInstruction
+    static auto decode(MMU& mmu, VirtualAddress pc) -> DecodedInstruction;
+
+    private:
+    /// @brief Decoded instructions of a single page.
+    struct Page {
+        // Code generation of the page when it was filled.
+        uint32_t generation;
+        std::array<DecodedInstruction, SlotsPerPage> slots;
+    };
+
+    /// @brief Extend the page table to cover page index, returns false if
+    /// the index is outside of memory.
+    auto grow(uint64_t index) -> bool;
+
+    /// @brief Allocate or clear the page holding pc and start watching it.
+    auto resetPage(VirtualAddress pc) -> void;
+
+    /// @brief Fetch and decode the instruction at pc into slot.
+    auto fill(DecodedInstruction& slot, VirtualAddress pc) -> void;
+
+    /// @brief Decode the instruction at pc without caching it, used for
+    /// program counters the cache can't index.
+    auto decodeUncached(VirtualAddress pc) -> const DecodedInstruction&;
+
+    /// @brief Memory the cached instructions were fetched from.
+    MMU* mmu;
+    /// @brief Pages indexed by page number from MemoryBaseAddr, the table
+    /// grows to cover the highest page executed from.
+    std::vector<std::unique_ptr<Page>> pages;
+    /// @brief Scratch entry returned by decodeUncached.
+    DecodedInstruction uncached;
+};
+
+/// @brief Privilege levels a hart executes in.
+enum class Privilege : uint8_t {
+    User       = 0,
+    Supervisor = 1,
+    Machine    = 3,
+};
+
+/// @brief Engine selects how CPU::run executes guest code.
+enum class Engine {
+    // Execute one instruction at a time out of the decode cache.
+    Interpreter,
+    // Execute translated basic blocks with direct threaded dispatch.
+    Threaded,
+    // Execute translated basic blocks with direct threaded dispatch,
+    // compiling hot blocks to native code.
+    Jit,
+};
+
+/// @brief Sampling configures sampled profiling runs, see CPU::setSampling.
+struct Sampling {
+    // Instructions between the starts of two detailed windows, 0 disables
+    // sampling.
+    uint64_t interval = 0;
+    // Instructions executed in each detailed window, at most interval.
+    uint64_t window = 0;
+};
+
+/// @brief Instruction budget of a run that only stops once the hart does.
+static constexpr uint64_t Unbounded = ~static_cast<uint64_t>(0);
+
+/// @brief RunStatus tells why CPU::step returned.
+enum class RunStatus {
+    // The instruction budget ran out, the hart can be resumed.
+    Budget,
+    // The hart left the program.
+    Exited,
+    // A trap without a trap handler (mtvec is 0) stopped the hart.
+    Trapped,
+    // The hart executed an EBREAK.
+    Breakpoint,
+    // The hart executed an ECALL not served by a system call proxy.
+    ECall,
+    // The hart is about to access an address outside of guest memory.
+    Mmio,
+    // The hart waits in WFI for a software interrupt only another hart can
+    // raise, the program counter stays on the WFI and the next step waits
+    // again.
+    Idle,
+};
+
+/// @brief Events CPU::step stops on, combined with a bitwise or.
+static constexpr uint32_t EventBreakpoint = 1 << 0;
+static constexpr uint32_t EventECall      = 1 << 1;
+static constexpr uint32_t EventMmio       = 1 << 2;
+
+/// @brief RunResult is the outcome of CPU::step.
+struct RunResult {
+    RunStatus status = RunStatus::Budget;
+    // Instructions retired by the step.
+    uint64_t retired = 0;
+    // Address of the instruction the hart stopped on: the EBREAK or ECALL
+    // (the program counter is past it), the instruction accessing outside
+    // of memory (the program counter is on it) or the trapping instruction.
+    VirtualAddress addr = 0;
+    // Trapped: cause of the trap. Mmio: LoadAccessFault or StoreAccessFault,
+    // the trap raised if no device handles the access.
+    TrapCause cause = TrapCause::IllegalInstruction;
+    // Trapped: trap value written to mtval. Mmio: physical address accessed.
+    uint64_t value = 0;
+};
+
+/// @brief Return a readable name for a trap cause.
+/// @param cause
+/// @return const char*
+auto trapName(TrapCause cause) -> const char*;
+
+/// @brief Return the handler executing instructions of the given mnemonic.
+/// @param mnemonic
+/// @return Handler
+auto handlerFor(Mnemonic mnemonic) -> Handler;
+
 /// @brief CPU represents the CPU unit in the emulator, it's responsible
 /// for the entire pipeline cycle (fetch, decode, execute).
-/// CPU owns MMU exclusively, any simulated threading is done at the context
-/// level.
+/// A CPU is a single hart, harts running on the same context share its MMU
+/// and own their registers, CSRs and code caches (see Machine).
 class CPU {
     public:
-    /// @brief CPU instance constructor.
-    CPU(VMContext ctx) : ctx(std::make_unique<VMContext>(std::move(ctx))) {
+    /// @brief CPU instance constructor, the CPU is hart 0 and owns ctx.
+    CPU(VMContext ctx)
+        : CPU(std::make_shared<VMContext>(std::move(ctx)), 0) {}
+
+    /// @brief CPU instance constructor for hart hartId of a context shared
+    /// with other harts.
+    CPU(std::shared_ptr<VMContext> ctx, uint64_t hartId)
+        : ctx(std::move(ctx)), icache(this->ctx->mmu),
+          blocks(this->ctx->mmu) {
         // Register x0 is always hardwired to 0.
         this->registers[0] = 0x00;
         /// Register x2 is used as the stack pointer by the ABI.
-        this->registers[2] = MemoryBaseAddr + MemoryMaxSize - 4;
-        /// Program counter is set to the base memory address.
-        this->pc = MemoryBaseAddr;
-        /// Move code to MMU.
-        std::memcpy(this->ctx->mmu.memory.data(), this->ctx->code.data(),
-                    this->ctx->code.size());
+        this->registers[2] = MemoryBaseAddr + this->ctx->mmu.memorySize() -
+                             4 - hartId * HartStackSize;
+        /// Program counter is set to the program entry point.
+        this->pc = this->ctx->entry;
+        this->csrs.store(MHartID, hartId);
+        /// The floating point and vector units start enabled, see
+        /// Semantics::writeCSR, vtype starts ill until a vsetvl.
+        this->csrs.store(MStatus, MaskFS | MaskVS | MaskSD);
+        this->csrs.store(VType, MaskVIll);
+        this->csrs.store(VLenB, VectorBytes);
     }
 
     /// @brief Return program counter.
     [[nodiscard]] auto inline getPC() const -> uint64_t { return pc; }
 
+    /// @brief Return the current privilege level.
+    [[nodiscard]] auto getPrivilege() const -> Privilege {
+        return this->privilege;
+    }
+
     /// @brief Run the CPU instance, asserts if memory is non-empty and has
     /// instructions.
     auto run() -> void;
 
+    /// @brief Run the CPU instance on the given execution engine, engines
+    /// are interchangeable and produce the same guest visible state.
+    /// With a profiler or a tracer set the CPU runs on the interpreter,
+    /// unless sampling is enabled (see setSampling).
+    /// @param engine
+    auto run(Engine engine) -> void;
+
+    /// @brief Run the CPU instance on the given execution engine for at
+    /// most budget instructions, or until one of the events set in events
+    /// (EventBreakpoint, EventECall, EventMmio) or until the hart stops.
+    /// The following step resumes where it returned: after an EBREAK or an
+    /// ECALL, the host may serve it in between, and with the access for
+    /// Mmio, which is then performed on the device bus whatever events are
+    /// set. Traps taken by a trap handler aren't events.
+    /// @param engine
+    /// @param budget Instructions retired at most, Unbounded for no limit.
+    /// @param events
+    /// @return RunResult
+    auto step(Engine engine, uint64_t budget, uint32_t events = 0)
+        -> RunResult;
+
+    /// @brief Record every instruction retired by the following runs in
+    /// profiler, nullptr stops profiling. The profiler must outlive the
+    /// runs.
+    /// @param profiler
+    auto setProfiler(Profiler* profiler) -> void {
+        this->profiler = profiler;
+    }
+
+    /// @brief Record every instruction retired and every trap raised by
+    /// the following runs in tracer, nullptr stops tracing. The tracer must
+    /// outlive the runs.
+    /// @param tracer
+    auto setTracer(Tracer* tracer) -> void { this->tracer = tracer; }
+
+    /// @brief Sample the profile of the following runs instead of profiling
+    /// every instruction: out of every sampling.interval instructions the
+    /// first ones are fast-forwarded on the engine given to run with the
+    /// profiler detached and the last sampling.window are executed on the
+    /// profiled interpreter. Only applies while a profiler is set, a tracer
+    /// then only records the windows.
+    /// @param sampling
+    auto setSampling(Sampling sampling) -> void {
+        this->sampling = sampling;
+    }
+
     /// @brief Fetch instruction at current program counter.
     // this implies each n+1 read is shifted by 8 bytes.
     auto fetch() -> uint32_t;
@@ -196,6 +661,10 @@ class CPU {
     /// @brief Get value stored in register.
     auto getCSR(uint64_t addr) -> uint64_t;
 
+    /// @brief Get the bits stored in floating point register idx, single
+    /// precision values are NaN-boxed.
+    auto getFloatRegister(uint64_t idx) -> uint64_t;
+
     /// @brief Set register with value.
     auto setRegister(Register reg, uint64_t value) -> void;
 
@@ -215,18 +684,603 @@ class CPU {
     /// @return void
     auto store(VirtualAddress addr, size_t size, uint64_t value) -> void;
 
+    /// @brief Load a value of type T at address, see MMU::load.
+    /// @param addr
+    /// @return value of type T at address.
+    template <typename T> auto load(VirtualAddress addr) -> T {
+        return this->ctx->mmu.load<T>(addr);
+    }
+
+    /// @brief Store value of type T at address, see MMU::store.
+    /// @param addr
+    /// @param value
+    template <typename T> auto store(VirtualAddress addr, T value) -> void {
+        this->ctx->mmu.store<T>(addr, value);
+    }
+
     private:
+    /// @brief Instruction semantics, handlers operate directly on the CPU
+    /// state.
+    friend struct Semantics;
+
+    /// @brief Checkpoints save and restore the hart state.
+    friend class Checkpoint;
+
+    /// @brief System calls access the registers and memory of the hart.
+    friend class SyscallProxy;
+
+    /// @brief Run loops fold the floating point exception flags on return.
+    friend class FloatFlagsScope;
+
+    /// @brief Guest load of a value of type T at virtual address addr, the
+    /// address is translated when paging is enabled (see translate).
+    /// Pages loaded from are cached in loadPages so following loads from
+    /// the same page are a single host load. Faults are raised as traps.
+    /// @param addr
+    /// @param value
+    /// @return false if the load raised a trap.
+    template <typename T> auto read(VirtualAddress addr, T& value) -> bool {
+        const auto* page = this->loadPages.lookup<T>(addr);
+        if (page != nullptr) [[likely]] {
+            std::memcpy(&value, page->host + (addr & (PageSize - 1)),
+                        sizeof(T));
+            return true;
+        }
+        return readMiss(addr, value);
+    }
+
+    /// @brief Guest store of value of type T at virtual address addr, see
+    /// read. Stores to a page holding decoded code take the checked path.
+    /// @param addr
+    /// @param value
+    /// @return false if the store raised a trap.
+    template <typename T> auto write(VirtualAddress addr, T value) -> bool {
+        const auto* page = this->storePages.lookup<T>(addr);
+        if (page != nullptr && std::atomic_ref(*page->code).load() == 0)
+            [[likely]] {
+            std::memcpy(page->host + (addr & (PageSize - 1)), &value,
+                        sizeof(T));
+            return true;
+        }
+        return writeMiss(addr, value);
+    }
+
+    /// @brief Checked path of read, translates and bounds checks the
+    /// access and caches its page.
+    template <typename T>
+    auto readMiss(VirtualAddress addr, T& value) -> bool {
+        auto paddr = addr;
+        if (this->paging.data) [[unlikely]] {
+            if (crossesPage<T>(addr)) {
+                return readSplit(addr, value);
+            }
+            if (!translate(addr, Access::Load, paddr)) {
+                return false;
+            }
+        }
+        if (!this->ctx->mmu.read<T>(paddr, value)) [[unlikely]] {
+            return readDevice(addr, paddr, value);
+        }
+        cachePage(this->loadPages, addr, paddr);
+        return true;
+    }
+
+    /// @brief Checked path of write, see readMiss.
+    template <typename T>
+    auto writeMiss(VirtualAddress addr, T value) -> bool {
+        auto paddr = addr;
+        if (this->paging.data) [[unlikely]] {
+            if (crossesPage<T>(addr)) {
+                return writeSplit(addr, value);
+            }
+            if (!translate(addr, Access::Store, paddr)) {
+                return false;
+            }
+        }
+        if (!this->ctx->mmu.write<T>(paddr, value)) [[unlikely]] {
+            return writeDevice(addr, paddr, value);
+        }
+        cachePage(this->storePages, addr, paddr);
+        return true;
+    }
+
+    /// @brief Load of a value of type T at the physical address paddr
+    /// outside of guest memory from the device bus, accesses no device
+    /// handles raise a load access fault. Device pages are never cached.
+    template <typename T>
+    auto readDevice(VirtualAddress addr, uint64_t paddr, T& value) -> bool {
+        if ((this->events & EventMmio) != 0) [[unlikely]] {
+            return stopBeforeDevice(TrapCause::LoadAccessFault, paddr);
+        }
+        uint64_t raw = 0;
+        if (!this->ctx->bus.read(paddr, sizeof(T), raw)) {
+            return raise(TrapCause::LoadAccessFault, addr);
+        }
+        value = (T)raw;
+        return true;
+    }
+
+    /// @brief Store of value of type T to the device bus, see readDevice.
+    template <typename T>
+    auto writeDevice(VirtualAddress addr, uint64_t paddr, T value) -> bool {
+        if ((this->events & EventMmio) != 0) [[unlikely]] {
+            return stopBeforeDevice(TrapCause::StoreAccessFault, paddr);
+        }
+        if (!this->ctx->bus.write(paddr, sizeof(T), (uint64_t)value)) {
+            return raise(TrapCause::StoreAccessFault, addr);
+        }
+        return true;
+    }
+
+    /// @brief Value of the counter CSR at addr, one of cycle, time, instret
+    /// and hpmcounter3 to 31 or their machine mode counterparts.
+    /// cycle counts one cycle per retired instruction.
+    /// @param addr
+    /// @return uint64_t
+    [[nodiscard]] auto readCounter(uint64_t addr) const -> uint64_t;
+
+    /// @brief Refresh the machine timer and software interrupt pending bits
+    /// of mip from the CLINT, they can't be written through the CSR.
+    auto updatePending() -> void {
+        auto mip = this->csrs.stored(MIp) & ~(MaskMTIP | MaskMSIP);
+        this->csrs.store(MIp, mip | this->ctx->clint->pending(
+                                        this->csrs.load(MHartID)));
+    }
+
+    /// @brief Add the exception flags in flags to fflags.
+    auto accrueFloatFlags(uint64_t flags) -> void {
+        this->csrs.store(FFlags, this->csrs.load(FFlags) | flags);
+    }
+
+    /// @brief Fold the exception flags raised on the host by the guest
+    /// since the last call into fflags, see Float.h. Called before fflags
+    /// or fcsr are read and when a run returns.
+    auto syncFloatFlags() -> void {
+        auto raised = takeHostFlags();
+        if (raised != 0) [[unlikely]] {
+            accrueFloatFlags(raised);
+        }
+    }
+
+    /// @brief Write the machine mode counter CSR at addr, the write is seen
+    /// by the next instruction which the writing instruction doesn't count
+    /// towards.
+    /// @param addr
+    /// @param value
+    auto writeCounter(uint64_t addr, uint64_t value) -> void;
+
+    /// @brief Write mcountinhibit, stopping or resuming mcycle and minstret.
+    /// @param value
+    auto writeCountInhibit(uint64_t value) -> void;
+
+    /// @brief Cache the host address of the physical page holding paddr
+    /// for the virtual address addr, pages only partially within memory
+    /// aren't cached.
+    /// @param cache
+    /// @param addr
+    /// @param paddr
+    auto cachePage(PageCache& cache, VirtualAddress addr, uint64_t paddr)
+        -> void;
+
+    /// @brief Host address of the naturally aligned value of type T at
+    /// virtual address addr, see MMU::hostAddress.
+    /// @param addr
+    /// @param access Access::Load or Access::Store.
+    /// @return T* or nullptr if the access raised a trap.
+    template <typename T>
+    auto hostAddress(VirtualAddress addr, Access access) -> T* {
+        auto paddr = addr;
+        if (this->paging.data && !translate(addr, access, paddr)) {
+            return nullptr;
+        }
+        auto* host =
+            this->ctx->mmu.hostAddress<T>(paddr, access == Access::Store);
+        if (host == nullptr) [[unlikely]] {
+            raise(access == Access::Store ? TrapCause::StoreAccessFault
+                                          : TrapCause::LoadAccessFault,
+                  addr);
+        }
+        return host;
+    }
+
+    /// @brief Returns true if a value of type T at addr spans two pages.
+    template <typename T>
+    static auto crossesPage(VirtualAddress addr) -> bool {
+        return (addr & (PageSize - 1)) > PageSize - sizeof(T);
+    }
+
+    /// @brief Load a value spanning two pages one byte at a time.
+    template <typename T>
+    auto readSplit(VirtualAddress addr, T& value) -> bool {
+        std::array<uint8_t, sizeof(T)> bytes{};
+        for (size_t i = 0; i < sizeof(T); i++) {
+            if (!read<uint8_t>(addr + i, bytes[i])) {
+                return false;
+            }
+        }
+        std::memcpy(&value, bytes.data(), sizeof(T));
+        return true;
+    }
+
+    /// @brief Store a value spanning two pages one byte at a time, both
+    /// pages are translated before anything is written.
+    template <typename T>
+    auto writeSplit(VirtualAddress addr, T value) -> bool {
+        std::array<uint64_t, sizeof(T)> paddrs{};
+        for (size_t i = 0; i < sizeof(T); i++) {
+            if (!translate(addr + i, Access::Store, paddrs[i])) {
+                return false;
+            }
+        }
+        std::array<uint8_t, sizeof(T)> bytes{};
+        std::memcpy(bytes.data(), &value, sizeof(T));
+        for (size_t i = 0; i < sizeof(T); i++) {
+            if (!this->ctx->mmu.write<uint8_t>(paddrs[i], bytes[i])) {
+                return raise(TrapCause::StoreAccessFault, addr + i);
+            }
+        }
+        return true;
+    }
+
+    /// @brief Translate the virtual address addr with the Sv39 page tables
+    /// rooted at satp, hits in the instruction or data TLB skip the walk.
+    /// Only called while paging is enabled for the access (see Paging).
+    /// @param addr
+    /// @param access
+    /// @param paddr Physical address when the translation succeeds.
+    /// @return false if the access raised a page fault.
+    auto translate(VirtualAddress addr, Access access, uint64_t& paddr)
+        -> bool {
+        const auto& tlb   = access == Access::Fetch ? this->itlb : this->dtlb;
+        const auto* entry = tlb.lookup(addr);
+        if (entry != nullptr && permitted(entry->flags, access)) [[likely]] {
+            paddr = entry->page | (addr & (PageSize - 1));
+            return true;
+        }
+        return walk(addr, access, paddr);
+    }
+
+    /// @brief Walk the page tables to translate addr and fill the TLB,
+    /// accessed and dirty flags are set in the leaf entry.
+    auto walk(VirtualAddress addr, Access access, uint64_t& paddr) -> bool;
+
+    /// @brief Returns true if a leaf entry with the given flags allows the
+    /// access at the current privilege, a store also requires the dirty
+    /// flag to be set so the first store to a page goes through a walk.
+    [[nodiscard]] auto permitted(uint64_t flags, Access access) const
+        -> bool {
+        auto privilege = access == Access::Fetch ? this->privilege
+                                                 : this->paging.privilege;
+        if ((flags & PteUser) != 0
+                ? privilege == Privilege::Supervisor &&
+                      (access == Access::Fetch || !this->paging.sum)
+                : privilege == Privilege::User) {
+            return false;
+        }
+        switch (access) {
+        case Access::Fetch:
+            return (flags & (PteExecute | PteAccessed)) ==
+                   (PteExecute | PteAccessed);
+        case Access::Load:
+            return (flags & PteAccessed) != 0 &&
+                   (flags & (PteRead |
+                             (this->paging.mxr ? PteExecute : 0))) != 0;
+        case Access::Store:
+            return (flags & (PteWrite | PteAccessed | PteDirty)) ==
+                   (PteWrite | PteAccessed | PteDirty);
+        }
+        return false;
+    }
+
+    /// @brief Translate the program counter for instruction fetch.
+    /// @param paddr Physical address of the instruction.
+    /// @return false if the fetch raised a trap.
+    auto fetchAddress(uint64_t& paddr) -> bool {
+        paddr = this->pc;
+        if (!this->paging.fetch) [[likely]] {
+            return true;
+        }
+        if (!translate(this->pc, Access::Fetch, paddr)) {
+            return false;
+        }
+        if (!this->ctx->mmu.withinRange(paddr)) {
+            return raise(TrapCause::InstructionAccessFault, this->pc);
+        }
+        return true;
+    }
+
+    /// @brief Fetch the upper half of a 32-bit instruction crossing into
+    /// the next page, the half is translated on its own so the fetch may
+    /// fault at addr + 2.
+    /// @param addr Address of the instruction.
+    /// @param half
+    /// @return false if the fetch raised a trap.
+    auto fetchUpperHalf(VirtualAddress addr, uint16_t& half) -> bool {
+        uint64_t paddr = addr + 2;
+        if (this->paging.fetch && !translate(addr + 2, Access::Fetch, paddr)) {
+            return false;
+        }
+        if (!this->ctx->mmu.read<uint16_t>(paddr, half)) {
+            return raise(TrapCause::InstructionAccessFault, addr + 2);
+        }
+        return true;
+    }
+
+    /// @brief Recompute when addresses are translated from satp, mstatus
+    /// and the current privilege, called whenever one of them changes.
+    auto updatePaging() -> void;
+
+    /// @brief Drop every cached translation, on SFENCE.VMA and satp writes.
+    auto flushTlb() -> void {
+        this->itlb.flush();
+        this->dtlb.flush();
+        this->loadPages.flush();
+        this->storePages.flush();
+    }
+
+    /// @brief Record a trap raised by the instruction being executed, the
+    /// engine executing it takes the trap once the handler returns.
+    /// @param cause
+    /// @param value Trap value written to mtval.
+    /// @return false, handlers return it to report the trap.
+    auto raise(TrapCause cause, uint64_t value) -> bool {
+        this->pending = {.cause = cause, .value = value};
+        return false;
+    }
+
+    /// @brief Stop the run once the instruction being executed retires,
+    /// the run reports status for the instruction at addr.
+    /// @param status
+    /// @param addr
+    /// @return true, the instruction completes.
+    auto stopOn(RunStatus status, VirtualAddress addr) -> bool {
+        this->outcome.status = status;
+        this->outcome.addr   = addr;
+        this->stopAt         = 0;
+        this->pollAt         = 0;
+        return true;
+    }
+
+    /// @brief Stop the run before the access outside of memory of the
+    /// instruction being executed, its handler fails without raising a
+    /// trap and takeTrap leaves the program counter on the instruction.
+    /// @param cause Trap raised if no device handles the access.
+    /// @param paddr
+    /// @return false, the instruction doesn't complete.
+    auto stopBeforeDevice(TrapCause cause, uint64_t paddr) -> bool {
+        this->pending = {.cause = cause, .value = paddr, .event = true};
+        this->outcome.status = RunStatus::Mmio;
+        this->outcome.cause  = cause;
+        this->outcome.value  = paddr;
+        this->stopAt         = 0;
+        this->pollAt         = 0;
+        return false;
+    }
+
+    /// @brief Stop the run on the WFI being executed when no interrupt can
+    /// become pending before another hart raises one. Like
+    /// stopBeforeDevice the handler fails without raising a trap, takeTrap
+    /// leaves the program counter on the WFI.
+    /// @return false, the instruction doesn't complete.
+    auto stopIdle() -> bool {
+        this->pending.event  = true;
+        this->outcome.status = RunStatus::Idle;
+        this->stopAt         = 0;
+        this->pollAt         = 0;
+        return false;
+    }
+
+    /// @brief Take the pending trap raised by the instruction at addr: the
+    /// trap is recorded in mepc, mcause and mtval and execution continues
+    /// at the mtvec base. A hart without a trap handler (mtvec is 0) stops
+    /// and the run reports RunStatus::Trapped.
+    /// @param addr
+    auto takeTrap(VirtualAddress addr) -> void;
+
+    /// @brief Take the highest priority interrupt pending and enabled at
+    /// the current privilege, called between blocks once instret reached
+    /// pollAt. The trap returns to the program counter.
+    /// @return true if an interrupt was taken.
+    auto pollInterrupts() -> bool;
+
+    /// @brief Idle in WFI until an interrupt enabled in mie is pending.
+    /// @return false if the hart waits for another hart, see stopIdle.
+    auto waitForInterrupt() -> bool;
+
+    /// @brief Enter the trap handler for cause, see takeTrap.
+    /// @param addr Address written to mepc or sepc.
+    /// @param cause
+    /// @param value Trap value written to mtval or stval.
+    /// @param supervisor true if the trap is delegated to supervisor mode.
+    auto enterTrap(VirtualAddress addr, uint64_t cause, uint64_t value,
+                   bool supervisor) -> void;
+
+    /// @brief Run loop of the Engine::Threaded and Engine::Jit engines,
+    /// tiered enables compilation of hot blocks.
+    auto runThreaded(bool tiered) -> void;
+
+    /// @brief Interpreter run loop recording retired instructions and
+    /// traps in profiler and tracer.
+    auto runInstrumented() -> void;
+
+    /// @brief Alternate fast-forwarding on engine and profiled windows,
+    /// see setSampling.
+    auto runSampled(Engine engine) -> void;
+
+    /// @brief Make the run loops return once instret reaches limit.
+    auto stopAfter(uint64_t limit) -> void {
+        this->stopAt = limit;
+        this->pollAt = 0;
+    }
+
+    /// @brief End of the executable code, execution stops once the program
+    /// counter leaves [MemoryBaseAddr, codeEnd()).
+    [[nodiscard]] auto codeEnd() const -> uint64_t {
+        return MemoryBaseAddr + this->ctx->codeSize;
+    }
+
+    /// @brief Returns true once the hart left the program. Only untranslated
+    /// program counters are checked, under paging the program counter is
+    /// a virtual address and stray fetches fault instead.
+    [[nodiscard]] auto outsideCode() const -> bool {
+        return !this->paging.fetch &&
+               (this->pc < MemoryBaseAddr || codeEnd() <= this->pc);
+    }
+
+    /// @brief Upper bound for translated blocks, see codeEnd.
+    [[nodiscard]] auto fetchLimit() const -> uint64_t {
+        return this->paging.fetch ? ~static_cast<uint64_t>(0) : codeEnd();
+    }
+
     /// @brief  Program counter,
     /// TODO: maybe start at an actual offset in MMU ?
     offset_t pc = MemoryBaseAddr;
     /// @brief Registers.
-    std::array<uint64_t, 32> registers;
+    std::array<uint64_t, 32> registers{};
+    /// @brief Floating point registers, holding the bits of their value.
+    std::array<uint64_t, 32> fregisters{};
+    /// @brief Vector registers, one contiguous array so a register group
+    /// is a contiguous run of bytes (see Vector.h).
+    alignas(64) std::array<uint8_t, VectorRegisters * VectorBytes>
+        vregisters{};
 
     /// @brief Control and Status registers.
-    CSR csrs;
+    CSR csrs{};
+
+    /// @brief Number of instructions retired. Engines may count the
+    /// instructions of a block ahead of executing them, but a handler
+    /// always sees the instructions retired before its own.
+    uint64_t instret = 0;
+    /// @brief Differences between mcycle and minstret and instret, set by
+    /// writes to the counters, or the counters themselves while
+    /// mcountinhibit stops them.
+    uint64_t cycleOffset   = 0;
+    uint64_t instretOffset = 0;
+
+    /// @brief Reservation taken by LR and released by SC.
+    struct Reservation {
+        // Reserved address.
+        VirtualAddress addr = 0;
+        // Value loaded by LR, zero extended.
+        uint64_t value = 0;
+        bool valid     = false;
+    };
+    Reservation reservation;
 
-    /// @brief CPU instance contexts.
-    std::unique_ptr<VMContext> ctx;
+    /// @brief Current privilege level, harts start in machine mode.
+    Privilege privilege = Privilege::Machine;
+
+    /// @brief Address translation state derived from satp, mstatus and the
+    /// privilege level, see updatePaging.
+    struct Paging {
+        // Instruction fetches are translated.
+        bool fetch = false;
+        // Loads and stores are translated.
+        bool data = false;
+        // Privilege loads and stores are checked against (mstatus.MPRV).
+        Privilege privilege = Privilege::Machine;
+        // Supervisor may access user pages (mstatus.SUM).
+        bool sum = false;
+        // Loads from executable pages are allowed (mstatus.MXR).
+        bool mxr = false;
+
+        auto operator==(const Paging&) const -> bool = default;
+    };
+    Paging paging;
+
+    /// @brief Instruction and data TLBs.
+    Tlb itlb;
+    Tlb dtlb;
+
+    /// @brief Host addresses of the pages recently loaded from and stored
+    /// to, only valid for the current Paging state.
+    PageCache loadPages;
+    PageCache storePages;
+
+    /// @brief Trap raised by the last instruction, see raise.
+    struct Trap {
+        TrapCause cause = TrapCause::IllegalInstruction;
+        // Value of mtval, the faulting address or instruction.
+        uint64_t value = 0;
+        // The instruction stopped the run before accessing a device or in
+        // WFI, see stopBeforeDevice and stopIdle, and raised no trap.
+        bool event = false;
+    };
+    Trap pending;
+
+    /// @brief CPU instance contexts, shared by the harts of a Machine.
+    std::shared_ptr<VMContext> ctx;
+
+    /// @brief Decoded instructions cache keyed by program counter.
+    DecodeCache icache;
+
+    /// @brief Translated blocks for the threaded engine.
+    BlockCache blocks;
+
+    /// @brief Native code compiler for hot blocks.
+    JitCompiler jit;
+
+    /// @brief Profiler set by setProfiler, nullptr when not profiling.
+    Profiler* profiler = nullptr;
+
+    /// @brief Tracer set by setTracer, nullptr when not tracing.
+    Tracer* tracer = nullptr;
+
+    /// @brief Sampling set by setSampling.
+    Sampling sampling;
+
+    /// @brief Run loops return once instret reaches it, the threaded
+    /// engines run the blocks longer than the instructions left one
+    /// instruction at a time so no engine overshoots it.
+    uint64_t stopAt = ~static_cast<uint64_t>(0);
+
+    /// @brief Run loops check for pending interrupts and for stopAt once
+    /// instret reaches it, so they compare instret against a single limit.
+    /// It never exceeds stopAt and is reset to 0 by every change that may
+    /// unmask an interrupt.
+    uint64_t pollAt = 0;
+
+    /// @brief Events the current step stops on, see step.
+    uint32_t events = 0;
+
+    /// @brief Outcome of the current step, the status stays Budget until
+    /// an event or a trap stops the hart.
+    RunResult outcome;
+
+    /// @brief The last step stopped before a device access, the next one
+    /// performs it first.
+    bool resumeDevice = false;
+};
+
+/// @brief Machine is a multi-hart system, harts share the memory of a
+/// single context and each hart runs on its own host thread.
+/// Harts start at the context entry point with their own stack (see
+/// HartStackSize) and tell themselves apart through the mhartid CSR.
+class Machine {
+    public:
+    /// @brief Machine constructor.
+    /// @param ctx Context shared by every hart.
+    /// @param harts Number of harts, at least one.
+    Machine(VMContext ctx, size_t harts);
+
+    /// @brief Run every hart on the given engine until they all stop, hart
+    /// 0 runs on the calling thread. Harts waiting in wfi for an interrupt
+    /// no hart is left to raise stop with RunStatus::Idle.
+    /// @param engine
+    /// @return Outcome of each hart, indexed by mhartid.
+    auto run(Engine engine) -> std::vector<RunResult>;
+
+    /// @brief Return hart id.
+    /// @param id
+    /// @return CPU&
+    auto hart(size_t id) -> CPU& { return *this->cpus.at(id); }
+
+    /// @brief Return the number of harts.
+    [[nodiscard]] auto harts() const -> size_t { return this->cpus.size(); }
+
+    private:
+    /// @brief Harts indexed by mhartid.
+    std::vector<std::unique_ptr<CPU>> cpus;
 };
 
 } // namespace riscvemu
@@ -0,0 +1,116 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace riscvemu {
+
+/// @brief Reserve bytes of zeroed anonymous memory, host pages are only
+/// committed once touched.
+/// @param bytes
+/// @return start of the reservation, throws std::bad_alloc on failure.
+auto reserveMemory(size_t bytes) -> void*;
+
+/// @brief Release a reservation made by reserveMemory.
+/// @param addr
+/// @param bytes
+auto releaseMemory(void* addr, size_t bytes) -> void;
+
+/// @brief Host page size, file mappings are aligned to it.
+auto hostPageSize() -> size_t;
+
+/// @brief Report which host pages of [addr, addr + bytes) are resident,
+/// pages of an anonymous reservation that aren't were never touched and
+/// read as zero.
+/// @param addr Must be aligned to hostPageSize().
+/// @param bytes
+/// @return one flag per host page, every page is reported resident when
+/// the host can't tell.
+auto residentPages(const void* addr, size_t bytes) -> std::vector<uint8_t>;
+
+/// @brief Map bytes of the open file fd starting at offset copy-on-write at
+/// addr, replacing the pages of a reservation. addr and offset must be
+/// aligned to hostPageSize().
+/// @param addr
+/// @param fd
+/// @param offset
+/// @param bytes
+/// @return true on success, errno is set otherwise.
+auto mapFile(void* addr, int fd, uint64_t offset, size_t bytes) -> bool;
+
+/// @brief Create an unnamed file of bytes bytes living in host memory, used
+/// to share memory contents between mappings.
+/// @param bytes
+/// @return file descriptor, throws std::system_error on failure.
+auto createMemoryFile(size_t bytes) -> int;
+
+/// @brief Map the file at path copy-on-write at addr, replacing the first
+/// bytes of a reservation of capacity bytes. The file contents are paged in
+/// on demand and guest writes never reach the file.
+/// @param addr Start of the reservation, must be page aligned.
+/// @param capacity Size of the reservation.
+/// @param path
+/// @return size of the file, throws std::system_error if the file can't be
+/// mapped and std::length_error if it doesn't fit in the reservation.
+auto mapImage(void* addr, size_t capacity, const std::string& path) -> size_t;
+
+/// @brief MappedArray is a fixed size, zero initialized array backed by an
+/// anonymous memory mapping instead of the heap. Construction is O(1)
+/// whatever the size and untouched elements cost no host memory, which
+/// makes it suitable for guest RAM and the per page tables shadowing it.
+template <typename T> class MappedArray {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "MappedArray elements are zero initialized by the kernel");
+
+    public:
+    MappedArray() = default;
+
+    /// @brief Reserve count elements.
+    /// @param count
+    explicit MappedArray(size_t count) : count(count) {
+        if (count != 0) {
+            this->elements = static_cast<T*>(reserveMemory(count * sizeof(T)));
+        }
+    }
+
+    ~MappedArray() {
+        if (this->elements != nullptr) {
+            releaseMemory(this->elements, this->count * sizeof(T));
+        }
+    }
+
+    MappedArray(const MappedArray&)                    = delete;
+    auto operator=(const MappedArray&) -> MappedArray& = delete;
+
+    MappedArray(MappedArray&& other) noexcept
+        : elements(std::exchange(other.elements, nullptr)),
+          count(std::exchange(other.count, 0)) {}
+
+    auto operator=(MappedArray&& other) noexcept -> MappedArray& {
+        std::swap(this->elements, other.elements);
+        std::swap(this->count, other.count);
+        return *this;
+    }
+
+    [[nodiscard]] auto data() -> T* { return this->elements; }
+    [[nodiscard]] auto data() const -> const T* { return this->elements; }
+    [[nodiscard]] auto size() const -> size_t { return this->count; }
+
+    auto operator[](size_t i) -> T& { return this->elements[i]; }
+    auto operator[](size_t i) const -> const T& { return this->elements[i]; }
+
+    private:
+    /// @brief Start of the mapping.
+    T* elements = nullptr;
+    /// @brief Number of elements in the mapping.
+    size_t count = 0;
+};
+
+} // namespace riscvemu
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace riscvemu {
+
+/// @brief HostPage maps a guest virtual page to the host memory backing it.
+struct HostPage {
+    // Virtual page number, InvalidTag if the entry is empty.
+    uint64_t tag;
+    // Host address of the first byte of the page.
+    uint8_t* host;
+    // Code page flag of the page in the MMU (see MMU::codePages), stores
+    // must invalidate the decoded code of pages with the flag set.
+    uint8_t* code;
+};
+
+/// @brief PageCache is a direct-mapped cache of the host addresses of
+/// recently accessed guest pages, so a guest access that hits only costs a
+/// tag compare and a host memory access. Entries are filled by the checked
+/// access path once it has translated the page and found it in memory.
+class PageCache {
+    public:
+    /// @brief Number of entries, a power of two.
+    static constexpr size_t Entries = 256;
+
+    /// @brief Tag of empty entries, never a valid virtual page number.
+    static constexpr uint64_t InvalidTag = ~static_cast<uint64_t>(0);
+
+    PageCache() { flush(); }
+
+    /// @brief Return the entry of the page holding the value of type T at
+    /// addr, a value spanning two pages never hits as its last byte is
+    /// compared against the tag.
+    /// @param addr Virtual address.
+    /// @return HostPage* or nullptr on a miss.
+    template <typename T>
+    [[nodiscard]] auto lookup(uint64_t addr) const -> const HostPage* {
+        const auto& entry = this->entries[(addr >> 12) & (Entries - 1)];
+        return entry.tag == (addr + sizeof(T) - 1) >> 12 ? &entry : nullptr;
+    }
+
+    /// @brief Cache the host address of the page holding addr, evicting the
+    /// entry it maps to.
+    /// @param addr Virtual address.
+    /// @param host Host address of the page.
+    /// @param code Code page flag of the page.
+    auto insert(uint64_t addr, uint8_t* host, uint8_t* code) -> void {
+        auto tag   = addr >> 12;
+        auto& slot = this->entries[tag & (Entries - 1)];
+        slot       = {.tag = tag, .host = host, .code = code};
+    }
+
+    /// @brief Drop every cached page.
+    auto flush() -> void {
+        this->entries.fill(
+            {.tag = InvalidTag, .host = nullptr, .code = nullptr});
+    }
+
+    private:
+    std::array<HostPage, Entries> entries;
+};
+
+} // namespace riscvemu
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "Decoder.h"
+#include "Instructions.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+namespace riscvemu {
+
+/// @brief Profiler counts the instructions a hart retires, per address and
+/// per mnemonic, along with the outcome of every conditional branch.
+/// Retired instructions are also attributed to a shadow call stack built
+/// from the calling convention hints of JAL and JALR (a link register rd
+/// is a call, jumping through a link register with rd x0 a return) and
+/// from trap entries and returns, so the profile can be rendered as a
+/// flame graph.
+/// A CPU only profiles when given a profiler (see CPU::setProfiler), runs
+/// without one don't execute any profiling code.
+class Profiler {
+    public:
+    /// @brief Counters of a single instruction address.
+    struct Counters {
+        Mnemonic mnemonic = Mnemonic::ILLEGAL;
+        // Number of times the instruction retired.
+        uint64_t executed = 0;
+        // Number of times the branch was taken, conditional branches only.
+        uint64_t taken = 0;
+    };
+
+    /// @brief Upper bound on the depth of the shadow call stack, deeper
+    /// calls are attributed to the deepest frame.
+    static constexpr size_t MaxStackDepth = 256;
+
+    /// @brief Profiler constructor, entry is the root frame of the shadow
+    /// call stack.
+    explicit Profiler(uint64_t entry);
+
+    // The current stack counter points into stacks, which moving keeps.
+    Profiler(const Profiler&)                    = delete;
+    auto operator=(const Profiler&) -> Profiler& = delete;
+    Profiler(Profiler&&)                         = default;
+    auto operator=(Profiler&&) -> Profiler&      = default;
+
+    /// @brief Record the instruction inst retired at addr.
+    /// @param addr
+    /// @param inst
+    /// @param next Program counter after the instruction.
+    auto record(uint64_t addr, const DecodedInstruction& inst, uint64_t next)
+        -> void {
+        auto& counters    = this->pcs[addr];
+        counters.mnemonic = inst.mnemonic;
+        counters.executed++;
+        this->mnemonics[(size_t)inst.mnemonic]++;
+        this->retired++;
+        (*this->current)++;
+        switch (inst.mnemonic) {
+        case Mnemonic::BEQ:
+        case Mnemonic::BNE:
+        case Mnemonic::BLT:
+        case Mnemonic::BGE:
+        case Mnemonic::BLTU:
+        case Mnemonic::BGEU:
+            counters.taken += next != addr + inst.size ? 1 : 0;
+            break;
+        case Mnemonic::JAL:
+        case Mnemonic::JALR:
+            followJump(inst, next);
+            break;
+        case Mnemonic::MRET:
+        case Mnemonic::SRET:
+            leave();
+            break;
+        default:
+            break;
+        }
+    }
+
+    /// @brief Record a trap taken to the handler at addr.
+    auto trap(uint64_t addr) -> void { enter(addr); }
+
+    /// @brief Record count instructions retired without being profiled,
+    /// when sampling (see CPU::setSampling).
+    auto skip(uint64_t count) -> void { this->skipped += count; }
+
+    /// @brief Number of instructions retired without being profiled.
+    [[nodiscard]] auto unprofiled() const -> uint64_t {
+        return this->skipped;
+    }
+
+    /// @brief Total number of retired instructions.
+    [[nodiscard]] auto instructions() const -> uint64_t {
+        return this->retired;
+    }
+
+    /// @brief Counters of the instruction at addr.
+    [[nodiscard]] auto at(uint64_t addr) const -> Counters;
+
+    /// @brief Number of retired instructions of the given mnemonic.
+    [[nodiscard]] auto count(Mnemonic mnemonic) const -> uint64_t {
+        return this->mnemonics[(size_t)mnemonic];
+    }
+
+    /// @brief Write a readable report: totals, branch outcomes, the top
+    /// hottest addresses and the instruction mix.
+    /// @param out
+    /// @param top Number of addresses listed.
+    auto writeReport(std::ostream& out, size_t top = 20) const -> void;
+
+    /// @brief Write the shadow call stacks in the collapsed format read by
+    /// flame graph tools, one "frame;frame;frame count" line per stack with
+    /// frames named by their entry address.
+    /// @param out
+    auto writeCollapsedStacks(std::ostream& out) const -> void;
+
+    private:
+    /// @brief Follow a call or a return, other jumps don't change the stack.
+    auto followJump(const DecodedInstruction& inst, uint64_t next) -> void;
+
+    /// @brief Push the frame of the function at addr.
+    auto enter(uint64_t addr) -> void;
+
+    /// @brief Pop the innermost frame, the root frame is never popped.
+    auto leave() -> void;
+
+    /// @brief Counters indexed by instruction address.
+    std::unordered_map<uint64_t, Counters> pcs;
+    /// @brief Retired instructions indexed by Mnemonic.
+    std::array<uint64_t, (size_t)Mnemonic::Count> mnemonics{};
+    uint64_t retired = 0;
+    uint64_t skipped = 0;
+    /// @brief Shadow call stack, function entry addresses from the root.
+    std::vector<uint64_t> stack;
+    /// @brief Calls made past MaxStackDepth, their returns pop nothing.
+    size_t overflow = 0;
+    /// @brief Retired instructions per call stack.
+    std::map<std::vector<uint64_t>, uint64_t> stacks;
+    /// @brief Counter of the current call stack.
+    uint64_t* current;
+};
+
+} // namespace riscvemu
+
+#endif
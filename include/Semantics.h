@@ -0,0 +1,2087 @@
+#ifndef SEMANTICS_H
+#define SEMANTICS_H
+
+#include "CSR.h"
+#include "Decoder.h"
+#include "Float.h"
+#include "Machine.h"
+#include "Syscalls.h"
+#include "Vector.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cfenv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace riscvemu {
+
+//==== Instruction Semantics ====//
+// Each handler executes a single mnemonic, by the time a handler runs the
+// program counter has already been advanced past the instruction so
+// pc-relative operations use (pc - size) as the instruction address.
+// Handlers return false when the instruction raised a trap (see
+// CPU::raise), the state is left as it was before the instruction and the
+// engine takes the trap, guest faults never unwind through C++ exceptions.
+
+struct Semantics {
+    /// @brief Read register at index idx.
+    static auto x(const CPU& cpu, uint8_t idx) -> uint64_t {
+        return cpu.registers[idx];
+    }
+
+    /// @brief Write value in register at index idx, x0 is hardwired to 0.
+    static auto setX(CPU& cpu, uint8_t idx, uint64_t value) -> void {
+        if (idx != 0) {
+            cpu.registers[idx] = value;
+        }
+    }
+
+    /// @brief Address of the instruction d being executed.
+    static auto instAddr(const CPU& cpu, const DecodedInstruction& d)
+        -> uint64_t {
+        return cpu.pc - d.size;
+    }
+
+    // Illegal or unimplemented instruction, mtval holds its encoding.
+    static auto illegal(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return cpu.raise(TrapCause::IllegalInstruction, d.raw);
+    }
+
+    // 32-bit instruction crossing a page boundary, only the lower half was
+    // cached (see DecodeCache::decode). The upper half is fetched every
+    // time so neither a change of the next page nor of its translation is
+    // missed, then the instruction executes as decoded from both halves.
+    static auto crossPage(CPU& cpu, const DecodedInstruction& d) -> bool {
+        uint16_t upper = 0;
+        if (!cpu.fetchUpperHalf(instAddr(cpu, d), upper)) {
+            return false;
+        }
+        auto inst    = predecode(d.raw | ((uint32_t)upper << 16));
+        inst.handler = handlerFor(inst.mnemonic);
+        return inst.handler(cpu, inst);
+    }
+
+    // ECALL: request a service from the execution environment, the cause
+    // encodes the privilege the call was made from. Under Linux system call
+    // emulation the host serves the call instead, see SyscallProxy, and a
+    // step stopping on EventECall returns to the host after the call.
+    static auto ecall(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (cpu.ctx->syscalls != nullptr) {
+            return cpu.ctx->syscalls->handle(cpu);
+        }
+        if ((cpu.events & EventECall) != 0) {
+            return cpu.stopOn(RunStatus::ECall, instAddr(cpu, d));
+        }
+        auto cause = (uint64_t)TrapCause::ECallFromU + (uint64_t)cpu.privilege;
+        return cpu.raise((TrapCause)cause, 0);
+    }
+
+    // EBREAK: return control to a debugger, mtval holds the address of the
+    // breakpoint. A step stopping on EventBreakpoint returns to the host.
+    static auto ebreak(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if ((cpu.events & EventBreakpoint) != 0) {
+            return cpu.stopOn(RunStatus::Breakpoint, instAddr(cpu, d));
+        }
+        return cpu.raise(TrapCause::Breakpoint, instAddr(cpu, d));
+    }
+
+    // MRET: return from a machine mode trap handler to mepc at the
+    // privilege stacked in MPP, the interrupt enable bit stacked in MPIE is
+    // restored. MPRV is cleared when returning below machine mode.
+    static auto mret(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (cpu.privilege != Privilege::Machine) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        auto status = cpu.csrs.load(MStatus);
+        auto mie    = (status & MaskMPIE) != 0 ? MaskMIE : 0;
+        auto mpp    = (Privilege)((status & MaskMPP) >> 11);
+        status &= ~(MaskMIE | MaskMPP); //NOLINT
+        if (mpp != Privilege::Machine) {
+            status &= ~MaskMPRV; //NOLINT
+        }
+        cpu.csrs.store(MStatus, status | mie | MaskMPIE);
+        cpu.privilege = mpp;
+        cpu.pc        = cpu.csrs.load(MEPc);
+        cpu.pollAt    = 0;
+        cpu.updatePaging();
+        return true;
+    }
+
+    // SRET: return from a supervisor mode trap handler to sepc at the
+    // privilege stacked in SPP, see MRET. mstatus.TSR makes it illegal in
+    // supervisor mode.
+    static auto sret(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto status = cpu.csrs.load(MStatus);
+        if (cpu.privilege == Privilege::User ||
+            (cpu.privilege == Privilege::Supervisor &&
+             (status & MaskTSR) != 0)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        auto sie    = (status & MaskSPIE) != 0 ? MaskSIE : 0;
+        auto spp    = (status & MaskSPP) != 0 ? Privilege::Supervisor
+                                              : Privilege::User;
+        status &= ~(MaskSIE | MaskSPP | MaskMPRV); //NOLINT
+        cpu.csrs.store(MStatus, status | sie | MaskSPIE);
+        cpu.privilege = spp;
+        cpu.pc        = cpu.csrs.load(Sepc);
+        cpu.pollAt    = 0;
+        cpu.updatePaging();
+        return true;
+    }
+
+    // WFI: stall the hart until an interrupt is pending, see
+    // CPU::waitForInterrupt. mstatus.TW makes it illegal below machine mode.
+    static auto wfi(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (cpu.privilege != Privilege::Machine &&
+            (cpu.csrs.load(MStatus) & MaskTW) != 0) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        if (!cpu.waitForInterrupt()) {
+            return cpu.stopIdle();
+        }
+        return true;
+    }
+
+    // SFENCE.VMA: order page table updates with the translations that
+    // follow, every cached translation is dropped whatever the operands.
+    // mstatus.TVM makes it illegal in supervisor mode.
+    static auto sfence(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (cpu.privilege == Privilege::User ||
+            (cpu.privilege == Privilege::Supervisor &&
+             (cpu.csrs.load(MStatus) & MaskTVM) != 0)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        cpu.flushTlb();
+        return true;
+    }
+
+    // LUI: load upper immediate places the the immediate value in the top
+    // 20 bits of the destination register rd filling the lowest 12 bits
+    // with zeroes.
+    static auto lui(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, (int64_t)d.imm);
+        return true;
+    }
+
+    // AUIPC: add upper immediate to pc builds a pc-relative address.
+    static auto auipc(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, instAddr(cpu, d) + (int64_t)d.imm);
+        return true;
+    }
+
+    // JAL: jump and link.
+    // TODO: raise Misaligned exception if address is misaligned
+    static auto jal(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto target = instAddr(cpu, d) + (int64_t)d.imm;
+        setX(cpu, d.rd, cpu.pc);
+        cpu.pc = target;
+        return true;
+    }
+
+    // JALR: (indirect) jump and link register.
+    // TODO: raise Misaligned exception if address is misaligned
+    static auto jalr(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto target = (x(cpu, d.rs1) + (int64_t)d.imm) & ~(uint64_t)1;
+        setX(cpu, d.rd, cpu.pc);
+        cpu.pc = target;
+        return true;
+    }
+
+    /// @brief Take the branch to the pc-relative immediate if taken.
+    static auto branch(CPU& cpu, const DecodedInstruction& d, bool taken)
+        -> void {
+        if (taken) {
+            cpu.pc = instAddr(cpu, d) + (int64_t)d.imm;
+        }
+    }
+
+    // BEQ : take the branch if [rs1] == [rs2]
+    static auto beq(CPU& cpu, const DecodedInstruction& d) -> bool {
+        branch(cpu, d, x(cpu, d.rs1) == x(cpu, d.rs2));
+        return true;
+    }
+
+    // BNE : take the branch if [rs1] != [rs2]
+    static auto bne(CPU& cpu, const DecodedInstruction& d) -> bool {
+        branch(cpu, d, x(cpu, d.rs1) != x(cpu, d.rs2));
+        return true;
+    }
+
+    // BLT : take the branch if [rs1] < [rs2]
+    static auto blt(CPU& cpu, const DecodedInstruction& d) -> bool {
+        branch(cpu, d, (int64_t)x(cpu, d.rs1) < (int64_t)x(cpu, d.rs2));
+        return true;
+    }
+
+    // BGE : take the branch if [rs1] >= [rs2]
+    static auto bge(CPU& cpu, const DecodedInstruction& d) -> bool {
+        branch(cpu, d, (int64_t)x(cpu, d.rs1) >= (int64_t)x(cpu, d.rs2));
+        return true;
+    }
+
+    // BLTU : (unsigned) take the branch if [rs1] < [rs2]
+    static auto bltu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        branch(cpu, d, x(cpu, d.rs1) < x(cpu, d.rs2));
+        return true;
+    }
+
+    // BGEU : (unsigned) take the branch if [rs1] >= [rs2]
+    static auto bgeu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        branch(cpu, d, x(cpu, d.rs1) >= x(cpu, d.rs2));
+        return true;
+    }
+
+    // Loads: load a value of type T at the effective address [rs1] + Imm
+    // and sign or zero extend it (following T's signedness) into Rd.
+    // LB, LH, LW, LD, LBU, LHU, LWU.
+    template <typename T>
+    static auto load(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto addr = x(cpu, d.rs1) + (int64_t)d.imm;
+        T value{};
+        if (!cpu.read<T>(addr, value)) [[unlikely]] {
+            return false;
+        }
+        setX(cpu, d.rd, (uint64_t)(int64_t)value);
+        return true;
+    }
+
+    // Stores: store the low bits of [rs2] (as many as fit in T) at the
+    // effective address [rs1] + Imm.
+    // SB, SH, SW, SD.
+    template <typename T>
+    static auto store(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto addr = x(cpu, d.rs1) + (int64_t)d.imm;
+        return cpu.write<T>(addr, (T)x(cpu, d.rs2));
+    }
+
+    // ADDI: add immmediate value to rs1 store result in rd.
+    static auto addi(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) + (int64_t)d.imm);
+        return true;
+    }
+
+    // SLTI : Set if Less Than Immediate.
+    static auto slti(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, ((int64_t)x(cpu, d.rs1) < (int64_t)d.imm) ? 1 : 0);
+        return true;
+    }
+
+    // SLTIU: Set if Less Than Immediate (Unsigned), the immediate is sign
+    // extended first then compared as unsigned.
+    static auto sltiu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, (x(cpu, d.rs1) < (uint64_t)(int64_t)d.imm) ? 1 : 0);
+        return true;
+    }
+
+    // XORI: Compute bitwise exclusive-OR of the sign-extended
+    // immediate and [rs1], writing the result to [rd].
+    static auto xori(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) ^ (int64_t)d.imm);
+        return true;
+    }
+
+    // ORI: Compute bitwise OR of the sign-extended
+    // immediate and [rs1], writing the result to [rd].
+    static auto ori(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) | (int64_t)d.imm);
+        return true;
+    }
+
+    // ANDI: Compute bitwise AND of the sign-extended
+    // immediate and [rs1], writing the result to [rd].
+    static auto andi(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) & (int64_t)d.imm);
+        return true;
+    }
+
+    // SLLI: Shift Left Logical Immediate.
+    static auto slli(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) << (d.imm & 0x3f));
+        return true;
+    }
+
+    // SRLI: Shift Right Logical Immediate.
+    static auto srli(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) >> (d.imm & 0x3f));
+        return true;
+    }
+
+    // SRAI: Shift Right Arithmetic Immediate.
+    static auto srai(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, (uint64_t)((int64_t)x(cpu, d.rs1) >> (d.imm & 0x3f)));
+        return true;
+    }
+
+    // ADDIW: Add Immediate Wide, the 32 bit result is sign extended.
+    static auto addiw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, (int64_t)(int32_t)(x(cpu, d.rs1) + (int64_t)d.imm));
+        return true;
+    }
+
+    // SLLIW: Shift Left Logical Immediate Wide.
+    static auto slliw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd,
+             (int64_t)(int32_t)((uint32_t)x(cpu, d.rs1) << (d.imm & 0x1f)));
+        return true;
+    }
+
+    // SRLIW: Shift Right Logical Immediate Wide.
+    static auto srliw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd,
+             (int64_t)(int32_t)((uint32_t)x(cpu, d.rs1) >> (d.imm & 0x1f)));
+        return true;
+    }
+
+    // SRAIW: Shift Right Arithmetic Immediate Wide.
+    static auto sraiw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, (int64_t)((int32_t)x(cpu, d.rs1) >> (d.imm & 0x1f)));
+        return true;
+    }
+
+    // ADD: add [rs1] to [rs2] store the result in [rd].
+    static auto add(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) + x(cpu, d.rs2));
+        return true;
+    }
+
+    // SUB: substract [rs2] from [rs1] store the result in [rd].
+    static auto sub(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) - x(cpu, d.rs2));
+        return true;
+    }
+
+    // SLL: Shift Left Logical.
+    static auto sll(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) << (x(cpu, d.rs2) & 0x3f));
+        return true;
+    }
+
+    // SLT: Set if Less Than
+    static auto slt(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd,
+             ((int64_t)x(cpu, d.rs1) < (int64_t)x(cpu, d.rs2)) ? 1 : 0);
+        return true;
+    }
+
+    // SLTU: Set if Less Than Unsigned.
+    static auto sltu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, (x(cpu, d.rs1) < x(cpu, d.rs2)) ? 1 : 0);
+        return true;
+    }
+
+    // XOR: Set [rd] to [rs1] ^ [rs2].
+    static auto xor_(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) ^ x(cpu, d.rs2));
+        return true;
+    }
+
+    // SRL: Shift Right Logical.
+    static auto srl(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) >> (x(cpu, d.rs2) & 0x3f));
+        return true;
+    }
+
+    // SRA: Shift Right Arithmetic.
+    static auto sra(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd,
+             (uint64_t)((int64_t)x(cpu, d.rs1) >> (x(cpu, d.rs2) & 0x3f)));
+        return true;
+    }
+
+    // OR: Set [rd] to [r1] | [r2].
+    static auto or_(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) | x(cpu, d.rs2));
+        return true;
+    }
+
+    // AND: Set [rd] to [r1] & [r2].
+    static auto and_(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) & x(cpu, d.rs2));
+        return true;
+    }
+
+    // ADDW: Add Wide, the 32 bit result is sign extended.
+    static auto addw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, (int64_t)(int32_t)(x(cpu, d.rs1) + x(cpu, d.rs2)));
+        return true;
+    }
+
+    // SUBW: Substract Wide, the 32 bit result is sign extended.
+    static auto subw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, (int64_t)(int32_t)(x(cpu, d.rs1) - x(cpu, d.rs2)));
+        return true;
+    }
+
+    // SLLW: Shift Left Logical Wide.
+    static auto sllw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd,
+             (int64_t)(int32_t)((uint32_t)x(cpu, d.rs1)
+                                << (x(cpu, d.rs2) & 0x1f)));
+        return true;
+    }
+
+    // SRLW: Shift Right Logical Wide.
+    static auto srlw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd,
+             (int64_t)(int32_t)((uint32_t)x(cpu, d.rs1) >>
+                                (x(cpu, d.rs2) & 0x1f)));
+        return true;
+    }
+
+    // SRAW: Shift Right Arithmetic Wide.
+    static auto sraw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd,
+             (int64_t)((int32_t)x(cpu, d.rs1) >> (x(cpu, d.rs2) & 0x1f)));
+        return true;
+    }
+
+    // Fused pairs (see Fusion), executed by the threaded engine with the
+    // program counter past the second instruction. A pair has the effect
+    // of its two instructions in order: the first one's write is kept and
+    // a trap raised by the second one leaves the first one retired.
+
+    // LUI+ADDI: 32-bit constant, both write rd.
+    static auto luiAddi(CPU& cpu, const DecodedInstruction& lui,
+                        const DecodedInstruction& addi) -> bool {
+        setX(cpu, addi.rd, (int64_t)lui.imm + (int64_t)addi.imm);
+        return true;
+    }
+
+    // LUI+ADDIW: 32-bit constant, sign extended from 32 bits.
+    static auto luiAddiw(CPU& cpu, const DecodedInstruction& lui,
+                         const DecodedInstruction& addiw) -> bool {
+        setX(cpu, addiw.rd,
+             (int64_t)(int32_t)((uint64_t)(int64_t)lui.imm +
+                                (int64_t)addiw.imm));
+        return true;
+    }
+
+    // AUIPC+JALR: far call or jump through the AUIPC result.
+    static auto auipcJalr(CPU& cpu, const DecodedInstruction& auipc,
+                          const DecodedInstruction& jalr) -> bool {
+        auto base = cpu.pc - jalr.size - auipc.size + (int64_t)auipc.imm;
+        setX(cpu, auipc.rd, base);
+        setX(cpu, jalr.rd, cpu.pc);
+        cpu.pc = (base + (int64_t)jalr.imm) & ~(uint64_t)1;
+        return true;
+    }
+
+    // AUIPC+LD: pc-relative load through the AUIPC result.
+    static auto auipcLd(CPU& cpu, const DecodedInstruction& auipc,
+                        const DecodedInstruction& ld) -> bool {
+        auto base = cpu.pc - ld.size - auipc.size + (int64_t)auipc.imm;
+        setX(cpu, auipc.rd, base);
+        int64_t value = 0;
+        if (!cpu.read<int64_t>(base + (int64_t)ld.imm, value)) [[unlikely]] {
+            return false;
+        }
+        setX(cpu, ld.rd, value);
+        return true;
+    }
+
+    // SLLI+SRLI: zero extension or bit field extraction, both write rd.
+    static auto slliSrli(CPU& cpu, const DecodedInstruction& slli,
+                         const DecodedInstruction& srli) -> bool {
+        setX(cpu, srli.rd,
+             (x(cpu, slli.rs1) << (slli.imm & 0x3f)) >> (srli.imm & 0x3f));
+        return true;
+    }
+
+    // Multiplications and divisions (RV64M), the upper halves of products
+    // come from the host 128 bit multiply. Divisions never trap: dividing
+    // by zero yields all ones and leaves the dividend as the remainder,
+    // the overflowing signed division of the most negative value by -1
+    // yields the dividend and a zero remainder.
+
+    // MUL: Set [rd] to the lower 64 bits of [r1] * [r2].
+    static auto mul(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd, x(cpu, d.rs1) * x(cpu, d.rs2));
+        return true;
+    }
+
+    // MULH: Upper 64 bits of the signed product.
+    static auto mulh(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto product =
+            (Int128)(int64_t)x(cpu, d.rs1) * (Int128)(int64_t)x(cpu, d.rs2);
+        setX(cpu, d.rd, (uint64_t)(product >> 64));
+        return true;
+    }
+
+    // MULHSU: Upper 64 bits of the product of signed [r1] and unsigned [r2].
+    static auto mulhsu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto product = (Int128)(int64_t)x(cpu, d.rs1) * (Int128)x(cpu, d.rs2);
+        setX(cpu, d.rd, (uint64_t)(product >> 64));
+        return true;
+    }
+
+    // MULHU: Upper 64 bits of the unsigned product.
+    static auto mulhu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto product = (UInt128)x(cpu, d.rs1) * (UInt128)x(cpu, d.rs2);
+        setX(cpu, d.rd, (uint64_t)(product >> 64));
+        return true;
+    }
+
+    // Signed quotient and remainder of T values, a and b are the register
+    // operands truncated to T.
+    template <typename T>
+    static auto quotient(T a, T b) -> T {
+        if (b == 0) {
+            return -1;
+        }
+        if (a == std::numeric_limits<T>::min() && b == -1) {
+            return a;
+        }
+        return a / b;
+    }
+
+    template <typename T>
+    static auto remainder(T a, T b) -> T {
+        if (b == 0) {
+            return a;
+        }
+        if (a == std::numeric_limits<T>::min() && b == -1) {
+            return 0;
+        }
+        return a % b;
+    }
+
+    // DIV: Signed division.
+    static auto div(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd,
+             (uint64_t)quotient((int64_t)x(cpu, d.rs1),
+                                (int64_t)x(cpu, d.rs2)));
+        return true;
+    }
+
+    // DIVU: Unsigned division.
+    static auto divu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto divisor = x(cpu, d.rs2);
+        setX(cpu, d.rd,
+             divisor == 0 ? ~static_cast<uint64_t>(0)
+                          : x(cpu, d.rs1) / divisor);
+        return true;
+    }
+
+    // REM: Signed remainder, it has the sign of the dividend.
+    static auto rem(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd,
+             (uint64_t)remainder((int64_t)x(cpu, d.rs1),
+                                 (int64_t)x(cpu, d.rs2)));
+        return true;
+    }
+
+    // REMU: Unsigned remainder.
+    static auto remu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto divisor = x(cpu, d.rs2);
+        setX(cpu, d.rd,
+             divisor == 0 ? x(cpu, d.rs1) : x(cpu, d.rs1) % divisor);
+        return true;
+    }
+
+    // MULW: Multiply Wide, the lower 32 bits of the product are sign
+    // extended.
+    static auto mulw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd,
+             (int64_t)(int32_t)((uint32_t)x(cpu, d.rs1) *
+                                (uint32_t)x(cpu, d.rs2)));
+        return true;
+    }
+
+    // DIVW: Signed division of the lower 32 bits.
+    static auto divw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd,
+             (int64_t)quotient((int32_t)x(cpu, d.rs1),
+                               (int32_t)x(cpu, d.rs2)));
+        return true;
+    }
+
+    // DIVUW: Unsigned division of the lower 32 bits, the 32 bit quotient
+    // is sign extended.
+    static auto divuw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto dividend = (uint32_t)x(cpu, d.rs1);
+        auto divisor  = (uint32_t)x(cpu, d.rs2);
+        setX(cpu, d.rd,
+             (int64_t)(int32_t)(divisor == 0 ? ~static_cast<uint32_t>(0)
+                                             : dividend / divisor));
+        return true;
+    }
+
+    // REMW: Signed remainder of the lower 32 bits.
+    static auto remw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        setX(cpu, d.rd,
+             (int64_t)remainder((int32_t)x(cpu, d.rs1),
+                                (int32_t)x(cpu, d.rs2)));
+        return true;
+    }
+
+    // REMUW: Unsigned remainder of the lower 32 bits, sign extended.
+    static auto remuw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto dividend = (uint32_t)x(cpu, d.rs1);
+        auto divisor  = (uint32_t)x(cpu, d.rs2);
+        setX(cpu, d.rd,
+             (int64_t)(int32_t)(divisor == 0 ? dividend : dividend % divisor));
+        return true;
+    }
+
+    // Floating point (RV64F/D), see Float.h. Registers hold the bits of
+    // their value, single precision values NaN-boxed. Every instruction is
+    // illegal while mstatus.FS is Off. Arithmetic runs on the host in round
+    // to nearest even without touching the host rounding mode, the other
+    // modes take the slower path of compute. Exception flags accrue in the
+    // host flags, the few flags the host doesn't raise as RISC-V does are
+    // added to fflags directly (see CPU::accrueFloatFlags).
+
+    /// @brief Returns true if the floating point unit is enabled.
+    static auto floatEnabled(const CPU& cpu) -> bool {
+        return (cpu.csrs.load(MStatus) & MaskFS) != 0;
+    }
+
+    /// @brief Read floating point register at index idx as a T.
+    template <typename T> static auto f(const CPU& cpu, uint8_t idx) -> T {
+        return std::bit_cast<T>(unboxed<T>(cpu.fregisters[idx]));
+    }
+
+    /// @brief Write value in floating point register at index idx.
+    template <typename T>
+    static auto setF(CPU& cpu, uint8_t idx, T value) -> void {
+        cpu.fregisters[idx] = boxed<T>(std::bit_cast<FloatBits<T>>(value));
+    }
+
+    /// @brief Rounding mode of d, the rm field or frm when it is dynamic.
+    /// @return false if the mode is reserved, the instruction is illegal.
+    static auto rounding(const CPU& cpu, const DecodedInstruction& d,
+                         Rounding& rm) -> bool {
+        rm = (Rounding)d.funct3;
+        if (rm == Rounding::Dynamic) {
+            rm = (Rounding)((cpu.csrs.stored(Fcsr) & MaskFrm) >> 5);
+        }
+        return (uint8_t)rm <= (uint8_t)Rounding::NearestMax;
+    }
+
+    // Write op() rounded following the rounding mode of d to rd, NaN
+    // results are canonical. Round to nearest even runs op as is, ties to
+    // max magnitude runs maxOp, the same operation computed by one of the
+    // NearestMax functions (see nearestMax).
+    template <typename T, typename Op, typename MaxOp>
+    static auto compute(CPU& cpu, const DecodedInstruction& d, Op op,
+                        MaxOp maxOp) -> bool {
+        auto rm = Rounding::NearestEven;
+        if (!floatEnabled(cpu) || !rounding(cpu, d, rm)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        if (rm == Rounding::NearestEven) [[likely]] {
+            setF<T>(cpu, d.rd, canonical(op()));
+            return true;
+        }
+        if (rm == Rounding::NearestMax) {
+            setF<T>(cpu, d.rd, canonical(maxOp()));
+            return true;
+        }
+        // The result is stored before the host mode is restored, so op
+        // can't be moved past the call restoring it.
+        std::fesetround(hostRounding(rm));
+        setF<T>(cpu, d.rd, canonical(op()));
+        std::fesetround(FE_TONEAREST);
+        return true;
+    }
+
+    // FLW, FLD: load a T at [rs1] + Imm into rd.
+    template <typename T>
+    static auto fload(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (!floatEnabled(cpu)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        FloatBits<T> value = 0;
+        if (!cpu.read<FloatBits<T>>(x(cpu, d.rs1) + (int64_t)d.imm, value))
+            [[unlikely]] {
+            return false;
+        }
+        cpu.fregisters[d.rd] = boxed<T>(value);
+        return true;
+    }
+
+    // FSW, FSD: store the low bits of [rs2] at [rs1] + Imm.
+    template <typename T>
+    static auto fstore(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (!floatEnabled(cpu)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        return cpu.write<FloatBits<T>>(x(cpu, d.rs1) + (int64_t)d.imm,
+                                       (FloatBits<T>)cpu.fregisters[d.rs2]);
+    }
+
+    // FMADD: rd = [rs1] * [rs2] + [rs3] with a single rounding, rs3 is held
+    // in the upper bits of funct7.
+    template <typename T>
+    static auto fmadd(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compute<T>(
+            cpu, d,
+            [&] {
+                return std::fma(f<T>(cpu, d.rs1), f<T>(cpu, d.rs2),
+                                f<T>(cpu, d.funct7 >> 2));
+            },
+            [&] {
+                return fmaNearestMax(f<T>(cpu, d.rs1), f<T>(cpu, d.rs2),
+                                     f<T>(cpu, d.funct7 >> 2));
+            });
+    }
+
+    // FMSUB: rd = [rs1] * [rs2] - [rs3].
+    template <typename T>
+    static auto fmsub(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compute<T>(
+            cpu, d,
+            [&] {
+                return std::fma(f<T>(cpu, d.rs1), f<T>(cpu, d.rs2),
+                                -f<T>(cpu, d.funct7 >> 2));
+            },
+            [&] {
+                return fmaNearestMax(f<T>(cpu, d.rs1), f<T>(cpu, d.rs2),
+                                     -f<T>(cpu, d.funct7 >> 2));
+            });
+    }
+
+    // FNMSUB: rd = -([rs1] * [rs2]) + [rs3].
+    template <typename T>
+    static auto fnmsub(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compute<T>(
+            cpu, d,
+            [&] {
+                return std::fma(-f<T>(cpu, d.rs1), f<T>(cpu, d.rs2),
+                                f<T>(cpu, d.funct7 >> 2));
+            },
+            [&] {
+                return fmaNearestMax(-f<T>(cpu, d.rs1), f<T>(cpu, d.rs2),
+                                     f<T>(cpu, d.funct7 >> 2));
+            });
+    }
+
+    // FNMADD: rd = -([rs1] * [rs2]) - [rs3].
+    template <typename T>
+    static auto fnmadd(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compute<T>(
+            cpu, d,
+            [&] {
+                return std::fma(-f<T>(cpu, d.rs1), f<T>(cpu, d.rs2),
+                                -f<T>(cpu, d.funct7 >> 2));
+            },
+            [&] {
+                return fmaNearestMax(-f<T>(cpu, d.rs1), f<T>(cpu, d.rs2),
+                                     -f<T>(cpu, d.funct7 >> 2));
+            });
+    }
+
+    // FADD: rd = [rs1] + [rs2].
+    template <typename T>
+    static auto fadd(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compute<T>(
+            cpu, d, [&] { return f<T>(cpu, d.rs1) + f<T>(cpu, d.rs2); },
+            [&] { return addNearestMax(f<T>(cpu, d.rs1), f<T>(cpu, d.rs2)); });
+    }
+
+    // FSUB: rd = [rs1] - [rs2].
+    template <typename T>
+    static auto fsub(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compute<T>(
+            cpu, d, [&] { return f<T>(cpu, d.rs1) - f<T>(cpu, d.rs2); },
+            [&] { return addNearestMax(f<T>(cpu, d.rs1), -f<T>(cpu, d.rs2)); });
+    }
+
+    // FMUL: rd = [rs1] * [rs2].
+    template <typename T>
+    static auto fmul(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compute<T>(
+            cpu, d, [&] { return f<T>(cpu, d.rs1) * f<T>(cpu, d.rs2); },
+            [&] { return mulNearestMax(f<T>(cpu, d.rs1), f<T>(cpu, d.rs2)); });
+    }
+
+    // FDIV: rd = [rs1] / [rs2].
+    template <typename T>
+    static auto fdiv(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compute<T>(
+            cpu, d, [&] { return f<T>(cpu, d.rs1) / f<T>(cpu, d.rs2); },
+            [&] { return divNearestMax(f<T>(cpu, d.rs1), f<T>(cpu, d.rs2)); });
+    }
+
+    // FSQRT: rd = sqrt([rs1]).
+    template <typename T>
+    static auto fsqrt(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compute<T>(
+            cpu, d, [&] { return std::sqrt(f<T>(cpu, d.rs1)); },
+            [&] { return sqrtNearestMax(f<T>(cpu, d.rs1)); });
+    }
+
+    // Sign injection: rd = [rs1] with the sign bit select(sign of [rs1],
+    // sign of [rs2]), the bits are moved as is and never raise a flag.
+    template <typename T, typename Select>
+    static auto inject(CPU& cpu, const DecodedInstruction& d, Select select)
+        -> bool {
+        if (!floatEnabled(cpu)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        constexpr auto sign = (FloatBits<T>)1 << (sizeof(T) * 8 - 1);
+        auto a = unboxed<T>(cpu.fregisters[d.rs1]);
+        auto b = unboxed<T>(cpu.fregisters[d.rs2]);
+        cpu.fregisters[d.rd] =
+            boxed<T>((a & ~sign) | (select(a, b) & sign)); //NOLINT
+        return true;
+    }
+
+    // FSGNJ: the sign of [rs2].
+    template <typename T>
+    static auto fsgnj(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return inject<T>(cpu, d, [](auto /*a*/, auto b) { return b; });
+    }
+
+    // FSGNJN: the opposite of the sign of [rs2].
+    template <typename T>
+    static auto fsgnjn(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return inject<T>(cpu, d, [](auto /*a*/, auto b) { return ~b; });
+    }
+
+    // FSGNJX: the sign of [rs1] xor the sign of [rs2].
+    template <typename T>
+    static auto fsgnjx(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return inject<T>(cpu, d, [](auto a, auto b) { return a ^ b; });
+    }
+
+    // FMIN, FMAX: the smaller or larger of [rs1] and [rs2], -0 is smaller
+    // than +0. A single NaN operand yields the other operand, two NaNs the
+    // canonical NaN. Signaling NaNs raise the invalid flag.
+    template <typename T>
+    static auto minMax(CPU& cpu, const DecodedInstruction& d, bool max)
+        -> bool {
+        if (!floatEnabled(cpu)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        auto a = f<T>(cpu, d.rs1);
+        auto b = f<T>(cpu, d.rs2);
+        if (std::isnan(a) || std::isnan(b)) [[unlikely]] {
+            if (isSignaling(a) || isSignaling(b)) {
+                cpu.accrueFloatFlags(FlagInvalid);
+            }
+            setF<T>(cpu, d.rd, canonical(std::isnan(a) ? b : a));
+            return true;
+        }
+        auto aFirst = a == b ? std::signbit(a) != max : std::isless(a, b) != max;
+        setF<T>(cpu, d.rd, aFirst ? a : b);
+        return true;
+    }
+
+    template <typename T>
+    static auto fmin(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return minMax<T>(cpu, d, false);
+    }
+
+    template <typename T>
+    static auto fmax(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return minMax<T>(cpu, d, true);
+    }
+
+    // FCVT.S.W, FCVT.D.L ...: convert the lower bits of [rs1] taken as an I
+    // to a T.
+    template <typename T, typename I>
+    static auto fcvtFromInt(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compute<T>(
+            cpu, d, [&] { return (T)(I)x(cpu, d.rs1); },
+            [&] { return convertNearestMax<T>((I)x(cpu, d.rs1)); });
+    }
+
+    // FCVT.S.D, FCVT.D.S: convert [rs1] from a From to a T.
+    template <typename T, typename From>
+    static auto fcvtFloat(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compute<T>(
+            cpu, d, [&] { return (T)f<From>(cpu, d.rs1); },
+            [&] { return convertNearestMax<T>(f<From>(cpu, d.rs1)); });
+    }
+
+    // FCVT.W.S, FCVT.LU.D ...: convert [rs1] to an I rounded following rm,
+    // out of range values saturate (see toInteger). 32 bit results are sign
+    // extended, unsigned ones included.
+    template <typename I, typename T>
+    static auto fcvtToInt(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto rm = Rounding::NearestEven;
+        if (!floatEnabled(cpu) || !rounding(cpu, d, rm)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        uint64_t flags = 0;
+        auto value     = toInteger<I>(f<T>(cpu, d.rs1), rm, flags);
+        if (flags != 0) {
+            cpu.accrueFloatFlags(flags);
+        }
+        setX(cpu, d.rd, (uint64_t)(int64_t)(std::make_signed_t<I>)value);
+        return true;
+    }
+
+    // FMV.X.W, FMV.X.D: move the low bits of [rs1] to rd, FMV.X.W sign
+    // extends them.
+    template <typename T>
+    static auto fmvToInt(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (!floatEnabled(cpu)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        setX(cpu, d.rd,
+             (uint64_t)(int64_t)(std::make_signed_t<FloatBits<T>>)
+                 cpu.fregisters[d.rs1]);
+        return true;
+    }
+
+    // FMV.W.X, FMV.D.X: move the low bits of [rs1] to rd.
+    template <typename T>
+    static auto fmvFromInt(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (!floatEnabled(cpu)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        cpu.fregisters[d.rd] = boxed<T>((FloatBits<T>)x(cpu, d.rs1));
+        return true;
+    }
+
+    // Comparisons write 1 to rd if [rs1] compares with [rs2], 0 otherwise
+    // and whenever an operand is a NaN. FEQ raises the invalid flag for
+    // signaling NaNs, FLT and FLE for every NaN. The host compares without
+    // raising flags.
+    template <typename T, typename Compare>
+    static auto compare(CPU& cpu, const DecodedInstruction& d, bool quiet,
+                        Compare cmp) -> bool {
+        if (!floatEnabled(cpu)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        auto a = f<T>(cpu, d.rs1);
+        auto b = f<T>(cpu, d.rs2);
+        if (std::isunordered(a, b) &&
+            (!quiet || isSignaling(a) || isSignaling(b))) [[unlikely]] {
+            cpu.accrueFloatFlags(FlagInvalid);
+        }
+        setX(cpu, d.rd, cmp(a, b) ? 1 : 0);
+        return true;
+    }
+
+    // FEQ: [rs1] == [rs2].
+    template <typename T>
+    static auto feq(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compare<T>(cpu, d, true, [](T a, T b) { return a == b; });
+    }
+
+    // FLT: [rs1] < [rs2].
+    template <typename T>
+    static auto flt(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compare<T>(cpu, d, false,
+                          [](T a, T b) { return std::isless(a, b); });
+    }
+
+    // FLE: [rs1] <= [rs2].
+    template <typename T>
+    static auto fle(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return compare<T>(cpu, d, false,
+                          [](T a, T b) { return std::islessequal(a, b); });
+    }
+
+    // FCLASS: write the class mask of [rs1] to rd.
+    template <typename T>
+    static auto fclass(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (!floatEnabled(cpu)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        setX(cpu, d.rd, classify(f<T>(cpu, d.rs1)));
+        return true;
+    }
+
+    // Vector (RVV 1.0), see Vector.h. Every instruction is illegal while
+    // mstatus.VS is Off and, but for the vsetvl instructions, while vtype
+    // is ill or a register group isn't aligned on its size. Instructions
+    // operate on the elements vstart to vl - 1 and reset vstart, a load or
+    // store faulting on an element leaves its index in vstart so the trap
+    // handler can resume the instruction. Integer operations are written
+    // once and instantiated by bySew for the unsigned integer type of SEW,
+    // floating point operations by byFloat, which rounds following frm.
+
+    /// @brief Returns true if the vector unit is enabled.
+    static auto vectorEnabled(const CPU& cpu) -> bool {
+        return (cpu.csrs.load(MStatus) & MaskVS) != 0;
+    }
+
+    /// @brief Elements of type E of the register group starting at vector
+    /// register idx.
+    template <typename E>
+    static auto group(CPU& cpu, uint8_t idx) -> Lane<E>* {
+        return reinterpret_cast<Lane<E>*>(cpu.vregisters.data() +
+                                          idx * VectorBytes);
+    }
+
+    /// @brief Returns true if element i is active in the mask register v0.
+    static auto active(const CPU& cpu, uint64_t i) -> bool {
+        return ((cpu.vregisters[i / 8] >> (i % 8)) & 1) != 0;
+    }
+
+    /// @brief Returns true if d is masked by v0, its vm bit is clear.
+    static auto masked(const DecodedInstruction& d) -> bool {
+        return (d.funct7 & 1) == 0;
+    }
+
+    /// @brief Returns true if the second operand of d is the vector
+    /// register group vs1.
+    static auto vectorOperand(const DecodedInstruction& d) -> bool {
+        return d.funct3 <= (uint8_t)VectorOperands::MVV;
+    }
+
+    /// @brief Returns true if vector register idx starts a group of
+    /// registers registers.
+    static auto aligned(uint8_t idx, uint64_t registers) -> bool {
+        return (idx & (registers - 1)) == 0;
+    }
+
+    /// @brief Decoded vtype of the hart.
+    /// @return false if the instruction is illegal, the vector unit is Off
+    /// or vtype is ill.
+    static auto vectorConfig(const CPU& cpu, VectorType& type) -> bool {
+        type = vectorType(cpu.csrs.load(VType));
+        return vectorEnabled(cpu) && !type.ill;
+    }
+
+    /// @brief Decoded vtype for the arithmetic instruction d, whose vd
+    /// (unless it is a mask), vs2 and vs1 are register groups.
+    /// @return false if the instruction is illegal.
+    static auto arithmetic(const CPU& cpu, const DecodedInstruction& d,
+                           VectorType& type, bool maskResult = false)
+        -> bool {
+        return vectorConfig(cpu, type) &&
+               (maskResult || aligned(d.rd, type.registers)) &&
+               aligned(d.rs2, type.registers) &&
+               (!vectorOperand(d) || aligned(d.rs1, type.registers));
+    }
+
+    // Call op with a zero of the unsigned integer type of sew.
+    template <typename Op> static auto bySew(uint64_t sew, Op op) -> void {
+        switch (sew) {
+        case 1:
+            op(uint8_t{});
+            break;
+        case 2:
+            op(uint16_t{});
+            break;
+        case 4:
+            op(uint32_t{});
+            break;
+        default:
+            op(uint64_t{});
+            break;
+        }
+    }
+
+    // Call op with a zero of the floating point type of the SEW of type,
+    // rounding following frm. Round to nearest runs op as is, ops check
+    // tiesToMax themselves.
+    // @return false if the instruction is illegal, the floating point unit
+    // is Off, SEW isn't 32 or 64 bits or frm is reserved.
+    template <typename Op>
+    static auto byFloat(CPU& cpu, const VectorType& type, Op op) -> bool {
+        auto rm = (Rounding)((cpu.csrs.stored(Fcsr) & MaskFrm) >> 5);
+        if (!floatEnabled(cpu) || type.sew < 4 ||
+            (uint8_t)rm > (uint8_t)Rounding::NearestMax) [[unlikely]] {
+            return false;
+        }
+        auto run = [&] {
+            if (type.sew == 4) {
+                op(float{});
+            } else {
+                op(double{});
+            }
+        };
+        if (rm == Rounding::NearestEven || rm == Rounding::NearestMax)
+            [[likely]] {
+            run();
+            return true;
+        }
+        // Results are stored before the host mode is restored, see compute.
+        std::fesetround(hostRounding(rm));
+        run();
+        std::fesetround(FE_TONEAREST);
+        return true;
+    }
+
+    /// @brief Returns true if frm is round to nearest, ties to max
+    /// magnitude: operations run by byFloat then compute their result with
+    /// one of the NearestMax functions.
+    static auto tiesToMax(const CPU& cpu) -> bool {
+        return (Rounding)((cpu.csrs.stored(Fcsr) & MaskFrm) >> 5) ==
+               Rounding::NearestMax;
+    }
+
+    // Call op with the second operand of d as a function of the element
+    // index: element i of vs1, or [rs1], the immediate or the floating
+    // point register rs1 for every element.
+    template <typename E, typename Op>
+    static auto withOperand(CPU& cpu, const DecodedInstruction& d, Op op)
+        -> void {
+        if (vectorOperand(d)) {
+            const auto* vs1 = group<E>(cpu, d.rs1);
+            op([vs1](uint64_t i) { return (E)vs1[i]; });
+        } else if constexpr (std::is_floating_point_v<E>) {
+            auto b = f<E>(cpu, d.rs1);
+            op([b](uint64_t) { return b; });
+        } else {
+            auto b = d.funct3 == (uint8_t)VectorOperands::IVI
+                         ? (E)(int64_t)d.imm
+                         : (E)x(cpu, d.rs1);
+            op([b](uint64_t) { return b; });
+        }
+    }
+
+    // Write f(i) to the active elements vstart to vl - 1 of vd. Unmasked
+    // operations compute a register of elements at a time into a local
+    // buffer, a loop of known count over operands that can't alias the
+    // results which the host vectorizes at any optimization level.
+    template <typename E, typename F>
+    static auto elementwise(CPU& cpu, const DecodedInstruction& d, F f)
+        -> void {
+        constexpr uint64_t chunk = VectorBytes / sizeof(E);
+        auto* vd   = group<E>(cpu, d.rd);
+        auto vl    = cpu.csrs.load(Vl);
+        auto start = cpu.csrs.load(VStart);
+        if (!masked(d)) [[likely]] {
+            auto i = start;
+            for (; i + chunk <= vl; i += chunk) {
+                std::array<E, chunk> results;
+                for (uint64_t k = 0; k < chunk; k++) {
+                    results[k] = f(i + k);
+                }
+                std::memcpy(&vd[i], results.data(), VectorBytes);
+            }
+            for (; i < vl; i++) {
+                vd[i] = f(i);
+            }
+        } else {
+            for (auto i = start; i < vl; i++) {
+                if (active(cpu, i)) {
+                    vd[i] = f(i);
+                }
+            }
+        }
+        cpu.csrs.store(VStart, 0);
+    }
+
+    // vd = op(vs2, operand) element-wise.
+    template <typename E, typename Op>
+    static auto binary(CPU& cpu, const DecodedInstruction& d, Op op)
+        -> void {
+        const auto* vs2 = group<E>(cpu, d.rs2);
+        withOperand<E>(cpu, d, [&](auto second) {
+            elementwise<E>(cpu, d, [&](uint64_t i) {
+                return (E)op((E)vs2[i], second(i));
+            });
+        });
+    }
+
+    // vd = op(vd, vs2, operand) element-wise.
+    template <typename E, typename Op>
+    static auto accumulate(CPU& cpu, const DecodedInstruction& d, Op op)
+        -> void {
+        const auto* acc = group<E>(cpu, d.rd);
+        const auto* vs2 = group<E>(cpu, d.rs2);
+        withOperand<E>(cpu, d, [&](auto second) {
+            elementwise<E>(cpu, d, [&](uint64_t i) {
+                return (E)op((E)acc[i], (E)vs2[i], second(i));
+            });
+        });
+    }
+
+    // vd[0] = vs1[0] op the active elements of vs2, vd is left as it is
+    // when vl is 0.
+    template <typename E, typename Op>
+    static auto reduce(CPU& cpu, const DecodedInstruction& d, Op op)
+        -> void {
+        auto vl = cpu.csrs.load(Vl);
+        if (vl == 0) {
+            return;
+        }
+        const auto* vs2 = group<E>(cpu, d.rs2);
+        auto sum        = (E)group<E>(cpu, d.rs1)[0];
+        for (uint64_t i = 0; i < vl; i++) {
+            if (!masked(d) || active(cpu, i)) {
+                sum = (E)op(sum, (E)vs2[i]);
+            }
+        }
+        group<E>(cpu, d.rd)[0] = sum;
+    }
+
+    // vd = operand where v0 is set and vs2 elsewhere, or operand for every
+    // element when d isn't masked (vmv.v).
+    template <typename E>
+    static auto merge(CPU& cpu, const DecodedInstruction& d) -> void {
+        auto* vd        = group<E>(cpu, d.rd);
+        const auto* vs2 = group<E>(cpu, d.rs2);
+        auto vl         = cpu.csrs.load(Vl);
+        auto start      = cpu.csrs.load(VStart);
+        withOperand<E>(cpu, d, [&](auto second) {
+            for (auto i = start; i < vl; i++) {
+                vd[i] = !masked(d) || active(cpu, i) ? second(i) : (E)vs2[i];
+            }
+        });
+        cpu.csrs.store(VStart, 0);
+    }
+
+    // Integer operation: vd = op(vs2, operand) on the elements of SEW.
+    template <typename Op>
+    static auto vinteger(CPU& cpu, const DecodedInstruction& d, Op op)
+        -> bool {
+        VectorType type;
+        if (!arithmetic(cpu, d, type)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        bySew(type.sew, [&](auto e) { binary<decltype(e)>(cpu, d, op); });
+        return true;
+    }
+
+    // Integer comparison: set bit i of the mask register vd to
+    // pred(vs2[i], operand) for the active elements.
+    template <typename Pred>
+    static auto vcompare(CPU& cpu, const DecodedInstruction& d, Pred pred)
+        -> bool {
+        VectorType type;
+        if (!arithmetic(cpu, d, type, true)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        // The result is built aside as vd may overlap the operands.
+        std::array<uint8_t, VectorBytes> mask{};
+        std::memcpy(mask.data(), group<uint8_t>(cpu, d.rd), VectorBytes);
+        auto vl    = cpu.csrs.load(Vl);
+        auto start = cpu.csrs.load(VStart);
+        bySew(type.sew, [&](auto e) {
+            using E         = decltype(e);
+            const auto* vs2 = group<E>(cpu, d.rs2);
+            withOperand<E>(cpu, d, [&](auto second) {
+                for (auto i = start; i < vl; i++) {
+                    if (masked(d) && !active(cpu, i)) {
+                        continue;
+                    }
+                    auto bit    = (uint8_t)(1 << (i % 8));
+                    mask[i / 8] = pred((E)vs2[i], second(i))
+                                      ? (uint8_t)(mask[i / 8] | bit)
+                                      : (uint8_t)(mask[i / 8] & ~bit);
+                }
+            });
+        });
+        std::memcpy(group<uint8_t>(cpu, d.rd), mask.data(), VectorBytes);
+        cpu.csrs.store(VStart, 0);
+        return true;
+    }
+
+    // Floating point operation: vd = op(vs2, operand) on the elements of
+    // SEW.
+    template <typename Op>
+    static auto vfloat(CPU& cpu, const DecodedInstruction& d, Op op)
+        -> bool {
+        VectorType type;
+        if (!arithmetic(cpu, d, type) ||
+            !byFloat(cpu, type,
+                     [&](auto e) { binary<decltype(e)>(cpu, d, op); }))
+            [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        return true;
+    }
+
+    // Set vtype to vtype and vl to the application vector length avl
+    // capped at VLMAX, or keep vl when keep is set. An unsupported vtype
+    // sets vill and clears vl. rd is written the new vl.
+    static auto configure(CPU& cpu, const DecodedInstruction& d,
+                          uint64_t vtype, uint64_t avl, bool keep) -> bool {
+        if (!vectorEnabled(cpu)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        auto type = vectorType(vtype);
+        if (type.ill) {
+            cpu.csrs.store(VType, MaskVIll);
+            cpu.csrs.store(Vl, 0);
+        } else {
+            cpu.csrs.store(VType, vtype);
+            cpu.csrs.store(Vl,
+                           std::min(keep ? cpu.csrs.load(Vl) : avl, type.vlmax));
+        }
+        cpu.csrs.store(VStart, 0);
+        setX(cpu, d.rd, cpu.csrs.load(Vl));
+        return true;
+    }
+
+    // VSETVLI: configure vtype from the immediate, the application vector
+    // length is [rs1], VLMAX when rs1 is x0 and rd isn't, vl is kept when
+    // both are x0.
+    static auto vsetvli(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return configure(cpu, d, (uint64_t)d.imm,
+                         d.rs1 != 0 ? x(cpu, d.rs1) : ~(uint64_t)0,
+                         d.rs1 == 0 && d.rd == 0);
+    }
+
+    // VSETIVLI: configure vtype from the immediate, the application vector
+    // length is the rs1 field.
+    static auto vsetivli(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return configure(cpu, d, (uint64_t)d.imm, d.rs1, false);
+    }
+
+    // VSETVL: as VSETVLI with vtype in [rs2].
+    static auto vsetvl(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return configure(cpu, d, x(cpu, d.rs2),
+                         d.rs1 != 0 ? x(cpu, d.rs1) : ~(uint64_t)0,
+                         d.rs1 == 0 && d.rd == 0);
+    }
+
+    // VMV.X.S: rd = vs2[0] sign extended.
+    static auto vmvXS(CPU& cpu, const DecodedInstruction& d) -> bool {
+        VectorType type;
+        if (!vectorConfig(cpu, type)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        bySew(type.sew, [&](auto e) {
+            using S = std::make_signed_t<decltype(e)>;
+            setX(cpu, d.rd,
+                 (int64_t)(S)group<decltype(e)>(cpu, d.rs2)[0]);
+        });
+        cpu.csrs.store(VStart, 0);
+        return true;
+    }
+
+    // VFMV.F.S: rd = vs2[0], single precision values are NaN-boxed.
+    static auto vfmvFS(CPU& cpu, const DecodedInstruction& d) -> bool {
+        VectorType type;
+        if (!vectorConfig(cpu, type) ||
+            !byFloat(cpu, type, [&](auto e) {
+                using T = decltype(e);
+                cpu.fregisters[d.rd] =
+                    boxed<T>(group<FloatBits<T>>(cpu, d.rs2)[0]);
+            })) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        cpu.csrs.store(VStart, 0);
+        return true;
+    }
+
+    // Element width of a vector load or store in bytes, from its width
+    // field (see isVectorWidth).
+    static auto memoryWidth(const DecodedInstruction& d) -> uint64_t {
+        return d.funct3 == 0 ? 1 : (uint64_t)1 << (d.funct3 - 4);
+    }
+
+    // Host address of the guest bytes [addr, addr + size) when they lie in
+    // a single page cached for the access, nullptr otherwise.
+    static auto hostRange(CPU& cpu, VirtualAddress addr, uint64_t size,
+                          bool store) -> uint8_t* {
+        if (((addr ^ (addr + size - 1)) >> PageShift) != 0) {
+            return nullptr;
+        }
+        const auto* page = store ? cpu.storePages.lookup<uint8_t>(addr)
+                                 : cpu.loadPages.lookup<uint8_t>(addr);
+        if (page == nullptr ||
+            (store && std::atomic_ref(*page->code).load() != 0)) {
+            return nullptr;
+        }
+        return page->host + (addr & (PageSize - 1));
+    }
+
+    // Load or store the active elements of the group of rd at [rs1] + i *
+    // stride. Unmasked unit-stride accesses within a cached page are a
+    // single host copy, the others go element by element.
+    template <typename E, bool Store>
+    static auto transfer(CPU& cpu, const DecodedInstruction& d,
+                         uint64_t stride) -> bool {
+        auto* vd   = group<E>(cpu, d.rd);
+        auto base  = x(cpu, d.rs1);
+        auto vl    = cpu.csrs.load(Vl);
+        auto start = cpu.csrs.load(VStart);
+        if (stride == sizeof(E) && start == 0 && !masked(d) && vl != 0) {
+            auto* host = hostRange(cpu, base, vl * sizeof(E), Store);
+            if (host != nullptr) [[likely]] {
+                if constexpr (Store) {
+                    std::memcpy(host, vd, vl * sizeof(E));
+                } else {
+                    std::memcpy(vd, host, vl * sizeof(E));
+                }
+                return true;
+            }
+        }
+        for (auto i = start; i < vl; i++) {
+            if (masked(d) && !active(cpu, i)) {
+                continue;
+            }
+            auto addr = base + i * stride;
+            auto done = false;
+            if constexpr (Store) {
+                done = cpu.write<E>(addr, (E)vd[i]);
+            } else {
+                E value = 0;
+                done    = cpu.read<E>(addr, value);
+                if (done) {
+                    vd[i] = value;
+                }
+            }
+            if (!done) [[unlikely]] {
+                cpu.csrs.store(VStart, i);
+                return false;
+            }
+        }
+        cpu.csrs.store(VStart, 0);
+        return true;
+    }
+
+    // VLE, VLSE, VSE, VSSE: load or store the register group of rd, the
+    // stride is [rs2] for the strided forms and the element width EEW
+    // otherwise. EEW scales the group of LMUL registers to EMUL = EEW /
+    // SEW * LMUL registers.
+    template <bool Store>
+    static auto vmemory(CPU& cpu, const DecodedInstruction& d, bool strided)
+        -> bool {
+        VectorType type;
+        auto eew = memoryWidth(d);
+        if (!vectorConfig(cpu, type) || type.lmul * eew < type.sew ||
+            type.lmul * eew > 64 * type.sew) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        auto emul = type.lmul * eew / type.sew;
+        if (!aligned(d.rd, emul < 8 ? 1 : emul / 8)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        auto stride = strided ? x(cpu, d.rs2) : eew;
+        switch (eew) {
+        case 1:
+            return transfer<uint8_t, Store>(cpu, d, stride);
+        case 2:
+            return transfer<uint16_t, Store>(cpu, d, stride);
+        case 4:
+            return transfer<uint32_t, Store>(cpu, d, stride);
+        default:
+            return transfer<uint64_t, Store>(cpu, d, stride);
+        }
+    }
+
+    // VLE: unit-stride load.
+    static auto vle(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vmemory<false>(cpu, d, false);
+    }
+
+    // VLSE: strided load.
+    static auto vlse(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vmemory<false>(cpu, d, true);
+    }
+
+    // VSE: unit-stride store.
+    static auto vse(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vmemory<true>(cpu, d, false);
+    }
+
+    // VSSE: strided store.
+    static auto vsse(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vmemory<true>(cpu, d, true);
+    }
+
+    // VADD: vd = vs2 + operand.
+    static auto vadd(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) { return a + b; });
+    }
+
+    // VSUB: vd = vs2 - operand.
+    static auto vsub(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) { return a - b; });
+    }
+
+    // VRSUB: vd = operand - vs2.
+    static auto vrsub(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) { return b - a; });
+    }
+
+    // VMINU: vd = min(vs2, operand), unsigned.
+    static auto vminu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) { return std::min(a, b); });
+    }
+
+    // VMIN: vd = min(vs2, operand), signed.
+    static auto vmin(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) {
+            using S = std::make_signed_t<decltype(a)>;
+            return (S)a < (S)b ? a : b;
+        });
+    }
+
+    // VMAXU: vd = max(vs2, operand), unsigned.
+    static auto vmaxu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) { return std::max(a, b); });
+    }
+
+    // VMAX: vd = max(vs2, operand), signed.
+    static auto vmax(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) {
+            using S = std::make_signed_t<decltype(a)>;
+            return (S)a < (S)b ? b : a;
+        });
+    }
+
+    // VAND: vd = vs2 & operand.
+    static auto vand(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) { return a & b; });
+    }
+
+    // VOR: vd = vs2 | operand.
+    static auto vor(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) { return a | b; });
+    }
+
+    // VXOR: vd = vs2 ^ operand.
+    static auto vxor(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) { return a ^ b; });
+    }
+
+    // VSLL: vd = vs2 << operand, the shift amount is taken modulo SEW.
+    static auto vsll(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) {
+            return a << (b & (sizeof(a) * 8 - 1));
+        });
+    }
+
+    // VSRL: vd = vs2 >> operand, logical.
+    static auto vsrl(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) {
+            return a >> (b & (sizeof(a) * 8 - 1));
+        });
+    }
+
+    // VSRA: vd = vs2 >> operand, arithmetic.
+    static auto vsra(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) {
+            using S = std::make_signed_t<decltype(a)>;
+            return (S)a >> (b & (sizeof(a) * 8 - 1));
+        });
+    }
+
+    // VMSEQ: vd.mask = vs2 == operand.
+    static auto vmseq(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vcompare(cpu, d, [](auto a, auto b) { return a == b; });
+    }
+
+    // VMSNE: vd.mask = vs2 != operand.
+    static auto vmsne(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vcompare(cpu, d, [](auto a, auto b) { return a != b; });
+    }
+
+    // VMSLTU: vd.mask = vs2 < operand, unsigned.
+    static auto vmsltu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vcompare(cpu, d, [](auto a, auto b) { return a < b; });
+    }
+
+    // VMSLT: vd.mask = vs2 < operand, signed.
+    static auto vmslt(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vcompare(cpu, d, [](auto a, auto b) {
+            using S = std::make_signed_t<decltype(a)>;
+            return (S)a < (S)b;
+        });
+    }
+
+    // VMSLEU: vd.mask = vs2 <= operand, unsigned.
+    static auto vmsleu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vcompare(cpu, d, [](auto a, auto b) { return a <= b; });
+    }
+
+    // VMSLE: vd.mask = vs2 <= operand, signed.
+    static auto vmsle(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vcompare(cpu, d, [](auto a, auto b) {
+            using S = std::make_signed_t<decltype(a)>;
+            return (S)a <= (S)b;
+        });
+    }
+
+    // VMSGTU: vd.mask = vs2 > operand, unsigned.
+    static auto vmsgtu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vcompare(cpu, d, [](auto a, auto b) { return a > b; });
+    }
+
+    // VMSGT: vd.mask = vs2 > operand, signed.
+    static auto vmsgt(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vcompare(cpu, d, [](auto a, auto b) {
+            using S = std::make_signed_t<decltype(a)>;
+            return (S)a > (S)b;
+        });
+    }
+
+    // VMERGE, VMV.V: see merge.
+    static auto vmerge(CPU& cpu, const DecodedInstruction& d) -> bool {
+        VectorType type;
+        if (!arithmetic(cpu, d, type)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        bySew(type.sew, [&](auto e) { merge<decltype(e)>(cpu, d); });
+        return true;
+    }
+
+    // VMUL: vd = vs2 * operand, low bits of the product.
+    static auto vmul(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vinteger(cpu, d, [](auto a, auto b) {
+            return (decltype(a))((uint64_t)a * b);
+        });
+    }
+
+    // VMACC: vd = vd + operand * vs2.
+    static auto vmacc(CPU& cpu, const DecodedInstruction& d) -> bool {
+        VectorType type;
+        if (!arithmetic(cpu, d, type)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        bySew(type.sew, [&](auto e) {
+            accumulate<decltype(e)>(cpu, d, [](auto acc, auto a, auto b) {
+                return acc + (uint64_t)a * b;
+            });
+        });
+        return true;
+    }
+
+    // VREDSUM: vd[0] = vs1[0] + the sum of the active elements of vs2.
+    static auto vredsum(CPU& cpu, const DecodedInstruction& d) -> bool {
+        VectorType type;
+        if (!vectorConfig(cpu, type) || !aligned(d.rs2, type.registers) ||
+            cpu.csrs.load(VStart) != 0) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        bySew(type.sew, [&](auto e) {
+            reduce<decltype(e)>(cpu, d, [](auto a, auto b) { return a + b; });
+        });
+        return true;
+    }
+
+    // VMV.S.X: vd[0] = [rs1], unless vstart >= vl.
+    static auto vmvSX(CPU& cpu, const DecodedInstruction& d) -> bool {
+        VectorType type;
+        if (!vectorConfig(cpu, type)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        if (cpu.csrs.load(VStart) < cpu.csrs.load(Vl)) {
+            bySew(type.sew, [&](auto e) {
+                using E                = decltype(e);
+                group<E>(cpu, d.rd)[0] = (E)x(cpu, d.rs1);
+            });
+        }
+        cpu.csrs.store(VStart, 0);
+        return true;
+    }
+
+    // VFADD: vd = vs2 + operand.
+    static auto vfadd(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vfloat(cpu, d, [max = tiesToMax(cpu)](auto a, auto b) {
+            return canonical(max ? addNearestMax(a, b) : a + b);
+        });
+    }
+
+    // VFSUB: vd = vs2 - operand.
+    static auto vfsub(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vfloat(cpu, d, [max = tiesToMax(cpu)](auto a, auto b) {
+            return canonical(max ? addNearestMax(a, -b) : a - b);
+        });
+    }
+
+    // VFMUL: vd = vs2 * operand.
+    static auto vfmul(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vfloat(cpu, d, [max = tiesToMax(cpu)](auto a, auto b) {
+            return canonical(max ? mulNearestMax(a, b) : a * b);
+        });
+    }
+
+    // VFDIV: vd = vs2 / operand.
+    static auto vfdiv(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return vfloat(cpu, d, [max = tiesToMax(cpu)](auto a, auto b) {
+            return canonical(max ? divNearestMax(a, b) : a / b);
+        });
+    }
+
+    // VFMACC: vd = operand * vs2 + vd with a single rounding.
+    static auto vfmacc(CPU& cpu, const DecodedInstruction& d) -> bool {
+        VectorType type;
+        if (!arithmetic(cpu, d, type) ||
+            !byFloat(cpu, type, [&](auto e) {
+                accumulate<decltype(e)>(
+                    cpu, d, [max = tiesToMax(cpu)](auto acc, auto a, auto b) {
+                        return canonical(max ? fmaNearestMax(b, a, acc)
+                                             : std::fma(b, a, acc));
+                    });
+            })) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        return true;
+    }
+
+    // VFREDUSUM: vd[0] = vs1[0] + the sum of the active elements of vs2,
+    // the unordered sum is computed in element order.
+    static auto vfredusum(CPU& cpu, const DecodedInstruction& d) -> bool {
+        VectorType type;
+        if (!vectorConfig(cpu, type) || !aligned(d.rs2, type.registers) ||
+            cpu.csrs.load(VStart) != 0 ||
+            !byFloat(cpu, type, [&](auto e) {
+                reduce<decltype(e)>(
+                    cpu, d, [max = tiesToMax(cpu)](auto a, auto b) {
+                        return canonical(max ? addNearestMax(a, b) : a + b);
+                    });
+            })) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        return true;
+    }
+
+    // VFMERGE, VFMV.V.F: see merge.
+    static auto vfmerge(CPU& cpu, const DecodedInstruction& d) -> bool {
+        VectorType type;
+        if (!arithmetic(cpu, d, type) ||
+            !byFloat(cpu, type, [&](auto e) { merge<decltype(e)>(cpu, d); }))
+            [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        return true;
+    }
+
+    // VFMV.S.F: vd[0] = rs1, unless vstart >= vl.
+    static auto vfmvSF(CPU& cpu, const DecodedInstruction& d) -> bool {
+        VectorType type;
+        if (!vectorConfig(cpu, type) ||
+            !byFloat(cpu, type, [&](auto e) {
+                using T = decltype(e);
+                if (cpu.csrs.load(VStart) < cpu.csrs.load(Vl)) {
+                    group<FloatBits<T>>(cpu, d.rd)[0] =
+                        unboxed<T>(cpu.fregisters[d.rs1]);
+                }
+            })) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        cpu.csrs.store(VStart, 0);
+        return true;
+    }
+
+    // Only implemented CSRs are accessible, from the privilege encoded in
+    // bits 9-8 of their address and above, CSRs with bits 11-10 set are
+    // read-only. Below machine mode the unprivileged counters must also be
+    // enabled in mcounteren, and in user mode in scounteren. The floating
+    // point and vector CSRs require mstatus.FS and mstatus.VS not to be Off,
+    // mstatus.TVM traps satp accesses in supervisor mode.
+    static auto csrAccessible(CPU& cpu, const DecodedInstruction& d,
+                              bool write) -> bool {
+        auto addr = (uint64_t)d.imm;
+        auto csr  = CSR::entry(addr);
+        auto kind = csr.kind;
+        if (kind == CSRKind::Unimplemented ||
+            ((addr >> 8) & 0b11) > (uint64_t)cpu.privilege ||
+            (write && (addr >> 10) == 0b11) ||
+            (csr.fp && !floatEnabled(cpu)) ||
+            (csr.vector && !vectorEnabled(cpu)) ||
+            (addr == Satp && cpu.privilege == Privilege::Supervisor &&
+             (cpu.csrs.load(MStatus) & MaskTVM) != 0)) {
+            return false;
+        }
+        if ((kind == CSRKind::Counter || kind == CSRKind::HpmCounter) &&
+            addr >= Cycle && cpu.privilege != Privilege::Machine) {
+            auto bit = (uint64_t)1 << (addr - Cycle);
+            return (cpu.csrs.load(MCounteren) & bit) != 0 &&
+                   (cpu.privilege != Privilege::User ||
+                    (cpu.csrs.load(SCounteren) & bit) != 0);
+        }
+        return true;
+    }
+
+    // Read a CSR, counters are computed on read, the interrupts pending
+    // in mip refreshed from the CLINT and the exception flags accrued on
+    // the host folded into fflags.
+    static auto readCSR(CPU& cpu, uint64_t addr) -> uint64_t {
+        auto csr  = CSR::entry(addr);
+        auto kind = csr.kind;
+        if (kind == CSRKind::Counter || kind == CSRKind::HpmCounter) {
+            return cpu.readCounter(addr);
+        }
+        if (csr.fp) {
+            cpu.syncFloatFlags();
+        }
+        if (addr == MIp || kind == CSRKind::Sip) {
+            cpu.updatePending();
+        }
+        return cpu.csrs.load(addr);
+    }
+
+    // Write a CSR, only machine mode counters are writable (the others are
+    // read-only) and writes to the registers address translation depends
+    // on update it. satp only accepts the modes implemented and flushes
+    // the TLBs. Writes that may unmask an interrupt have it checked before
+    // the next block. mstatus.FS and mstatus.VS are never Initial nor
+    // Clean, an enabled floating point or vector unit is always reported
+    // Dirty so writes to its registers don't need to update mstatus. Bit 0
+    // of mepc and sepc is always clear, instructions are 16 bit aligned.
+    static auto writeCSR(CPU& cpu, uint64_t addr, uint64_t value) -> void {
+        auto csr = CSR::entry(addr);
+        if (csr.kind == CSRKind::Counter || csr.kind == CSRKind::HpmCounter) {
+            cpu.writeCounter(addr, value);
+            return;
+        }
+        if (csr.interrupts) {
+            cpu.pollAt = 0;
+        }
+        if (addr == MCountInhibit) {
+            cpu.writeCountInhibit(value);
+            return;
+        }
+        if (addr == VStart) {
+            value &= MaskVStart;
+        }
+        if (addr == MEPc || addr == Sepc) {
+            value &= ~(uint64_t)1; //NOLINT
+        }
+        if (!csr.paging) {
+            cpu.csrs.store(addr, value);
+            return;
+        }
+        if (addr == MStatus || addr == SStatus) {
+            value |= ((value & MaskFS) != 0 ? MaskFS : 0) |
+                     ((value & MaskVS) != 0 ? MaskVS : 0);
+            value = (value & (MaskFS | MaskVS)) != 0 ? value | MaskSD
+                                                     : value & ~MaskSD; //NOLINT
+        }
+        if (addr == Satp) {
+            auto mode = value >> 60;
+            if (mode != SatpModeBare && mode != SatpModeSv39) {
+                return;
+            }
+            cpu.flushTlb();
+        }
+        cpu.csrs.store(addr, value);
+        cpu.updatePaging();
+    }
+
+    // CSRRW: atomically swap [csr] and [rs1].
+    static auto csrrw(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (!csrAccessible(cpu, d, true)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        auto t = readCSR(cpu, d.imm);
+        writeCSR(cpu, d.imm, x(cpu, d.rs1));
+        setX(cpu, d.rd, t);
+        return true;
+    }
+
+    // CSRRS: set the bits of [rs1] in [csr].
+    static auto csrrs(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (!csrAccessible(cpu, d, d.rs1 != 0)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        auto t = readCSR(cpu, d.imm);
+        if (d.rs1 != 0) {
+            writeCSR(cpu, d.imm, t | x(cpu, d.rs1));
+        }
+        setX(cpu, d.rd, t);
+        return true;
+    }
+
+    // CSRRC: clear the bits of [rs1] in [csr].
+    static auto csrrc(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (!csrAccessible(cpu, d, d.rs1 != 0)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        auto t = readCSR(cpu, d.imm);
+        if (d.rs1 != 0) {
+            writeCSR(cpu, d.imm, t & (~x(cpu, d.rs1))); //NOLINT
+        }
+        setX(cpu, d.rd, t);
+        return true;
+    }
+
+    // CSRRWI: write the zero extended immediate (zimm) to [csr].
+    static auto csrrwi(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (!csrAccessible(cpu, d, true)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        auto t = readCSR(cpu, d.imm);
+        writeCSR(cpu, d.imm, d.rs1);
+        setX(cpu, d.rd, t);
+        return true;
+    }
+
+    // CSRRSI: set the bits of zimm in [csr].
+    static auto csrrsi(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (!csrAccessible(cpu, d, d.rs1 != 0)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        auto t = readCSR(cpu, d.imm);
+        if (d.rs1 != 0) {
+            writeCSR(cpu, d.imm, t | d.rs1);
+        }
+        setX(cpu, d.rd, t);
+        return true;
+    }
+
+    // CSRRCI: clear the bits of zimm in [csr].
+    static auto csrrci(CPU& cpu, const DecodedInstruction& d) -> bool {
+        if (!csrAccessible(cpu, d, d.rs1 != 0)) [[unlikely]] {
+            return illegal(cpu, d);
+        }
+        auto t = readCSR(cpu, d.imm);
+        if (d.rs1 != 0) {
+            writeCSR(cpu, d.imm, t & (~(uint64_t)d.rs1)); //NOLINT
+        }
+        setX(cpu, d.rd, t);
+        return true;
+    }
+
+    // FENCE, FENCE.I: order memory accesses. Decoded code is kept coherent
+    // with stores by the caches so FENCE.I has nothing else to do.
+    static auto fence(CPU& /*cpu*/, const DecodedInstruction& /*d*/)
+        -> bool {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return true;
+    }
+
+    // Atomics: operate on the naturally aligned value of type T at [rs1],
+    // values loaded into rd are sign extended.
+    template <typename T> static auto signExtend(T value) -> uint64_t {
+        return (uint64_t)(int64_t)(std::make_signed_t<T>)value;
+    }
+
+    // Return the host address of the T at addr for an atomic access, or
+    // nullptr once the misaligned address, page or access fault is raised.
+    // LR raises load faults, SC and the AMOs store faults.
+    template <typename T>
+    static auto atomicAt(CPU& cpu, uint64_t addr, bool write) -> T* {
+        if ((addr & (sizeof(T) - 1)) != 0) [[unlikely]] {
+            cpu.raise(write ? TrapCause::StoreAddressMisaligned
+                            : TrapCause::LoadAddressMisaligned,
+                      addr);
+            return nullptr;
+        }
+        return cpu.hostAddress<T>(addr, write ? Access::Store : Access::Load);
+    }
+
+    // LR: load [rs1] into rd and reserve the address.
+    template <typename T>
+    static auto lr(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto addr = x(cpu, d.rs1);
+        auto* ptr = atomicAt<T>(cpu, addr, false);
+        if (ptr == nullptr) [[unlikely]] {
+            return false;
+        }
+        auto value      = std::atomic_ref<T>(*ptr).load();
+        cpu.reservation = {.addr = addr, .value = value, .valid = true};
+        setX(cpu, d.rd, signExtend(value));
+        return true;
+    }
+
+    // SC: store [rs2] at [rs1] if the hart holds a reservation on the
+    // address and the value loaded by LR is still there, rd is set to 0 on
+    // success and 1 on failure. The reservation is released either way.
+    // Comparing values instead of tracking writes keeps reservations local
+    // to the hart, the ABA case is indistinguishable to the guest from a
+    // reservation that was never lost.
+    template <typename T>
+    static auto sc(CPU& cpu, const DecodedInstruction& d) -> bool {
+        auto addr     = x(cpu, d.rs1);
+        auto src      = (T)x(cpu, d.rs2);
+        auto* ptr     = atomicAt<T>(cpu, addr, true);
+        if (ptr == nullptr) [[unlikely]] {
+            return false;
+        }
+        auto ref      = std::atomic_ref<T>(*ptr);
+        auto reserved = std::exchange(cpu.reservation.valid, false) &&
+                        cpu.reservation.addr == addr;
+        auto expected = (T)cpu.reservation.value;
+        auto success  = reserved && ref.compare_exchange_strong(expected, src);
+        setX(cpu, d.rd, success ? 0 : 1);
+        return true;
+    }
+
+    // AMOs: atomically replace [rs1] with op([rs1], [rs2]) and load the
+    // previous value into rd.
+    template <typename T, typename Op>
+    static auto amo(CPU& cpu, const DecodedInstruction& d, Op op) -> bool {
+        auto src  = (T)x(cpu, d.rs2);
+        auto* ptr = atomicAt<T>(cpu, x(cpu, d.rs1), true);
+        if (ptr == nullptr) [[unlikely]] {
+            return false;
+        }
+        auto old = op(std::atomic_ref<T>(*ptr), src);
+        setX(cpu, d.rd, signExtend(old));
+        return true;
+    }
+
+    // Read-modify-write the host has no single instruction for.
+    template <typename T, typename Pick>
+    static auto update(std::atomic_ref<T> ref, T src, Pick pick) -> T {
+        auto old = ref.load();
+        while (!ref.compare_exchange_weak(old, pick(old, src))) {
+        }
+        return old;
+    }
+
+    template <typename T>
+    static auto amoswap(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return amo<T>(cpu, d, [](std::atomic_ref<T> ref, T v) {
+            return ref.exchange(v);
+        });
+    }
+
+    template <typename T>
+    static auto amoadd(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return amo<T>(cpu, d, [](std::atomic_ref<T> ref, T v) {
+            return ref.fetch_add(v);
+        });
+    }
+
+    template <typename T>
+    static auto amoxor(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return amo<T>(cpu, d, [](std::atomic_ref<T> ref, T v) {
+            return ref.fetch_xor(v);
+        });
+    }
+
+    template <typename T>
+    static auto amoand(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return amo<T>(cpu, d, [](std::atomic_ref<T> ref, T v) {
+            return ref.fetch_and(v);
+        });
+    }
+
+    template <typename T>
+    static auto amoor(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return amo<T>(cpu, d, [](std::atomic_ref<T> ref, T v) {
+            return ref.fetch_or(v);
+        });
+    }
+
+    // AMOMIN, AMOMAX: signed comparison.
+    template <typename T>
+    static auto amomin(CPU& cpu, const DecodedInstruction& d) -> bool {
+        using S = std::make_signed_t<T>;
+        return amo<T>(cpu, d, [](std::atomic_ref<T> ref, T v) {
+            return update(ref, v, [](T a, T b) { return (S)a < (S)b ? a : b; });
+        });
+    }
+
+    template <typename T>
+    static auto amomax(CPU& cpu, const DecodedInstruction& d) -> bool {
+        using S = std::make_signed_t<T>;
+        return amo<T>(cpu, d, [](std::atomic_ref<T> ref, T v) {
+            return update(ref, v, [](T a, T b) { return (S)a > (S)b ? a : b; });
+        });
+    }
+
+    // AMOMINU, AMOMAXU: unsigned comparison.
+    template <typename T>
+    static auto amominu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return amo<T>(cpu, d, [](std::atomic_ref<T> ref, T v) {
+            return update(ref, v, [](T a, T b) { return a < b ? a : b; });
+        });
+    }
+
+    template <typename T>
+    static auto amomaxu(CPU& cpu, const DecodedInstruction& d) -> bool {
+        return amo<T>(cpu, d, [](std::atomic_ref<T> ref, T v) {
+            return update(ref, v, [](T a, T b) { return a > b ? a : b; });
+        });
+    }
+};
+
+} // namespace riscvemu
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "Machine.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace riscvemu {
+
+/// @brief Snapshot is an immutable copy of the memory of a loaded context,
+/// new contexts are cloned from it copy-on-write.
+/// The loaded image (see VMContext::imageSize) is copied once to a host
+/// memory file, a clone maps the file privately over a fresh memory
+/// reservation so cloning costs a single mapping whatever the image size
+/// and a run only copies the pages it writes to.
+class Snapshot {
+    public:
+    /// @brief Capture the memory of ctx.
+    /// @param ctx
+    explicit Snapshot(const VMContext& ctx);
+    ~Snapshot();
+
+    Snapshot(const Snapshot&)                    = delete;
+    auto operator=(const Snapshot&) -> Snapshot& = delete;
+    Snapshot(Snapshot&& other) noexcept;
+    auto operator=(Snapshot&& other) noexcept -> Snapshot&;
+
+    /// @brief Create a context in the state the snapshot was taken in.
+    /// @return VMContext
+    [[nodiscard]] auto clone() const -> VMContext;
+
+    private:
+    /// @brief Host memory file holding the image pages, -1 if empty.
+    int fd = -1;
+    /// @brief Bytes of the file mapped by clones, a multiple of the host
+    /// page size.
+    size_t bytes = 0;
+    /// @brief Context attributes restored by clones.
+    uint64_t memorySize = 0;
+    uint64_t codeSize   = 0;
+    uint64_t entry      = 0;
+    uint64_t imageSize  = 0;
+};
+
+} // namespace riscvemu
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef SYSCALLS_H
+#define SYSCALLS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace riscvemu {
+
+class CPU;
+struct VMContext;
+
+/// @brief Linux system call numbers served by SyscallProxy, the RISC-V
+/// Linux ABI uses the asm-generic numbering.
+enum class Syscall : uint64_t {
+    Openat       = 56,
+    Close        = 57,
+    Lseek        = 62,
+    Read         = 63,
+    Write        = 64,
+    Writev       = 66,
+    Exit         = 93,
+    ExitGroup    = 94,
+    ClockGettime = 113,
+    Brk          = 214,
+    Munmap       = 215,
+    Mmap         = 222,
+};
+
+/// @brief Stack reserved at the top of guest memory for programs started by
+/// SyscallProxy, mappings are placed right below it.
+static constexpr uint64_t UserStackSize = static_cast<uint64_t>(8) << 20;
+
+/// @brief SyscallProxy emulates the Linux user-mode environment of
+/// statically linked programs: ECALL serves the system call numbered a7
+/// with arguments a0 to a5 on the host and returns its result, or a
+/// negated errno, in a0 instead of raising a trap.
+///
+/// Guest buffers are handed to the host system calls in place, guest
+/// memory is contiguous in the host so a buffer within memory is a single
+/// host pointer. Programs run untranslated, buffers accessed while paging
+/// is enabled fail with EFAULT.
+///
+/// Guest file descriptors are indices in a table of host descriptors, 0, 1
+/// and 2 are the host standard streams. The heap grows with brk from the
+/// end of the program and anonymous mappings are carved out of the memory
+/// below the stack, never to be reused. exit and exit_group stop the hart
+/// calling them, the program counter is left outside of memory.
+/// The proxy is shared by the harts of a context.
+class SyscallProxy {
+    public:
+    /// @brief SyscallProxy constructor, the heap starts past the program
+    /// loaded in ctx (see VMContext::dataSize).
+    /// @param ctx
+    explicit SyscallProxy(const VMContext& ctx);
+
+    /// @brief Close the files the program left open.
+    ~SyscallProxy();
+
+    SyscallProxy(const SyscallProxy&)                    = delete;
+    auto operator=(const SyscallProxy&) -> SyscallProxy& = delete;
+
+    /// @brief Lay out the initial process stack of cpu as the Linux ELF
+    /// loader does: argc, the argv and envp arrays and the auxiliary vector
+    /// from the stack pointer up, followed by the strings.
+    /// @param cpu
+    /// @param args
+    /// @param env
+    auto start(CPU& cpu, const std::vector<std::string>& args,
+               const std::vector<std::string>& env) -> void;
+
+    /// @brief Serve the system call requested by the ECALL cpu executes.
+    /// @param cpu
+    /// @return true, system calls never trap.
+    auto handle(CPU& cpu) -> bool;
+
+    /// @brief Status the program passed to exit, 0 until it exits.
+    [[nodiscard]] auto exitStatus() const -> int { return this->status; }
+
+    private:
+    /// @brief Host descriptor of the guest descriptor fd, -1 if it isn't
+    /// open.
+    auto hostFd(uint64_t fd) -> int;
+
+    /// @brief Host address of the guest buffer of bytes bytes at addr,
+    /// nullptr if it isn't within memory.
+    static auto buffer(CPU& cpu, uint64_t addr, uint64_t bytes, bool write)
+        -> uint8_t*;
+
+    auto openat(CPU& cpu, int dirfd, uint64_t path, uint64_t flags,
+                uint64_t mode) -> int64_t;
+    auto close(uint64_t fd) -> int64_t;
+    auto writev(CPU& cpu, uint64_t fd, uint64_t iov, uint64_t count)
+        -> int64_t;
+    auto clockGettime(CPU& cpu, uint64_t clock, uint64_t addr) -> int64_t;
+    auto brk(CPU& cpu, uint64_t addr) -> int64_t;
+    auto mmap(CPU& cpu, uint64_t addr, uint64_t length, uint64_t flags,
+              uint64_t fd, uint64_t offset) -> int64_t;
+
+    std::mutex lock;
+    // Host descriptors indexed by guest descriptor, -1 for closed ones.
+    std::vector<int> fds = {0, 1, 2};
+    // Start and current end of the heap.
+    uint64_t heapStart;
+    uint64_t heapEnd;
+    // Highest heap end so far, memory below it is zeroed when reused.
+    uint64_t heapMax;
+    // Lowest mapping, mappings grow down towards the heap.
+    uint64_t mappings;
+    int status = 0;
+};
+
+} // namespace riscvemu
+
+#endif
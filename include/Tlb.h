@@ -0,0 +1,88 @@
+#ifndef TLB_H
+#define TLB_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace riscvemu {
+
+/// @brief satp MODE field values.
+static constexpr uint64_t SatpModeBare = 0;
+static constexpr uint64_t SatpModeSv39 = 8;
+
+/// @brief Sv39 page table entry flags.
+static constexpr uint64_t PteValid    = 1 << 0;
+static constexpr uint64_t PteRead     = 1 << 1;
+static constexpr uint64_t PteWrite    = 1 << 2;
+static constexpr uint64_t PteExecute  = 1 << 3;
+static constexpr uint64_t PteUser     = 1 << 4;
+static constexpr uint64_t PteGlobal   = 1 << 5;
+static constexpr uint64_t PteAccessed = 1 << 6;
+static constexpr uint64_t PteDirty    = 1 << 7;
+
+/// @brief Access distinguishes the kind of guest memory access being
+/// translated, permissions and fault causes depend on it.
+enum class Access : uint8_t {
+    Fetch,
+    Load,
+    Store,
+};
+
+/// @brief TlbEntry caches the translation of a single 4 KiB virtual page,
+/// superpages are cached one 4 KiB page at a time.
+struct TlbEntry {
+    // Virtual page number, InvalidTag if the entry is empty.
+    uint64_t tag;
+    // Physical address of the page.
+    uint64_t page;
+    // Flags of the leaf page table entry.
+    uint64_t flags;
+};
+
+/// @brief Tlb is a direct-mapped software TLB indexed by the low bits of
+/// the virtual page number. Entries only cache the walk, permissions are
+/// checked on every hit against the current privilege so changing the
+/// privilege or mstatus doesn't require a flush.
+class Tlb {
+    public:
+    /// @brief Number of entries, a power of two.
+    static constexpr size_t Entries = 256;
+
+    /// @brief Tag of empty entries, never a valid virtual page number.
+    static constexpr uint64_t InvalidTag = ~static_cast<uint64_t>(0);
+
+    Tlb() { flush(); }
+
+    /// @brief Return the entry translating addr or nullptr on a miss.
+    /// @param addr Virtual address.
+    /// @return TlbEntry*
+    [[nodiscard]] auto lookup(uint64_t addr) const -> const TlbEntry* {
+        auto tag          = addr >> 12;
+        const auto& entry = this->entries[tag & (Entries - 1)];
+        return entry.tag == tag ? &entry : nullptr;
+    }
+
+    /// @brief Cache the translation of the page holding addr, evicting the
+    /// entry it maps to.
+    /// @param addr Virtual address.
+    /// @param page Physical address of the page.
+    /// @param flags Leaf page table entry flags.
+    auto insert(uint64_t addr, uint64_t page, uint64_t flags) -> void {
+        auto tag   = addr >> 12;
+        auto& slot = this->entries[tag & (Entries - 1)];
+        slot       = {.tag = tag, .page = page, .flags = flags};
+    }
+
+    /// @brief Drop every cached translation.
+    auto flush() -> void {
+        this->entries.fill({.tag = InvalidTag, .page = 0, .flags = 0});
+    }
+
+    private:
+    std::array<TlbEntry, Entries> entries;
+};
+
+} // namespace riscvemu
+
+#endif
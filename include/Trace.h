@@ -0,0 +1,208 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace riscvemu {
+
+/// @brief TraceError is raised when a trace can't be written or a trace
+/// file is malformed.
+struct TraceError : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+/// @brief TraceRecord flags.
+// The instruction accessed memory at TraceRecord::addr.
+static constexpr uint8_t TraceMemory = 1;
+// The instruction raised a trap instead of retiring, value holds the trap
+// cause and addr the trap value.
+static constexpr uint8_t TraceTrap = 2;
+
+/// @brief TraceRecord describes an instruction retired by a hart, or the
+/// trap it raised.
+struct TraceRecord {
+    // Address of the instruction.
+    uint64_t pc = 0;
+    // Value written to rd, 0 if the instruction wrote no register.
+    uint64_t value = 0;
+    // Address accessed for TraceMemory records, trap value for TraceTrap.
+    uint64_t addr = 0;
+    // Encoded instruction bits.
+    uint32_t inst = 0;
+    // Destination register, 0 if none.
+    uint8_t rd        = 0;
+    uint8_t flags     = 0;
+    uint16_t reserved = 0;
+
+    auto operator==(const TraceRecord&) const -> bool = default;
+};
+
+static_assert(sizeof(TraceRecord) == 32, "unexpected trace record layout");
+
+/// @brief TraceFormat selects the encoding of the records in a trace file.
+enum class TraceFormat : uint32_t {
+    // Records are stored as is, 32 bytes each.
+    Raw = 0,
+    // Records are delta encoded against the previous one with variable
+    // length integers, sequential instructions take 4 to 8 bytes.
+    Delta = 1,
+};
+
+/// @brief TraceRing is a bounded single producer, single consumer queue of
+/// records. The hart pushes and the writer thread pops without locks, each
+/// side only writes its own index and caches the other one so a push
+/// usually touches no cache line shared with the consumer.
+class TraceRing {
+    public:
+    /// @brief TraceRing constructor.
+    /// @param capacity Number of records, rounded up to a power of two.
+    explicit TraceRing(size_t capacity);
+
+    /// @brief Append record, waits for the consumer while the ring is full
+    /// so no record is ever dropped.
+    /// @param record
+    auto push(const TraceRecord& record) -> void {
+        auto head = this->head.load(std::memory_order_relaxed);
+        if (head - this->cachedTail == this->records.size()) [[unlikely]] {
+            waitForSpace(head);
+        }
+        this->records[head & this->mask] = record;
+        this->head.store(head + 1, std::memory_order_release);
+    }
+
+    /// @brief Move up to max records to out.
+    /// @param out
+    /// @param max
+    /// @return Number of records moved.
+    auto pop(TraceRecord* out, size_t max) -> size_t;
+
+    private:
+    /// @brief Wait until the record at head can be written.
+    auto waitForSpace(uint64_t head) -> void;
+
+    std::vector<TraceRecord> records;
+    uint64_t mask;
+    // Written by the producer.
+    alignas(64) std::atomic<uint64_t> head{0};
+    uint64_t cachedTail = 0;
+    // Written by the consumer.
+    alignas(64) std::atomic<uint64_t> tail{0};
+};
+
+/// @brief TraceEncoder encodes records in the delta format, it keeps the
+/// state records are encoded against.
+class TraceEncoder {
+    public:
+    /// @brief Append the encoding of record to out.
+    /// @param record
+    /// @param out
+    auto encode(const TraceRecord& record, std::vector<uint8_t>& out)
+        -> void;
+
+    private:
+    // Address following the previous instruction.
+    uint64_t sequential = 0;
+    uint64_t addr = 0;
+    // Last value written to each register.
+    std::array<uint64_t, 32> values{};
+};
+
+/// @brief Tracer writes the records of a hart to a trace file, records are
+/// queued in a TraceRing and encoded and written by a background thread so
+/// the hart only pays for copying them.
+/// A trace file starts with a header (Magic, the format version and the
+/// TraceFormat) followed by the encoded records.
+class Tracer {
+    public:
+    /// @brief First bytes of a trace file, "RVEMTRCE".
+    static constexpr uint64_t Magic = 0x454352544d455652;
+
+    /// @brief Format version, bumped on any layout change.
+    static constexpr uint32_t Version = 2;
+
+    /// @brief Default ring capacity in records.
+    static constexpr size_t DefaultCapacity = 1 << 16;
+
+    /// @brief Start tracing to the file at path.
+    /// @param path
+    /// @param format
+    /// @param capacity Ring capacity in records.
+    /// @throws TraceError if the file can't be created.
+    explicit Tracer(const std::string& path,
+                    TraceFormat format = TraceFormat::Delta,
+                    size_t capacity    = DefaultCapacity);
+
+    /// @brief Flush the queued records and close the file, see close.
+    ~Tracer();
+
+    // The writer thread refers to the tracer.
+    Tracer(const Tracer&)                    = delete;
+    auto operator=(const Tracer&) -> Tracer& = delete;
+    Tracer(Tracer&&)                         = delete;
+    auto operator=(Tracer&&) -> Tracer&      = delete;
+
+    /// @brief Queue record.
+    auto record(const TraceRecord& record) -> void {
+        this->ring.push(record);
+        this->recorded++;
+    }
+
+    /// @brief Number of records queued.
+    [[nodiscard]] auto records() const -> uint64_t { return this->recorded; }
+
+    /// @brief Wait for the writer thread to write every queued record and
+    /// close the file, records can't be queued once closed.
+    /// @throws TraceError if writing failed.
+    auto close() -> void;
+
+    private:
+    /// @brief Writer thread loop.
+    auto drain() -> void;
+
+    TraceRing ring;
+    TraceFormat format;
+    std::ofstream out;
+    uint64_t recorded = 0;
+    std::atomic<bool> stopping{false};
+    bool failed = false;
+    std::thread writer;
+};
+
+/// @brief TraceReader decodes the records of a trace file.
+class TraceReader {
+    public:
+    /// @brief Read the trace header from in.
+    /// @param in
+    /// @throws TraceError if in isn't a trace of this version.
+    explicit TraceReader(std::istream& in);
+
+    /// @brief Format of the trace.
+    [[nodiscard]] auto format() const -> TraceFormat { return this->encoding; }
+
+    /// @brief Decode the next record.
+    /// @param record
+    /// @return false at the end of the trace.
+    /// @throws TraceError if the trace is truncated.
+    auto next(TraceRecord& record) -> bool;
+
+    private:
+    std::istream* in;
+    TraceFormat encoding = TraceFormat::Raw;
+    // Delta decoding state, see TraceEncoder.
+    uint64_t sequential = 0;
+    uint64_t addr = 0;
+    std::array<uint64_t, 32> values{};
+};
+
+} // namespace riscvemu
+
+#endif
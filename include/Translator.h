@@ -0,0 +1,166 @@
+#ifndef TRANSLATOR_H
+#define TRANSLATOR_H
+
+#include "Decoder.h"
+#include "Instructions.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace riscvemu {
+
+struct MMU;
+struct JitState;
+
+/// @brief JitFunction is the entry point of a natively compiled block,
+/// it executes the block and returns the address to continue at.
+using JitFunction = auto (*)(JitState*) -> uint64_t;
+
+/// @brief Upper bound on the number of instructions in a translated block.
+static constexpr size_t MaxBlockInstructions = 64;
+
+/// @brief Returns true if instructions of the given mnemonic end a basic
+/// block, i.e control flow instructions and instructions that touch the
+/// machine state outside of the register file.
+/// @param mnemonic
+/// @return bool
+static constexpr auto isBlockTerminator(Mnemonic mnemonic) -> bool {
+    switch (mnemonic) {
+    case Mnemonic::JAL:
+    case Mnemonic::JALR:
+    case Mnemonic::BEQ:
+    case Mnemonic::BNE:
+    case Mnemonic::BLT:
+    case Mnemonic::BGE:
+    case Mnemonic::BLTU:
+    case Mnemonic::BGEU:
+    case Mnemonic::ECALL:
+    case Mnemonic::EBREAK:
+    case Mnemonic::MRET:
+    case Mnemonic::SRET:
+    case Mnemonic::SFENCE_VMA:
+    case Mnemonic::WFI:
+    case Mnemonic::CSRRW:
+    case Mnemonic::CSRRS:
+    case Mnemonic::CSRRC:
+    case Mnemonic::CSRRWI:
+    case Mnemonic::CSRRSI:
+    case Mnemonic::CSRRCI:
+    case Mnemonic::ILLEGAL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// @brief Instruction pairs the translator fuses, the threaded engine
+/// executes both instructions of a pair with a single dispatch. Pairs only
+/// fuse when the second instruction consumes the register the first one
+/// writes. Their dispatch targets follow the exit sentinel.
+enum class Fusion : uint8_t {
+    // LUI+ADDI, LUI+ADDIW: 32-bit constant.
+    LuiAddi,
+    LuiAddiw,
+    // AUIPC+JALR: far call or jump.
+    AuipcJalr,
+    // AUIPC+LD: pc-relative load.
+    AuipcLd,
+    // SLLI+SRLI: zero extension or bit field extraction.
+    SlliSrli,
+    Count,
+};
+
+/// @brief ThreadedOp pairs a decoded instruction with the address of the
+/// code executing it, so the threaded engine dispatches to the next
+/// instruction with a single indirect jump.
+struct ThreadedOp {
+    // Dispatch target in the threaded engine.
+    const void* dispatch;
+    DecodedInstruction decoded;
+};
+
+/// @brief TranslatedBlock is a straight-line sequence of instructions
+/// ending with a block terminator, a page boundary or the end of the code.
+/// The last op is always an exit sentinel continuing at end.
+/// The first op of a fused pair dispatches to the pair, the second op is
+/// kept in place so ops still map one to one to instructions.
+struct TranslatedBlock {
+    // Address of the first instruction.
+    uint64_t pc = 0;
+    // Physical address of the first instruction, equal to pc unless the
+    // block was translated with paging enabled.
+    uint64_t paddr = 0;
+    // Address following the last instruction.
+    uint64_t end = 0;
+    // Page holding the block.
+    uint64_t page = 0;
+    // Code generation of the page when the block was translated.
+    uint32_t generation = 0;
+    std::vector<ThreadedOp> ops;
+    // Offset of each op from pc, instructions are 2 or 4 bytes long. The
+    // exit sentinel's offset is the end of the block.
+    std::vector<uint16_t> offsets;
+    // Number of times the block was entered, used to pick blocks to compile.
+    uint32_t executions = 0;
+    // Native code compiled from the block, nullptr while interpreted.
+    JitFunction native = nullptr;
+    // Chained successors, the fallthrough block and the last taken target.
+    std::array<TranslatedBlock*, 2> successors = {nullptr, nullptr};
+};
+
+/// @brief BlockCache translates and owns the basic blocks executed by
+/// the threaded engine, blocks are keyed by the physical address they
+/// start at and record the virtual address they were entered from, a
+/// block entered from another virtual address is translated again.
+/// Blocks are never freed until the cache is flushed, a stale block is
+/// translated again in place so chained successors stay valid.
+class BlockCache {
+    public:
+    /// @brief BlockCache constructor, mmu is the memory the code is
+    /// fetched from.
+    BlockCache(MMU& mmu);
+
+    /// @brief Return the block starting at pc, translating it on a miss.
+    /// @param pc
+    /// @param paddr Physical address of pc.
+    /// @param limit End of the executable code, blocks stop before it.
+    /// @param dispatch Dispatch targets indexed by mnemonic, the entry at
+    /// Mnemonic::Count is the exit sentinel followed by the fused pairs
+    /// indexed by Fusion.
+    /// @return TranslatedBlock ready to execute.
+    auto lookup(uint64_t pc, uint64_t paddr, uint64_t limit,
+                const void* const* dispatch) -> TranslatedBlock*;
+
+    /// @brief Returns true if the code the block was translated from has
+    /// been written to since.
+    [[nodiscard]] auto isStale(const TranslatedBlock& block) const -> bool {
+        return block.generation != this->generations[block.page];
+    }
+
+    /// @brief Translate block again from the current memory contents.
+    auto retranslate(TranslatedBlock& block, uint64_t limit,
+                     const void* const* dispatch) -> void;
+
+    /// @brief Drop every translated block.
+    auto flush() -> void;
+
+    private:
+    /// @brief Decode instructions from paddr into block.
+    auto translate(TranslatedBlock& block, uint64_t pc, uint64_t paddr,
+                   uint64_t limit, const void* const* dispatch) -> void;
+
+    /// @brief Memory the blocks were translated from.
+    MMU* mmu;
+    /// @brief Per page code generations maintained by the MMU.
+    const uint32_t* generations;
+    /// @brief Blocks indexed by physical start address.
+    std::unordered_map<uint64_t, std::unique_ptr<TranslatedBlock>> blocks;
+};
+
+} // namespace riscvemu
+
+#endif
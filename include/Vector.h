@@ -0,0 +1,99 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <cstdint>
+
+namespace riscvemu {
+
+//==== Vector ====//
+// Vector extension (RVV 1.0) with VLEN = 256 and ELEN = 64. The vector
+// register file is a single contiguous array, a register group of LMUL
+// registers is the contiguous run of bytes starting at its first register
+// so an operation on a group is a loop over plain host arrays that the
+// compiler vectorizes for the host SIMD unit. Elements past vl and
+// elements masked off are left undisturbed, which is valid for both the
+// undisturbed and agnostic policies.
+
+/// @brief Vector register length in bits.
+static constexpr uint64_t VectorLength = 256;
+
+/// @brief Vector register length in bytes, the value of vlenb.
+static constexpr uint64_t VectorBytes = VectorLength / 8;
+
+/// @brief Number of vector registers.
+static constexpr uint64_t VectorRegisters = 32;
+
+/// @brief Writable bits of vstart, enough for the index of any element of
+/// a register group.
+static constexpr uint64_t MaskVStart = VectorLength - 1;
+
+// vtype fields.
+static constexpr uint64_t MaskVLMul = 0b111;
+static constexpr uint64_t MaskVSew  = 0b111 << 3;
+static constexpr uint64_t MaskVTA   = 1 << 6;
+static constexpr uint64_t MaskVMA   = 1 << 7;
+static constexpr uint64_t MaskVIll  = 1ULL << 63;
+
+/// @brief VectorType is the decoded form of a vtype value.
+struct VectorType {
+    // Selected element width in bytes.
+    uint64_t sew = 0;
+    // Register group multiplier in eighths of a register, 1 to 64.
+    uint64_t lmul = 0;
+    // Maximum number of elements of a register group, VLMAX.
+    uint64_t vlmax = 0;
+    // Number of registers in a register group, 1 for fractional LMUL.
+    uint64_t registers = 0;
+    // The vtype value isn't supported.
+    bool ill = true;
+};
+
+/// @brief Lane<E> is the type of the elements of type E in the vector
+/// register file. The file is accessed with every element type, so the
+/// accesses are declared as aliasing each other.
+template <typename E> struct LaneType;
+template <> struct LaneType<uint8_t> {
+    typedef uint8_t __attribute__((may_alias)) type;
+};
+template <> struct LaneType<uint16_t> {
+    typedef uint16_t __attribute__((may_alias)) type;
+};
+template <> struct LaneType<uint32_t> {
+    typedef uint32_t __attribute__((may_alias)) type;
+};
+template <> struct LaneType<uint64_t> {
+    typedef uint64_t __attribute__((may_alias)) type;
+};
+template <> struct LaneType<float> {
+    typedef float __attribute__((may_alias)) type;
+};
+template <> struct LaneType<double> {
+    typedef double __attribute__((may_alias)) type;
+};
+template <typename E> using Lane = typename LaneType<E>::type;
+
+/// @brief Decode vtype, values with reserved bits, a reserved vsew or
+/// vlmul and fractional LMUL with SEW > LMUL * ELEN are ill.
+static inline auto vectorType(uint64_t vtype) -> VectorType {
+    VectorType type{};
+    auto vlmul = vtype & MaskVLMul;
+    auto vsew  = (vtype & MaskVSew) >> 3;
+    if ((vtype & ~(MaskVLMul | MaskVSew | MaskVTA | MaskVMA)) != 0 ||
+        vsew > 3 || vlmul == 0b100) {
+        return type;
+    }
+    type.sew  = (uint64_t)1 << vsew;
+    type.lmul = vlmul < 4 ? 8 << vlmul : 8 >> (8 - vlmul);
+    // SEW * 8 bits > LMUL / 8 * ELEN.
+    if (type.sew > type.lmul) {
+        return type;
+    }
+    type.vlmax     = VectorBytes * type.lmul / 8 / type.sew;
+    type.registers = type.lmul < 8 ? 1 : type.lmul / 8;
+    type.ill       = false;
+    return type;
+}
+
+} // namespace riscvemu
+
+#endif
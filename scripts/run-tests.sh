@@ -2,3 +2,9 @@ cd ../build/
 
 ninja all
 ./riscvemu-tests
+
+# Run the riscv-tests ISA programs when they are built, e.g.
+# RISCV_TESTS=$HOME/riscv-tests/isa ./run-tests.sh
+if [ -n "$RISCV_TESTS" ]; then
+    ./riscvemu-conformance "$RISCV_TESTS"
+fi
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Conformance.h"
+#include "Elf.h"
+#include "Machine.h"
+
+// riscvemu-conformance runs the riscv-tests ISA programs on every execution
+// engine in parallel, checks their result through tohost and records the
+// instructions and wall time of every run. Runs are compared against a
+// baseline written by a previous invocation: a different instruction count
+// means the program took another path, a run slower than the tolerance is
+// reported as a regression.
+
+/// @brief Runs shorter than this are too noisy to be reported as slower.
+static constexpr double MinRegressionSeconds = 0.0005;
+
+/// @brief Baseline measurement of a run.
+struct Baseline {
+    uint64_t instructions = 0;
+    double seconds        = 0;
+};
+
+/// @brief Name of an engine as accepted by --engine.
+static auto engineName(riscvemu::Engine engine) -> const char* {
+    switch (engine) {
+    case riscvemu::Engine::Interpreter:
+        return "interpreter";
+    case riscvemu::Engine::Threaded:
+        return "threaded";
+    case riscvemu::Engine::Jit:
+        return "jit";
+    }
+    return "unknown";
+}
+
+/// @brief Name of a status as printed in the report.
+static auto statusName(riscvemu::ConformanceStatus status) -> const char* {
+    switch (status) {
+    case riscvemu::ConformanceStatus::Pass:
+        return "PASS";
+    case riscvemu::ConformanceStatus::Fail:
+        return "FAIL";
+    case riscvemu::ConformanceStatus::Stopped:
+        return "STOPPED";
+    case riscvemu::ConformanceStatus::Timeout:
+        return "TIMEOUT";
+    case riscvemu::ConformanceStatus::Error:
+        return "ERROR";
+    }
+    return "UNKNOWN";
+}
+
+/// @brief Key of a run in the baseline, the program name and the engine.
+static auto baselineKey(const riscvemu::ConformanceResult& result)
+    -> std::string {
+    return std::filesystem::path(result.path).filename().string() + ' ' +
+           engineName(result.engine);
+}
+
+/// @brief Expand the paths given on the command line, directories stand
+/// for the ELF files they hold (riscv-tests also builds .dump files next
+/// to the programs).
+/// @param args
+/// @return Program paths, sorted within each directory.
+static auto programPaths(const std::vector<std::string>& args)
+    -> std::vector<std::string> {
+    std::vector<std::string> paths;
+    for (const auto& arg : args) {
+        if (!std::filesystem::is_directory(arg)) {
+            paths.push_back(arg);
+            continue;
+        }
+        std::vector<std::string> found;
+        for (const auto& entry : std::filesystem::directory_iterator(arg)) {
+            if (entry.is_regular_file() &&
+                riscvemu::isElf(entry.path().string())) {
+                found.push_back(entry.path().string());
+            }
+        }
+        std::sort(found.begin(), found.end());
+        paths.insert(paths.end(), found.begin(), found.end());
+    }
+    return paths;
+}
+
+/// @brief Read a baseline written by --save, one run per line: program,
+/// engine, instructions and seconds.
+/// @param path
+/// @param baseline
+/// @return false if the file can't be opened.
+static auto readBaseline(const std::string& path,
+                         std::map<std::string, Baseline>& baseline) -> bool {
+    auto file = std::ifstream(path);
+    if (!file) {
+        return false;
+    }
+    std::string name;
+    std::string engine;
+    Baseline run;
+    while (file >> name >> engine >> run.instructions >> run.seconds) {
+        baseline[name + ' ' + engine] = run;
+    }
+    return true;
+}
+
+auto main(int argc, char* argv[]) -> int {
+    std::vector<riscvemu::Engine> engines = {riscvemu::Engine::Interpreter,
+                                             riscvemu::Engine::Threaded,
+                                             riscvemu::Engine::Jit};
+    auto options     = riscvemu::ConformanceOptions{};
+    double tolerance = 0.25;
+    std::string baselinePath;
+    std::string savePath;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        auto option = std::string(argv[i]);
+        if (option == "--engine=interpreter") {
+            engines = {riscvemu::Engine::Interpreter};
+        } else if (option == "--engine=threaded") {
+            engines = {riscvemu::Engine::Threaded};
+        } else if (option == "--engine=jit") {
+            engines = {riscvemu::Engine::Jit};
+        } else if (option.starts_with("--threads=")) {
+            options.threads = std::stoull(option.substr(10));
+        } else if (option.starts_with("--slice=")) {
+            options.slice = std::stoull(option.substr(8));
+        } else if (option.starts_with("--limit=")) {
+            options.limit = std::stoull(option.substr(8));
+        } else if (option.starts_with("--baseline=")) {
+            baselinePath = option.substr(11);
+        } else if (option.starts_with("--save=")) {
+            savePath = option.substr(7);
+        } else if (option.starts_with("--tolerance=")) {
+            // Slowdown tolerated against the baseline, in percent.
+            tolerance = std::stod(option.substr(12)) / 100;
+        } else if (option.starts_with("--")) {
+            args.clear();
+            break;
+        } else {
+            args.push_back(option);
+        }
+    }
+    if (args.empty()) {
+        std::cout << "Usage: riscvemu-conformance "
+                     "[--engine=interpreter|threaded|jit] [--threads=N] "
+                     "[--slice=N] [--limit=N] [--baseline=FILE "
+                     "[--tolerance=PCT]] [--save=FILE] program|directory..."
+                  << '\n';
+        return -1;
+    }
+
+    std::map<std::string, Baseline> baseline;
+    if (!baselinePath.empty() && !readBaseline(baselinePath, baseline)) {
+        std::cout << "failed to open " << baselinePath << '\n';
+        return -1;
+    }
+
+    auto runner  = riscvemu::ConformanceRunner(options);
+    auto results = runner.run(programPaths(args), engines);
+
+    size_t passed    = 0;
+    size_t changed   = 0;
+    size_t regressed = 0;
+    double total     = 0;
+    char line[160];
+    for (const auto& result : results) {
+        auto name = std::filesystem::path(result.path).filename().string();
+        std::snprintf(line, sizeof(line), "%-28s %-12s %-8s %12llu %10.3f",
+                      name.c_str(), engineName(result.engine),
+                      statusName(result.status),
+                      (unsigned long long)result.instructions,
+                      result.seconds * 1e3);
+        std::cout << line;
+        if (result.status == riscvemu::ConformanceStatus::Pass) {
+            passed++;
+        } else if (result.status == riscvemu::ConformanceStatus::Fail) {
+            std::cout << " test " << result.test;
+        } else if (result.status == riscvemu::ConformanceStatus::Error) {
+            std::cout << ' ' << result.error;
+        }
+        total += result.seconds;
+
+        auto known = baseline.find(baselineKey(result));
+        if (known != baseline.end()) {
+            const auto& before = known->second;
+            if (result.instructions != before.instructions) {
+                std::cout << " CHANGED from " << before.instructions;
+                changed++;
+            }
+            if (result.seconds > before.seconds * (1 + tolerance) &&
+                result.seconds - before.seconds >= MinRegressionSeconds) {
+                std::snprintf(line, sizeof(line),
+                              " SLOWER %.2fx than %.3f ms",
+                              result.seconds / before.seconds,
+                              before.seconds * 1e3);
+                std::cout << line;
+                regressed++;
+            }
+        }
+        std::cout << '\n';
+    }
+    std::snprintf(line, sizeof(line),
+                  "%zu/%zu passed, %zu changed, %zu slower, %.3f ms", passed,
+                  results.size(), changed, regressed, total * 1e3);
+    std::cout << line << '\n';
+
+    if (!savePath.empty()) {
+        auto file = std::ofstream(savePath);
+        if (!file) {
+            std::cout << "failed to open " << savePath << '\n';
+            return -1;
+        }
+        for (const auto& result : results) {
+            file << baselineKey(result) << ' ' << result.instructions << ' '
+                 << result.seconds << '\n';
+        }
+    }
+    return passed == results.size() && changed == 0 && regressed == 0 ? 0
+                                                                       : 1;
+}
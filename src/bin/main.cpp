@@ -1,41 +1,364 @@
+#include <cinttypes>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include <unistd.h>
+
+#include "Batch.h"
+#include "Checkpoint.h"
+#include "Elf.h"
 #include "Instructions.h"
 #include "Machine.h"
+#include "Profiler.h"
+#include "Syscalls.h"
+#include "Trace.h"
+
+/// @brief Print the trap that stopped a hart, if any.
+/// @param result
+static auto reportTrap(const riscvemu::RunResult& result) -> void {
+    if (result.status == riscvemu::RunStatus::Trapped) {
+        printf("Exception Raised: %s @ 0x%llx\n",
+               riscvemu::trapName(result.cause),
+               (unsigned long long)result.addr);
+    }
+}
+
+/// @brief Run the program loaded in ctx against every input listed in the
+/// file at list and print the value of a0 each run stopped with.
+/// @param ctx
+/// @param list
+/// @param engine
+/// @param threads
+/// @return Exit code.
+static auto runBatch(const riscvemu::VMContext& ctx, const std::string& list,
+                     riscvemu::Engine engine, size_t threads) -> int {
+    std::vector<std::string> paths;
+    std::vector<std::vector<uint8_t>> inputs;
+    auto listFile = std::ifstream(list);
+    if (!listFile) {
+        std::cout << "failed to open " << list << '\n';
+        return -1;
+    }
+    for (std::string path; std::getline(listFile, path);) {
+        if (path.empty()) {
+            continue;
+        }
+        auto input = std::ifstream(path, std::ios::binary);
+        if (!input) {
+            std::cout << "failed to open " << path << '\n';
+            return -1;
+        }
+        inputs.emplace_back(std::istreambuf_iterator<char>(input),
+                            std::istreambuf_iterator<char>());
+        paths.push_back(std::move(path));
+    }
+
+    auto runner  = riscvemu::BatchRunner(ctx, threads);
+    auto results = runner.run(inputs, engine);
+    for (size_t i = 0; i < results.size(); i++) {
+        std::cout << i << ' ' << paths[i] << " a0 = 0x" << std::hex
+                  << results[i].registers[(size_t)riscvemu::Register::A0]
+                  << " pc = 0x" << results[i].pc << std::dec;
+        if (!results[i].error.empty()) {
+            std::cout << ' ' << results[i].error;
+        }
+        if (results[i].outcome.status == riscvemu::RunStatus::Trapped) {
+            std::cout << ' ' << riscvemu::trapName(results[i].outcome.cause);
+        }
+        std::cout << '\n';
+    }
+    return 0;
+}
+
+/// @brief Write the profile of every hart, the profile of hart N goes to
+/// PREFIX.N.txt and PREFIX.N.folded (PREFIX.txt and PREFIX.folded when
+/// there is a single hart).
+/// @param profilers
+/// @param prefix
+static auto writeProfiles(const std::vector<riscvemu::Profiler>& profilers,
+                          const std::string& prefix) -> void {
+    for (size_t id = 0; id < profilers.size(); id++) {
+        auto path = profilers.size() > 1
+                        ? prefix + '.' + std::to_string(id)
+                        : prefix;
+        auto report = std::ofstream(path + ".txt");
+        profilers[id].writeReport(report);
+        auto stacks = std::ofstream(path + ".folded");
+        profilers[id].writeCollapsedStacks(stacks);
+        std::cout << "profile written to " << path << ".txt and " << path
+                  << ".folded" << '\n';
+    }
+}
+
+/// @brief Start tracing every hart of machine, the trace of hart N goes to
+/// PATH.N (PATH when there is a single hart).
+/// @param machine
+/// @param path
+/// @param format
+/// @return Tracers, empty if a trace file can't be created.
+static auto startTraces(riscvemu::Machine& machine, const std::string& path,
+                        riscvemu::TraceFormat format)
+    -> std::vector<std::unique_ptr<riscvemu::Tracer>> {
+    std::vector<std::unique_ptr<riscvemu::Tracer>> tracers;
+    try {
+        for (size_t id = 0; id < machine.harts(); id++) {
+            tracers.push_back(std::make_unique<riscvemu::Tracer>(
+                machine.harts() > 1 ? path + '.' + std::to_string(id) : path,
+                format));
+            machine.hart(id).setTracer(tracers.back().get());
+        }
+    } catch (std::exception& e) {
+        std::cout << e.what() << '\n';
+        for (size_t id = 0; id < machine.harts(); id++) {
+            machine.hart(id).setTracer(nullptr);
+        }
+        tracers.clear();
+    }
+    return tracers;
+}
+
+/// @brief Write a checkpoint of cpu to the file at path, appended to it if
+/// append is set.
+/// @param cpu
+/// @param path
+/// @param append
+/// @return Exit code.
+static auto saveCheckpoint(riscvemu::CPU& cpu, const std::string& path,
+                           bool append) -> int {
+    auto file = std::ofstream(path, std::ios::binary |
+                                        (append ? std::ios::app
+                                                : std::ios::trunc));
+    try {
+        auto pages = riscvemu::Checkpoint::write(cpu, file);
+        std::cout << "checkpoint written to " << path << ", " << pages
+                  << " pages" << '\n';
+    } catch (std::exception& e) {
+        std::cout << e.what() << '\n';
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Resume the run saved in the checkpoint file at path, a checkpoint
+/// written back to the same file is appended to it.
+/// @param path
+/// @param engine
+/// @param checkpoint Path of the checkpoint written once the run stops,
+/// empty for none.
+/// @return Exit code.
+static auto resume(const std::string& path, riscvemu::Engine engine,
+                   const std::string& checkpoint) -> int {
+    auto file = std::ifstream(path, std::ios::binary);
+    auto cpu  = std::optional<riscvemu::CPU>();
+    try {
+        cpu.emplace(riscvemu::Checkpoint::read(file));
+    } catch (std::exception& e) {
+        std::cout << e.what() << '\n';
+        return -1;
+    }
+    cpu->dumpRegisters();
+    try {
+        reportTrap(cpu->step(engine, riscvemu::Unbounded));
+    } catch (std::exception& e) {
+        printf("%s @ %" PRIx64 "\n", e.what(), cpu->getPC());
+        return -1;
+    }
+    cpu->dumpRegisters();
+    return checkpoint.empty() ? 0
+                              : saveCheckpoint(*cpu, checkpoint,
+                                               checkpoint == path);
+}
+
+/// @brief Host environment variables, passed to programs run under system
+/// call emulation.
+/// @return std::vector<std::string>
+static auto hostEnvironment() -> std::vector<std::string> {
+    std::vector<std::string> env;
+    for (char** var = environ; *var != nullptr; var++) {
+        env.emplace_back(*var);
+    }
+    return env;
+}
 
 auto main(int argc, char* argv[]) -> int {
+    auto engine     = riscvemu::Engine::Interpreter;
+    auto memorySize = riscvemu::MemoryMaxSize;
+    size_t harts    = 1;
+    size_t threads  = 0;
+    std::string batch;
+    std::string profile;
+    std::string checkpoint;
+    std::string trace;
+    bool emulateLinux = false;
+    auto traceFormat = riscvemu::TraceFormat::Delta;
+    auto sampling = riscvemu::Sampling{.window = 100000};
+    // Options come before the file.
+    while (argc > 2 && std::string(argv[1]).starts_with("--")) {
+        auto option = std::string(argv[1]);
+        if (option == "--engine=interpreter") {
+            engine = riscvemu::Engine::Interpreter;
+        } else if (option == "--engine=threaded") {
+            engine = riscvemu::Engine::Threaded;
+        } else if (option == "--engine=jit") {
+            engine = riscvemu::Engine::Jit;
+        } else if (option.starts_with("--memory=")) {
+            // Guest memory size in MiB.
+            memorySize = std::stoull(option.substr(9)) << 20;
+        } else if (option.starts_with("--harts=")) {
+            harts = std::stoull(option.substr(8));
+        } else if (option.starts_with("--batch=")) {
+            // File listing one input path per line.
+            batch = option.substr(8);
+        } else if (option.starts_with("--threads=")) {
+            threads = std::stoull(option.substr(10));
+        } else if (option.starts_with("--profile=")) {
+            // Prefix of the profile report and collapsed stacks files.
+            profile = option.substr(10);
+        } else if (option.starts_with("--sample=")) {
+            // Profile a window every N million instructions.
+            sampling.interval = std::stoull(option.substr(9)) * 1000000;
+        } else if (option.starts_with("--sample-window=")) {
+            // Instructions profiled per window, in thousands.
+            sampling.window = std::stoull(option.substr(16)) * 1000;
+        } else if (option.starts_with("--trace=")) {
+            // Trace file of the retired instructions.
+            trace = option.substr(8);
+        } else if (option == "--trace-raw") {
+            // Store trace records as is instead of delta encoding them.
+            traceFormat = riscvemu::TraceFormat::Raw;
+        } else if (option == "--linux") {
+            // Serve ECALL as Linux system calls, arguments following the
+            // file are passed to the program.
+            emulateLinux = true;
+        } else if (option.starts_with("--checkpoint=")) {
+            // Checkpoint written once the run stops.
+            checkpoint = option.substr(13);
+        } else {
+            break;
+        }
+        argv++;
+        argc--;
+    }
     if (argc < 2) {
-        std::cout << "Usage: riscvemu file.bin" << '\n';
+        std::cout << "Usage: riscvemu [--engine=interpreter|threaded|jit] "
+                     "[--memory=MiB] [--harts=N] "
+                     "[--batch=LIST [--threads=N]] [--profile=PREFIX "
+                     "[--sample=N [--sample-window=K]]] "
+                     "[--trace=FILE [--trace-raw]] [--checkpoint=FILE] "
+                     "[--linux] file.bin|file.elf|checkpoint [args...]"
+                  << '\n';
         return -1;
     }
 
-    std::cout << argv[1] << '\n';
+    // Under system call emulation the output is the program's own.
+    if (!emulateLinux) {
+        std::cout << argv[1] << '\n';
+    }
+    if (riscvemu::isCheckpoint(argv[1])) {
+        return resume(argv[1], engine, checkpoint);
+    }
+    if (!checkpoint.empty() && harts != 1) {
+        std::cout << "checkpoints only support a single hart" << '\n';
+        return -1;
+    }
+    if (emulateLinux && (harts != 1 || !batch.empty())) {
+        std::cout << "system call emulation only supports a single hart"
+                  << '\n';
+        return -1;
+    }
     /// @example
     /// add two constants
     /// addi x29, x0, 5 // Add 5 and 0 store the value to x29
     /// addi x30, x0, 37 // Add 37 and 0 store the value in x30
     /// add x31, x30, x29 // Add x29 and x30 and store the value in x31
     /// 00500e93
-    std::ifstream input(argv[1], std::ios::binary);
-    std::vector<uint8_t> const buffer(std::istreambuf_iterator<char>(input),
-                                      {});
-    printf("Buffer size : %zu\n", buffer.size());
-    auto ctx = riscvemu::VMContext(buffer);
-    auto cpu = riscvemu::CPU(ctx);
-
-    cpu.dumpRegisters();
+    auto ctx = riscvemu::VMContext();
     try {
-        cpu.run();
+        ctx = riscvemu::isElf(argv[1])
+                  ? riscvemu::VMContext::fromElf(argv[1], memorySize)
+                  : riscvemu::VMContext::fromImage(argv[1], memorySize);
     } catch (std::exception& e) {
-        printf("%s @ %llx\n", e.what(), cpu.getPC());
+        printf("%s\n", e.what());
+        return -1;
+    }
+    if (!batch.empty()) {
+        std::cout << "Code size : " << ctx.codeSize << '\n';
+        return runBatch(ctx, batch, engine, threads);
+    }
+    if (emulateLinux) {
+        ctx.syscalls = std::make_shared<riscvemu::SyscallProxy>(ctx);
+    } else {
+        std::cout << "Code size : " << ctx.codeSize << '\n';
+    }
+    auto syscalls = ctx.syscalls;
+    auto entry    = ctx.entry;
+    auto machine  = riscvemu::Machine(std::move(ctx), harts);
+    if (syscalls != nullptr) {
+        syscalls->start(machine.hart(0),
+                        std::vector<std::string>(argv + 1, argv + argc),
+                        hostEnvironment());
+    }
+    std::vector<riscvemu::Profiler> profilers;
+    if (!profile.empty()) {
+        for (size_t id = 0; id < machine.harts(); id++) {
+            profilers.emplace_back(entry);
+        }
+        for (size_t id = 0; id < machine.harts(); id++) {
+            machine.hart(id).setProfiler(&profilers[id]);
+            machine.hart(id).setSampling(sampling);
+        }
+    }
+    std::vector<std::unique_ptr<riscvemu::Tracer>> tracers;
+    if (!trace.empty()) {
+        tracers = startTraces(machine, trace, traceFormat);
+        if (tracers.empty()) {
+            return -1;
+        }
+    }
+
+    if (syscalls == nullptr) {
+        machine.hart(0).dumpRegisters();
+    }
+    try {
+        for (const auto& result : machine.run(engine)) {
+            reportTrap(result);
+        }
+    } catch (std::exception& e) {
+        printf("%s @ %" PRIx64 "\n", e.what(), machine.hart(0).getPC());
         return - -1;
     }
 
-    cpu.dumpRegisters();
+    for (size_t id = 0; id < machine.harts() && syscalls == nullptr; id++) {
+        if (machine.harts() > 1) {
+            std::cout << "hart " << id << '\n';
+        }
+        machine.hart(id).dumpRegisters();
+    }
+    if (!profile.empty()) {
+        writeProfiles(profilers, profile);
+    }
+    for (auto& tracer : tracers) {
+        try {
+            tracer->close();
+            std::cout << "trace written, " << tracer->records() << " records"
+                      << '\n';
+        } catch (std::exception& e) {
+            std::cout << e.what() << '\n';
+            return -1;
+        }
+    }
+    if (!checkpoint.empty()) {
+        return saveCheckpoint(machine.hart(0), checkpoint, false);
+    }
+    return syscalls != nullptr ? syscalls->exitStatus() : 0;
 }
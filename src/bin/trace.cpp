@@ -0,0 +1,70 @@
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "Decoder.h"
+#include "Instructions.h"
+#include "Trace.h"
+
+/// @brief Print the records of a trace written with riscvemu --trace, one
+/// line per record: the instruction address, its encoding and mnemonic,
+/// the register written, the memory address accessed or the trap raised.
+/// With --raw the trace is converted to the raw format instead.
+auto main(int argc, char* argv[]) -> int {
+    if (argc != 2 && !(argc == 4 && std::string(argv[1]) == "--raw")) {
+        std::cout << "Usage: riscvemu-trace [--raw OUTPUT] trace" << '\n';
+        return -1;
+    }
+    auto path = std::string(argv[argc - 1]);
+    auto file = std::ifstream(path, std::ios::binary);
+    if (!file) {
+        std::cout << "failed to open " << path << '\n';
+        return -1;
+    }
+    try {
+        auto reader = riscvemu::TraceReader(file);
+        auto record = riscvemu::TraceRecord{};
+        if (argc == 4) {
+            auto tracer =
+                riscvemu::Tracer(argv[2], riscvemu::TraceFormat::Raw);
+            while (reader.next(record)) {
+                tracer.record(record);
+            }
+            tracer.close();
+            return 0;
+        }
+        char line[128];
+        while (reader.next(record)) {
+            auto inst = riscvemu::predecode(record.inst);
+            std::snprintf(line, sizeof(line), "0x%016llx %08x %-10s",
+                          (unsigned long long)record.pc, record.inst,
+                          riscvemu::getMnemonicName(inst.mnemonic));
+            std::cout << line;
+            if ((record.flags & riscvemu::TraceTrap) != 0) {
+                std::snprintf(line, sizeof(line),
+                              " trap cause %llu tval 0x%llx",
+                              (unsigned long long)record.value,
+                              (unsigned long long)record.addr);
+                std::cout << line;
+            } else if (record.rd != 0) {
+                std::snprintf(line, sizeof(line), " x%u = 0x%llx",
+                              (unsigned)record.rd,
+                              (unsigned long long)record.value);
+                std::cout << line;
+            }
+            if ((record.flags & riscvemu::TraceMemory) != 0) {
+                std::snprintf(line, sizeof(line), " [0x%llx]",
+                              (unsigned long long)record.addr);
+                std::cout << line;
+            }
+            std::cout << '\n';
+        }
+    } catch (std::exception& e) {
+        std::cout << e.what() << '\n';
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include "Batch.h"
+#include "Instructions.h"
+#include "Machine.h"
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace riscvemu {
+
+namespace {
+
+/// @brief WorkRange is the range of item indices owned by a worker, the
+/// owner takes items from the front and thieves take the back half.
+struct WorkRange {
+    std::mutex lock;
+    size_t begin = 0;
+    size_t end   = 0;
+};
+
+/// @brief Take the next item for worker self, stealing from other workers
+/// once its own range is empty. A worker never holds two locks at once.
+/// @param ranges
+/// @param self
+/// @param item
+/// @return false once every range is empty.
+auto nextItem(std::vector<WorkRange>& ranges, size_t self, size_t& item)
+    -> bool {
+    auto& own = ranges[self];
+    {
+        auto guard = std::lock_guard(own.lock);
+        if (own.begin < own.end) {
+            item = own.begin++;
+            return true;
+        }
+    }
+    for (size_t k = 1; k < ranges.size(); k++) {
+        auto& victim = ranges[(self + k) % ranges.size()];
+        size_t first = 0;
+        size_t last  = 0;
+        {
+            auto guard = std::lock_guard(victim.lock);
+            if (victim.begin == victim.end) {
+                continue;
+            }
+            last       = victim.end;
+            first      = victim.end - (victim.end - victim.begin + 1) / 2;
+            victim.end = first;
+        }
+        auto guard = std::lock_guard(own.lock);
+        own.begin  = first + 1;
+        own.end    = last;
+        item       = first;
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+//=== BatchRunner Methods Implementations ====//
+
+BatchRunner::BatchRunner(const VMContext& ctx, size_t threads)
+    : snapshot(ctx),
+      workers(threads != 0
+                  ? threads
+                  : std::max<size_t>(std::thread::hardware_concurrency(), 1)) {
+}
+
+/// @brief Run the program once per input, inputs are split evenly between
+/// the workers up front and rebalanced by stealing. The calling thread is
+/// one of the workers.
+/// @param inputs
+/// @param engine
+/// @return Results in the order of inputs.
+auto BatchRunner::run(const std::vector<std::vector<uint8_t>>& inputs,
+                      Engine engine) -> std::vector<BatchResult> {
+    std::vector<BatchResult> results(inputs.size());
+    auto count = std::min(this->workers, std::max<size_t>(inputs.size(), 1));
+    std::vector<WorkRange> ranges(count);
+    for (size_t id = 0; id < count; id++) {
+        ranges[id].begin = inputs.size() * id / count;
+        ranges[id].end   = inputs.size() * (id + 1) / count;
+    }
+
+    auto work = [&](size_t self) {
+        size_t item = 0;
+        while (nextItem(ranges, self, item)) {
+            results[item] = runOne(inputs[item], engine);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t id = 1; id < count; id++) {
+        threads.emplace_back(work, id);
+    }
+    work(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return results;
+}
+
+/// @brief Run the program against a single input, the input is copied
+/// below the stack and passed in a0 (address) and a1 (length).
+/// @param input
+/// @param engine
+/// @return BatchResult
+auto BatchRunner::runOne(const std::vector<uint8_t>& input,
+                         Engine engine) const -> BatchResult {
+    BatchResult result;
+    try {
+        auto ctx  = this->snapshot.clone();
+        auto top  = MemoryBaseAddr + ctx.mmu.memorySize() - 4;
+        auto addr = (top - input.size()) & ~uint64_t{15};
+        if (input.size() > top - MemoryBaseAddr ||
+            addr < MemoryBaseAddr + ctx.imageSize) {
+            throw std::length_error("input doesn't fit in guest memory");
+        }
+        std::memcpy(ctx.mmu.memory.data() + (addr - MemoryBaseAddr),
+                    input.data(), input.size());
+
+        auto cpu = CPU(std::move(ctx));
+        cpu.setRegister(Register::Sp, addr);
+        cpu.setRegister(Register::A0, addr);
+        cpu.setRegister(Register::A1, input.size());
+        result.outcome = cpu.step(engine, Unbounded);
+
+        result.pc = cpu.getPC();
+        for (size_t i = 0; i < result.registers.size(); i++) {
+            result.registers[i] = cpu.getRegister(getRegisterFromIndex(i));
+        }
+    } catch (std::exception& e) {
+        result.error = e.what();
+    }
+    return result;
+}
+
+} // namespace riscvemu
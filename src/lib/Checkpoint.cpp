@@ -0,0 +1,335 @@
+#include "Checkpoint.h"
+#include "CSR.h"
+#include "Devices.h"
+#include "Machine.h"
+#include "Memory.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace riscvemu {
+
+/// @brief Record flag of the first checkpoint of a context.
+static constexpr uint32_t InitialRecord = 1;
+
+/// @brief Page entry flag of pages holding only zeros, no data follows.
+static constexpr uint64_t ZeroPage = static_cast<uint64_t>(1) << 63;
+
+/// @brief Header of a checkpoint record, followed by the hart state and
+/// pages page entries. A page entry is its page number from MemoryBaseAddr
+/// followed by PageSize bytes of data unless ZeroPage is set.
+struct RecordHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t flags;
+    // Context attributes, see VMContext.
+    uint64_t memorySize;
+    uint64_t codeSize;
+    uint64_t entry;
+    uint64_t imageSize;
+    // Number of page entries.
+    uint64_t pages;
+};
+
+/// @brief Architectural state of the hart.
+struct HartState {
+    uint64_t pc;
+    std::array<uint64_t, 32> registers;
+    std::array<uint64_t, 32> fregisters;
+    std::array<uint8_t, VectorRegisters * VectorBytes> vregisters;
+    std::array<uint64_t, CSRSlots> csrs;
+    uint64_t instret;
+    uint64_t cycleOffset;
+    uint64_t instretOffset;
+    uint64_t reservationAddr;
+    uint64_t reservationValue;
+    uint8_t reservationValid;
+    uint8_t privilege;
+    std::array<uint8_t, 6> padding;
+};
+
+/// @brief State of the devices of the context, follows the hart state: the
+/// CLINT registers of the hart and the UART registers, followed by the
+/// input bytes received by the UART and not read yet.
+struct DeviceState {
+    uint64_t mtime;
+    uint64_t mtimecmp;
+    uint32_t msip;
+    uint8_t ier;
+    uint8_t fcr;
+    uint8_t lcr;
+    uint8_t mcr;
+    uint8_t scr;
+    uint8_t dll;
+    uint8_t dlm;
+    std::array<uint8_t, 5> padding;
+    // Number of input bytes.
+    uint64_t input;
+};
+
+/// @brief Write the bytes of value to out.
+template <typename T>
+static auto put(std::ostream& out, const T& value) -> void {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/// @brief Read the bytes of value from in.
+template <typename T> static auto get(std::istream& in, T& value) -> void {
+    if (!in.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+        throw CheckpointError("checkpoint: truncated record");
+    }
+}
+
+/// @brief Returns true if the bytes bytes at data are all zero.
+static auto isZero(const uint8_t* data, size_t bytes) -> bool {
+    return std::all_of(data, data + bytes, [](uint8_t b) { return b == 0; });
+}
+
+/// @brief Pages of mmu holding data, the pages past the loaded image that
+/// were never touched are skipped without reading them.
+/// @param mmu
+/// @param imageSize
+/// @return page numbers.
+static auto usedPages(const MMU& mmu, uint64_t imageSize)
+    -> std::vector<uint64_t> {
+    auto size     = mmu.memory.size();
+    auto host     = hostPageSize();
+    auto resident = residentPages(mmu.memory.data(), size);
+    std::vector<uint64_t> pages;
+    for (uint64_t page = 0; page < mmu.codePages.size(); page++) {
+        auto offset = page << PageShift;
+        auto bytes  = std::min<uint64_t>(PageSize, size - offset);
+        if (offset >= imageSize && resident[offset / host] == 0 &&
+            resident[(offset + bytes - 1) / host] == 0) {
+            continue;
+        }
+        if (!isZero(mmu.memory.data() + offset, bytes)) {
+            pages.push_back(page);
+        }
+    }
+    return pages;
+}
+
+//=== Checkpoint Methods Implementations ====//
+
+/// @brief Append a checkpoint of cpu to out. The first checkpoint of the
+/// context saves every page holding data, following ones every page
+/// stored to since the previous checkpoint. Saved pages are flagged clean.
+/// @param cpu
+/// @param out
+/// @return Number of pages saved.
+auto Checkpoint::write(CPU& cpu, std::ostream& out) -> size_t {
+    auto& ctx    = *cpu.ctx;
+    auto& mmu    = ctx.mmu;
+    auto initial = ctx.checkpoints == 0;
+    auto size    = mmu.memory.size();
+    auto* memory = mmu.memory.data();
+
+    std::vector<uint64_t> pages;
+    if (initial) {
+        pages = usedPages(mmu, ctx.imageSize);
+    } else {
+        for (uint64_t page = 0; page < mmu.codePages.size(); page++) {
+            auto flags = std::atomic_ref(mmu.codePages[page]).load();
+            if ((flags & MMU::CleanFlag) == 0) {
+                pages.push_back(page);
+            }
+        }
+    }
+
+    put(out, RecordHeader{
+                 .magic      = Magic,
+                 .version    = Version,
+                 .flags      = initial ? InitialRecord : 0,
+                 .memorySize = size,
+                 .codeSize   = ctx.codeSize,
+                 .entry      = ctx.entry,
+                 .imageSize  = ctx.imageSize,
+                 .pages      = pages.size(),
+             });
+    put(out, HartState{
+                 .pc               = cpu.pc,
+                 .registers        = cpu.registers,
+                 .fregisters       = cpu.fregisters,
+                 .vregisters       = cpu.vregisters,
+                 .csrs             = cpu.csrs.values,
+                 .instret          = cpu.instret,
+                 .cycleOffset      = cpu.cycleOffset,
+                 .instretOffset    = cpu.instretOffset,
+                 .reservationAddr  = cpu.reservation.addr,
+                 .reservationValue = cpu.reservation.value,
+                 .reservationValid = cpu.reservation.valid,
+                 .privilege        = (uint8_t)cpu.privilege,
+                 .padding          = {},
+             });
+
+    // The CLINT registers of the hart are read through the device, mtime
+    // resumes from its saved value on restore.
+    auto hart = cpu.csrs.load(MHartID);
+    uint64_t mtime    = 0;
+    uint64_t mtimecmp = 0;
+    uint64_t msip     = 0;
+    ctx.clint->read(Clint::MTime, 8, mtime);
+    ctx.clint->read(Clint::MTimeCmp + hart * 8, 8, mtimecmp);
+    ctx.clint->read(Clint::MSip + hart * 4, 4, msip);
+    auto uart = ctx.uart->save();
+    put(out, DeviceState{
+                 .mtime    = mtime,
+                 .mtimecmp = mtimecmp,
+                 .msip     = (uint32_t)msip,
+                 .ier      = uart.ier,
+                 .fcr      = uart.fcr,
+                 .lcr      = uart.lcr,
+                 .mcr      = uart.mcr,
+                 .scr      = uart.scr,
+                 .dll      = uart.dll,
+                 .dlm      = uart.dlm,
+                 .padding  = {},
+                 .input    = uart.input.size(),
+             });
+    out.write(reinterpret_cast<const char*>(uart.input.data()),
+              (std::streamsize)uart.input.size());
+    for (auto page : pages) {
+        auto offset = page << PageShift;
+        auto bytes  = std::min<uint64_t>(PageSize, size - offset);
+        if (isZero(memory + offset, bytes)) {
+            put(out, page | ZeroPage);
+            continue;
+        }
+        put(out, page);
+        out.write(reinterpret_cast<const char*>(memory + offset),
+                  (std::streamsize)bytes);
+    }
+    if (!out) {
+        throw CheckpointError("checkpoint: write failed");
+    }
+
+    for (uint64_t page = 0; page < mmu.codePages.size(); page++) {
+        std::atomic_ref(mmu.codePages[page]).fetch_or(MMU::CleanFlag);
+    }
+    ctx.checkpoints++;
+    return pages.size();
+}
+
+/// @brief Restore a hart from the records of in. The restored context
+/// continues the history of the last record applied, its pages are clean
+/// and its next checkpoint only saves the pages stored to after it.
+/// @param in
+/// @param records
+/// @return CPU
+auto Checkpoint::read(std::istream& in, size_t records) -> CPU {
+    RecordHeader header{};
+    get(in, header);
+    if (header.magic != Magic || header.version != Version) {
+        throw CheckpointError("checkpoint: not a checkpoint of this version");
+    }
+    if ((header.flags & InitialRecord) == 0) {
+        throw CheckpointError("checkpoint: missing initial record");
+    }
+    auto ctx      = VMContext(header.memorySize);
+    ctx.codeSize  = header.codeSize;
+    ctx.entry     = header.entry;
+    ctx.imageSize = header.imageSize;
+    auto cpu      = CPU(std::move(ctx));
+    auto& mmu     = cpu.ctx->mmu;
+    auto size     = mmu.memory.size();
+
+    for (size_t record = 0; record < std::max<size_t>(records, 1); record++) {
+        if (record != 0) {
+            if (in.peek() == std::istream::traits_type::eof()) {
+                break;
+            }
+            get(in, header);
+            if (header.magic != Magic || header.version != Version ||
+                (header.flags & InitialRecord) != 0 ||
+                header.memorySize != size) {
+                throw CheckpointError("checkpoint: unexpected record");
+            }
+        }
+        HartState hart{};
+        get(in, hart);
+        cpu.pc                = hart.pc;
+        cpu.registers         = hart.registers;
+        cpu.fregisters        = hart.fregisters;
+        cpu.vregisters        = hart.vregisters;
+        cpu.csrs.values       = hart.csrs;
+        cpu.instret           = hart.instret;
+        cpu.cycleOffset       = hart.cycleOffset;
+        cpu.instretOffset     = hart.instretOffset;
+        cpu.reservation.addr  = hart.reservationAddr;
+        cpu.reservation.value = hart.reservationValue;
+        cpu.reservation.valid = hart.reservationValid != 0;
+        cpu.privilege         = (Privilege)hart.privilege;
+
+        DeviceState devices{};
+        get(in, devices);
+        auto uart = Uart::State{
+            .ier   = devices.ier,
+            .fcr   = devices.fcr,
+            .lcr   = devices.lcr,
+            .mcr   = devices.mcr,
+            .scr   = devices.scr,
+            .dll   = devices.dll,
+            .dlm   = devices.dlm,
+            .input = {},
+        };
+        for (uint64_t i = 0; i < devices.input; i++) {
+            uint8_t byte = 0;
+            get(in, byte);
+            uart.input.push_back(byte);
+        }
+        auto id = cpu.csrs.load(MHartID);
+        cpu.ctx->clint->write(Clint::MTime, 8, devices.mtime);
+        cpu.ctx->clint->write(Clint::MTimeCmp + id * 8, 8, devices.mtimecmp);
+        cpu.ctx->clint->write(Clint::MSip + id * 4, 4, devices.msip);
+        cpu.ctx->uart->restore(uart);
+
+        for (uint64_t i = 0; i < header.pages; i++) {
+            uint64_t entry = 0;
+            get(in, entry);
+            auto page = entry & ~ZeroPage;
+            if (page >= mmu.codePages.size()) {
+                throw CheckpointError("checkpoint: page outside of memory");
+            }
+            auto offset = page << PageShift;
+            auto bytes  = std::min<uint64_t>(PageSize, size - offset);
+            auto* data  = mmu.memory.data() + offset;
+            if ((entry & ZeroPage) != 0) {
+                std::memset(data, 0, bytes);
+            } else if (!in.read(reinterpret_cast<char*>(data),
+                                (std::streamsize)bytes)) {
+                throw CheckpointError("checkpoint: truncated record");
+            }
+        }
+        cpu.ctx->checkpoints++;
+    }
+
+    for (uint64_t page = 0; page < mmu.codePages.size(); page++) {
+        mmu.codePages[page] = MMU::CleanFlag;
+    }
+    cpu.updatePaging();
+    return cpu;
+}
+
+/// @brief Returns true if the file at path starts with the checkpoint
+/// magic.
+/// @param path
+/// @return bool
+auto isCheckpoint(const std::string& path) -> bool {
+    auto file      = std::ifstream(path, std::ios::binary);
+    uint64_t magic = 0;
+    return file.read(reinterpret_cast<char*>(&magic), sizeof(magic)) &&
+           magic == Checkpoint::Magic;
+}
+
+} // namespace riscvemu
@@ -0,0 +1,104 @@
+#include "Conformance.h"
+#include "Elf.h"
+#include "Machine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace riscvemu {
+
+//=== ConformanceRunner Methods Implementations ====//
+
+ConformanceRunner::ConformanceRunner(ConformanceOptions options)
+    : options(options) {
+    if (this->options.threads == 0) {
+        this->options.threads =
+            std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    this->options.slice = std::max<uint64_t>(this->options.slice, 1);
+}
+
+/// @brief Run every program on every engine, the workers (the calling
+/// thread included) take the next run from a shared counter since run
+/// times vary by orders of magnitude between programs.
+/// @param paths
+/// @param engines
+/// @return Results ordered by program, then by engine.
+auto ConformanceRunner::run(const std::vector<std::string>& paths,
+                            const std::vector<Engine>& engines)
+    -> std::vector<ConformanceResult> {
+    std::vector<ConformanceResult> results(paths.size() * engines.size());
+    std::atomic<size_t> next = 0;
+    auto work                = [&]() {
+        for (auto item = next++; item < results.size(); item = next++) {
+            results[item] = runOne(paths[item / engines.size()],
+                                   engines[item % engines.size()]);
+        }
+    };
+    auto count = std::min(this->options.threads,
+                          std::max<size_t>(results.size(), 1));
+    std::vector<std::thread> threads;
+    for (size_t id = 1; id < count; id++) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return results;
+}
+
+/// @brief Run a program in steps of slice instructions until it writes to
+/// tohost, stops or reaches the instruction limit.
+/// @param path
+/// @param engine
+/// @return ConformanceResult
+auto ConformanceRunner::runOne(const std::string& path, Engine engine) const
+    -> ConformanceResult {
+    ConformanceResult result;
+    result.path   = path;
+    result.engine = engine;
+    try {
+        uint64_t tohost = 0;
+        if (!findElfSymbol(path, "tohost", tohost)) {
+            throw ElfError(path + ": no tohost symbol");
+        }
+        auto cpu = CPU(VMContext::fromElf(path, this->options.memorySize));
+
+        auto start = std::chrono::steady_clock::now();
+        result.status = ConformanceStatus::Timeout;
+        while (result.instructions < this->options.limit) {
+            auto step = cpu.step(
+                engine, std::min(this->options.slice,
+                                 this->options.limit - result.instructions));
+            result.instructions += step.retired;
+            auto value = cpu.load<uint64_t>(tohost);
+            if (value != 0) {
+                result.status = value == 1 ? ConformanceStatus::Pass
+                                           : ConformanceStatus::Fail;
+                result.test   = value >> 1;
+                break;
+            }
+            if (step.status != RunStatus::Budget) {
+                result.status = ConformanceStatus::Stopped;
+                break;
+            }
+        }
+        result.seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    } catch (std::exception& e) {
+        result.status = ConformanceStatus::Error;
+        result.error  = e.what();
+    }
+    return result;
+}
+
+} // namespace riscvemu
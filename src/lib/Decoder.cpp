@@ -0,0 +1,1135 @@
+#include "Decoder.h"
+#include "Instructions.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace riscvemu {
+
+/// @brief Resolve the mnemonic of a BRANCH group instruction.
+static auto branchMnemonic(uint32_t funct3) -> Mnemonic {
+    switch (funct3) {
+    case 0b000:
+        return Mnemonic::BEQ;
+    case 0b001:
+        return Mnemonic::BNE;
+    case 0b100:
+        return Mnemonic::BLT;
+    case 0b101:
+        return Mnemonic::BGE;
+    case 0b110:
+        return Mnemonic::BLTU;
+    case 0b111:
+        return Mnemonic::BGEU;
+    default:
+        return Mnemonic::ILLEGAL;
+    }
+}
+
+/// @brief Resolve the mnemonic of a LOAD group instruction.
+static auto loadMnemonic(uint32_t funct3) -> Mnemonic {
+    switch (funct3) {
+    case 0b000:
+        return Mnemonic::LB;
+    case 0b001:
+        return Mnemonic::LH;
+    case 0b010:
+        return Mnemonic::LW;
+    case 0b011:
+        return Mnemonic::LD;
+    case 0b100:
+        return Mnemonic::LBU;
+    case 0b101:
+        return Mnemonic::LHU;
+    case 0b110:
+        return Mnemonic::LWU;
+    default:
+        return Mnemonic::ILLEGAL;
+    }
+}
+
+/// @brief Resolve the mnemonic of a STORE group instruction.
+static auto storeMnemonic(uint32_t funct3) -> Mnemonic {
+    switch (funct3) {
+    case 0b000:
+        return Mnemonic::SB;
+    case 0b001:
+        return Mnemonic::SH;
+    case 0b010:
+        return Mnemonic::SW;
+    case 0b011:
+        return Mnemonic::SD;
+    default:
+        return Mnemonic::ILLEGAL;
+    }
+}
+
+/// @brief Resolve the mnemonic of an ARITHI group instruction, shifts
+/// are distinguished by the upper six bits (funct6) since RV64I uses six
+/// bit shift amounts.
+static auto arithiMnemonic(uint32_t funct3, uint32_t funct6) -> Mnemonic {
+    switch (funct3) {
+    case 0b000:
+        return Mnemonic::ADDI;
+    case 0b010:
+        return Mnemonic::SLTI;
+    case 0b011:
+        return Mnemonic::SLTIU;
+    case 0b100:
+        return Mnemonic::XORI;
+    case 0b110:
+        return Mnemonic::ORI;
+    case 0b111:
+        return Mnemonic::ANDI;
+    case 0b001:
+        return funct6 == 0x00 ? Mnemonic::SLLI : Mnemonic::ILLEGAL;
+    case 0b101:
+        if (funct6 == 0x00) {
+            return Mnemonic::SRLI;
+        }
+        if (funct6 == 0x10) {
+            return Mnemonic::SRAI;
+        }
+        return Mnemonic::ILLEGAL;
+    default:
+        return Mnemonic::ILLEGAL;
+    }
+}
+
+/// @brief Resolve the mnemonic of an ARITHIW group instruction.
+static auto arithiwMnemonic(uint32_t funct3, uint32_t funct7) -> Mnemonic {
+    switch (funct3) {
+    case 0b000:
+        return Mnemonic::ADDIW;
+    case 0b001:
+        return funct7 == 0x00 ? Mnemonic::SLLIW : Mnemonic::ILLEGAL;
+    case 0b101:
+        if (funct7 == 0x00) {
+            return Mnemonic::SRLIW;
+        }
+        if (funct7 == 0x20) {
+            return Mnemonic::SRAIW;
+        }
+        return Mnemonic::ILLEGAL;
+    default:
+        return Mnemonic::ILLEGAL;
+    }
+}
+
+/// @brief Resolve the mnemonic of an ARITHR group instruction.
+static auto arithrMnemonic(uint32_t funct3, uint32_t funct7) -> Mnemonic {
+    if (funct7 == 0x00) {
+        switch (funct3) {
+        case 0b000:
+            return Mnemonic::ADD;
+        case 0b001:
+            return Mnemonic::SLL;
+        case 0b010:
+            return Mnemonic::SLT;
+        case 0b011:
+            return Mnemonic::SLTU;
+        case 0b100:
+            return Mnemonic::XOR;
+        case 0b101:
+            return Mnemonic::SRL;
+        case 0b110:
+            return Mnemonic::OR;
+        case 0b111:
+            return Mnemonic::AND;
+        default:
+            return Mnemonic::ILLEGAL;
+        }
+    }
+    if (funct7 == 0x20) {
+        if (funct3 == 0b000) {
+            return Mnemonic::SUB;
+        }
+        if (funct3 == 0b101) {
+            return Mnemonic::SRA;
+        }
+    }
+    // Multiplications and divisions (RV64M), in funct3 order from MUL.
+    if (funct7 == 0x01) {
+        return (Mnemonic)((uint32_t)Mnemonic::MUL + funct3);
+    }
+    return Mnemonic::ILLEGAL;
+}
+
+/// @brief Resolve the mnemonic of an ARITHRW group instruction.
+static auto arithrwMnemonic(uint32_t funct3, uint32_t funct7) -> Mnemonic {
+    if (funct7 == 0x00) {
+        switch (funct3) {
+        case 0b000:
+            return Mnemonic::ADDW;
+        case 0b001:
+            return Mnemonic::SLLW;
+        case 0b101:
+            return Mnemonic::SRLW;
+        default:
+            return Mnemonic::ILLEGAL;
+        }
+    }
+    if (funct7 == 0x20) {
+        if (funct3 == 0b000) {
+            return Mnemonic::SUBW;
+        }
+        if (funct3 == 0b101) {
+            return Mnemonic::SRAW;
+        }
+    }
+    if (funct7 == 0x01) {
+        switch (funct3) {
+        case 0b000:
+            return Mnemonic::MULW;
+        case 0b100:
+            return Mnemonic::DIVW;
+        case 0b101:
+            return Mnemonic::DIVUW;
+        case 0b110:
+            return Mnemonic::REMW;
+        case 0b111:
+            return Mnemonic::REMUW;
+        default:
+            return Mnemonic::ILLEGAL;
+        }
+    }
+    return Mnemonic::ILLEGAL;
+}
+
+/// @brief Resolve the mnemonic of a CSR (SYSTEM) group instruction.
+static auto systemMnemonic(uint32_t funct3, uint32_t imm) -> Mnemonic {
+    switch (funct3) {
+    case 0b000:
+        if (imm == 0) {
+            return Mnemonic::ECALL;
+        }
+        if (imm == 1) {
+            return Mnemonic::EBREAK;
+        }
+        if (imm == 0x302) {
+            return Mnemonic::MRET;
+        }
+        if (imm == 0x102) {
+            return Mnemonic::SRET;
+        }
+        if (imm == 0x105) {
+            return Mnemonic::WFI;
+        }
+        // SFENCE.VMA rs1, rs2 has funct7 0b0001001.
+        if ((imm >> 5) == 0b0001001) {
+            return Mnemonic::SFENCE_VMA;
+        }
+        return Mnemonic::ILLEGAL;
+    case 0b001:
+        return Mnemonic::CSRRW;
+    case 0b010:
+        return Mnemonic::CSRRS;
+    case 0b011:
+        return Mnemonic::CSRRC;
+    case 0b101:
+        return Mnemonic::CSRRWI;
+    case 0b110:
+        return Mnemonic::CSRRSI;
+    case 0b111:
+        return Mnemonic::CSRRCI;
+    default:
+        return Mnemonic::ILLEGAL;
+    }
+}
+
+/// @brief Resolve the mnemonic of an AMO group instruction, the W and D
+/// variants of an operation are consecutive mnemonics.
+static auto amoMnemonic(uint32_t funct3, uint32_t funct5, uint32_t rs2)
+    -> Mnemonic {
+    if (funct3 != 0b010 && funct3 != 0b011) {
+        return Mnemonic::ILLEGAL;
+    }
+    auto op = Mnemonic::ILLEGAL;
+    switch (funct5) {
+    case 0b00010:
+        op = rs2 == 0 ? Mnemonic::LR_W : Mnemonic::ILLEGAL;
+        break;
+    case 0b00011:
+        op = Mnemonic::SC_W;
+        break;
+    case 0b00001:
+        op = Mnemonic::AMOSWAP_W;
+        break;
+    case 0b00000:
+        op = Mnemonic::AMOADD_W;
+        break;
+    case 0b00100:
+        op = Mnemonic::AMOXOR_W;
+        break;
+    case 0b01100:
+        op = Mnemonic::AMOAND_W;
+        break;
+    case 0b01000:
+        op = Mnemonic::AMOOR_W;
+        break;
+    case 0b10000:
+        op = Mnemonic::AMOMIN_W;
+        break;
+    case 0b10100:
+        op = Mnemonic::AMOMAX_W;
+        break;
+    case 0b11000:
+        op = Mnemonic::AMOMINU_W;
+        break;
+    case 0b11100:
+        op = Mnemonic::AMOMAXU_W;
+        break;
+    default:
+        return Mnemonic::ILLEGAL;
+    }
+    if (op == Mnemonic::ILLEGAL || funct3 == 0b010) {
+        return op;
+    }
+    return Mnemonic((uint8_t)op + ((uint8_t)Mnemonic::LR_D -
+                                   (uint8_t)Mnemonic::LR_W));
+}
+
+/// @brief Select the single or double precision mnemonic following the
+/// fmt field of a floating point instruction.
+static auto precision(uint32_t fmt, Mnemonic single, Mnemonic dbl)
+    -> Mnemonic {
+    switch (fmt) {
+    case 0b00:
+        return single;
+    case 0b01:
+        return dbl;
+    default:
+        return Mnemonic::ILLEGAL;
+    }
+}
+
+/// @brief Resolve the mnemonic of a fused multiply-add instruction.
+static auto fmaMnemonic(OPCode opcode, uint32_t fmt) -> Mnemonic {
+    switch (opcode) {
+    case OPCode::FMADD:
+        return precision(fmt, Mnemonic::FMADD_S, Mnemonic::FMADD_D);
+    case OPCode::FMSUB:
+        return precision(fmt, Mnemonic::FMSUB_S, Mnemonic::FMSUB_D);
+    case OPCode::FNMSUB:
+        return precision(fmt, Mnemonic::FNMSUB_S, Mnemonic::FNMSUB_D);
+    default:
+        return precision(fmt, Mnemonic::FNMADD_S, Mnemonic::FNMADD_D);
+    }
+}
+
+/// @brief Resolve the mnemonic of an ARITHF group instruction, funct7
+/// holds the operation in bits 6-2 and fmt in bits 1-0. rs2 selects the
+/// conversions and funct3 the operations that don't round.
+static auto arithfMnemonic(uint32_t funct7, uint32_t rs2, uint32_t funct3)
+    -> Mnemonic {
+    auto fmt = funct7 & 0b11;
+    switch (funct7 >> 2) {
+    case 0b00000:
+        return precision(fmt, Mnemonic::FADD_S, Mnemonic::FADD_D);
+    case 0b00001:
+        return precision(fmt, Mnemonic::FSUB_S, Mnemonic::FSUB_D);
+    case 0b00010:
+        return precision(fmt, Mnemonic::FMUL_S, Mnemonic::FMUL_D);
+    case 0b00011:
+        return precision(fmt, Mnemonic::FDIV_S, Mnemonic::FDIV_D);
+    case 0b01011:
+        return rs2 == 0 ? precision(fmt, Mnemonic::FSQRT_S, Mnemonic::FSQRT_D)
+                        : Mnemonic::ILLEGAL;
+    case 0b00100:
+        switch (funct3) {
+        case 0b000:
+            return precision(fmt, Mnemonic::FSGNJ_S, Mnemonic::FSGNJ_D);
+        case 0b001:
+            return precision(fmt, Mnemonic::FSGNJN_S, Mnemonic::FSGNJN_D);
+        case 0b010:
+            return precision(fmt, Mnemonic::FSGNJX_S, Mnemonic::FSGNJX_D);
+        default:
+            return Mnemonic::ILLEGAL;
+        }
+    case 0b00101:
+        switch (funct3) {
+        case 0b000:
+            return precision(fmt, Mnemonic::FMIN_S, Mnemonic::FMIN_D);
+        case 0b001:
+            return precision(fmt, Mnemonic::FMAX_S, Mnemonic::FMAX_D);
+        default:
+            return Mnemonic::ILLEGAL;
+        }
+    case 0b01000:
+        // Conversions between precisions, rs2 is the source fmt.
+        if (fmt == 0b00 && rs2 == 0b01) {
+            return Mnemonic::FCVT_S_D;
+        }
+        if (fmt == 0b01 && rs2 == 0b00) {
+            return Mnemonic::FCVT_D_S;
+        }
+        return Mnemonic::ILLEGAL;
+    case 0b10100:
+        switch (funct3) {
+        case 0b000:
+            return precision(fmt, Mnemonic::FLE_S, Mnemonic::FLE_D);
+        case 0b001:
+            return precision(fmt, Mnemonic::FLT_S, Mnemonic::FLT_D);
+        case 0b010:
+            return precision(fmt, Mnemonic::FEQ_S, Mnemonic::FEQ_D);
+        default:
+            return Mnemonic::ILLEGAL;
+        }
+    case 0b11000:
+        // Conversions to W, WU, L and LU, in mnemonic order.
+        if (rs2 > 0b11) {
+            return Mnemonic::ILLEGAL;
+        }
+        return (Mnemonic)((uint32_t)precision(fmt, Mnemonic::FCVT_W_S,
+                                              Mnemonic::FCVT_W_D) +
+                          rs2);
+    case 0b11010:
+        // Conversions from W, WU, L and LU.
+        if (rs2 > 0b11) {
+            return Mnemonic::ILLEGAL;
+        }
+        return (Mnemonic)((uint32_t)precision(fmt, Mnemonic::FCVT_S_W,
+                                              Mnemonic::FCVT_D_W) +
+                          rs2);
+    case 0b11100:
+        if (rs2 != 0) {
+            return Mnemonic::ILLEGAL;
+        }
+        if (funct3 == 0b000) {
+            return precision(fmt, Mnemonic::FMV_X_W, Mnemonic::FMV_X_D);
+        }
+        if (funct3 == 0b001) {
+            return precision(fmt, Mnemonic::FCLASS_S, Mnemonic::FCLASS_D);
+        }
+        return Mnemonic::ILLEGAL;
+    case 0b11110:
+        return rs2 == 0 && funct3 == 0b000
+                   ? precision(fmt, Mnemonic::FMV_W_X, Mnemonic::FMV_D_X)
+                   : Mnemonic::ILLEGAL;
+    default:
+        return Mnemonic::ILLEGAL;
+    }
+}
+
+/// @brief Returns true if the width field of a LOADFP or STOREFP
+/// instruction is a vector element width.
+static auto isVectorWidth(uint32_t funct3) -> bool {
+    return funct3 == 0b000 || funct3 >= 0b101;
+}
+
+/// @brief Resolve the mnemonic of a vector load or store, only unit-stride
+/// and strided accesses to a single register group are implemented
+/// (nf = 0, mew = 0, plain unit-stride lumop).
+static auto vectorMemoryMnemonic(uint32_t instruction, Mnemonic unit,
+                                 Mnemonic strided) -> Mnemonic {
+    if ((instruction >> 28) != 0) {
+        return Mnemonic::ILLEGAL;
+    }
+    switch ((instruction >> 26) & 0b11) {
+    case 0b00:
+        return ((instruction >> 20) & 0b11111) == 0 ? unit : Mnemonic::ILLEGAL;
+    case 0b10:
+        return strided;
+    default:
+        return Mnemonic::ILLEGAL;
+    }
+}
+
+/// @brief Resolve the mnemonic of an OPV group instruction from funct6 and
+/// the operand kind in funct3, operations only exist in some of the
+/// operand kinds. vm is bit 25 and must be set by the moves, vmerge with
+/// vm set is vmv.v.
+static auto vectorMnemonic(uint32_t instruction) -> Mnemonic {
+    // Operand kinds an operation exists in, as a mask of funct3 bits.
+    constexpr uint32_t VV = 1 << (uint32_t)VectorOperands::IVV |
+                            1 << (uint32_t)VectorOperands::MVV |
+                            1 << (uint32_t)VectorOperands::FVV;
+    constexpr uint32_t VX = 1 << (uint32_t)VectorOperands::IVX |
+                            1 << (uint32_t)VectorOperands::MVX |
+                            1 << (uint32_t)VectorOperands::FVF;
+    constexpr uint32_t VI = 1 << (uint32_t)VectorOperands::IVI;
+
+    auto funct3 = (instruction >> 12) & 0b111;
+    auto funct6 = instruction >> 26;
+    auto vm     = ((instruction >> 25) & 1) != 0;
+    auto rs1    = (instruction >> 15) & 0b11111;
+    auto rs2    = (instruction >> 20) & 0b11111;
+    auto op     = Mnemonic::ILLEGAL;
+    uint32_t kinds = 0;
+    switch ((VectorOperands)funct3) {
+    case VectorOperands::CFG:
+        if ((instruction >> 31) == 0) {
+            return Mnemonic::VSETVLI;
+        }
+        if ((instruction >> 30) == 0b11) {
+            return Mnemonic::VSETIVLI;
+        }
+        return ((instruction >> 25) & 0b111111) == 0 ? Mnemonic::VSETVL
+                                                     : Mnemonic::ILLEGAL;
+    case VectorOperands::IVV:
+    case VectorOperands::IVX:
+    case VectorOperands::IVI:
+        switch (funct6) {
+        case 0b000000:
+            op    = Mnemonic::VADD;
+            kinds = VV | VX | VI;
+            break;
+        case 0b000010:
+            op    = Mnemonic::VSUB;
+            kinds = VV | VX;
+            break;
+        case 0b000011:
+            op    = Mnemonic::VRSUB;
+            kinds = VX | VI;
+            break;
+        case 0b000100:
+            op    = Mnemonic::VMINU;
+            kinds = VV | VX;
+            break;
+        case 0b000101:
+            op    = Mnemonic::VMIN;
+            kinds = VV | VX;
+            break;
+        case 0b000110:
+            op    = Mnemonic::VMAXU;
+            kinds = VV | VX;
+            break;
+        case 0b000111:
+            op    = Mnemonic::VMAX;
+            kinds = VV | VX;
+            break;
+        case 0b001001:
+            op    = Mnemonic::VAND;
+            kinds = VV | VX | VI;
+            break;
+        case 0b001010:
+            op    = Mnemonic::VOR;
+            kinds = VV | VX | VI;
+            break;
+        case 0b001011:
+            op    = Mnemonic::VXOR;
+            kinds = VV | VX | VI;
+            break;
+        case 0b010111:
+            op    = !vm || rs2 == 0 ? Mnemonic::VMERGE : Mnemonic::ILLEGAL;
+            kinds = VV | VX | VI;
+            break;
+        case 0b011000:
+            op    = Mnemonic::VMSEQ;
+            kinds = VV | VX | VI;
+            break;
+        case 0b011001:
+            op    = Mnemonic::VMSNE;
+            kinds = VV | VX | VI;
+            break;
+        case 0b011010:
+            op    = Mnemonic::VMSLTU;
+            kinds = VV | VX;
+            break;
+        case 0b011011:
+            op    = Mnemonic::VMSLT;
+            kinds = VV | VX;
+            break;
+        case 0b011100:
+            op    = Mnemonic::VMSLEU;
+            kinds = VV | VX | VI;
+            break;
+        case 0b011101:
+            op    = Mnemonic::VMSLE;
+            kinds = VV | VX | VI;
+            break;
+        case 0b011110:
+            op    = Mnemonic::VMSGTU;
+            kinds = VX | VI;
+            break;
+        case 0b011111:
+            op    = Mnemonic::VMSGT;
+            kinds = VX | VI;
+            break;
+        case 0b100101:
+            op    = Mnemonic::VSLL;
+            kinds = VV | VX | VI;
+            break;
+        case 0b101000:
+            op    = Mnemonic::VSRL;
+            kinds = VV | VX | VI;
+            break;
+        case 0b101001:
+            op    = Mnemonic::VSRA;
+            kinds = VV | VX | VI;
+            break;
+        default:
+            break;
+        }
+        break;
+    case VectorOperands::MVV:
+    case VectorOperands::MVX:
+        switch (funct6) {
+        case 0b000000:
+            op    = Mnemonic::VREDSUM;
+            kinds = VV;
+            break;
+        case 0b010000:
+            // VWXUNARY0 and VRXUNARY0, the other operand field is zero.
+            if (vm && funct3 == (uint32_t)VectorOperands::MVV && rs1 == 0) {
+                return Mnemonic::VMV_X_S;
+            }
+            if (vm && funct3 == (uint32_t)VectorOperands::MVX && rs2 == 0) {
+                return Mnemonic::VMV_S_X;
+            }
+            return Mnemonic::ILLEGAL;
+        case 0b100101:
+            op    = Mnemonic::VMUL;
+            kinds = VV | VX;
+            break;
+        case 0b101101:
+            op    = Mnemonic::VMACC;
+            kinds = VV | VX;
+            break;
+        default:
+            break;
+        }
+        break;
+    case VectorOperands::FVV:
+    case VectorOperands::FVF:
+        switch (funct6) {
+        case 0b000000:
+            op    = Mnemonic::VFADD;
+            kinds = VV | VX;
+            break;
+        case 0b000001:
+            op    = Mnemonic::VFREDUSUM;
+            kinds = VV;
+            break;
+        case 0b000010:
+            op    = Mnemonic::VFSUB;
+            kinds = VV | VX;
+            break;
+        case 0b010000:
+            // VWFUNARY0 and VRFUNARY0, the other operand field is zero.
+            if (vm && funct3 == (uint32_t)VectorOperands::FVV && rs1 == 0) {
+                return Mnemonic::VFMV_F_S;
+            }
+            if (vm && funct3 == (uint32_t)VectorOperands::FVF && rs2 == 0) {
+                return Mnemonic::VFMV_S_F;
+            }
+            return Mnemonic::ILLEGAL;
+        case 0b010111:
+            op    = !vm || rs2 == 0 ? Mnemonic::VFMERGE : Mnemonic::ILLEGAL;
+            kinds = VX;
+            break;
+        case 0b100000:
+            op    = Mnemonic::VFDIV;
+            kinds = VV | VX;
+            break;
+        case 0b100100:
+            op    = Mnemonic::VFMUL;
+            kinds = VV | VX;
+            break;
+        case 0b101100:
+            op    = Mnemonic::VFMACC;
+            kinds = VV | VX;
+            break;
+        default:
+            break;
+        }
+        break;
+    }
+    return (kinds & (1 << funct3)) != 0 ? op : Mnemonic::ILLEGAL;
+}
+
+/// @brief Decode a 32-bit instruction, see predecode.
+static auto decodeStandard(uint32_t instruction) -> DecodedInstruction {
+    DecodedInstruction decoded;
+    decoded.raw    = instruction;
+    decoded.funct3 = (instruction >> 12) & 0b111;
+    decoded.funct7 = (instruction >> 25) & 0b1111111;
+
+    switch (OPCode(instruction & OPCodeMask)) {
+    case OPCode::LUI:
+    case OPCode::AUIPC: {
+        auto inst        = Utype(instruction);
+        decoded.mnemonic = OPCode(instruction & OPCodeMask) == OPCode::LUI
+                               ? Mnemonic::LUI
+                               : Mnemonic::AUIPC;
+        decoded.rd       = (uint8_t)inst.Rd;
+        decoded.imm      = inst.Imm;
+        break;
+    }
+    case OPCode::JAL: {
+        auto inst        = Jtype(instruction);
+        decoded.mnemonic = Mnemonic::JAL;
+        decoded.rd       = (uint8_t)inst.Rd;
+        decoded.imm      = inst.Imm;
+        break;
+    }
+    case OPCode::JALR: {
+        auto inst        = Itype(instruction);
+        decoded.mnemonic = inst.Funct3 == 0 ? Mnemonic::JALR : Mnemonic::ILLEGAL;
+        decoded.rd       = (uint8_t)inst.Rd;
+        decoded.rs1      = (uint8_t)inst.Rs1;
+        decoded.imm      = inst.Imm;
+        break;
+    }
+    case OPCode::BRANCH: {
+        auto inst        = Btype(instruction);
+        decoded.mnemonic = branchMnemonic(inst.Funct3);
+        decoded.rs1      = (uint8_t)inst.Rs1;
+        decoded.rs2      = (uint8_t)inst.Rs2;
+        decoded.imm      = inst.Imm;
+        break;
+    }
+    case OPCode::LOAD: {
+        auto inst        = Itype(instruction);
+        decoded.mnemonic = loadMnemonic(inst.Funct3);
+        decoded.rd       = (uint8_t)inst.Rd;
+        decoded.rs1      = (uint8_t)inst.Rs1;
+        decoded.imm      = inst.Imm;
+        break;
+    }
+    case OPCode::STORE: {
+        auto inst        = Stype(instruction);
+        decoded.mnemonic = storeMnemonic(inst.Funct3);
+        decoded.rs1      = (uint8_t)inst.Rs1;
+        decoded.rs2      = (uint8_t)inst.Rs2;
+        decoded.imm      = inst.Imm;
+        break;
+    }
+    case OPCode::ARITHI: {
+        auto inst        = Itype(instruction);
+        decoded.mnemonic = arithiMnemonic(inst.Funct3, instruction >> 26);
+        decoded.rd       = (uint8_t)inst.Rd;
+        decoded.rs1      = (uint8_t)inst.Rs1;
+        decoded.imm      = inst.Imm;
+        break;
+    }
+    case OPCode::ARITHIW: {
+        auto inst        = Itype(instruction);
+        decoded.mnemonic = arithiwMnemonic(inst.Funct3, decoded.funct7);
+        decoded.rd       = (uint8_t)inst.Rd;
+        decoded.rs1      = (uint8_t)inst.Rs1;
+        decoded.imm      = inst.Imm;
+        break;
+    }
+    case OPCode::ARITHR: {
+        auto inst        = Rtype(instruction);
+        decoded.mnemonic = arithrMnemonic(inst.Funct3, inst.Funct7);
+        decoded.rd       = (uint8_t)inst.Rd;
+        decoded.rs1      = (uint8_t)inst.Rs1;
+        decoded.rs2      = (uint8_t)inst.Rs2;
+        break;
+    }
+    case OPCode::ARITHRW: {
+        auto inst        = Rtype(instruction);
+        decoded.mnemonic = arithrwMnemonic(inst.Funct3, inst.Funct7);
+        decoded.rd       = (uint8_t)inst.Rd;
+        decoded.rs1      = (uint8_t)inst.Rs1;
+        decoded.rs2      = (uint8_t)inst.Rs2;
+        break;
+    }
+    case OPCode::FENCE: {
+        // Operands of FENCE (predecessor and successor sets) are ignored,
+        // every fence orders all memory accesses.
+        decoded.mnemonic = decoded.funct3 == 0b000   ? Mnemonic::FENCE
+                           : decoded.funct3 == 0b001 ? Mnemonic::FENCE_I
+                                                     : Mnemonic::ILLEGAL;
+        break;
+    }
+    case OPCode::AMO: {
+        // The aq and rl bits are ignored, atomics are sequentially
+        // consistent.
+        auto inst        = Rtype(instruction);
+        decoded.mnemonic = amoMnemonic(inst.Funct3, instruction >> 27,
+                                       (uint32_t)inst.Rs2);
+        decoded.rd       = (uint8_t)inst.Rd;
+        decoded.rs1      = (uint8_t)inst.Rs1;
+        decoded.rs2      = (uint8_t)inst.Rs2;
+        break;
+    }
+    case OPCode::LOADFP: {
+        if (isVectorWidth(decoded.funct3)) {
+            // rs2 is the stride register of strided loads.
+            decoded.mnemonic = vectorMemoryMnemonic(
+                instruction, Mnemonic::VLE, Mnemonic::VLSE);
+            decoded.rd  = (instruction >> 7) & 0b11111;
+            decoded.rs1 = (instruction >> 15) & 0b11111;
+            decoded.rs2 = (instruction >> 20) & 0b11111;
+            break;
+        }
+        auto inst        = Itype(instruction);
+        decoded.mnemonic = inst.Funct3 == 0b010   ? Mnemonic::FLW
+                           : inst.Funct3 == 0b011 ? Mnemonic::FLD
+                                                  : Mnemonic::ILLEGAL;
+        decoded.rd       = (uint8_t)inst.Rd;
+        decoded.rs1      = (uint8_t)inst.Rs1;
+        decoded.imm      = inst.Imm;
+        break;
+    }
+    case OPCode::STOREFP: {
+        if (isVectorWidth(decoded.funct3)) {
+            // The stored register group is held in the rd field.
+            decoded.mnemonic = vectorMemoryMnemonic(
+                instruction, Mnemonic::VSE, Mnemonic::VSSE);
+            decoded.rd  = (instruction >> 7) & 0b11111;
+            decoded.rs1 = (instruction >> 15) & 0b11111;
+            decoded.rs2 = (instruction >> 20) & 0b11111;
+            break;
+        }
+        auto inst        = Stype(instruction);
+        decoded.mnemonic = inst.Funct3 == 0b010   ? Mnemonic::FSW
+                           : inst.Funct3 == 0b011 ? Mnemonic::FSD
+                                                  : Mnemonic::ILLEGAL;
+        decoded.rs1      = (uint8_t)inst.Rs1;
+        decoded.rs2      = (uint8_t)inst.Rs2;
+        decoded.imm      = inst.Imm;
+        break;
+    }
+    case OPCode::FMADD:
+    case OPCode::FMSUB:
+    case OPCode::FNMSUB:
+    case OPCode::FNMADD: {
+        // R4-type, rs3 is held in bits 6-2 of funct7 and fmt in bits 1-0,
+        // funct3 is the rounding mode.
+        auto inst        = Rtype(instruction);
+        decoded.mnemonic = fmaMnemonic(OPCode(instruction & OPCodeMask),
+                                       inst.Funct7 & 0b11);
+        decoded.rd       = (uint8_t)inst.Rd;
+        decoded.rs1      = (uint8_t)inst.Rs1;
+        decoded.rs2      = (uint8_t)inst.Rs2;
+        break;
+    }
+    case OPCode::ARITHF: {
+        // funct3 is the rounding mode of the operations that round.
+        auto inst        = Rtype(instruction);
+        decoded.mnemonic = arithfMnemonic(inst.Funct7, (uint32_t)inst.Rs2,
+                                          inst.Funct3);
+        decoded.rd       = (uint8_t)inst.Rd;
+        decoded.rs1      = (uint8_t)inst.Rs1;
+        decoded.rs2      = (uint8_t)inst.Rs2;
+        break;
+    }
+    case OPCode::OPV: {
+        // vm is bit 0 of funct7. The immediate is the vtype of vsetvli and
+        // vsetivli, and the sign extended rs1 field of OPIVI instructions.
+        decoded.mnemonic = vectorMnemonic(instruction);
+        decoded.rd       = (instruction >> 7) & 0b11111;
+        decoded.rs1      = (instruction >> 15) & 0b11111;
+        decoded.rs2      = (instruction >> 20) & 0b11111;
+        if (decoded.funct3 == (uint8_t)VectorOperands::CFG) {
+            decoded.imm = (int32_t)((instruction >> 20) &
+                                    ((instruction >> 31) == 0 ? 0x7ff : 0x3ff));
+        } else {
+            decoded.imm = (int32_t)(instruction << 12) >> 27;
+        }
+        break;
+    }
+    case OPCode::CSR: {
+        // CSR instructions carry the CSR address in the immediate field
+        // and either a source register or a 5 bit zero extended immediate
+        // (zimm) in rs1.
+        auto addr        = (instruction >> 20) & 0xfff;
+        decoded.mnemonic = systemMnemonic(decoded.funct3, addr);
+        decoded.rd       = (instruction >> 7) & 0b11111;
+        decoded.rs1      = (instruction >> 15) & 0b11111;
+        decoded.imm      = (int32_t)addr;
+        break;
+    }
+    default:
+        break;
+    }
+    return decoded;
+}
+
+//==== Compressed Instructions ====//
+// Compressed instructions (RVC) are expanded to the 32-bit instruction
+// they stand for, which is then decoded as any other instruction. The
+// expansion follows the RV64C tables of the unprivileged specification.
+
+// EBREAK, C.EBREAK expands to it.
+static constexpr uint32_t Ebreak = 0x00100073;
+
+/// @brief Extract bits hi to lo (inclusive) of value.
+static auto bits(uint32_t value, unsigned hi, unsigned lo) -> uint32_t {
+    return (value >> lo) & ((1U << (hi - lo + 1)) - 1);
+}
+
+/// @brief Encode an I-type instruction.
+static auto encodeI(OPCode opcode, uint32_t rd, uint32_t funct3,
+                    uint32_t rs1, int32_t imm) -> uint32_t {
+    return ((uint32_t)imm << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) |
+           (uint32_t)opcode;
+}
+
+/// @brief Encode an S-type instruction.
+static auto encodeS(OPCode opcode, uint32_t funct3, uint32_t rs1,
+                    uint32_t rs2, int32_t imm) -> uint32_t {
+    auto offset = (uint32_t)imm;
+    return (bits(offset, 11, 5) << 25) | (rs2 << 20) | (rs1 << 15) |
+           (funct3 << 12) | (bits(offset, 4, 0) << 7) | (uint32_t)opcode;
+}
+
+/// @brief Encode an R-type instruction.
+static auto encodeR(OPCode opcode, uint32_t funct7, uint32_t rs2,
+                    uint32_t rs1, uint32_t funct3, uint32_t rd) -> uint32_t {
+    return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) |
+           (rd << 7) | (uint32_t)opcode;
+}
+
+/// @brief Encode a conditional branch comparing rs1 to x0.
+static auto encodeB(uint32_t funct3, uint32_t rs1, int32_t imm) -> uint32_t {
+    auto offset = (uint32_t)imm;
+    return (bits(offset, 12, 12) << 31) | (bits(offset, 10, 5) << 25) |
+           (rs1 << 15) | (funct3 << 12) | (bits(offset, 4, 1) << 8) |
+           (bits(offset, 11, 11) << 7) | (uint32_t)OPCode::BRANCH;
+}
+
+/// @brief Encode a JAL instruction.
+static auto encodeJ(uint32_t rd, int32_t imm) -> uint32_t {
+    auto offset = (uint32_t)imm;
+    return (bits(offset, 20, 20) << 31) | (bits(offset, 10, 1) << 21) |
+           (bits(offset, 11, 11) << 20) | (bits(offset, 19, 12) << 12) |
+           (rd << 7) | (uint32_t)OPCode::JAL;
+}
+
+/// @brief Sign extend the low width bits of value.
+static auto sext(uint32_t value, uint64_t width) -> int32_t {
+    return (int32_t)signExtend(value, width);
+}
+
+/// @brief Expand a quadrant 0 instruction: stack pointer relative
+/// additions and register based loads and stores.
+static auto expandQuadrant0(uint32_t inst) -> uint32_t {
+    // Registers x8 to x15 addressed by the 3-bit register fields.
+    auto rd  = 8 + bits(inst, 4, 2);
+    auto rs1 = 8 + bits(inst, 9, 7);
+    // Offsets of word and double word accesses.
+    auto word  = (int32_t)((bits(inst, 12, 10) << 3) |
+                          (bits(inst, 6, 6) << 2) | (bits(inst, 5, 5) << 6));
+    auto dword = (int32_t)((bits(inst, 12, 10) << 3) | (bits(inst, 6, 5) << 6));
+    switch (bits(inst, 15, 13)) {
+    case 0b000: {
+        // C.ADDI4SPN, a zero immediate is reserved (and the all zero
+        // instruction illegal).
+        auto imm = (int32_t)((bits(inst, 12, 11) << 4) |
+                             (bits(inst, 10, 7) << 6) |
+                             (bits(inst, 6, 6) << 2) | (bits(inst, 5, 5) << 3));
+        return imm == 0 ? 0 : encodeI(OPCode::ARITHI, rd, 0b000, 2, imm);
+    }
+    case 0b001:
+        return encodeI(OPCode::LOADFP, rd, 0b011, rs1, dword);
+    case 0b010:
+        return encodeI(OPCode::LOAD, rd, 0b010, rs1, word);
+    case 0b011:
+        return encodeI(OPCode::LOAD, rd, 0b011, rs1, dword);
+    case 0b101:
+        return encodeS(OPCode::STOREFP, 0b011, rs1, rd, dword);
+    case 0b110:
+        return encodeS(OPCode::STORE, 0b010, rs1, rd, word);
+    case 0b111:
+        return encodeS(OPCode::STORE, 0b011, rs1, rd, dword);
+    default:
+        return 0;
+    }
+}
+
+/// @brief Expand a quadrant 1 instruction: immediate operations, register
+/// to register operations on x8 to x15, jumps and branches.
+static auto expandQuadrant1(uint32_t inst) -> uint32_t {
+    auto rd  = bits(inst, 11, 7);
+    auto imm = sext((bits(inst, 12, 12) << 5) | bits(inst, 6, 2), 6);
+    // Registers x8 to x15 addressed by the 3-bit register fields.
+    auto rs1 = 8 + bits(inst, 9, 7);
+    auto rs2 = 8 + bits(inst, 4, 2);
+    switch (bits(inst, 15, 13)) {
+    case 0b000:
+        // C.ADDI, C.NOP with rd x0.
+        return encodeI(OPCode::ARITHI, rd, 0b000, rd, imm);
+    case 0b001:
+        // C.ADDIW, rd x0 is reserved.
+        return rd == 0 ? 0 : encodeI(OPCode::ARITHIW, rd, 0b000, rd, imm);
+    case 0b010:
+        // C.LI
+        return encodeI(OPCode::ARITHI, rd, 0b000, 0, imm);
+    case 0b011: {
+        // C.ADDI16SP with rd x2, C.LUI otherwise, zero immediates are
+        // reserved.
+        if (rd == 2) {
+            auto offset = sext((bits(inst, 12, 12) << 9) |
+                                   (bits(inst, 6, 6) << 4) |
+                                   (bits(inst, 5, 5) << 6) |
+                                   (bits(inst, 4, 3) << 7) |
+                                   (bits(inst, 2, 2) << 5),
+                               10);
+            return offset == 0 ? 0
+                               : encodeI(OPCode::ARITHI, 2, 0b000, 2, offset);
+        }
+        auto upper = sext((bits(inst, 12, 12) << 17) | (bits(inst, 6, 2) << 12),
+                          18);
+        return upper == 0 ? 0
+                          : ((uint32_t)upper & 0xfffff000) | (rd << 7) |
+                                (uint32_t)OPCode::LUI;
+    }
+    case 0b100: {
+        auto shamt = (int32_t)((bits(inst, 12, 12) << 5) | bits(inst, 6, 2));
+        switch (bits(inst, 11, 10)) {
+        case 0b00:
+            // C.SRLI
+            return encodeI(OPCode::ARITHI, rs1, 0b101, rs1, shamt);
+        case 0b01:
+            // C.SRAI, funct6 0b010000 sits above the shift amount.
+            return encodeI(OPCode::ARITHI, rs1, 0b101, rs1, 0x400 | shamt);
+        case 0b10:
+            // C.ANDI
+            return encodeI(OPCode::ARITHI, rs1, 0b111, rs1, imm);
+        default:
+            break;
+        }
+        // C.SUB, C.XOR, C.OR, C.AND and their W forms C.SUBW and C.ADDW.
+        if (bits(inst, 12, 12) == 0) {
+            static constexpr uint32_t funct3[] = {0b000, 0b100, 0b110, 0b111};
+            auto op = bits(inst, 6, 5);
+            return encodeR(OPCode::ARITHR, op == 0 ? 0x20 : 0x00, rs2, rs1,
+                           funct3[op], rs1);
+        }
+        switch (bits(inst, 6, 5)) {
+        case 0b00:
+            return encodeR(OPCode::ARITHRW, 0x20, rs2, rs1, 0b000, rs1);
+        case 0b01:
+            return encodeR(OPCode::ARITHRW, 0x00, rs2, rs1, 0b000, rs1);
+        default:
+            return 0;
+        }
+    }
+    case 0b101: {
+        // C.J
+        auto offset = sext((bits(inst, 12, 12) << 11) |
+                               (bits(inst, 11, 11) << 4) |
+                               (bits(inst, 10, 9) << 8) |
+                               (bits(inst, 8, 8) << 10) |
+                               (bits(inst, 7, 7) << 6) |
+                               (bits(inst, 6, 6) << 7) |
+                               (bits(inst, 5, 3) << 1) |
+                               (bits(inst, 2, 2) << 5),
+                           12);
+        return encodeJ(0, offset);
+    }
+    default: {
+        // C.BEQZ and C.BNEZ
+        auto offset = sext((bits(inst, 12, 12) << 8) |
+                               (bits(inst, 11, 10) << 3) |
+                               (bits(inst, 6, 5) << 6) |
+                               (bits(inst, 4, 3) << 1) |
+                               (bits(inst, 2, 2) << 5),
+                           9);
+        return encodeB(bits(inst, 13, 13), rs1, offset);
+    }
+    }
+}
+
+/// @brief Expand a quadrant 2 instruction: stack pointer relative loads
+/// and stores, shifts, moves and indirect jumps on the full register set.
+static auto expandQuadrant2(uint32_t inst) -> uint32_t {
+    auto rd  = bits(inst, 11, 7);
+    auto rs2 = bits(inst, 6, 2);
+    // Offsets of stack pointer relative word and double word loads.
+    auto word = (int32_t)((bits(inst, 12, 12) << 5) | (bits(inst, 6, 4) << 2) |
+                          (bits(inst, 3, 2) << 6));
+    auto dword = (int32_t)((bits(inst, 12, 12) << 5) |
+                           (bits(inst, 6, 5) << 3) | (bits(inst, 4, 2) << 6));
+    switch (bits(inst, 15, 13)) {
+    case 0b000: {
+        // C.SLLI
+        auto shamt = (int32_t)((bits(inst, 12, 12) << 5) | rs2);
+        return encodeI(OPCode::ARITHI, rd, 0b001, rd, shamt);
+    }
+    case 0b001:
+        return encodeI(OPCode::LOADFP, rd, 0b011, 2, dword);
+    case 0b010:
+        // C.LWSP, rd x0 is reserved.
+        return rd == 0 ? 0 : encodeI(OPCode::LOAD, rd, 0b010, 2, word);
+    case 0b011:
+        // C.LDSP, rd x0 is reserved.
+        return rd == 0 ? 0 : encodeI(OPCode::LOAD, rd, 0b011, 2, dword);
+    case 0b100:
+        if (bits(inst, 12, 12) == 0) {
+            // C.JR (rs1 x0 is reserved) and C.MV.
+            if (rs2 == 0) {
+                return rd == 0 ? 0 : encodeI(OPCode::JALR, 0, 0b000, rd, 0);
+            }
+            return encodeR(OPCode::ARITHR, 0x00, rs2, 0, 0b000, rd);
+        }
+        // C.EBREAK, C.JALR and C.ADD.
+        if (rs2 == 0) {
+            return rd == 0 ? Ebreak : encodeI(OPCode::JALR, 1, 0b000, rd, 0);
+        }
+        return encodeR(OPCode::ARITHR, 0x00, rs2, rd, 0b000, rd);
+    case 0b101:
+    case 0b111: {
+        // C.FSDSP and C.SDSP
+        auto offset =
+            (int32_t)((bits(inst, 12, 10) << 3) | (bits(inst, 9, 7) << 6));
+        return encodeS(bits(inst, 14, 14) != 0 ? OPCode::STORE
+                                               : OPCode::STOREFP,
+                       0b011, 2, rs2, offset);
+    }
+    default: {
+        // C.SWSP
+        auto offset =
+            (int32_t)((bits(inst, 12, 9) << 2) | (bits(inst, 8, 7) << 6));
+        return encodeS(OPCode::STORE, 0b010, 2, rs2, offset);
+    }
+    }
+}
+
+/// @brief Expand a compressed instruction to the 32-bit instruction it
+/// stands for.
+/// @param instruction
+/// @return uint32_t, 0 for reserved and illegal encodings.
+auto expandCompressed(uint16_t instruction) -> uint32_t {
+    switch (instruction & CompressedMask) {
+    case 0b00:
+        return expandQuadrant0(instruction);
+    case 0b01:
+        return expandQuadrant1(instruction);
+    case 0b10:
+        return expandQuadrant2(instruction);
+    default:
+        return 0;
+    }
+}
+
+/// @brief Every compressed instruction decoded ahead of time, indexed by
+/// encoding. The table is built on the first compressed instruction
+/// decoded so programs without any don't pay for it.
+static auto compressedTable() -> const std::vector<DecodedInstruction>& {
+    static const auto table = [] {
+        auto decoded = std::vector<DecodedInstruction>(1 << 16);
+        for (size_t inst = 0; inst < decoded.size(); inst++) {
+            if ((inst & CompressedMask) == CompressedMask) {
+                continue;
+            }
+            auto& entry = decoded[inst];
+            entry       = decodeStandard(expandCompressed((uint16_t)inst));
+            entry.raw   = (uint32_t)inst;
+            entry.size  = 2;
+        }
+        return decoded;
+    }();
+    return table;
+}
+
+/// @brief Decode an encoded instruction into its mnemonic and operands.
+/// Operands are unpacked using the instruction format of the opcode group
+/// so executing the result never needs to look at the encoded bits again,
+/// compressed instructions are looked up in the table of their expansions.
+/// @param instruction
+/// @return DecodedInstruction without a handler.
+auto predecode(uint32_t instruction) -> DecodedInstruction {
+    if ((instruction & CompressedMask) != CompressedMask) {
+        return compressedTable()[instruction & 0xffff];
+    }
+    return decodeStandard(instruction);
+}
+
+} // namespace riscvemu
@@ -0,0 +1,367 @@
+#include "Devices.h"
+#include "CSR.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace riscvemu {
+
+/// @brief Mask of the low size bytes.
+static auto byteMask(size_t size) -> uint64_t {
+    return size >= 8 ? ~static_cast<uint64_t>(0)
+                     : (static_cast<uint64_t>(1) << (size * 8)) - 1;
+}
+
+/// @brief Returns true if an access of size bytes at offset stays within a
+/// register of width bytes.
+static auto withinRegister(uint64_t offset, size_t size, size_t width)
+    -> bool {
+    return (offset & (width - 1)) + size <= width;
+}
+
+/// @brief Bytes of reg read by an access of size bytes at offset.
+static auto extract(uint64_t reg, uint64_t offset, size_t size, size_t width)
+    -> uint64_t {
+    return (reg >> ((offset & (width - 1)) * 8)) & byteMask(size);
+}
+
+/// @brief Value of reg once an access of size bytes at offset wrote value.
+static auto merge(uint64_t reg, uint64_t offset, size_t size, size_t width,
+                  uint64_t value) -> uint64_t {
+    auto shift = (offset & (width - 1)) * 8;
+    auto mask  = byteMask(size) << shift;
+    return (reg & ~mask) | ((value << shift) & mask);
+}
+
+//=== Bus Methods Implementations ====//
+
+/// @brief Attach device at base.
+/// @param base
+/// @param size
+/// @param device
+auto Bus::attach(uint64_t base, uint64_t size, std::shared_ptr<Device> device)
+    -> void {
+    for (const auto& mapping : this->mappings) {
+        if (base < mapping.base + mapping.size && mapping.base < base + size) {
+            throw std::invalid_argument("bus: overlapping device ranges");
+        }
+    }
+    this->mappings.push_back({base, size, std::move(device)});
+}
+
+/// @brief Mapping covering the size bytes at addr.
+/// @param addr
+/// @param size
+/// @return Mapping* or nullptr.
+auto Bus::find(uint64_t addr, size_t size) -> Mapping* {
+    for (auto& mapping : this->mappings) {
+        if (addr - mapping.base < mapping.size &&
+            addr - mapping.base + size <= mapping.size) {
+            return &mapping;
+        }
+    }
+    return nullptr;
+}
+
+/// @brief Read from the device attached at addr.
+/// @param addr
+/// @param size
+/// @param value
+/// @return false if no device handles the access.
+auto Bus::read(uint64_t addr, size_t size, uint64_t& value) -> bool {
+    auto* mapping = find(addr, size);
+    return mapping != nullptr &&
+           mapping->device->read(addr - mapping->base, size, value);
+}
+
+/// @brief Write to the device attached at addr.
+/// @param addr
+/// @param size
+/// @param value
+/// @return false if no device handles the access.
+auto Bus::write(uint64_t addr, size_t size, uint64_t value) -> bool {
+    auto* mapping = find(addr, size);
+    return mapping != nullptr &&
+           mapping->device->write(addr - mapping->base, size, value);
+}
+
+//=== Uart Methods Implementations ====//
+
+/// @brief Write the following transmitted bytes to out.
+/// @param out
+auto Uart::setOutput(std::ostream& out) -> void {
+    auto guard = std::lock_guard(this->lock);
+    this->out  = &out;
+}
+
+/// @brief Queue byte for the guest, it is read from RBR.
+/// @param byte
+auto Uart::receive(uint8_t byte) -> void {
+    auto guard = std::lock_guard(this->lock);
+    this->input.push_back(byte);
+}
+
+/// @brief Current register values and received bytes.
+/// @return State
+auto Uart::save() -> State {
+    auto guard = std::lock_guard(this->lock);
+    return State{
+        .ier   = this->ier,
+        .fcr   = this->fcr,
+        .lcr   = this->lcr,
+        .mcr   = this->mcr,
+        .scr   = this->scr,
+        .dll   = this->dll,
+        .dlm   = this->dlm,
+        .input = std::vector<uint8_t>(this->input.begin(), this->input.end()),
+    };
+}
+
+/// @brief Replace the register values and received bytes.
+/// @param state
+auto Uart::restore(const State& state) -> void {
+    auto guard  = std::lock_guard(this->lock);
+    this->ier   = state.ier;
+    this->fcr   = state.fcr;
+    this->lcr   = state.lcr;
+    this->mcr   = state.mcr;
+    this->scr   = state.scr;
+    this->dll   = state.dll;
+    this->dlm   = state.dlm;
+    this->input = std::deque<uint8_t>(state.input.begin(), state.input.end());
+}
+
+/// @brief Read a UART register.
+/// @param offset
+/// @param size
+/// @param value
+/// @return false unless size is 1.
+auto Uart::read(uint64_t offset, size_t size, uint64_t& value) -> bool {
+    if (size != 1) {
+        return false;
+    }
+    auto guard = std::lock_guard(this->lock);
+    auto dlab  = (this->lcr & LcrDlab) != 0;
+    switch (offset) {
+    case RBR:
+        if (dlab) {
+            value = this->dll;
+        } else if (this->input.empty()) {
+            value = 0;
+        } else {
+            value = this->input.front();
+            this->input.pop_front();
+        }
+        return true;
+    case IER:
+        value = dlab ? this->dlm : this->ier;
+        return true;
+    case IIR:
+        // No interrupt pending, FIFOs enabled as set in FCR.
+        value = 0x01 | ((this->fcr & 1) != 0 ? 0xc0 : 0);
+        return true;
+    case LCR:
+        value = this->lcr;
+        return true;
+    case MCR:
+        value = this->mcr;
+        return true;
+    case LSR:
+        value = LsrTransmitterEmpty | (this->input.empty() ? 0 : LsrDataReady);
+        return true;
+    case MSR:
+        value = 0;
+        return true;
+    case SCR:
+        value = this->scr;
+        return true;
+    default:
+        value = 0;
+        return true;
+    }
+}
+
+/// @brief Write a UART register, bytes written to THR are transmitted
+/// right away and the output is flushed at every newline.
+/// @param offset
+/// @param size
+/// @param value
+/// @return false unless size is 1.
+auto Uart::write(uint64_t offset, size_t size, uint64_t value) -> bool {
+    if (size != 1) {
+        return false;
+    }
+    auto guard = std::lock_guard(this->lock);
+    auto dlab  = (this->lcr & LcrDlab) != 0;
+    auto byte  = (uint8_t)value;
+    switch (offset) {
+    case THR:
+        if (dlab) {
+            this->dll = byte;
+            break;
+        }
+        this->out->put((char)byte);
+        if (byte == '\n') {
+            this->out->flush();
+        }
+        break;
+    case IER:
+        if (dlab) {
+            this->dlm = byte;
+        } else {
+            this->ier = byte & 0x0f;
+        }
+        break;
+    case FCR:
+        this->fcr = byte;
+        // Clear the receive FIFO.
+        if ((byte & 0b10) != 0) {
+            this->input.clear();
+        }
+        break;
+    case LCR:
+        this->lcr = byte;
+        break;
+    case MCR:
+        this->mcr = byte & 0x1f;
+        break;
+    case SCR:
+        this->scr = byte;
+        break;
+    default:
+        // LSR and MSR are read-only.
+        break;
+    }
+    return true;
+}
+
+//=== Clint Methods Implementations ====//
+
+Clint::Clint(std::chrono::steady_clock::time_point started)
+    : started(started),
+      msip(std::make_unique<std::atomic<uint32_t>[]>(MaxHarts)),
+      timecmp(std::make_unique<std::atomic<uint64_t>[]>(MaxHarts)) {
+    // No timer interrupt is pending until a hart sets its mtimecmp.
+    for (size_t hart = 0; hart < MaxHarts; hart++) {
+        this->timecmp[hart].store(~static_cast<uint64_t>(0));
+    }
+}
+
+/// @brief Host time ticks at TimeFrequency since started.
+/// @return uint64_t
+auto Clint::hostTicks() const -> uint64_t {
+    auto elapsed = std::chrono::steady_clock::now() - this->started;
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               elapsed)
+               .count() /
+           (1000000000 / TimeFrequency);
+}
+
+/// @brief Current value of mtime.
+/// @return uint64_t
+auto Clint::mtime() const -> uint64_t {
+    return hostTicks() + this->offset.load(std::memory_order_relaxed);
+}
+
+/// @brief Move mtime forward by ticks.
+/// @param ticks
+auto Clint::advance(uint64_t ticks) -> void {
+    this->offset.fetch_add(ticks, std::memory_order_relaxed);
+}
+
+/// @brief mtimecmp of hart, harts past MaxHarts never have a deadline.
+/// @param hart
+/// @return uint64_t
+auto Clint::mtimecmp(uint64_t hart) const -> uint64_t {
+    return hart < MaxHarts ? this->timecmp[hart].load()
+                           : ~static_cast<uint64_t>(0);
+}
+
+/// @brief Machine interrupts pending for hart.
+/// @param hart
+/// @return MaskMTIP and MaskMSIP bits.
+auto Clint::pending(uint64_t hart) const -> uint64_t {
+    if (hart >= MaxHarts) {
+        return 0;
+    }
+    auto bits = (this->msip[hart].load() & 1) != 0 ? MaskMSIP : 0;
+    return mtime() >= this->timecmp[hart].load() ? bits | MaskMTIP : bits;
+}
+
+/// @brief Read a CLINT register, accesses must stay within a register.
+/// @param offset
+/// @param size
+/// @param value
+/// @return false for unaligned accesses.
+auto Clint::read(uint64_t offset, size_t size, uint64_t& value) -> bool {
+    if (offset < MSip + MaxHarts * 4) {
+        if (!withinRegister(offset, size, 4)) {
+            return false;
+        }
+        value = extract(this->msip[offset / 4].load(), offset, size, 4);
+        return true;
+    }
+    if (offset >= MTimeCmp && offset < MTimeCmp + MaxHarts * 8) {
+        if (!withinRegister(offset, size, 8)) {
+            return false;
+        }
+        value = extract(this->timecmp[(offset - MTimeCmp) / 8].load(), offset,
+                        size, 8);
+        return true;
+    }
+    if (offset >= MTime && offset < MTime + 8) {
+        if (!withinRegister(offset, size, 8)) {
+            return false;
+        }
+        value = extract(mtime(), offset, size, 8);
+        return true;
+    }
+    value = 0;
+    return true;
+}
+
+/// @brief Write a CLINT register, accesses must stay within a register.
+/// Only bit 0 of msip is writable.
+/// @param offset
+/// @param size
+/// @param value
+/// @return false for unaligned accesses.
+auto Clint::write(uint64_t offset, size_t size, uint64_t value) -> bool {
+    if (offset < MSip + MaxHarts * 4) {
+        if (!withinRegister(offset, size, 4)) {
+            return false;
+        }
+        auto& reg = this->msip[offset / 4];
+        reg.store((uint32_t)merge(reg.load(), offset, size, 4, value) & 1);
+        return true;
+    }
+    if (offset >= MTimeCmp && offset < MTimeCmp + MaxHarts * 8) {
+        if (!withinRegister(offset, size, 8)) {
+            return false;
+        }
+        auto& reg = this->timecmp[(offset - MTimeCmp) / 8];
+        reg.store(merge(reg.load(), offset, size, 8, value));
+        return true;
+    }
+    if (offset >= MTime && offset < MTime + 8) {
+        if (!withinRegister(offset, size, 8)) {
+            return false;
+        }
+        auto ticks = hostTicks();
+        auto time  = merge(ticks + this->offset.load(), offset, size, 8, value);
+        this->offset.store(time - ticks);
+        return true;
+    }
+    return true;
+}
+
+} // namespace riscvemu
@@ -0,0 +1,249 @@
+#include "Elf.h"
+#include "Machine.h"
+#include "Memory.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace riscvemu {
+
+//=== ELF Loader Implementation ====//
+// Segments are placed at their virtual addresses in guest memory, the
+// pages of a segment that are entirely file backed are mapped straight
+// from the file when the segment offset and address agree modulo the host
+// page size (which linkers guarantee for page aligned segments). The head
+// and tail pages, which may be shared with a neighbouring segment or hold
+// .bss, are copied so bytes past p_filesz stay zero.
+
+/// @brief Open file descriptor closed when going out of scope.
+struct File {
+    int fd;
+
+    File(const std::string& path)
+        : fd(open(path.c_str(), O_RDONLY | O_CLOEXEC)) {}
+    File(const File&)                    = delete;
+    auto operator=(const File&) -> File& = delete;
+    ~File() {
+        if (this->fd >= 0) {
+            close(this->fd);
+        }
+    }
+};
+
+/// @brief Read exactly bytes at offset of the file into buffer.
+/// @param file
+/// @param path
+/// @param buffer
+/// @param offset
+/// @param bytes
+static auto readAt(const File& file, const std::string& path, void* buffer,
+                   uint64_t offset, size_t bytes) -> void {
+    auto* out = static_cast<uint8_t*>(buffer);
+    while (bytes > 0) {
+        auto n = pread(file.fd, out, bytes, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+        if (n == 0) {
+            throw ElfError(path + ": truncated ELF file");
+        }
+        out += n;
+        offset += n;
+        bytes -= n;
+    }
+}
+
+/// @brief Returns true if the file at path starts with the ELF magic.
+/// @param path
+/// @return bool
+auto isElf(const std::string& path) -> bool {
+    auto file = File(path);
+    uint8_t magic[sizeof(ElfMagic)];
+    return file.fd >= 0 &&
+           pread(file.fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+           std::memcmp(magic, ElfMagic, sizeof(magic)) == 0;
+}
+
+/// @brief Validate the file header of a RISC-V ELF64 executable.
+/// @param header
+/// @param path
+static auto checkHeader(const Elf64Header& header, const std::string& path)
+    -> void {
+    if (std::memcmp(header.ident, ElfMagic, sizeof(ElfMagic)) != 0) {
+        throw ElfError(path + ": not an ELF file");
+    }
+    if (header.ident[4] != ElfClass64 || header.ident[5] != ElfDataLSB) {
+        throw ElfError(path + ": not a little endian ELF64 file");
+    }
+    if (header.type != ElfTypeExec || header.machine != ElfMachineRISCV) {
+        throw ElfError(path + ": not a RISC-V executable");
+    }
+    if (header.phentsize != sizeof(Elf64ProgramHeader)) {
+        throw ElfError(path + ": unexpected program header size");
+    }
+}
+
+/// @brief Place the file backed part of segment in guest memory.
+/// @param mmu
+/// @param file
+/// @param path
+/// @param segment
+static auto loadSegment(MMU& mmu, const File& file, const std::string& path,
+                        const Elf64ProgramHeader& segment) -> void {
+    auto* dest  = mmu.memory.data() + (segment.vaddr - MemoryBaseAddr);
+    auto page   = hostPageSize();
+    auto offset = segment.offset;
+    auto bytes  = static_cast<size_t>(segment.filesz);
+
+    // The guest memory reservation is page aligned, a segment can be mapped
+    // if its address and offset share the same page offset.
+    if ((segment.vaddr - MemoryBaseAddr) % page == offset % page) {
+        auto head = std::min<size_t>((page - offset % page) % page, bytes);
+        readAt(file, path, dest, offset, head);
+        dest += head;
+        offset += head;
+        bytes -= head;
+
+        auto mapped = bytes - bytes % page;
+        if (mapped > 0) {
+            if (!mapFile(dest, file.fd, offset, mapped)) {
+                throw std::system_error(errno, std::generic_category(), path);
+            }
+            dest += mapped;
+            offset += mapped;
+            bytes -= mapped;
+        }
+    }
+    readAt(file, path, dest, offset, bytes);
+}
+
+/// @brief Load the RISC-V ELF64 executable at path in mmu.
+/// @param mmu
+/// @param path
+/// @return ElfImage
+auto loadElf(MMU& mmu, const std::string& path) -> ElfImage {
+    auto file = File(path);
+    if (file.fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    struct stat info {};
+    if (fstat(file.fd, &info) != 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    auto size = static_cast<uint64_t>(info.st_size);
+    Elf64Header header{};
+    readAt(file, path, &header, 0, sizeof(header));
+    checkHeader(header, path);
+
+    std::vector<Elf64ProgramHeader> segments(header.phnum);
+    readAt(file, path, segments.data(), header.phoff,
+           segments.size() * sizeof(Elf64ProgramHeader));
+
+    auto image = ElfImage{.entry    = header.entry,
+                          .codeEnd  = MemoryBaseAddr,
+                          .imageEnd = MemoryBaseAddr,
+                          .end      = MemoryBaseAddr,
+                          .phdr     = 0,
+                          .phnum    = header.phnum};
+    for (const auto& segment : segments) {
+        if (segment.type == ElfSegmentPhdr) {
+            image.phdr = segment.vaddr;
+        }
+        if (segment.type != ElfSegmentLoad || segment.memsz == 0) {
+            continue;
+        }
+        auto start = segment.vaddr - MemoryBaseAddr;
+        if (segment.filesz > segment.memsz || segment.vaddr < MemoryBaseAddr ||
+            start > mmu.memorySize() ||
+            segment.memsz > mmu.memorySize() - start) {
+            throw ElfError(path + ": segment outside of guest memory");
+        }
+        // Mapped pages past the end of the file fault on access instead
+        // of reading as zero.
+        if (segment.offset > size || segment.filesz > size - segment.offset) {
+            throw ElfError(path + ": truncated ELF file");
+        }
+        loadSegment(mmu, file, path, segment);
+        image.imageEnd =
+            std::max(image.imageEnd, segment.vaddr + segment.filesz);
+        image.end = std::max(image.end, segment.vaddr + segment.memsz);
+        // Without PT_PHDR the headers are found in the segment loading
+        // them, usually the first one.
+        if (image.phdr == 0 && header.phoff >= segment.offset &&
+            header.phoff - segment.offset < segment.filesz) {
+            image.phdr = segment.vaddr + (header.phoff - segment.offset);
+        }
+        if ((segment.flags & ElfSegmentExec) != 0) {
+            image.codeEnd =
+                std::max(image.codeEnd, segment.vaddr + segment.memsz);
+        }
+    }
+    if (!mmu.withinRange(image.entry) || image.entry >= image.codeEnd) {
+        throw ElfError(path + ": entry point outside of executable segments");
+    }
+    return image;
+}
+
+/// @brief Look a symbol up in the symbol tables of the executable at path,
+/// the names of a table are in the string table its sh_link refers to.
+/// @param path
+/// @param name
+/// @param value
+/// @return bool
+auto findElfSymbol(const std::string& path, const std::string& name,
+                   uint64_t& value) -> bool {
+    auto file = File(path);
+    if (file.fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    Elf64Header header{};
+    readAt(file, path, &header, 0, sizeof(header));
+    checkHeader(header, path);
+    if (header.shnum == 0) {
+        return false;
+    }
+    if (header.shentsize != sizeof(Elf64SectionHeader)) {
+        throw ElfError(path + ": unexpected section header size");
+    }
+
+    std::vector<Elf64SectionHeader> sections(header.shnum);
+    readAt(file, path, sections.data(), header.shoff,
+           sections.size() * sizeof(Elf64SectionHeader));
+    for (const auto& section : sections) {
+        if (section.type != ElfSectionSymbols) {
+            continue;
+        }
+        if (section.link >= sections.size()) {
+            throw ElfError(path + ": symbol table without string table");
+        }
+        const auto& strings = sections[section.link];
+        std::vector<char> names(strings.size + 1);
+        readAt(file, path, names.data(), strings.offset, strings.size);
+        std::vector<Elf64Symbol> symbols(section.size / sizeof(Elf64Symbol));
+        readAt(file, path, symbols.data(), section.offset,
+               symbols.size() * sizeof(Elf64Symbol));
+        for (const auto& symbol : symbols) {
+            if (symbol.name < strings.size &&
+                name == names.data() + symbol.name) {
+                value = symbol.value;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace riscvemu
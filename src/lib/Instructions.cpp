@@ -1,5 +1,6 @@
 #include "Instructions.h"
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
@@ -153,4 +154,68 @@ auto getRegisterFromIndex(uint64_t idx) -> Register {
     }
 }
 
+/// @brief Returns true if mnemonic writes a floating point register, the
+/// floating point loads and the instructions writing a floating point
+/// register are listed together.
+/// @param mnemonic
+/// @return bool
+auto writesFloatRegister(Mnemonic mnemonic) -> bool {
+    return (mnemonic >= Mnemonic::FLW && mnemonic <= Mnemonic::FCVT_D_S) ||
+           mnemonic == Mnemonic::VFMV_F_S;
+}
+
+/// @brief Returns true if the rd field of mnemonic is an integer register,
+/// the vector instructions naming a vector register in rd are listed
+/// together.
+/// @param mnemonic
+/// @return bool
+auto writesIntegerRegister(Mnemonic mnemonic) -> bool {
+    return !writesFloatRegister(mnemonic) &&
+           (mnemonic < Mnemonic::VLE || mnemonic > Mnemonic::VFMV_S_F);
+}
+
+/// @brief Returns the assembly name of a mnemonic.
+/// @param mnemonic
+/// @return const char*
+auto getMnemonicName(Mnemonic mnemonic) -> const char* {
+    // Names indexed by Mnemonic.
+    static const char* const names[] = {
+        "illegal", "lui", "auipc", "jal", "jalr", "beq", "bne", "blt", "bge",
+        "bltu", "bgeu", "lb", "lh", "lw", "ld", "lbu", "lhu", "lwu", "sb", "sh",
+        "sw", "sd", "addi", "slti", "sltiu", "xori", "ori", "andi", "slli",
+        "srli", "srai", "addiw", "slliw", "srliw", "sraiw", "add", "sub", "sll",
+        "slt", "sltu", "xor", "srl", "sra", "or", "and", "addw", "subw", "sllw",
+        "srlw", "sraw", "ecall", "ebreak", "mret", "sret", "sfence.vma",
+        "wfi", "csrrw", "csrrs", "csrrc", "csrrwi", "csrrsi", "csrrci", "fence",
+        "fence.i", "lr.w", "sc.w", "amoswap.w", "amoadd.w", "amoxor.w",
+        "amoand.w", "amoor.w", "amomin.w", "amomax.w", "amominu.w", "amomaxu.w",
+        "lr.d", "sc.d", "amoswap.d", "amoadd.d", "amoxor.d", "amoand.d",
+        "amoor.d", "amomin.d", "amomax.d", "amominu.d", "amomaxu.d", "mul",
+        "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu", "mulw", "divw",
+        "divuw", "remw", "remuw", "fsw", "fsd", "flw", "fld", "fmadd.s",
+        "fmsub.s", "fnmsub.s", "fnmadd.s", "fadd.s", "fsub.s", "fmul.s",
+        "fdiv.s", "fsqrt.s", "fsgnj.s", "fsgnjn.s", "fsgnjx.s", "fmin.s",
+        "fmax.s", "fcvt.s.w", "fcvt.s.wu", "fcvt.s.l", "fcvt.s.lu", "fmv.w.x",
+        "fcvt.s.d", "fmadd.d", "fmsub.d", "fnmsub.d", "fnmadd.d", "fadd.d",
+        "fsub.d", "fmul.d", "fdiv.d", "fsqrt.d", "fsgnj.d", "fsgnjn.d",
+        "fsgnjx.d", "fmin.d", "fmax.d", "fcvt.d.w", "fcvt.d.wu", "fcvt.d.l",
+        "fcvt.d.lu", "fmv.d.x", "fcvt.d.s", "fcvt.w.s", "fcvt.wu.s", "fcvt.l.s",
+        "fcvt.lu.s", "fmv.x.w", "feq.s", "flt.s", "fle.s", "fclass.s",
+        "fcvt.w.d", "fcvt.wu.d", "fcvt.l.d", "fcvt.lu.d", "fmv.x.d", "feq.d",
+        "flt.d", "fle.d", "fclass.d", "vsetvli", "vsetivli", "vsetvl",
+        "vmv.x.s", "vfmv.f.s", "vle", "vlse", "vse", "vsse", "vadd", "vsub",
+        "vrsub", "vminu", "vmin", "vmaxu", "vmax", "vand", "vor", "vxor",
+        "vsll", "vsrl", "vsra", "vmseq", "vmsne", "vmsltu", "vmslt",
+        "vmsleu", "vmsle", "vmsgtu", "vmsgt", "vmerge", "vmul", "vmacc",
+        "vredsum", "vmv.s.x", "vfadd", "vfsub", "vfmul", "vfdiv", "vfmacc",
+        "vfredusum", "vfmerge", "vfmv.s.f",
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == (size_t)Mnemonic::Count,
+                  "every mnemonic must have a name");
+    if (mnemonic >= Mnemonic::Count) {
+        return "unknown";
+    }
+    return names[(size_t)mnemonic];
+}
+
 } // namespace riscvemu
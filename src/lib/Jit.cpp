@@ -0,0 +1,780 @@
+#include "Jit.h"
+#include "Decoder.h"
+#include "Instructions.h"
+#include "Machine.h"
+#include "Translator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+
+namespace riscvemu {
+
+#if defined(__x86_64__)
+
+//==== x86-64 Backend ====//
+// Compiled blocks follow the System V calling convention, they take the
+// JitState in rdi and return the next program counter in rax.
+// For the duration of a block the following host registers are pinned:
+//
+//  rbx : guest register file, x[i] lives at [rbx + 8 * i].
+//  r12 : host address of MemoryBaseAddr.
+//  r13 : size of the guest memory.
+//  r14 : MMU code page flags.
+//  r15 : JitState.
+//
+// rax, rcx and rdx are scratch registers, guest registers are loaded from
+// and stored back to the register file around every instruction.
+
+/// @brief Host registers used by the backend.
+enum HostRegister : uint8_t {
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+};
+
+/// @brief Condition codes for jcc and setcc.
+enum Condition : uint8_t {
+    Below        = 0x2,
+    AboveEqual   = 0x3,
+    Equal        = 0x4,
+    NotEqual     = 0x5,
+    Above        = 0x7,
+    Less         = 0xc,
+    GreaterEqual = 0xd,
+};
+
+/// @brief Arithmetic operations sharing the x86 ALU encodings, values are
+/// the /digit of the immediate forms.
+enum AluOp : uint8_t {
+    Add = 0,
+    Or  = 1,
+    And = 4,
+    Sub = 5,
+    Xor = 6,
+    Cmp = 7,
+};
+
+/// @brief Shift operations, values are the /digit of the shift encodings.
+enum ShiftOp : uint8_t {
+    Shl = 4,
+    Shr = 5,
+    Sar = 7,
+};
+
+/// @brief Assembler emits x86-64 machine code for a single block, jumps
+/// target labels within the block and are resolved once the block is
+/// complete.
+class Assembler {
+    public:
+    /// @brief Label is an index into the label table.
+    using Label = size_t;
+
+    auto bytes() const -> const std::vector<uint8_t>& { return buffer; }
+
+    auto emit(std::initializer_list<uint8_t> bytes) -> void {
+        buffer.insert(buffer.end(), bytes);
+    }
+
+    auto emit32(uint32_t value) -> void {
+        for (int i = 0; i < 4; i++) {
+            buffer.push_back((value >> (8 * i)) & 0xff);
+        }
+    }
+
+    auto emit64(uint64_t value) -> void {
+        for (int i = 0; i < 8; i++) {
+            buffer.push_back((value >> (8 * i)) & 0xff);
+        }
+    }
+
+    auto newLabel() -> Label {
+        labels.push_back(-1);
+        return labels.size() - 1;
+    }
+
+    auto bind(Label label) -> void { labels[label] = (int64_t)buffer.size(); }
+
+    /// @brief jcc rel32 to label.
+    auto jcc(Condition cc, Label label) -> void {
+        emit({0x0f, (uint8_t)(0x80 | cc)});
+        fixup(label);
+    }
+
+    /// @brief jmp rel32 to label.
+    auto jmp(Label label) -> void {
+        emit({0xe9});
+        fixup(label);
+    }
+
+    /// @brief Patch the jumps to their labels, returns false if a label was
+    /// never bound.
+    auto resolve() -> bool {
+        for (auto [at, label] : fixups) {
+            if (labels[label] < 0) {
+                return false;
+            }
+            auto rel = (int32_t)(labels[label] - (int64_t)(at + 4));
+            std::memcpy(&buffer[at], &rel, sizeof(rel));
+        }
+        return true;
+    }
+
+    /// @brief mov reg, x[guest].
+    auto loadGuest(HostRegister reg, uint8_t guest) -> void {
+        if (guest == 0) {
+            // xor reg32, reg32
+            emit({0x31, (uint8_t)(0xc0 | (reg << 3) | reg)});
+            return;
+        }
+        emit({0x48, 0x8b, (uint8_t)(0x83 | (reg << 3))});
+        emit32(8 * guest);
+    }
+
+    /// @brief mov x[guest], reg, writes to x0 are dropped.
+    auto storeGuest(uint8_t guest, HostRegister reg) -> void {
+        if (guest == 0) {
+            return;
+        }
+        emit({0x48, 0x89, (uint8_t)(0x83 | (reg << 3))});
+        emit32(8 * guest);
+    }
+
+    /// @brief mov reg, imm64 using the shortest encoding.
+    auto movImm(HostRegister reg, uint64_t imm) -> void {
+        if ((int64_t)imm == (int64_t)(int32_t)imm) {
+            emit({0x48, 0xc7, (uint8_t)(0xc0 | reg)});
+            emit32((uint32_t)imm);
+            return;
+        }
+        emit({0x48, (uint8_t)(0xb8 | reg)});
+        emit64(imm);
+    }
+
+    /// @brief op rax, rcx (64 or 32 bit).
+    auto alu(AluOp op, bool wide) -> void {
+        static constexpr uint8_t Opcodes[] = {0x01, 0x09, 0, 0,
+                                              0x21, 0x29, 0x31, 0x39};
+        if (wide) {
+            emit({0x48});
+        }
+        emit({Opcodes[op], 0xc8});
+    }
+
+    /// @brief op rax, imm32 (64 or 32 bit).
+    auto aluImm(AluOp op, int32_t imm, bool wide) -> void {
+        if (wide) {
+            emit({0x48});
+        }
+        emit({0x81, (uint8_t)(0xc0 | (op << 3))});
+        emit32((uint32_t)imm);
+    }
+
+    /// @brief imul rax, rcx (64 or 32 bit), the lower half of the product.
+    auto imul(bool wide) -> void {
+        if (wide) {
+            emit({0x48});
+        }
+        emit({0x0f, 0xaf, 0xc1});
+    }
+
+    /// @brief imul rcx or mul rcx, the upper half of the product is left
+    /// in rdx.
+    auto mulHigh(bool sign) -> void {
+        emit({0x48, 0xf7, (uint8_t)(sign ? 0xe9 : 0xe1)});
+    }
+
+    /// @brief shift rax by cl (64 or 32 bit), x86 masks the shift amount
+    /// like RISC-V does.
+    auto shift(ShiftOp op, bool wide) -> void {
+        if (wide) {
+            emit({0x48});
+        }
+        emit({0xd3, (uint8_t)(0xc0 | (op << 3))});
+    }
+
+    /// @brief shift rax by imm8 (64 or 32 bit).
+    auto shiftImm(ShiftOp op, uint8_t imm, bool wide) -> void {
+        if (wide) {
+            emit({0x48});
+        }
+        emit({0xc1, (uint8_t)(0xc0 | (op << 3)), imm});
+    }
+
+    /// @brief movsxd rax, eax.
+    auto signExtend32() -> void { emit({0x48, 0x63, 0xc0}); }
+
+    /// @brief setcc al; movzx eax, al.
+    auto setcc(Condition cc) -> void {
+        emit({0x0f, (uint8_t)(0x90 | cc), 0xc0});
+        emit({0x0f, 0xb6, 0xc0});
+    }
+
+    private:
+    auto fixup(Label label) -> void {
+        fixups.emplace_back(buffer.size(), label);
+        emit32(0);
+    }
+
+    std::vector<uint8_t> buffer;
+    std::vector<int64_t> labels;
+    std::vector<std::pair<size_t, Label>> fixups;
+};
+
+/// @brief Called by compiled blocks when a store hits a code page.
+static auto invalidateCode(JitState* state, uint64_t offset, uint64_t bytes)
+    -> void {
+    state->mmu->invalidateCode(offset + MemoryBaseAddr, bytes);
+}
+
+/// @brief Compiler emits the native code of a single block.
+class BlockCompiler {
+    public:
+    BlockCompiler() : epilogue(as.newLabel()) {}
+
+    /// @brief Compile block, returns false if no instruction of the block
+    /// could be compiled.
+    auto compile(const TranslatedBlock& block) -> bool {
+        prologue();
+        auto pc        = block.pc;
+        this->compiled = 0;
+        for (const auto& op : block.ops) {
+            const auto& d = op.decoded;
+            if (d.handler == nullptr) {
+                // Exit sentinel.
+                exit(block.end, this->compiled);
+                break;
+            }
+            if (!instruction(d, pc)) {
+                // Leave the instruction to the threaded engine.
+                exit(pc, this->compiled);
+                break;
+            }
+            this->compiled++;
+            pc += d.size;
+        }
+        emitStubs();
+        as.bind(epilogue);
+        // pop r15; pop r14; pop r13; pop r12; pop rbx; ret
+        as.emit({0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3});
+        return this->compiled > 0 && as.resolve();
+    }
+
+    auto bytes() const -> const std::vector<uint8_t>& { return as.bytes(); }
+
+    private:
+    /// @brief Save callee saved registers and pin the JitState fields.
+    auto prologue() -> void {
+        // push rbx; push r12; push r13; push r14; push r15
+        as.emit({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});
+        // mov r15, rdi
+        as.emit({0x49, 0x89, 0xff});
+        // mov rbx, [r15 + registers]
+        as.emit({0x49, 0x8b, 0x5f, (uint8_t)offsetof(JitState, registers)});
+        // mov r12, [r15 + memory]
+        as.emit({0x4d, 0x8b, 0x67, (uint8_t)offsetof(JitState, memory)});
+        // mov r13, [r15 + memorySize]
+        as.emit({0x4d, 0x8b, 0x6f, (uint8_t)offsetof(JitState, memorySize)});
+        // mov r14, [r15 + codePages]
+        as.emit({0x4d, 0x8b, 0x77, (uint8_t)offsetof(JitState, codePages)});
+    }
+
+    /// @brief Leave the block continuing at pc, reporting the given number
+    /// of instructions as retired.
+    auto exit(uint64_t pc, uint32_t retired) -> void {
+        retire(retired);
+        as.movImm(RAX, pc);
+        as.jmp(epilogue);
+    }
+
+    /// @brief Report count instructions of the block as retired.
+    auto retire(uint32_t count) -> void {
+        // mov qword [r15 + retired], count
+        as.emit({0x49, 0xc7, 0x47, (uint8_t)offsetof(JitState, retired)});
+        as.emit32(count);
+    }
+
+    /// @brief Compute the memory offset [rs1] + imm - MemoryBaseAddr in rax
+    /// and branch to a fault stub if size bytes at the offset aren't
+    /// within memory.
+    auto address(const DecodedInstruction& d, uint8_t size, uint64_t pc)
+        -> void {
+        as.loadGuest(RAX, d.rs1);
+        as.aluImm(Add, d.imm, true);
+        // mov ecx, MemoryBaseAddr; sub rax, rcx
+        as.emit({0xb9});
+        as.emit32((uint32_t)MemoryBaseAddr);
+        as.alu(Sub, true);
+        // lea rdx, [r13 - size]; cmp rax, rdx
+        as.emit({0x49, 0x8d, 0x55, (uint8_t)-size});
+        as.emit({0x48, 0x39, 0xd0});
+        auto fault = as.newLabel();
+        as.jcc(Above, fault);
+        // The faulting instruction doesn't retire.
+        faults.push_back({fault, pc, this->compiled});
+    }
+
+    /// @brief Emit a load of size bytes at the offset in rax into rd.
+    auto load(const DecodedInstruction& d, uint64_t pc) -> void {
+        switch (d.mnemonic) {
+        case Mnemonic::LB:
+            address(d, 1, pc);
+            // movsx rax, byte [r12 + rax]
+            as.emit({0x49, 0x0f, 0xbe, 0x04, 0x04});
+            break;
+        case Mnemonic::LBU:
+            address(d, 1, pc);
+            // movzx eax, byte [r12 + rax]
+            as.emit({0x41, 0x0f, 0xb6, 0x04, 0x04});
+            break;
+        case Mnemonic::LH:
+            address(d, 2, pc);
+            // movsx rax, word [r12 + rax]
+            as.emit({0x49, 0x0f, 0xbf, 0x04, 0x04});
+            break;
+        case Mnemonic::LHU:
+            address(d, 2, pc);
+            // movzx eax, word [r12 + rax]
+            as.emit({0x41, 0x0f, 0xb7, 0x04, 0x04});
+            break;
+        case Mnemonic::LW:
+            address(d, 4, pc);
+            // movsxd rax, dword [r12 + rax]
+            as.emit({0x49, 0x63, 0x04, 0x04});
+            break;
+        case Mnemonic::LWU:
+            address(d, 4, pc);
+            // mov eax, dword [r12 + rax]
+            as.emit({0x41, 0x8b, 0x04, 0x04});
+            break;
+        default:
+            address(d, 8, pc);
+            // mov rax, qword [r12 + rax]
+            as.emit({0x49, 0x8b, 0x04, 0x04});
+            break;
+        }
+        as.storeGuest(d.rd, RAX);
+    }
+
+    /// @brief Emit a store of size bytes of rs2 at the offset in rax, if
+    /// the store hits a code page the MMU is told and the block is left.
+    auto store(const DecodedInstruction& d, uint8_t size, uint64_t pc)
+        -> void {
+        address(d, size, pc);
+        as.loadGuest(RCX, d.rs2);
+        switch (size) {
+        case 1:
+            // mov byte [r12 + rax], cl
+            as.emit({0x41, 0x88, 0x0c, 0x04});
+            break;
+        case 2:
+            // mov word [r12 + rax], cx
+            as.emit({0x66, 0x41, 0x89, 0x0c, 0x04});
+            break;
+        case 4:
+            // mov dword [r12 + rax], ecx
+            as.emit({0x41, 0x89, 0x0c, 0x04});
+            break;
+        default:
+            // mov qword [r12 + rax], rcx
+            as.emit({0x49, 0x89, 0x0c, 0x04});
+            break;
+        }
+        auto invalidate = as.newLabel();
+        // Check the page of the first and last byte stored.
+        // lea rdx, [rax + offset]; shr rdx, PageShift;
+        // cmp byte [r14 + rdx], 0; jne invalidate
+        for (uint8_t offset : {(uint8_t)0, (uint8_t)(size - 1)}) {
+            as.emit({0x48, 0x8d, 0x50, offset});
+            as.emit({0x48, 0xc1, 0xea, (uint8_t)PageShift});
+            as.emit({0x41, 0x80, 0x3c, 0x16, 0x00});
+            as.jcc(NotEqual, invalidate);
+        }
+        invalidations.push_back(
+            {invalidate, pc + d.size, this->compiled + 1, size});
+    }
+
+    /// @brief Emit a conditional branch ending the block.
+    auto branch(const DecodedInstruction& d, Condition cc, uint64_t pc)
+        -> void {
+        as.loadGuest(RAX, d.rs1);
+        as.loadGuest(RCX, d.rs2);
+        as.alu(Cmp, true);
+        auto taken = as.newLabel();
+        as.jcc(cc, taken);
+        exit(pc + d.size, this->compiled + 1);
+        as.bind(taken);
+        exit(pc + (int64_t)d.imm, this->compiled + 1);
+    }
+
+    /// @brief rd = rs1 op imm.
+    auto aluImm(const DecodedInstruction& d, AluOp op, bool wide) -> void {
+        as.loadGuest(RAX, d.rs1);
+        as.aluImm(op, d.imm, wide);
+        if (!wide) {
+            as.signExtend32();
+        }
+        as.storeGuest(d.rd, RAX);
+    }
+
+    /// @brief rd = rs1 op rs2.
+    auto alu(const DecodedInstruction& d, AluOp op, bool wide) -> void {
+        as.loadGuest(RAX, d.rs1);
+        as.loadGuest(RCX, d.rs2);
+        as.alu(op, wide);
+        if (!wide) {
+            as.signExtend32();
+        }
+        as.storeGuest(d.rd, RAX);
+    }
+
+    /// @brief rd = rs1 * rs2, the lower half of the product.
+    auto mul(const DecodedInstruction& d, bool wide) -> void {
+        as.loadGuest(RAX, d.rs1);
+        as.loadGuest(RCX, d.rs2);
+        as.imul(wide);
+        if (!wide) {
+            as.signExtend32();
+        }
+        as.storeGuest(d.rd, RAX);
+    }
+
+    /// @brief rd = upper half of rs1 * rs2, both signed or both unsigned.
+    auto mulHigh(const DecodedInstruction& d, bool sign) -> void {
+        as.loadGuest(RAX, d.rs1);
+        as.loadGuest(RCX, d.rs2);
+        as.mulHigh(sign);
+        as.storeGuest(d.rd, RDX);
+    }
+
+    /// @brief rd = rs1 shifted by the immediate shift amount.
+    auto shiftImm(const DecodedInstruction& d, ShiftOp op, bool wide)
+        -> void {
+        as.loadGuest(RAX, d.rs1);
+        as.shiftImm(op, d.imm & (wide ? 0x3f : 0x1f), wide);
+        if (!wide) {
+            as.signExtend32();
+        }
+        as.storeGuest(d.rd, RAX);
+    }
+
+    /// @brief rd = rs1 shifted by rs2.
+    auto shift(const DecodedInstruction& d, ShiftOp op, bool wide) -> void {
+        as.loadGuest(RAX, d.rs1);
+        as.loadGuest(RCX, d.rs2);
+        as.shift(op, wide);
+        if (!wide) {
+            as.signExtend32();
+        }
+        as.storeGuest(d.rd, RAX);
+    }
+
+    /// @brief rd = (rs1 < rs2) or (rs1 < imm) under condition cc.
+    auto compare(const DecodedInstruction& d, Condition cc, bool immediate)
+        -> void {
+        as.loadGuest(RAX, d.rs1);
+        if (immediate) {
+            as.aluImm(Cmp, d.imm, true);
+        } else {
+            as.loadGuest(RCX, d.rs2);
+            as.alu(Cmp, true);
+        }
+        as.setcc(cc);
+        as.storeGuest(d.rd, RAX);
+    }
+
+    /// @brief Emit instruction d located at pc, returns false if the
+    /// instruction isn't supported.
+    auto instruction(const DecodedInstruction& d, uint64_t pc) -> bool {
+        switch (d.mnemonic) {
+        case Mnemonic::LUI:
+            as.movImm(RAX, (int64_t)d.imm);
+            as.storeGuest(d.rd, RAX);
+            return true;
+        case Mnemonic::AUIPC:
+            as.movImm(RAX, pc + (int64_t)d.imm);
+            as.storeGuest(d.rd, RAX);
+            return true;
+        case Mnemonic::JAL:
+            as.movImm(RAX, pc + d.size);
+            as.storeGuest(d.rd, RAX);
+            exit(pc + (int64_t)d.imm, this->compiled + 1);
+            return true;
+        case Mnemonic::JALR:
+            as.loadGuest(RAX, d.rs1);
+            as.aluImm(Add, d.imm, true);
+            // and rax, -2; mov rdx, rax
+            as.emit({0x48, 0x83, 0xe0, 0xfe});
+            as.emit({0x48, 0x89, 0xc2});
+            as.movImm(RCX, pc + d.size);
+            as.storeGuest(d.rd, RCX);
+            retire(this->compiled + 1);
+            // mov rax, rdx
+            as.emit({0x48, 0x89, 0xd0});
+            as.jmp(epilogue);
+            return true;
+        case Mnemonic::BEQ:
+            branch(d, Equal, pc);
+            return true;
+        case Mnemonic::BNE:
+            branch(d, NotEqual, pc);
+            return true;
+        case Mnemonic::BLT:
+            branch(d, Less, pc);
+            return true;
+        case Mnemonic::BGE:
+            branch(d, GreaterEqual, pc);
+            return true;
+        case Mnemonic::BLTU:
+            branch(d, Below, pc);
+            return true;
+        case Mnemonic::BGEU:
+            branch(d, AboveEqual, pc);
+            return true;
+        case Mnemonic::LB:
+        case Mnemonic::LH:
+        case Mnemonic::LW:
+        case Mnemonic::LD:
+        case Mnemonic::LBU:
+        case Mnemonic::LHU:
+        case Mnemonic::LWU:
+            load(d, pc);
+            return true;
+        case Mnemonic::SB:
+            store(d, 1, pc);
+            return true;
+        case Mnemonic::SH:
+            store(d, 2, pc);
+            return true;
+        case Mnemonic::SW:
+            store(d, 4, pc);
+            return true;
+        case Mnemonic::SD:
+            store(d, 8, pc);
+            return true;
+        case Mnemonic::ADDI:
+            aluImm(d, Add, true);
+            return true;
+        case Mnemonic::XORI:
+            aluImm(d, Xor, true);
+            return true;
+        case Mnemonic::ORI:
+            aluImm(d, Or, true);
+            return true;
+        case Mnemonic::ANDI:
+            aluImm(d, And, true);
+            return true;
+        case Mnemonic::SLTI:
+            compare(d, Less, true);
+            return true;
+        case Mnemonic::SLTIU:
+            compare(d, Below, true);
+            return true;
+        case Mnemonic::SLLI:
+            shiftImm(d, Shl, true);
+            return true;
+        case Mnemonic::SRLI:
+            shiftImm(d, Shr, true);
+            return true;
+        case Mnemonic::SRAI:
+            shiftImm(d, Sar, true);
+            return true;
+        case Mnemonic::ADDIW:
+            aluImm(d, Add, false);
+            return true;
+        case Mnemonic::SLLIW:
+            shiftImm(d, Shl, false);
+            return true;
+        case Mnemonic::SRLIW:
+            shiftImm(d, Shr, false);
+            return true;
+        case Mnemonic::SRAIW:
+            shiftImm(d, Sar, false);
+            return true;
+        case Mnemonic::ADD:
+            alu(d, Add, true);
+            return true;
+        case Mnemonic::SUB:
+            alu(d, Sub, true);
+            return true;
+        case Mnemonic::XOR:
+            alu(d, Xor, true);
+            return true;
+        case Mnemonic::OR:
+            alu(d, Or, true);
+            return true;
+        case Mnemonic::AND:
+            alu(d, And, true);
+            return true;
+        case Mnemonic::SLT:
+            compare(d, Less, false);
+            return true;
+        case Mnemonic::SLTU:
+            compare(d, Below, false);
+            return true;
+        case Mnemonic::SLL:
+            shift(d, Shl, true);
+            return true;
+        case Mnemonic::SRL:
+            shift(d, Shr, true);
+            return true;
+        case Mnemonic::SRA:
+            shift(d, Sar, true);
+            return true;
+        case Mnemonic::ADDW:
+            alu(d, Add, false);
+            return true;
+        case Mnemonic::SUBW:
+            alu(d, Sub, false);
+            return true;
+        case Mnemonic::SLLW:
+            shift(d, Shl, false);
+            return true;
+        case Mnemonic::SRLW:
+            shift(d, Shr, false);
+            return true;
+        case Mnemonic::SRAW:
+            shift(d, Sar, false);
+            return true;
+        case Mnemonic::MUL:
+            mul(d, true);
+            return true;
+        case Mnemonic::MULH:
+            mulHigh(d, true);
+            return true;
+        case Mnemonic::MULHU:
+            mulHigh(d, false);
+            return true;
+        case Mnemonic::MULW:
+            mul(d, false);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /// @brief Emit the out of line fault and invalidation paths.
+    auto emitStubs() -> void {
+        for (auto [label, pc, retired] : faults) {
+            as.bind(label);
+            // mov dword [r15 + status], AccessFault
+            as.emit({0x41, 0xc7, 0x47, (uint8_t)offsetof(JitState, status)});
+            as.emit32((uint32_t)JitStatus::AccessFault);
+            exit(pc, retired);
+        }
+        for (auto [label, next, retired, size] : invalidations) {
+            as.bind(label);
+            // mov rdi, r15; mov rsi, rax; mov edx, size
+            as.emit({0x4c, 0x89, 0xff});
+            as.emit({0x48, 0x89, 0xc6});
+            as.emit({0xba});
+            as.emit32(size);
+            // mov rax, invalidateCode; call rax
+            as.movImm(RAX, (uint64_t)&invalidateCode);
+            as.emit({0xff, 0xd0});
+            exit(next, retired);
+        }
+    }
+
+    /// @brief Pending access fault stub, leaving at the faulting
+    /// instruction.
+    struct Fault {
+        Assembler::Label label;
+        uint64_t pc;
+        uint32_t retired;
+    };
+
+    /// @brief Pending store invalidation stub.
+    struct Invalidation {
+        Assembler::Label label;
+        uint64_t next;
+        uint32_t retired;
+        uint8_t size;
+    };
+
+    Assembler as;
+    Assembler::Label epilogue;
+    /// @brief Instructions of the block compiled before the current one.
+    uint32_t compiled = 0;
+    std::vector<Fault> faults;
+    std::vector<Invalidation> invalidations;
+};
+
+#endif
+
+//=== JitCompiler Methods Implementations ====//
+
+JitCompiler::JitCompiler() = default;
+
+JitCompiler::~JitCompiler() {
+    if (this->code != nullptr) {
+        munmap(this->code, JitCodeSize);
+    }
+}
+
+JitCompiler::JitCompiler(JitCompiler&& other) noexcept
+    : code(std::exchange(other.code, nullptr)),
+      used(std::exchange(other.used, 0)),
+      failed(std::exchange(other.failed, false)) {}
+
+auto JitCompiler::operator=(JitCompiler&& other) noexcept -> JitCompiler& {
+    std::swap(this->code, other.code);
+    std::swap(this->used, other.used);
+    std::swap(this->failed, other.failed);
+    return *this;
+}
+
+/// @brief Returns true if blocks can be compiled on this host.
+/// @return bool
+auto JitCompiler::available() const -> bool {
+#if defined(__x86_64__)
+    return !this->failed;
+#else
+    return false;
+#endif
+}
+
+/// @brief Compile block to native code, blocks are never freed and
+/// compilation stops once the executable buffer is full.
+/// @param block
+/// @return JitFunction or nullptr.
+auto JitCompiler::compile([[maybe_unused]] const TranslatedBlock& block)
+    -> JitFunction {
+    if (!available()) {
+        return nullptr;
+    }
+#if defined(__x86_64__)
+    if (this->code == nullptr) {
+        void* buffer = mmap(nullptr, JitCodeSize,
+                            PROT_READ | PROT_WRITE | PROT_EXEC,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer == MAP_FAILED) {
+            this->failed = true;
+            return nullptr;
+        }
+        this->code = static_cast<uint8_t*>(buffer);
+    }
+    BlockCompiler compiler;
+    if (!compiler.compile(block)) {
+        return nullptr;
+    }
+    const auto& bytes = compiler.bytes();
+    // Keep compiled blocks 16 bytes aligned.
+    auto start = (this->used + 15) & ~(size_t)15;
+    if (start + bytes.size() > JitCodeSize) {
+        return nullptr;
+    }
+    std::memcpy(this->code + start, bytes.data(), bytes.size());
+    this->used = start + bytes.size();
+    return reinterpret_cast<JitFunction>(this->code + start);
+#else
+    return nullptr;
+#endif
+}
+
+} // namespace riscvemu
@@ -1,27 +1,33 @@
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
 #include <cstdint>
 #include <cstdio>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "CSR.h"
 #include "Decoder.h"
+#include "Elf.h"
 #include "Instructions.h"
 #include "Machine.h"
+#include "Semantics.h"
 
 namespace riscvemu {
 
 //=== MMU Methods Implementations ====//
-// MMU stores data in byte aligned Little Endian format.
-// e.g a single DWORD is laid out on byte alignment of four successive
-// entries, to read a DWORD at a given address we first compute the actual
-// address as [addr - BASE_ADDRESS] because the heap grows upwards.
-// Each k-th read is shifted by k * 8 to lift the bits to their MSB position.
-// After the shift the LSB's are zeroes, using OR we essentially replace
-// the zeroed-out bits in the right hand side by the bits in the left hand side
-// e.g our first read yields [11001100] our second read yields [01101110]
-// after a left shift by eight on the second read we end up with :
-//  [01101110 || 00000000] doing an OR with the previous read we end up with:
-//  [11001100] OR [01101110 || 00000000] = [01101110 || 11001100]
+// MMU stores data in byte aligned Little Endian format, the same layout as
+// the (little endian) host so values are accessed with a single host load
+// or store at offset [addr - BASE_ADDRESS] because the heap grows upwards.
+// The size specialized MMU::load<T> and MMU::store<T> in Machine.h are the
+// fast paths, the functions below dispatch to them on a runtime size.
 
 /// @brief Load size number of bytes from memory at the given address.
 /// @param addr Memory address.
@@ -29,11 +35,6 @@ namespace riscvemu {
 /// @return Memory contents at address cast as uint64_t.
 auto MMU::load(VirtualAddress addr, size_t size) // NOLINT
     -> uint64_t {
-    // If the memory access is not within the access range
-    // throw a LoadAccessFault exception.
-    if (!withinRange(addr)) {
-        throw LoadAccessFault();
-    }
     switch (size) {
     case 8:
         return load8(addr);
@@ -57,9 +58,6 @@ auto MMU::load(VirtualAddress addr, size_t size) // NOLINT
 /// @return void.
 auto MMU::store(VirtualAddress addr, size_t size, uint64_t value)
     -> void { // NOLINT
-    if (!withinRange(addr)) {
-        throw LoadAccessFault();
-    }
     switch (size) {
     case 8:
         return store8(addr, value);
@@ -76,39 +74,28 @@ auto MMU::store(VirtualAddress addr, size_t size, uint64_t value)
 /// @param addr
 /// @return byte value represented as uint64_t.
 auto MMU::load8(VirtualAddress addr) -> uint64_t {
-    return (uint64_t)this->memory[addr - MemoryBaseAddr];
+    return load<uint8_t>(addr);
 }
 
 /// @brief Load a HALFWORD from memory.
 /// @param addr
 /// @return 2 byte value represented as uint64_t.
 auto MMU::load16(VirtualAddress addr) -> uint64_t {
-    return (uint64_t)this->memory[addr - MemoryBaseAddr] |
-           (uint64_t)this->memory[addr - MemoryBaseAddr + 1] << 8;
+    return load<uint16_t>(addr);
 }
 
 /// @brief Load a WORD from memory.
 /// @param addr
 /// @return 4 byte value represented as uint64_t.
 auto MMU::load32(VirtualAddress addr) -> uint64_t {
-    return (uint64_t)this->memory[addr - MemoryBaseAddr] |
-           (uint64_t)this->memory[addr - MemoryBaseAddr + 1] << 8 |
-           (uint64_t)this->memory[addr - MemoryBaseAddr + 2] << 16 |
-           (uint64_t)this->memory[addr - MemoryBaseAddr + 3] << 24;
+    return load<uint32_t>(addr);
 }
 
 /// @brief Load a DWORD from meory.
 /// @param addr
 /// @return 8 byte value represented as uint64_t.
 auto MMU::load64(VirtualAddress addr) -> uint64_t {
-    return (uint64_t)this->memory[addr - MemoryBaseAddr] |
-           (uint64_t)this->memory[addr - MemoryBaseAddr + 1] << 8 |
-           (uint64_t)this->memory[addr - MemoryBaseAddr + 2] << 16 |
-           (uint64_t)this->memory[addr - MemoryBaseAddr + 3] << 24 |
-           (uint64_t)this->memory[addr - MemoryBaseAddr + 4] << 32 |
-           (uint64_t)this->memory[addr - MemoryBaseAddr + 5] << 40 |
-           (uint64_t)this->memory[addr - MemoryBaseAddr + 6] << 48 |
-           (uint64_t)this->memory[addr - MemoryBaseAddr + 7] << 56;
+    return load<uint64_t>(addr);
 }
 
 /// @brief Store a byte in memory.
@@ -116,7 +103,7 @@ auto MMU::load64(VirtualAddress addr) -> uint64_t {
 /// @param value
 /// @return
 auto MMU::store8(VirtualAddress addr, uint64_t value) -> void {
-    this->memory[addr - MemoryBaseAddr] = (uint8_t)(value & 0xFF);
+    store<uint8_t>(addr, (uint8_t)value);
 }
 
 /// @brief Store a HALFWORD in memory.
@@ -124,8 +111,7 @@ auto MMU::store8(VirtualAddress addr, uint64_t value) -> void {
 /// @param value
 /// @return
 auto MMU::store16(VirtualAddress addr, uint64_t value) -> void {
-    this->memory[addr - MemoryBaseAddr]     = (uint8_t)(value & 0xFF);
-    this->memory[addr - MemoryBaseAddr + 1] = (uint8_t)((value >> 8) & 0xFF);
+    store<uint16_t>(addr, (uint16_t)value);
 }
 
 /// @brief Store a WORD in memory.
@@ -133,10 +119,7 @@ auto MMU::store16(VirtualAddress addr, uint64_t value) -> void {
 /// @param value
 /// @return
 auto MMU::store32(VirtualAddress addr, uint64_t value) -> void {
-    this->memory[addr - MemoryBaseAddr]     = (uint8_t)(value & 0xFF);
-    this->memory[addr - MemoryBaseAddr + 1] = (uint8_t)((value >> 8) & 0xFF);
-    this->memory[addr - MemoryBaseAddr + 2] = (uint8_t)((value >> 16) & 0xFF);
-    this->memory[addr - MemoryBaseAddr + 3] = (uint8_t)((value >> 24) & 0xFF);
+    store<uint32_t>(addr, (uint32_t)value);
 }
 
 /// @brief Store a DWORD in memory.
@@ -144,14 +127,7 @@ auto MMU::store32(VirtualAddress addr, uint64_t value) -> void {
 /// @param value
 /// @return
 auto MMU::store64(VirtualAddress addr, uint64_t value) -> void {
-    this->memory[addr - MemoryBaseAddr]     = (uint8_t)(value & 0xFF);
-    this->memory[addr - MemoryBaseAddr + 1] = (uint8_t)((value >> 8) & 0xFF);
-    this->memory[addr - MemoryBaseAddr + 2] = (uint8_t)((value >> 16) & 0xFF);
-    this->memory[addr - MemoryBaseAddr + 3] = (uint8_t)((value >> 24) & 0xFF);
-    this->memory[addr - MemoryBaseAddr + 4] = (uint8_t)((value >> 32) & 0xFF);
-    this->memory[addr - MemoryBaseAddr + 5] = (uint8_t)((value >> 40) & 0xFF);
-    this->memory[addr - MemoryBaseAddr + 6] = (uint8_t)((value >> 48) & 0xFF);
-    this->memory[addr - MemoryBaseAddr + 7] = (uint8_t)((value >> 56) & 0xFF);
+    store<uint64_t>(addr, value);
 }
 
 /// @brief Dump memory contents to stdout.
@@ -165,11 +141,54 @@ auto MMU::dumpMemory() -> void {
     printf("\n");
 }
 
+//=== VMContext Methods Implementations ====//
+
+/// @brief Create a context running the raw binary image at path.
+/// @param path
+/// @param memorySize
+/// @return VMContext
+auto VMContext::fromImage(const std::string& path, uint64_t memorySize)
+    -> VMContext {
+    auto ctx     = VMContext(memorySize);
+    ctx.codeSize  = mapImage(ctx.mmu.memory.data(), ctx.mmu.memory.size(),
+                             path);
+    ctx.imageSize = ctx.codeSize;
+    ctx.dataSize  = ctx.codeSize;
+    return ctx;
+}
+
+/// @brief Create a context running the ELF executable at path.
+/// @param path
+/// @param memorySize
+/// @return VMContext
+auto VMContext::fromElf(const std::string& path, uint64_t memorySize)
+    -> VMContext {
+    auto ctx      = VMContext(memorySize);
+    auto image    = loadElf(ctx.mmu, path);
+    ctx.entry     = image.entry;
+    ctx.codeSize  = image.codeEnd - MemoryBaseAddr;
+    ctx.imageSize = image.imageEnd - MemoryBaseAddr;
+    ctx.dataSize  = image.end - MemoryBaseAddr;
+    ctx.phdr      = image.phdr;
+    ctx.phnum     = image.phnum;
+    return ctx;
+}
+
+/// @brief Attach the console UART and the CLINT to the bus.
+auto VMContext::attachDevices() -> void {
+    this->uart  = std::make_shared<Uart>(std::cout);
+    this->clint = std::make_shared<Clint>(this->started);
+    this->bus.attach(UartBaseAddr, UartSize, this->uart);
+    this->bus.attach(ClintBaseAddr, ClintSize, this->clint);
+}
+
 //==== CPU Methods Implementations ====//
 
 /// @brief Fetches the next instruction to execute stored @ pc.
 /// @return Returns the instruction in 32-bit format (encoded.)
-auto CPU::fetch() -> uint32_t { return this->ctx->mmu.load(this->pc, 32); }
+auto CPU::fetch() -> uint32_t {
+    return this->ctx->mmu.load<uint32_t>(this->pc);
+}
 
 /// @brief Decode the fetched instruction to execute.
 auto CPU::decode(uint32_t instruction) -> Instruction {
@@ -189,7 +208,20 @@ auto CPU::getRegister(Register reg) -> uint64_t {
 /// @brief Get value stored in the control or status registers.
 /// @param addr uitn64_t
 /// @return uint64_t
-auto CPU::getCSR(uint64_t addr) -> uint64_t { return this->csrs.csrs[addr]; }
+auto CPU::getCSR(uint64_t addr) -> uint64_t {
+    auto kind = CSR::entry(addr).kind;
+    if (kind == CSRKind::Counter || kind == CSRKind::HpmCounter) {
+        return readCounter(addr);
+    }
+    return this->csrs.stored(addr);
+}
+
+/// @brief Get the bits stored in floating point register idx.
+/// @param idx
+/// @return uint64_t
+auto CPU::getFloatRegister(uint64_t idx) -> uint64_t {
+    return this->fregisters[idx];
+}
 
 /// @brief Set register reg with given value.
 /// @param reg: Register
@@ -221,463 +253,1197 @@ auto CPU::store(VirtualAddress addr, size_t size, uint64_t value) -> void {
 auto CPU::dumpRegisters() -> void {
     for (int i = 0; i < 32; i++) {
         Register const reg = getRegisterFromIndex(i);
-        printf("x[%d]/%s  =  0x%llx\n", i, getRegisterABIName(reg),
+        printf("x[%d]/%s  =  0x%" PRIx64 "\n", i, getRegisterABIName(reg),
                this->registers[i]);
     }
     printf("\n");
 }
 
+/// @brief Return the handler executing instructions of the given mnemonic.
+/// @param mnemonic
+/// @return Handler
+auto handlerFor(Mnemonic mnemonic) -> Handler {
+    switch (mnemonic) {
+    case Mnemonic::LUI:
+        return &Semantics::lui;
+    case Mnemonic::AUIPC:
+        return &Semantics::auipc;
+    case Mnemonic::JAL:
+        return &Semantics::jal;
+    case Mnemonic::JALR:
+        return &Semantics::jalr;
+    case Mnemonic::BEQ:
+        return &Semantics::beq;
+    case Mnemonic::BNE:
+        return &Semantics::bne;
+    case Mnemonic::BLT:
+        return &Semantics::blt;
+    case Mnemonic::BGE:
+        return &Semantics::bge;
+    case Mnemonic::BLTU:
+        return &Semantics::bltu;
+    case Mnemonic::BGEU:
+        return &Semantics::bgeu;
+    case Mnemonic::LB:
+        return &Semantics::load<int8_t>;
+    case Mnemonic::LH:
+        return &Semantics::load<int16_t>;
+    case Mnemonic::LW:
+        return &Semantics::load<int32_t>;
+    case Mnemonic::LD:
+        return &Semantics::load<int64_t>;
+    case Mnemonic::LBU:
+        return &Semantics::load<uint8_t>;
+    case Mnemonic::LHU:
+        return &Semantics::load<uint16_t>;
+    case Mnemonic::LWU:
+        return &Semantics::load<uint32_t>;
+    case Mnemonic::SB:
+        return &Semantics::store<uint8_t>;
+    case Mnemonic::SH:
+        return &Semantics::store<uint16_t>;
+    case Mnemonic::SW:
+        return &Semantics::store<uint32_t>;
+    case Mnemonic::SD:
+        return &Semantics::store<uint64_t>;
+    case Mnemonic::ADDI:
+        return &Semantics::addi;
+    case Mnemonic::SLTI:
+        return &Semantics::slti;
+    case Mnemonic::SLTIU:
+        return &Semantics::sltiu;
+    case Mnemonic::XORI:
+        return &Semantics::xori;
+    case Mnemonic::ORI:
+        return &Semantics::ori;
+    case Mnemonic::ANDI:
+        return &Semantics::andi;
+    case Mnemonic::SLLI:
+        return &Semantics::slli;
+    case Mnemonic::SRLI:
+        return &Semantics::srli;
+    case Mnemonic::SRAI:
+        return &Semantics::srai;
+    case Mnemonic::ADDIW:
+        return &Semantics::addiw;
+    case Mnemonic::SLLIW:
+        return &Semantics::slliw;
+    case Mnemonic::SRLIW:
+        return &Semantics::srliw;
+    case Mnemonic::SRAIW:
+        return &Semantics::sraiw;
+    case Mnemonic::ADD:
+        return &Semantics::add;
+    case Mnemonic::SUB:
+        return &Semantics::sub;
+    case Mnemonic::SLL:
+        return &Semantics::sll;
+    case Mnemonic::SLT:
+        return &Semantics::slt;
+    case Mnemonic::SLTU:
+        return &Semantics::sltu;
+    case Mnemonic::XOR:
+        return &Semantics::xor_;
+    case Mnemonic::SRL:
+        return &Semantics::srl;
+    case Mnemonic::SRA:
+        return &Semantics::sra;
+    case Mnemonic::OR:
+        return &Semantics::or_;
+    case Mnemonic::AND:
+        return &Semantics::and_;
+    case Mnemonic::ADDW:
+        return &Semantics::addw;
+    case Mnemonic::SUBW:
+        return &Semantics::subw;
+    case Mnemonic::SLLW:
+        return &Semantics::sllw;
+    case Mnemonic::SRLW:
+        return &Semantics::srlw;
+    case Mnemonic::SRAW:
+        return &Semantics::sraw;
+    case Mnemonic::ECALL:
+        return &Semantics::ecall;
+    case Mnemonic::EBREAK:
+        return &Semantics::ebreak;
+    case Mnemonic::MRET:
+        return &Semantics::mret;
+    case Mnemonic::SRET:
+        return &Semantics::sret;
+    case Mnemonic::SFENCE_VMA:
+        return &Semantics::sfence;
+    case Mnemonic::WFI:
+        return &Semantics::wfi;
+    case Mnemonic::CSRRW:
+        return &Semantics::csrrw;
+    case Mnemonic::CSRRS:
+        return &Semantics::csrrs;
+    case Mnemonic::CSRRC:
+        return &Semantics::csrrc;
+    case Mnemonic::CSRRWI:
+        return &Semantics::csrrwi;
+    case Mnemonic::CSRRSI:
+        return &Semantics::csrrsi;
+    case Mnemonic::CSRRCI:
+        return &Semantics::csrrci;
+    case Mnemonic::FENCE:
+    case Mnemonic::FENCE_I:
+        return &Semantics::fence;
+    case Mnemonic::LR_W:
+        return &Semantics::lr<uint32_t>;
+    case Mnemonic::SC_W:
+        return &Semantics::sc<uint32_t>;
+    case Mnemonic::AMOSWAP_W:
+        return &Semantics::amoswap<uint32_t>;
+    case Mnemonic::AMOADD_W:
+        return &Semantics::amoadd<uint32_t>;
+    case Mnemonic::AMOXOR_W:
+        return &Semantics::amoxor<uint32_t>;
+    case Mnemonic::AMOAND_W:
+        return &Semantics::amoand<uint32_t>;
+    case Mnemonic::AMOOR_W:
+        return &Semantics::amoor<uint32_t>;
+    case Mnemonic::AMOMIN_W:
+        return &Semantics::amomin<uint32_t>;
+    case Mnemonic::AMOMAX_W:
+        return &Semantics::amomax<uint32_t>;
+    case Mnemonic::AMOMINU_W:
+        return &Semantics::amominu<uint32_t>;
+    case Mnemonic::AMOMAXU_W:
+        return &Semantics::amomaxu<uint32_t>;
+    case Mnemonic::LR_D:
+        return &Semantics::lr<uint64_t>;
+    case Mnemonic::SC_D:
+        return &Semantics::sc<uint64_t>;
+    case Mnemonic::AMOSWAP_D:
+        return &Semantics::amoswap<uint64_t>;
+    case Mnemonic::AMOADD_D:
+        return &Semantics::amoadd<uint64_t>;
+    case Mnemonic::AMOXOR_D:
+        return &Semantics::amoxor<uint64_t>;
+    case Mnemonic::AMOAND_D:
+        return &Semantics::amoand<uint64_t>;
+    case Mnemonic::AMOOR_D:
+        return &Semantics::amoor<uint64_t>;
+    case Mnemonic::AMOMIN_D:
+        return &Semantics::amomin<uint64_t>;
+    case Mnemonic::AMOMAX_D:
+        return &Semantics::amomax<uint64_t>;
+    case Mnemonic::AMOMINU_D:
+        return &Semantics::amominu<uint64_t>;
+    case Mnemonic::AMOMAXU_D:
+        return &Semantics::amomaxu<uint64_t>;
+    case Mnemonic::MUL:
+        return &Semantics::mul;
+    case Mnemonic::MULH:
+        return &Semantics::mulh;
+    case Mnemonic::MULHSU:
+        return &Semantics::mulhsu;
+    case Mnemonic::MULHU:
+        return &Semantics::mulhu;
+    case Mnemonic::DIV:
+        return &Semantics::div;
+    case Mnemonic::DIVU:
+        return &Semantics::divu;
+    case Mnemonic::REM:
+        return &Semantics::rem;
+    case Mnemonic::REMU:
+        return &Semantics::remu;
+    case Mnemonic::MULW:
+        return &Semantics::mulw;
+    case Mnemonic::DIVW:
+        return &Semantics::divw;
+    case Mnemonic::DIVUW:
+        return &Semantics::divuw;
+    case Mnemonic::REMW:
+        return &Semantics::remw;
+    case Mnemonic::REMUW:
+        return &Semantics::remuw;
+    case Mnemonic::FSW:
+        return &Semantics::fstore<float>;
+    case Mnemonic::FSD:
+        return &Semantics::fstore<double>;
+    case Mnemonic::FLW:
+        return &Semantics::fload<float>;
+    case Mnemonic::FLD:
+        return &Semantics::fload<double>;
+    case Mnemonic::FMADD_S:
+        return &Semantics::fmadd<float>;
+    case Mnemonic::FMSUB_S:
+        return &Semantics::fmsub<float>;
+    case Mnemonic::FNMSUB_S:
+        return &Semantics::fnmsub<float>;
+    case Mnemonic::FNMADD_S:
+        return &Semantics::fnmadd<float>;
+    case Mnemonic::FADD_S:
+        return &Semantics::fadd<float>;
+    case Mnemonic::FSUB_S:
+        return &Semantics::fsub<float>;
+    case Mnemonic::FMUL_S:
+        return &Semantics::fmul<float>;
+    case Mnemonic::FDIV_S:
+        return &Semantics::fdiv<float>;
+    case Mnemonic::FSQRT_S:
+        return &Semantics::fsqrt<float>;
+    case Mnemonic::FSGNJ_S:
+        return &Semantics::fsgnj<float>;
+    case Mnemonic::FSGNJN_S:
+        return &Semantics::fsgnjn<float>;
+    case Mnemonic::FSGNJX_S:
+        return &Semantics::fsgnjx<float>;
+    case Mnemonic::FMIN_S:
+        return &Semantics::fmin<float>;
+    case Mnemonic::FMAX_S:
+        return &Semantics::fmax<float>;
+    case Mnemonic::FCVT_S_W:
+        return &Semantics::fcvtFromInt<float, int32_t>;
+    case Mnemonic::FCVT_S_WU:
+        return &Semantics::fcvtFromInt<float, uint32_t>;
+    case Mnemonic::FCVT_S_L:
+        return &Semantics::fcvtFromInt<float, int64_t>;
+    case Mnemonic::FCVT_S_LU:
+        return &Semantics::fcvtFromInt<float, uint64_t>;
+    case Mnemonic::FMV_W_X:
+        return &Semantics::fmvFromInt<float>;
+    case Mnemonic::FCVT_S_D:
+        return &Semantics::fcvtFloat<float, double>;
+    case Mnemonic::FMADD_D:
+        return &Semantics::fmadd<double>;
+    case Mnemonic::FMSUB_D:
+        return &Semantics::fmsub<double>;
+    case Mnemonic::FNMSUB_D:
+        return &Semantics::fnmsub<double>;
+    case Mnemonic::FNMADD_D:
+        return &Semantics::fnmadd<double>;
+    case Mnemonic::FADD_D:
+        return &Semantics::fadd<double>;
+    case Mnemonic::FSUB_D:
+        return &Semantics::fsub<double>;
+    case Mnemonic::FMUL_D:
+        return &Semantics::fmul<double>;
+    case Mnemonic::FDIV_D:
+        return &Semantics::fdiv<double>;
+    case Mnemonic::FSQRT_D:
+        return &Semantics::fsqrt<double>;
+    case Mnemonic::FSGNJ_D:
+        return &Semantics::fsgnj<double>;
+    case Mnemonic::FSGNJN_D:
+        return &Semantics::fsgnjn<double>;
+    case Mnemonic::FSGNJX_D:
+        return &Semantics::fsgnjx<double>;
+    case Mnemonic::FMIN_D:
+        return &Semantics::fmin<double>;
+    case Mnemonic::FMAX_D:
+        return &Semantics::fmax<double>;
+    case Mnemonic::FCVT_D_W:
+        return &Semantics::fcvtFromInt<double, int32_t>;
+    case Mnemonic::FCVT_D_WU:
+        return &Semantics::fcvtFromInt<double, uint32_t>;
+    case Mnemonic::FCVT_D_L:
+        return &Semantics::fcvtFromInt<double, int64_t>;
+    case Mnemonic::FCVT_D_LU:
+        return &Semantics::fcvtFromInt<double, uint64_t>;
+    case Mnemonic::FMV_D_X:
+        return &Semantics::fmvFromInt<double>;
+    case Mnemonic::FCVT_D_S:
+        return &Semantics::fcvtFloat<double, float>;
+    case Mnemonic::FCVT_W_S:
+        return &Semantics::fcvtToInt<int32_t, float>;
+    case Mnemonic::FCVT_WU_S:
+        return &Semantics::fcvtToInt<uint32_t, float>;
+    case Mnemonic::FCVT_L_S:
+        return &Semantics::fcvtToInt<int64_t, float>;
+    case Mnemonic::FCVT_LU_S:
+        return &Semantics::fcvtToInt<uint64_t, float>;
+    case Mnemonic::FMV_X_W:
+        return &Semantics::fmvToInt<float>;
+    case Mnemonic::FEQ_S:
+        return &Semantics::feq<float>;
+    case Mnemonic::FLT_S:
+        return &Semantics::flt<float>;
+    case Mnemonic::FLE_S:
+        return &Semantics::fle<float>;
+    case Mnemonic::FCLASS_S:
+        return &Semantics::fclass<float>;
+    case Mnemonic::FCVT_W_D:
+        return &Semantics::fcvtToInt<int32_t, double>;
+    case Mnemonic::FCVT_WU_D:
+        return &Semantics::fcvtToInt<uint32_t, double>;
+    case Mnemonic::FCVT_L_D:
+        return &Semantics::fcvtToInt<int64_t, double>;
+    case Mnemonic::FCVT_LU_D:
+        return &Semantics::fcvtToInt<uint64_t, double>;
+    case Mnemonic::FMV_X_D:
+        return &Semantics::fmvToInt<double>;
+    case Mnemonic::FEQ_D:
+        return &Semantics::feq<double>;
+    case Mnemonic::FLT_D:
+        return &Semantics::flt<double>;
+    case Mnemonic::FLE_D:
+        return &Semantics::fle<double>;
+    case Mnemonic::FCLASS_D:
+        return &Semantics::fclass<double>;
+    case Mnemonic::VSETVLI:
+        return &Semantics::vsetvli;
+    case Mnemonic::VSETIVLI:
+        return &Semantics::vsetivli;
+    case Mnemonic::VSETVL:
+        return &Semantics::vsetvl;
+    case Mnemonic::VMV_X_S:
+        return &Semantics::vmvXS;
+    case Mnemonic::VFMV_F_S:
+        return &Semantics::vfmvFS;
+    case Mnemonic::VLE:
+        return &Semantics::vle;
+    case Mnemonic::VLSE:
+        return &Semantics::vlse;
+    case Mnemonic::VSE:
+        return &Semantics::vse;
+    case Mnemonic::VSSE:
+        return &Semantics::vsse;
+    case Mnemonic::VADD:
+        return &Semantics::vadd;
+    case Mnemonic::VSUB:
+        return &Semantics::vsub;
+    case Mnemonic::VRSUB:
+        return &Semantics::vrsub;
+    case Mnemonic::VMINU:
+        return &Semantics::vminu;
+    case Mnemonic::VMIN:
+        return &Semantics::vmin;
+    case Mnemonic::VMAXU:
+        return &Semantics::vmaxu;
+    case Mnemonic::VMAX:
+        return &Semantics::vmax;
+    case Mnemonic::VAND:
+        return &Semantics::vand;
+    case Mnemonic::VOR:
+        return &Semantics::vor;
+    case Mnemonic::VXOR:
+        return &Semantics::vxor;
+    case Mnemonic::VSLL:
+        return &Semantics::vsll;
+    case Mnemonic::VSRL:
+        return &Semantics::vsrl;
+    case Mnemonic::VSRA:
+        return &Semantics::vsra;
+    case Mnemonic::VMSEQ:
+        return &Semantics::vmseq;
+    case Mnemonic::VMSNE:
+        return &Semantics::vmsne;
+    case Mnemonic::VMSLTU:
+        return &Semantics::vmsltu;
+    case Mnemonic::VMSLT:
+        return &Semantics::vmslt;
+    case Mnemonic::VMSLEU:
+        return &Semantics::vmsleu;
+    case Mnemonic::VMSLE:
+        return &Semantics::vmsle;
+    case Mnemonic::VMSGTU:
+        return &Semantics::vmsgtu;
+    case Mnemonic::VMSGT:
+        return &Semantics::vmsgt;
+    case Mnemonic::VMERGE:
+        return &Semantics::vmerge;
+    case Mnemonic::VMUL:
+        return &Semantics::vmul;
+    case Mnemonic::VMACC:
+        return &Semantics::vmacc;
+    case Mnemonic::VREDSUM:
+        return &Semantics::vredsum;
+    case Mnemonic::VMV_S_X:
+        return &Semantics::vmvSX;
+    case Mnemonic::VFADD:
+        return &Semantics::vfadd;
+    case Mnemonic::VFSUB:
+        return &Semantics::vfsub;
+    case Mnemonic::VFMUL:
+        return &Semantics::vfmul;
+    case Mnemonic::VFDIV:
+        return &Semantics::vfdiv;
+    case Mnemonic::VFMACC:
+        return &Semantics::vfmacc;
+    case Mnemonic::VFREDUSUM:
+        return &Semantics::vfredusum;
+    case Mnemonic::VFMERGE:
+        return &Semantics::vfmerge;
+    case Mnemonic::VFMV_S_F:
+        return &Semantics::vfmvSF;
+    default:
+        return &Semantics::illegal;
+    }
+}
+
 /// @brief Execute an instruction.
 /// @param Instruction&
 /// @return void
 auto CPU::execute(const Instruction& instruction) -> void {
-    switch (instruction.opcode) {
-    case OPCode::LUI: {
-        // Utype instruction (LUI).
-        auto inst = Utype(instruction.instruction);
-        auto rd   = inst.Rd;
-        auto imm  = inst.Imm;
-        // LUI: load upper immediate places the the immediate value
-        // in the top 20 bits of the destination register rd filling
-        // the lowest 12 bits with zeroes.
-        auto value = signExtend(imm & 0xFFFFF000, 64);
-        this->setRegister(rd, value);
-        break;
-    }
-    case OPCode::AUIPC: {
-        // Utype instruction (AUIPC).
-        auto inst = Utype(instruction.instruction);
-        auto rd   = inst.Rd;
-        auto imm  = inst.Imm;
-        // AUIPC: add upper immediate to pc builds a pc-relative address.
-        auto offset = (this->pc + signExtend(imm & 0xFFFFF000, 64) - 4);
-        this->setRegister(rd, offset);
-        break;
-    }
-    case OPCode::JAL: {
-        // Jtype instrtuction (JAL)
-        auto inst = Jtype(instruction.instruction);
-        auto rd   = inst.Rd;
-        auto imm  = inst.Imm;
-        // JAL: jump and link
-        this->setRegister(rd, this->pc);
-        this->pc = this->pc + signExtend(imm - 4, 64);
-        // TODO: raise Misaligned exception if address is misaligned
-        break;
+    auto decoded    = predecode(instruction.instruction);
+    decoded.handler = handlerFor(decoded.mnemonic);
+    if (!decoded.handler(*this, decoded)) {
+        takeTrap(this->pc - decoded.size);
+        return;
     }
-    case OPCode::JALR: {
-        // Itype instruction (JALR)
-        auto inst = Itype(instruction.instruction);
-        auto rd   = inst.Rd;
-        auto rs1  = inst.Rs1;
-        auto imm  = inst.Imm;
-        // JALR: (indirect) jump and link register.
-        auto oldPC = this->pc;
-        this->pc   = (this->registers[(size_t)rs1] + signExtend(imm, 64)) &
-                   0xFFFFFFFE - 4;
-        this->setRegister(rd, oldPC);
-        // TODO: raise Misaligned exception if address is misaligned
-        break;
+    this->instret++;
+}
+
+/// @brief FloatFlagsScope clears the host exception flags when a run loop
+/// starts and folds the flags the guest raised into fflags when it returns,
+/// flags raised by the host in between runs are never seen by the guest.
+class FloatFlagsScope {
+    public:
+    explicit FloatFlagsScope(CPU& cpu) : cpu(cpu) { clearHostFlags(); }
+    ~FloatFlagsScope() { cpu.syncFloatFlags(); }
+    FloatFlagsScope(const FloatFlagsScope&)                    = delete;
+    auto operator=(const FloatFlagsScope&) -> FloatFlagsScope& = delete;
+
+    private:
+    CPU& cpu;
+};
+
+void CPU::run() {
+    this->outcome = {};
+    if (this->profiler != nullptr || this->tracer != nullptr) {
+        return this->profiler != nullptr && this->sampling.interval != 0
+                   ? runSampled(Engine::Interpreter)
+                   : runInstrumented();
     }
-    case OPCode::BRANCH: {
-        // Btype instruction (Branching).
-        auto inst = Btype(instruction.instruction);
-        auto imm  = inst.Imm;
-        auto rs1  = inst.Rs1;
-        auto rs2  = inst.Rs2;
-
-        if (inst.Funct3 == 0b000) /* BEQ */ {
-            // BEQ : take the branch if [rs1] == [rs2]
-            if (this->getRegister(rs1) == this->getRegister(rs2)) {
-                this->pc = this->pc + signExtend(imm, 64);
-            }
+    auto flags = FloatFlagsScope(*this);
+    while (true) {
+        if (outsideCode()) {
+            break;
         }
-        if (inst.Funct3 == 0b001) /* BNE */ {
-            // BNE : take the branch if [rs1] != [rs2]
-            if (this->getRegister(rs1) != this->getRegister(rs2)) {
-                this->pc = (this->pc + signExtend(imm, 64));
+        if (this->instret >= this->pollAt) [[unlikely]] {
+            if (this->instret >= this->stopAt) {
+                break;
             }
-        }
-        if (inst.Funct3 == 0b100) /* BLT */ {
-            // BLT : take the branch if [rs1] < [rs2]
-            if ((int64_t)this->getRegister(rs1) <
-                (int64_t)this->getRegister(rs2)) {
-                this->pc = this->pc + (int64_t)imm;
+            if (pollInterrupts()) {
+                continue;
             }
         }
-        if (inst.Funct3 == 0b101) /* BGE */ {
-            // BGE : take the branch if [rs1] >= [rs2]
-            if ((int64_t)this->getRegister(rs1) >=
-                (int64_t)this->getRegister(rs2)) {
-                this->pc = this->pc + (int64_t)imm;
-            }
+        uint64_t paddr = 0;
+        if (!fetchAddress(paddr)) [[unlikely]] {
+            takeTrap(this->pc);
+            continue;
         }
-        if (inst.Funct3 == 0b110) /* BLTU */ {
-            // BLTU : (unsigned) take the branch if [rs1] < [rs2]
-            if (this->getRegister(rs1) < this->getRegister(rs2)) {
-                this->pc = this->pc + (int64_t)imm;
-            }
+        const auto& inst = this->icache.lookup(paddr);
+        // Branch on the size rather than adding it, the next fetch then
+        // doesn't wait on the load of the decoded instruction.
+        if (inst.size == 4) [[likely]] {
+            this->pc += 4;
+        } else {
+            this->pc += 2;
         }
-        if (inst.Funct3 == 0b111) /* BGEU */ {
-            // BGEU : (unsigned) take the branch if [rs1] >= [rs2]
-            if (this->getRegister(rs1) >= this->getRegister(rs2)) {
-                this->pc = this->pc + (int64_t)imm;
-            }
+        if (!inst.handler(*this, inst)) [[unlikely]] {
+            takeTrap(this->pc - inst.size);
+            continue;
         }
+        this->instret++;
+    }
+}
 
-        break;
+/// @brief Address accessed by the memory instruction inst, checked before
+/// it executes since it may overwrite rs1.
+/// @param inst
+/// @param registers
+/// @param addr Set to the accessed address.
+/// @return false if inst doesn't access memory.
+static auto memoryAddress(const DecodedInstruction& inst,
+                          const std::array<uint64_t, 32>& registers,
+                          uint64_t& addr) -> bool {
+    if (inst.mnemonic >= Mnemonic::LB && inst.mnemonic <= Mnemonic::SD) {
+        addr = registers[inst.rs1] + (int64_t)inst.imm;
+        return true;
     }
-    case OPCode::LOAD: {
-        // Itype instruction.
-        auto inst = Itype(instruction.instruction);
-        auto rs1  = this->registers[(size_t)inst.Rs1];
-        auto imm  = (int64_t)inst.Imm;
-
-        if (inst.Funct3 == 0b000) {
-            // LB : load byte at the effective address [rs1] +  Imm and sign into Rd.
-            auto addr  = (uint64_t)rs1 + (uint64_t)imm;
-            auto value = (int64_t)((int8_t)this->load(addr, 8));
-            this->setRegister(inst.Rd, value);
-        } else if (inst.Funct3 == 0b001) {
-            // LH: load halfword at the effective address [rs1] + Imm and sign extend
-            // into Rd.
-            auto addr  = rs1 + imm;
-            auto value = (int64_t)((int16_t)this->load(addr, 16));
-            this->setRegister(inst.Rd, value);
-        } else if (inst.Funct3 == 0b010) {
-            // LW: load word at the effective address [rs1] + Imm and sign extend
-            // into Rd.
-            auto addr  = rs1 + imm;
-            auto value = (int64_t)((int32_t)this->load(addr, 32));
-            this->setRegister(inst.Rd, value);
-        } else if (inst.Funct3 == 0b011) {
-            // LD: Load double word unsigned at the effective address [rs1] + Imm
-            // into Rd.
-            auto addr  = rs1 + imm;
-            auto value = (int64_t)this->load(addr, 64);
-            this->setRegister(inst.Rd, value);
-        } else if (inst.Funct3 == 0b100) {
-            // LBU: load byte unsigned at the effective address [rs1] + Imm into Rd.
-            auto addr  = rs1 + imm;
-            auto value = this->load(addr, 8);
-            this->setRegister(inst.Rd, value);
-        } else if (inst.Funct3 == 0b101) {
-            // LHU (RV64i): load half word unsigned at the effective address
-            // [rs1] + Imm into Rd.
-            auto addr  = rs1 + imm;
-            auto value = this->load(addr, 16);
-            this->setRegister(inst.Rd, value);
-        } else if (inst.Funct3 == 0b110) {
-            // LWU: load word unsigned at the effective address [rs1] + Imm into Rd.
-            auto addr  = rs1 + imm;
-            auto value = this->load(addr, 32);
-            this->setRegister(inst.Rd, value);
-        }
-        break;
+    if (inst.mnemonic >= Mnemonic::LR_W &&
+        inst.mnemonic <= Mnemonic::AMOMAXU_D) {
+        addr = registers[inst.rs1];
+        return true;
     }
-    case OPCode::STORE: {
-        // Stype instruction.
-        auto inst  = Stype(instruction.instruction);
-        auto imm   = inst.Imm;
-        auto rs1   = inst.Rs1;
-        auto rs2   = inst.Rs2;
-        auto addr  = this->getRegister(rs1) + (int64_t)imm;
-        auto value = this->getRegister(rs2);
-
-        if (inst.Funct3 == 0b000) {
-            // SB: Store byte at address.
-            this->store(addr, 8, value);
-        }
-        if (inst.Funct3 == 0b001) {
-            // SH: Store half word at address.
-            this->store(addr, 16, value);
-        }
-        if (inst.Funct3 == 0b010) {
-            // SW: Store word at address.
-            this->store(addr, 32, value);
-        }
-        if (inst.Funct3 == 0b011) {
-            // SD: Store double word at address.
-            this->store(addr, 64, value);
-        }
-        break;
+    if (inst.mnemonic >= Mnemonic::FSW && inst.mnemonic <= Mnemonic::FLD) {
+        addr = registers[inst.rs1] + (int64_t)inst.imm;
+        return true;
+    }
+    if (inst.mnemonic >= Mnemonic::VLE && inst.mnemonic <= Mnemonic::VSSE) {
+        addr = registers[inst.rs1];
+        return true;
     }
-    case OPCode::ARITHR: {
-        auto inst = Rtype(instruction.instruction);
-        auto rs1  = this->getRegister(inst.Rs1);
-        auto rs2  = this->getRegister(inst.Rs2);
+    return false;
+}
 
-        if (inst.Funct3 == 0b000 && inst.Funct7 == 0b0000000) {
-            // ADD: add [rs1] to [rs2] store the result in [rd].
-            this->setRegister(inst.Rd, rs1 + rs2);
-        }
-        if (inst.Funct3 == 0b000 && inst.Funct7 == 0b0000010) {
-            // SUB: substract [rs2] from [rs1] store the result in [rd].
-            this->setRegister(inst.Rd, rs1 - rs2);
-        }
-        if (inst.Funct3 == 0b001 && inst.Funct7 == 0b0000000) {
-            // SLL: Shift Left Logical.
-            // auto shamt = (this->getRegister(inst.Rs2) & 0x3f);
-            auto value = rs1 << rs2;
-            this->setRegister(inst.Rd, value);
-        }
-        if (inst.Funct3 == 0b010 && inst.Funct7 == 0b0000000) {
-            // SLT: Set if Less Than
-            auto value = ((int64_t)rs1 < (int64_t)rs2) ? 1 : 0;
-            this->setRegister(inst.Rd, value);
+/// @brief Run loop of CPU::run with the profiler and tracer hooks, kept
+/// apart so runs without them don't pay for them. Only integer register
+/// writes are traced.
+auto CPU::runInstrumented() -> void {
+    auto flags = FloatFlagsScope(*this);
+    while (true) {
+        if (outsideCode()) {
+            break;
         }
-        if (inst.Funct3 == 0b011 && inst.Funct7 == 0b0000000) {
-            // SLTU: Set if Less Than Unsigned.
-            auto value = (rs1 < rs2) ? 1 : 0;
-            this->setRegister(inst.Rd, value);
+        if (this->instret >= this->pollAt) [[unlikely]] {
+            if (this->instret >= this->stopAt) {
+                break;
+            }
+            if (pollInterrupts()) {
+                if (this->profiler != nullptr) {
+                    this->profiler->trap(this->pc);
+                }
+                continue;
+            }
         }
-        if (inst.Funct3 == 0b100 && inst.Funct7 == 0b0000000) {
-            // XOR: Set [rd] to [rs1] ^ [rs2].
-            auto value = rs1 ^ rs2;
-            this->setRegister(inst.Rd, value);
+        uint64_t paddr = 0;
+        if (!fetchAddress(paddr)) [[unlikely]] {
+            if (this->tracer != nullptr) {
+                this->tracer->record({.pc    = this->pc,
+                                      .value = (uint64_t)this->pending.cause,
+                                      .addr  = this->pending.value,
+                                      .flags = TraceTrap});
+            }
+            takeTrap(this->pc);
+            if (this->profiler != nullptr) {
+                this->profiler->trap(this->pc);
+            }
+            continue;
         }
-        if (inst.Funct3 == 0b101 && inst.Funct7 == 0b0000000) {
-            // SRL: Shift Right Logical.
-            auto shamt = (this->getRegister(inst.Rs2) & 0x3f);
-            auto value = rs1 >> shamt;
-            this->setRegister(inst.Rd, value);
+        const auto& inst = this->icache.lookup(paddr);
+        auto addr        = this->pc;
+        TraceRecord record{.pc = addr, .inst = inst.raw};
+        if (this->tracer != nullptr &&
+            memoryAddress(inst, this->registers, record.addr)) {
+            record.flags = TraceMemory;
         }
-        if (inst.Funct3 == 0b101 && inst.Funct7 == 0b0100000) {
-            // SRA: Shift Right Arithmetic.
-            auto shamt = rs2 & 0x3f;
-            auto value = (uint64_t)((int64_t)rs1 >> shamt);
-            this->setRegister(inst.Rd, value);
+        this->pc += inst.size;
+        if (!inst.handler(*this, inst)) [[unlikely]] {
+            if (this->pending.event) {
+                // Stopped before a device access, nothing was executed.
+                takeTrap(addr);
+                continue;
+            }
+            if (this->tracer != nullptr) {
+                record.value = (uint64_t)this->pending.cause;
+                record.addr  = this->pending.value;
+                record.flags = TraceTrap;
+                this->tracer->record(record);
+            }
+            takeTrap(addr);
+            if (this->profiler != nullptr) {
+                this->profiler->trap(this->pc);
+            }
+            continue;
         }
-        if (inst.Funct3 == 0b110 && inst.Funct7 == 0b0000000) {
-            // OR: Set [rd] to [r1] | [r2].
-            auto value = rs1 | rs2;
-            this->setRegister(inst.Rd, value);
+        this->instret++;
+        if (this->tracer != nullptr) {
+            if (inst.rd != 0 && writesIntegerRegister(inst.mnemonic)) {
+                record.rd    = inst.rd;
+                record.value = this->registers[inst.rd];
+            }
+            this->tracer->record(record);
         }
-        if (inst.Funct3 == 0b111 && inst.Funct7 == 0b0000000) {
-            // AND: Set [rd] to [r1] ^ [r2].
-            auto value = rs1 & rs2;
-            this->setRegister(inst.Rd, value);
+        if (this->profiler != nullptr) {
+            this->profiler->record(addr, inst, this->pc);
         }
-        break;
     }
-    case OPCode::ARITHI: {
-        auto inst = Itype(instruction.instruction);
-        auto rs1  = this->registers[(size_t)inst.Rs1];
-        auto imm  = inst.Imm;
+}
 
-        if (inst.Funct3 == 0b000) {
-            // ADDI: add immmediate value to rs1 store result in rd.
-            this->setRegister(inst.Rd, rs1 + imm);
-        }
-        if (inst.Funct3 == 0b010) {
-            // SLTI : Set if Less Than Immediate.
-            auto value = (this->getRegister(inst.Rs1) < (int64_t)imm) ? 1 : 0;
-            this->setRegister(inst.Rd, value);
-        }
-        if (inst.Funct3 == 0b011) {
-            // SLTIU: Set if Less Than Immediate (Unsigned).
-            auto value = (this->getRegister(inst.Rs1) < imm) ? 1 : 0;
-            this->setRegister(inst.Rd, value);
+/// @brief Fast-forward on engine with the profiler and tracer detached,
+/// then run the detailed window on the instrumented interpreter, until the
+/// hart leaves the program or the stopAt limit of the run. The instructions
+/// fast-forwarded are reported to the profiler.
+/// @param engine
+auto CPU::runSampled(Engine engine) -> void {
+    auto* profiler = std::exchange(this->profiler, nullptr);
+    auto* tracer   = std::exchange(this->tracer, nullptr);
+    auto window    = std::min(this->sampling.window, this->sampling.interval);
+    auto limit     = this->stopAt;
+    auto stopped   = [&]() {
+        return outsideCode() || this->instret >= limit ||
+               this->outcome.status != RunStatus::Budget;
+    };
+    while (!stopped()) {
+        auto start   = this->instret;
+        stopAfter(std::min(start + this->sampling.interval - window, limit));
+        run(engine);
+        profiler->skip(this->instret - start);
+        if (stopped()) {
+            break;
         }
-        if (inst.Funct3 == 0b100) {
-            // XORI: Compute bitwise exclusive-OR of the sign-extended
-            // immediate and [rs1], writing the result to [rd].
-            auto value = (this->getRegister(inst.Rs1) ^ imm);
-            this->setRegister(inst.Rd, value);
+        this->profiler = profiler;
+        this->tracer   = tracer;
+        stopAfter(std::min(this->instret + window, limit));
+        runInstrumented();
+        this->profiler = nullptr;
+        this->tracer   = nullptr;
+    }
+    this->profiler = profiler;
+    this->tracer   = tracer;
+    stopAfter(this->outcome.status == RunStatus::Budget ? limit : 0);
+}
+
+/// @brief Return a readable name for a trap cause.
+/// @param cause
+/// @return const char*
+auto trapName(TrapCause cause) -> const char* {
+    switch (cause) {
+    case TrapCause::InstructionAddressMisaligned:
+        return "Instruction Address Misaligned";
+    case TrapCause::InstructionAccessFault:
+        return "Instruction Access Fault";
+    case TrapCause::IllegalInstruction:
+        return "Illegal Instruction";
+    case TrapCause::Breakpoint:
+        return "Breakpoint";
+    case TrapCause::LoadAddressMisaligned:
+        return "Load Address Misaligned";
+    case TrapCause::LoadAccessFault:
+        return "Load Access Fault";
+    case TrapCause::StoreAddressMisaligned:
+        return "Store Address Misaligned";
+    case TrapCause::StoreAccessFault:
+        return "Store Access Fault";
+    case TrapCause::ECallFromU:
+    case TrapCause::ECallFromS:
+    case TrapCause::ECallFromM:
+        return "Environment Call";
+    case TrapCause::InstructionPageFault:
+        return "Instruction Page Fault";
+    case TrapCause::LoadPageFault:
+        return "Load Page Fault";
+    case TrapCause::StorePageFault:
+        return "Store Page Fault";
+    }
+    return "Unknown Trap";
+}
+
+/// @brief Take the pending trap raised by the instruction at addr. Traps
+/// raised below machine mode whose cause is set in medeleg are handled in
+/// supervisor mode (sepc, scause, stval, stvec), every other trap in
+/// machine mode (mepc, mcause, mtval, mtvec). The interrupt enable bit and
+/// the previous privilege are stacked in mstatus, synchronous exceptions
+/// ignore the vectored mode of the trap vector.
+/// Without a machine mode trap handler the hart stops, as the program
+/// counter is left outside of memory, and the run reports the trap.
+/// An instruction stopped before a device access raised no trap, it is
+/// executed again when the hart resumes.
+/// @param addr
+auto CPU::takeTrap(VirtualAddress addr) -> void {
+    if (this->pending.event) {
+        this->pending.event = false;
+        this->outcome.addr  = addr;
+        this->pc            = addr;
+        return;
+    }
+    auto cause     = (uint64_t)this->pending.cause;
+    auto delegated = this->privilege != Privilege::Machine &&
+                     ((this->csrs.load(MEDeleg) >> cause) & 1) != 0;
+    enterTrap(addr, cause, this->pending.value, delegated);
+    if (!delegated && this->pc == 0) {
+        this->outcome = {.status = RunStatus::Trapped,
+                         .addr   = addr,
+                         .cause  = this->pending.cause,
+                         .value  = this->pending.value};
+    }
+}
+
+/// @brief Enter the trap handler for cause in supervisor or machine mode.
+/// Interrupts are taken to the vector of their cause when the trap vector
+/// mode is vectored.
+/// @param addr
+/// @param cause
+/// @param value
+/// @param supervisor
+auto CPU::enterTrap(VirtualAddress addr, uint64_t cause, uint64_t value,
+                    bool supervisor) -> void {
+    auto status   = this->csrs.load(MStatus);
+    uint64_t tvec = 0;
+    this->reservation.valid = false;
+    this->pollAt            = 0;
+
+    if (supervisor) {
+        auto spie = (status & MaskSIE) != 0 ? MaskSPIE : 0;
+        auto spp  = this->privilege == Privilege::Supervisor ? MaskSPP : 0;
+        status &= ~(MaskSIE | MaskSPIE | MaskSPP); //NOLINT
+        this->csrs.store(MStatus, status | spie | spp);
+        this->csrs.store(Sepc, addr);
+        this->csrs.store(SCause, cause);
+        this->csrs.store(STVal, value);
+        this->privilege = Privilege::Supervisor;
+        tvec            = this->csrs.load(STVec);
+    } else {
+        auto mpie = (status & MaskMIE) != 0 ? MaskMPIE : 0;
+        auto mpp  = (uint64_t)this->privilege << 11;
+        status &= ~(MaskMIE | MaskMPIE | MaskMPP); //NOLINT
+        this->csrs.store(MStatus, status | mpie | mpp);
+        this->csrs.store(MEPc, addr);
+        this->csrs.store(MCause, cause);
+        this->csrs.store(MTVal, value);
+        this->privilege = Privilege::Machine;
+        tvec            = this->csrs.load(MTVec);
+    }
+    this->pc = tvec & ~(uint64_t)0b11;
+    if ((cause & CauseInterrupt) != 0 && (tvec & 0b11) == 1) {
+        this->pc += (cause & ~CauseInterrupt) * 4;
+    }
+    updatePaging();
+}
+
+/// @brief Take the highest priority interrupt pending in mip and enabled
+/// in mie. Interrupts handled in machine mode are taken below machine mode
+/// or in machine mode with mstatus.MIE set, interrupts delegated in
+/// mideleg are taken in user mode or in supervisor mode with mstatus.SIE
+/// set and never in machine mode.
+/// @return true if an interrupt was taken.
+auto CPU::pollInterrupts() -> bool {
+    this->pollAt =
+        std::min(this->instret + InterruptPollInterval, this->stopAt);
+    auto enabled = this->csrs.load(MIE);
+    if (enabled == 0) [[likely]] {
+        return false;
+    }
+    updatePending();
+    auto pending = this->csrs.stored(MIp) & enabled;
+    if (pending == 0) {
+        return false;
+    }
+    auto status     = this->csrs.load(MStatus);
+    auto delegated  = this->csrs.load(MIDeleg);
+    auto machine    = this->privilege != Privilege::Machine ||
+                      (status & MaskMIE) != 0;
+    auto supervisor = this->privilege == Privilege::User ||
+                      (this->privilege == Privilege::Supervisor &&
+                       (status & MaskSIE) != 0);
+    auto takeable   = (machine ? pending & ~delegated : 0) |
+                      (supervisor ? pending & delegated : 0);
+    for (auto code : InterruptPriority) {
+        if (((takeable >> code) & 1) != 0) {
+            enterTrap(this->pc, CauseInterrupt | code, 0,
+                      ((delegated >> code) & 1) != 0);
+            return true;
         }
-        if (inst.Funct3 == 0b110) {
-            // ORI: Compute bitwise OR of the sign-extended
-            // immediate and [rs1], writing the result to [rd].
-            auto value = (this->getRegister(inst.Rs1) | imm);
-            this->setRegister(inst.Rd, value);
+    }
+    return false;
+}
+
+/// @brief Idle until an interrupt enabled in mie is pending, whether or
+/// not it is globally enabled. A hart waiting for its timer skips ahead:
+/// mtime is advanced straight to the hart's mtimecmp (time is shared, the
+/// other harts see it advance too). A hart waiting for a software
+/// interrupt from another hart sleeps on the host for IdleSleep and gives
+/// up the run if it still isn't raised, so the step returns
+/// RunStatus::Idle instead of holding the host thread. WFI completes at
+/// once when no enabled interrupt can become pending.
+/// @return false if the hart is idle.
+auto CPU::waitForInterrupt() -> bool {
+    auto& clint  = *this->ctx->clint;
+    auto hart    = this->csrs.load(MHartID);
+    auto slept   = false;
+    this->pollAt = 0;
+    while (true) {
+        auto enabled = this->csrs.load(MIE);
+        updatePending();
+        if ((this->csrs.stored(MIp) & enabled) != 0) {
+            return true;
         }
-        if (inst.Funct3 == 0b111) {
-            // AND: Compute bitwise AND of the sign-extended
-            // immediate and [rs1], writing the result to [rd].
-            auto value = (this->getRegister(inst.Rs1) & imm);
-            this->setRegister(inst.Rd, value);
+        auto deadline = clint.mtimecmp(hart);
+        if ((enabled & MaskMTIP) != 0 && deadline != ~(uint64_t)0) {
+            auto now = clint.mtime();
+            if (deadline > now) {
+                clint.advance(deadline - now);
+            }
+            continue;
         }
-        if (inst.Funct3 == 0b001) {
-            // SLLI: Shift Left Logical Immediate
-            auto shamt = (uint32_t)(imm & 0x3f);
-            this->setRegister(inst.Rd, this->getRegister(inst.Rs1) << shamt);
+        if ((enabled & MaskMSIP) == 0) {
+            return true;
         }
-        if (inst.Funct3 == 0b101) {
-            auto funct7 = Rtype(instruction.instruction).Funct7;
-            auto shamt  = (uint32_t)(imm & 0x3f);
-            if ((funct7) == 0x00) {
-                // SRLI: Shift Right Logical Immediate.
-                this->setRegister(inst.Rd,
-                                  this->getRegister(inst.Rs1) >> shamt);
-
-            } else if ((funct7 >> 1) == 0x10) {
-                // SRAI: Shift Right Arithmetic Immediate.
-                this->setRegister(
-                    inst.Rd,
-                    (uint64_t)((int64_t)this->getRegister(inst.Rs1) >> shamt));
-            }
+        if (slept) {
+            return false;
         }
+        std::this_thread::sleep_for(IdleSleep);
+        slept = true;
+    }
+}
+
+/// @brief Recompute the address translation state. Translation is enabled
+/// by the satp mode outside of machine mode, loads and stores in machine
+/// mode are translated at the privilege in mstatus.MPP when mstatus.MPRV
+/// is set.
+auto CPU::updatePaging() -> void {
+    auto sv39   = (this->csrs.load(Satp) >> 60) == SatpModeSv39;
+    auto status = this->csrs.load(MStatus);
+    auto data   = this->privilege;
+    if (data == Privilege::Machine && (status & MaskMPRV) != 0) {
+        data = (Privilege)((status & MaskMPP) >> 11);
+    }
+    auto paging = Paging{
+        .fetch     = sv39 && this->privilege != Privilege::Machine,
+        .data      = sv39 && data != Privilege::Machine,
+        .privilege = data,
+        .sum       = (status & MaskSUM) != 0,
+        .mxr       = (status & MaskMXR) != 0,
+    };
+    // Cached host pages were checked against the previous state.
+    if (paging != this->paging) {
+        this->paging = paging;
+        this->loadPages.flush();
+        this->storePages.flush();
+    }
+}
+
+/// @brief Read a counter CSR, counters are derived from the number of
+/// retired instructions and the CLINT mtime on every read.
+/// @param addr
+/// @return uint64_t
+auto CPU::readCounter(uint64_t addr) const -> uint64_t {
+    auto index     = addr & 0x1f;
+    auto inhibited = this->csrs.load(MCountInhibit);
+    switch (index) {
+    case 0:
+        return (inhibited & MaskCY) != 0 ? this->cycleOffset
+                                         : this->instret + this->cycleOffset;
+    case 1:
+        return addr == Time ? this->ctx->clint->mtime() : 0;
+    case 2:
+        return (inhibited & MaskIR) != 0
+                   ? this->instretOffset
+                   : this->instret + this->instretOffset;
+    default:
+        return this->csrs.load(MHpmCounter3 + index - 3);
+    }
+}
+
+/// @brief Write a machine mode counter CSR.
+/// @param addr
+/// @param value
+auto CPU::writeCounter(uint64_t addr, uint64_t value) -> void {
+    // The counters read value once the writing instruction retired.
+    auto index     = addr & 0x1f;
+    auto inhibited = this->csrs.load(MCountInhibit);
+    switch (index) {
+    case 0:
+        this->cycleOffset =
+            (inhibited & MaskCY) != 0 ? value : value - (this->instret + 1);
+        break;
+    case 1:
+        break;
+    case 2:
+        this->instretOffset =
+            (inhibited & MaskIR) != 0 ? value : value - (this->instret + 1);
+        break;
+    default:
+        this->csrs.store(MHpmCounter3 + index - 3, value);
         break;
     }
-    case OPCode::ARITHIW: {
-        // Decode as Itype for ADDI
-        auto instItype = Itype(instruction.instruction);
-        auto imm       = instItype.Imm;
-        auto rd        = instItype.Rd;
-        auto rs1       = instItype.Rs1;
-        // Decode as Rtype for SLLIW/SRLIW/SRAIW
-        auto inst   = Rtype(instruction.instruction);
-        auto funct7 = inst.Funct7;
-        auto funct3 = instItype.Funct3;
-        if (funct3 == 0b000) {
-            // ADDIW
-            this->setRegister(
-                rd, (int64_t)(int32_t)(this->getRegister(rs1) + (int64_t)imm));
-        }
-        if (funct3 == 0b001) {
-            // SLLIW
-            auto shamt = (uint32_t)(imm & 0x3f);
-            this->setRegister(inst.Rd,
-                              (int64_t)(int32_t)this->getRegister(inst.Rs1)
-                                  << shamt);
-        }
-        if (funct3 == 0b101) {
-            auto shamt = (uint32_t)(imm & 0x3f);
-            if (funct7 >> 1 == 0x00) {
-                // SRLIW
-                this->setRegister(
-                    inst.Rd, (int64_t)(int32_t)this->getRegister(rs1) >> shamt);
-            }
-            if (funct7 >> 1 == 0x10) {
-                // SRAIW
-                this->setRegister(
-                    inst.Rd, (int64_t)(int32_t)this->getRegister(rs1) >> shamt);
-            }
-        }
+}
+
+/// @brief Write mcountinhibit, mcycle and minstret stop at the value they
+/// have once the writing instruction retired and resume from it with the
+/// next instruction once allowed again.
+/// @param value
+auto CPU::writeCountInhibit(uint64_t value) -> void {
+    value &= ~MaskTM; //NOLINT
+    auto changed = this->csrs.load(MCountInhibit) ^ value;
+    auto retired = this->instret + 1;
+    if ((changed & MaskCY) != 0) {
+        this->cycleOffset = (value & MaskCY) != 0 ? this->cycleOffset + retired
+                                                  : this->cycleOffset - retired;
     }
-    case OPCode::ARITHRW: {
-        // Stype instruction.
-        auto inst   = Rtype(instruction.instruction);
-        auto rd     = inst.Rd;
-        auto rs1    = inst.Rs1;
-        auto rs2    = inst.Rs2;
-        auto funct3 = inst.Funct3;
-        auto funct7 = inst.Funct7;
-        if (funct3 == 0b000) {
-            if (funct7 >> 1 == 0x00) {
-                // ADDW
-                auto value = (int64_t)(int32_t)this->getRegister(rs1) +
-                             (int64_t)this->getRegister(rs2);
-                this->setRegister(rd, value);
-            }
-            if (funct7 >> 1 == 0x10) {
-                // SUBW
-                auto value = (int64_t)(int32_t)this->getRegister(rs1) -
-                             (int64_t)this->getRegister(rs2);
-                this->setRegister(rd, value);
-            }
-        }
-        if (funct3 == 0b001) {
-            // SLLW
-            auto value = (int64_t)(int32_t)(this->getRegister(rs1)
-                                            << this->getRegister(rs2));
-            this->setRegister(rd, value);
-        }
-        if (funct3 == 0b101) {
-            if (funct7 >> 1 == 0x00) {
-                // SRLW
-                auto value = (int64_t)(int32_t)(this->getRegister(rs1) >>
-                                                this->getRegister(rs2));
-                this->setRegister(rd, value);
-            }
-            if (funct7 >> 1 == 0x10) {
-                // SRAW
-                auto value =
-                    (int64_t)(int32_t)(this->getRegister(rs1) >>
-                                       (int32_t)this->getRegister(rs2));
-                this->setRegister(rd, value);
-            }
-        }
+    if ((changed & MaskIR) != 0) {
+        this->instretOffset = (value & MaskIR) != 0
+                                  ? this->instretOffset + retired
+                                  : this->instretOffset - retired;
     }
+    this->csrs.store(MCountInhibit, value);
+}
 
-    case OPCode::CSR: {
-        auto inst   = instruction.instruction;
-        auto rd     = (uint64_t)((inst & 0x00000f80) >> 7);
-        auto rs1    = (uint64_t)((inst & 0x000f8000) >> 15);
-        auto addr   = (uint64_t)((inst & 0xfff00000) >> 20);
-        auto funct3 = (inst & 0x00007000) >> 12;
-        if (funct3 == 0x1) {
-            // CSRRW
-            auto t = this->csrs.load(addr);
-            this->csrs.store(addr, this->registers[rs1]);
-            this->registers[rd] = t;
-        }
-        if (funct3 == 0x2) {
-            // CSRRS
-            auto t = this->csrs.load(addr);
-            this->csrs.store(addr, t | this->registers[rs1]);
-            this->registers[rd] = t;
+/// @brief Cache the host address of the page holding paddr.
+/// @param cache
+/// @param addr
+/// @param paddr
+auto CPU::cachePage(PageCache& cache, VirtualAddress addr, uint64_t paddr)
+    -> void {
+    auto& mmu   = this->ctx->mmu;
+    auto offset = (paddr - MemoryBaseAddr) & ~(PageSize - 1);
+    if (offset + PageSize > mmu.memory.size()) {
+        return;
+    }
+    cache.insert(addr, mmu.memory.data() + offset,
+                 &mmu.codePages[offset >> PageShift]);
+}
+
+/// @brief Walk the Sv39 page tables for addr. Page table entries are read
+/// from guest physical memory, the walk raises a page fault for invalid or
+/// misaligned entries and accesses the leaf doesn't permit, and an access
+/// fault if a table is outside of memory. Accessed and dirty flags are set
+/// atomically as other harts may walk the same tables.
+/// @param addr
+/// @param access
+/// @param paddr
+/// @return false if the walk raised a trap.
+auto CPU::walk(VirtualAddress addr, Access access, uint64_t& paddr) -> bool {
+    auto pageFault = [&]() {
+        return raise(access == Access::Fetch  ? TrapCause::InstructionPageFault
+                     : access == Access::Load ? TrapCause::LoadPageFault
+                                              : TrapCause::StorePageFault,
+                     addr);
+    };
+    // Bits 63-39 of a virtual address must match bit 38.
+    if ((uint64_t)((int64_t)(addr << 25) >> 25) != addr) {
+        return pageFault();
+    }
+
+    static constexpr uint64_t PpnMask = (static_cast<uint64_t>(1) << 44) - 1;
+    auto table = (this->csrs.load(Satp) & PpnMask) << PageShift;
+    for (int level = 2; level >= 0; level--) {
+        auto shift = PageShift + 9 * level;
+        auto* pte  = this->ctx->mmu.hostAddress<uint64_t>(
+            table + ((addr >> shift) & 0x1ff) * 8, false);
+        if (pte == nullptr) {
+            return raise(access == Access::Fetch
+                             ? TrapCause::InstructionAccessFault
+                         : access == Access::Load ? TrapCause::LoadAccessFault
+                                                  : TrapCause::StoreAccessFault,
+                         addr);
         }
-        if (funct3 == 0x3) {
-            // CSRRC
-            auto t = this->csrs.load(addr);
-            this->csrs.store(addr, t & (~this->registers[rs1])); //NOLINT
-            this->registers[rd] = t;
+        auto ref   = std::atomic_ref<uint64_t>(*pte);
+        auto entry = ref.load();
+        if ((entry & PteValid) == 0 ||
+            (entry & (PteRead | PteWrite)) == PteWrite) {
+            return pageFault();
         }
-        if (funct3 == 0x5) {
-            // CSRRWI
-            auto zimm           = rs1;
-            this->registers[rd] = this->csrs.load(addr);
-            this->csrs.store(addr, zimm);
+        auto ppn = (entry >> 10) & PpnMask;
+        if ((entry & (PteRead | PteExecute)) == 0) {
+            table = ppn << PageShift;
+            continue;
         }
-        if (funct3 == 0x6) {
-            // CSRRSI
-            auto zimm = rs1;
-            auto t    = this->csrs.load(addr);
-            this->csrs.store(addr, t | zimm);
-            this->registers[rd] = t;
+
+        // Leaf, superpages must be aligned to their size.
+        auto low = (static_cast<uint64_t>(1) << (9 * level)) - 1;
+        if ((ppn & low) != 0 ||
+            !permitted(entry | PteAccessed | PteDirty, access)) {
+            return pageFault();
         }
-        if (funct3 == 0x7) {
-            // CSRRCI
-            auto zimm = rs1;
-            auto t    = this->csrs.load(addr);
-            this->csrs.store(addr, t & (~zimm)); //NOLINT
-            this->registers[rd] = t;
+        auto flags = PteAccessed | (access == Access::Store ? PteDirty : 0);
+        while ((entry & flags) != flags &&
+               !ref.compare_exchange_weak(entry, entry | flags)) {
         }
-        // Control and Status instructions.
-        //
-        // ECALL & EBREAK differ on their Funct7 but since we don't need the debug
-        // calls we can just skip them.
+        entry |= flags;
 
-        break;
+        auto page = ((ppn & ~low) | ((addr >> PageShift) & low)) << PageShift;
+        (access == Access::Fetch ? this->itlb : this->dtlb)
+            .insert(addr, page, entry & 0xff);
+        paddr = page | (addr & (PageSize - 1));
+        return true;
     }
+    return pageFault();
+}
 
-    default: {
-        throw IllegalInstruction();
-        break;
+/// @brief Run the CPU instance on the given execution engine.
+/// @param engine
+auto CPU::run(Engine engine) -> void {
+    this->outcome = {};
+    if (this->profiler != nullptr || this->tracer != nullptr) {
+        return this->profiler != nullptr && this->sampling.interval != 0
+                   ? runSampled(engine)
+                   : runInstrumented();
     }
+    auto flags = FloatFlagsScope(*this);
+    switch (engine) {
+    case Engine::Interpreter:
+        return run();
+    case Engine::Threaded:
+        return runThreaded(false);
+    case Engine::Jit:
+        return runThreaded(true);
     }
 }
 
-void CPU::run() {
-    while (true) {
-        if (this->pc < MemoryBaseAddr ||
-            (MemoryBaseAddr + this->ctx->code.size()) <= this->pc) {
-            break;
-        }
-        auto nextInst = this->fetch();
-        auto inst     = this->decode(nextInst);
-        this->pc += 4;
+/// @brief Run for at most budget instructions or until an event in
+/// events, see CPU::step. The budget is the stopAt limit of the run and
+/// events stop it through stopOn and stopBeforeDevice.
+/// @param engine
+/// @param budget
+/// @param events
+/// @return RunResult
+auto CPU::step(Engine engine, uint64_t budget, uint32_t events) -> RunResult {
+    auto start    = this->instret;
+    auto limit    = budget < Unbounded - start ? start + budget : Unbounded;
+    this->outcome = {};
+    if (this->resumeDevice && budget > 0) {
+        // Perform the access the last step stopped before.
+        this->resumeDevice = false;
+        this->events       = events & ~EventMmio;
+        stopAfter(start + 1);
+        run(Engine::Interpreter);
+    }
+    if (this->outcome.status == RunStatus::Budget) {
+        this->events = events;
+        stopAfter(limit);
+        run(engine);
+    }
+    this->events = 0;
+    stopAfter(Unbounded);
+
+    auto result    = this->outcome;
+    result.retired = this->instret - start;
+    if (result.status == RunStatus::Budget && outsideCode()) {
+        result.status = RunStatus::Exited;
+    }
+    this->resumeDevice = result.status == RunStatus::Mmio;
+    return result;
+}
+
+//=== Machine Methods Implementations ====//
+
+Machine::Machine(VMContext ctx, size_t harts) {
+    auto shared = std::make_shared<VMContext>(std::move(ctx));
+    for (size_t id = 0; id < std::max<size_t>(harts, 1); id++) {
+        this->cpus.push_back(std::make_unique<CPU>(shared, id));
+    }
+}
+
+/// @brief Run every hart on its own thread and wait for all of them,
+/// exceptions escaping a hart are rethrown once every hart stopped.
+/// @param engine
+/// @return std::vector<RunResult>
+auto Machine::run(Engine engine) -> std::vector<RunResult> {
+    std::vector<std::exception_ptr> errors(this->cpus.size());
+    std::vector<RunResult> results(this->cpus.size());
+    // An idle hart is stepped again as long as another hart may raise its
+    // software interrupt. Every step retiring instructions starts a new
+    // round, a hart that went through a whole round idle without retiring
+    // any is quiet: once every running hart is quiet nothing can wake them
+    // anymore and they all stop.
+    std::mutex mutex;
+    size_t running = this->cpus.size();
+    size_t quiet   = 0;
+    uint64_t round = 0;
+    bool asleep    = false;
+    std::vector<uint64_t> quietIn(this->cpus.size(), ~(uint64_t)0);
+    auto runHart = [&](size_t id) {
         try {
-            this->execute(inst);
-        } catch (riscvemu::IllegalInstruction& e) {
-            printf("Exception Raised: Illegal Instruction: %s\n", e.what());
-            break;
-        } catch (riscvemu::LoadAccessFault& e) {
-            printf("Exception Raised: Load Access Fault: %s\n", e.what());
-            break;
+            uint64_t retired = 0;
+            auto idle        = true;
+            while (idle) {
+                uint64_t started = 0;
+                {
+                    std::lock_guard lock(mutex);
+                    started = round;
+                }
+                results[id] = this->cpus[id]->step(engine, Unbounded);
+                retired += results[id].retired;
+
+                std::lock_guard lock(mutex);
+                if (results[id].status != RunStatus::Idle ||
+                    results[id].retired > 0) {
+                    round++;
+                    quiet = 0;
+                } else if (started == round && quietIn[id] != round) {
+                    quietIn[id] = round;
+                    quiet++;
+                }
+                asleep = asleep || quiet == running;
+                idle   = results[id].status == RunStatus::Idle &&
+                       running > 1 && !asleep;
+                if (!idle) {
+                    running--;
+                }
+            }
+            results[id].retired = retired;
+        } catch (...) {
+            errors[id] = std::current_exception();
+            std::lock_guard lock(mutex);
+            running--;
+            round++;
+            quiet = 0;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(this->cpus.size() - 1);
+    for (size_t id = 1; id < this->cpus.size(); id++) {
+        threads.emplace_back(runHart, id);
+    }
+    runHart(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto& error : errors) {
+        if (error != nullptr) {
+            std::rethrow_exception(error);
         }
     }
+    return results;
+}
+
+//=== DecodeCache Methods Implementations ====//
+
+/// @brief Drop every decoded instruction.
+auto DecodeCache::flush() -> void {
+    for (auto& page : this->pages) {
+        page.reset();
+    }
+}
+
+/// @brief Allocate or clear the page holding pc, record the page's code
+/// generation and flag it in the MMU so stores to it are reported.
+/// @param pc
+auto DecodeCache::resetPage(VirtualAddress pc) -> void {
+    auto& page = this->pages[(pc - MemoryBaseAddr) >> PageShift];
+    if (page == nullptr) {
+        page = std::make_unique<Page>();
+    } else {
+        page->slots.fill(DecodedInstruction{});
+    }
+    page->generation = this->mmu->watchCode(pc);
+}
+
+/// @brief Extend the page table to cover page index.
+/// @param index
+/// @return false if the page is outside of memory.
+auto DecodeCache::grow(uint64_t index) -> bool {
+    if (index >= this->mmu->codePages.size()) {
+        return false;
+    }
+    this->pages.resize(index + 1);
+    return true;
+}
+
+/// @brief Fetch and decode the instruction at pc into slot.
+/// @param slot
+/// @param pc
+auto DecodeCache::fill(DecodedInstruction& slot, VirtualAddress pc) -> void {
+    slot = decode(*this->mmu, pc);
+}
+
+/// @brief Fetch and decode the instruction at pc.
+/// @param mmu
+/// @param pc
+/// @return DecodedInstruction with its handler resolved.
+auto DecodeCache::decode(MMU& mmu, VirtualAddress pc) -> DecodedInstruction {
+    auto half = mmu.load<uint16_t>(pc);
+    if (instructionSize(half) == 4 &&
+        (pc & (PageSize - 1)) == PageSize - 2) [[unlikely]] {
+        // Only the lower half is known, the instruction is decoded once
+        // both halves are fetched. Its mnemonic stays ILLEGAL so it ends
+        // translated blocks and is never compiled.
+        DecodedInstruction crossing;
+        crossing.raw     = half;
+        crossing.handler = &Semantics::crossPage;
+        return crossing;
+    }
+    auto decoded = predecode(instructionSize(half) == 2
+                                 ? half
+                                 : mmu.load<uint32_t>(pc));
+    decoded.handler = handlerFor(decoded.mnemonic);
+    return decoded;
+}
+
+/// @brief Decode the instruction at pc without caching it.
+/// @param pc
+/// @return DecodedInstruction valid until the next call.
+auto DecodeCache::decodeUncached(VirtualAddress pc)
+    -> const DecodedInstruction& {
+    fill(this->uncached, pc);
+    return this->uncached;
 }
 
 } // namespace riscvemu
@@ -0,0 +1,139 @@
+#include "Memory.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace riscvemu {
+
+/// @brief Reserve bytes of zeroed anonymous memory, the reservation is
+/// not accounted against the host commit limit (MAP_NORESERVE) so guests
+/// can be given more memory than they will ever touch.
+/// @param bytes
+/// @return start of the reservation.
+auto reserveMemory(size_t bytes) -> void* {
+    void* addr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    return addr;
+}
+
+/// @brief Release a reservation made by reserveMemory.
+/// @param addr
+/// @param bytes
+auto releaseMemory(void* addr, size_t bytes) -> void { munmap(addr, bytes); }
+
+/// @brief Host page size.
+/// @return page size in bytes.
+auto hostPageSize() -> size_t {
+    static const auto size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+/// @brief Report the resident host pages of [addr, addr + bytes).
+/// @param addr
+/// @param bytes
+/// @return one flag per host page.
+auto residentPages(const void* addr, size_t bytes) -> std::vector<uint8_t> {
+    auto page = hostPageSize();
+    std::vector<uint8_t> resident((bytes + page - 1) / page, 1);
+#if defined(__linux__)
+    auto* vec = reinterpret_cast<unsigned char*>(resident.data());
+#else
+    auto* vec = reinterpret_cast<char*>(resident.data());
+#endif
+    if (mincore(const_cast<void*>(addr), bytes, vec) != 0) {
+        std::fill(resident.begin(), resident.end(), 1);
+    }
+    for (auto& flag : resident) {
+        flag &= 1;
+    }
+    return resident;
+}
+
+/// @brief Map bytes of the open file fd starting at offset copy-on-write at
+/// addr.
+/// @param addr
+/// @param fd
+/// @param offset
+/// @param bytes
+/// @return true on success.
+auto mapFile(void* addr, int fd, uint64_t offset, size_t bytes) -> bool {
+    return mmap(addr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                fd, static_cast<off_t>(offset)) != MAP_FAILED;
+}
+
+/// @brief Create an unnamed file of bytes bytes living in host memory, a
+/// memfd on Linux and an unlinked temporary file elsewhere.
+/// @param bytes
+/// @return file descriptor.
+auto createMemoryFile(size_t bytes) -> int {
+#if defined(__linux__)
+    int fd = memfd_create("riscvemu", MFD_CLOEXEC);
+#else
+    char name[] = "/tmp/riscvemu-XXXXXX";
+    int fd      = mkstemp(name);
+    if (fd >= 0) {
+        unlink(name);
+    }
+#endif
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "memory file");
+    }
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        auto error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(),
+                                "memory file");
+    }
+    return fd;
+}
+
+/// @brief Map the file at path copy-on-write over the start of a
+/// reservation, the tail of the last page past the end of the file reads
+/// as zeroes like the rest of the reservation.
+/// @param addr
+/// @param capacity
+/// @param path
+/// @return size of the file.
+auto mapImage(void* addr, size_t capacity, const std::string& path)
+    -> size_t {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        auto error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), path);
+    }
+    auto size = static_cast<size_t>(st.st_size);
+    if (size > capacity) {
+        close(fd);
+        throw std::length_error(path + " doesn't fit in guest memory");
+    }
+    if (size != 0 && !mapFile(addr, fd, 0, size)) {
+        auto error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), path);
+    }
+    close(fd);
+    return size;
+}
+
+} // namespace riscvemu
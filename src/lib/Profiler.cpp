@@ -0,0 +1,175 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace riscvemu {
+
+/// @brief Format value as a hexadecimal address.
+/// @param value
+/// @return Address string, e.g "0x80000000".
+static auto hex(uint64_t value) -> std::string {
+    char buffer[20];
+    std::snprintf(buffer, sizeof(buffer), "0x%llx",
+                  (unsigned long long)value);
+    return buffer;
+}
+
+/// @brief Returns true for conditional branches.
+static auto isBranch(Mnemonic mnemonic) -> bool {
+    return mnemonic >= Mnemonic::BEQ && mnemonic <= Mnemonic::BGEU;
+}
+
+/// @brief Percentage of part in total.
+static auto percent(uint64_t part, uint64_t total) -> double {
+    return total == 0 ? 0.0 : 100.0 * (double)part / (double)total;
+}
+
+//=== Profiler Methods Implementations ====//
+
+Profiler::Profiler(uint64_t entry) : stack{entry} {
+    this->current = &this->stacks[this->stack];
+}
+
+/// @brief Counters of the instruction at addr, zero if it never retired.
+/// @param addr
+/// @return Counters
+auto Profiler::at(uint64_t addr) const -> Counters {
+    auto it = this->pcs.find(addr);
+    return it != this->pcs.end() ? it->second : Counters{};
+}
+
+/// @brief Write the profile report.
+/// @param out
+/// @param top
+auto Profiler::writeReport(std::ostream& out, size_t top) const -> void {
+    uint64_t branches = 0;
+    uint64_t taken    = 0;
+    std::vector<std::pair<uint64_t, Counters>> hottest(this->pcs.begin(),
+                                                       this->pcs.end());
+    for (const auto& [addr, counters] : hottest) {
+        if (isBranch(counters.mnemonic)) {
+            branches += counters.executed;
+            taken += counters.taken;
+        }
+    }
+    std::sort(hottest.begin(), hottest.end(), [](const auto& a, const auto& b) {
+        return a.second.executed != b.second.executed
+                   ? a.second.executed > b.second.executed
+                   : a.first < b.first;
+    });
+    hottest.resize(std::min(top, hottest.size()));
+
+    char line[128];
+    out << "instructions: " << this->retired << '\n';
+    if (this->skipped != 0) {
+        out << "fast-forwarded: " << this->skipped << '\n';
+    }
+    std::snprintf(line, sizeof(line),
+                  "branches: %llu, %llu taken (%.2f%%), %llu not taken\n",
+                  (unsigned long long)branches, (unsigned long long)taken,
+                  percent(taken, branches),
+                  (unsigned long long)(branches - taken));
+    out << line;
+
+    out << "\nhot spots:\n";
+    std::snprintf(line, sizeof(line), "%18s %18s %8s  %-12s %s\n", "address",
+                  "count", "%", "instruction", "taken/not taken");
+    out << line;
+    for (const auto& [addr, counters] : hottest) {
+        std::snprintf(line, sizeof(line), "%18s %18llu %8.2f  ",
+                      hex(addr).c_str(),
+                      (unsigned long long)counters.executed,
+                      percent(counters.executed, this->retired));
+        out << line;
+        if (isBranch(counters.mnemonic)) {
+            std::snprintf(line, sizeof(line), "%-12s %llu/%llu",
+                          getMnemonicName(counters.mnemonic),
+                          (unsigned long long)counters.taken,
+                          (unsigned long long)(counters.executed -
+                                               counters.taken));
+            out << line;
+        } else {
+            out << getMnemonicName(counters.mnemonic);
+        }
+        out << '\n';
+    }
+
+    out << "\ninstruction mix:\n";
+    std::vector<std::pair<uint64_t, size_t>> mix;
+    for (size_t i = 0; i < this->mnemonics.size(); i++) {
+        if (this->mnemonics[i] != 0) {
+            mix.emplace_back(this->mnemonics[i], i);
+        }
+    }
+    std::sort(mix.begin(), mix.end(), std::greater<>());
+    for (const auto& [count, mnemonic] : mix) {
+        std::snprintf(line, sizeof(line), "%-12s %18llu %8.2f\n",
+                      getMnemonicName((Mnemonic)mnemonic),
+                      (unsigned long long)count, percent(count, this->retired));
+        out << line;
+    }
+}
+
+/// @brief Write the collapsed call stacks.
+/// @param out
+auto Profiler::writeCollapsedStacks(std::ostream& out) const -> void {
+    for (const auto& [frames, count] : this->stacks) {
+        if (count == 0) {
+            continue;
+        }
+        for (size_t i = 0; i < frames.size(); i++) {
+            out << (i == 0 ? "" : ";") << hex(frames[i]);
+        }
+        out << ' ' << count << '\n';
+    }
+}
+
+/// @brief Follow the jump inst to next. Following the RISC-V calling
+/// convention ra and t0 are link registers: linking to one is a call, an
+/// indirect jump through one that doesn't link is a return.
+/// @param inst
+/// @param next
+auto Profiler::followJump(const DecodedInstruction& inst, uint64_t next)
+    -> void {
+    auto link = [](uint8_t reg) { return reg == 1 || reg == 5; };
+    if (link(inst.rd)) {
+        enter(next);
+    } else if (inst.mnemonic == Mnemonic::JALR && inst.rd == 0 &&
+               link(inst.rs1)) {
+        leave();
+    }
+}
+
+/// @brief Push the frame of the function at addr.
+/// @param addr
+auto Profiler::enter(uint64_t addr) -> void {
+    if (this->stack.size() == MaxStackDepth) {
+        this->overflow++;
+        return;
+    }
+    this->stack.push_back(addr);
+    this->current = &this->stacks[this->stack];
+}
+
+/// @brief Pop the innermost frame.
+auto Profiler::leave() -> void {
+    if (this->overflow != 0) {
+        this->overflow--;
+        return;
+    }
+    if (this->stack.size() == 1) {
+        return;
+    }
+    this->stack.pop_back();
+    this->current = &this->stacks[this->stack];
+}
+
+} // namespace riscvemu
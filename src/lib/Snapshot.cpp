@@ -0,0 +1,83 @@
+#include "Snapshot.h"
+#include "Machine.h"
+#include "Memory.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include <utility>
+
+#include <unistd.h>
+
+namespace riscvemu {
+
+//=== Snapshot Methods Implementations ====//
+
+Snapshot::Snapshot(const VMContext& ctx)
+    : memorySize(ctx.mmu.memorySize()), codeSize(ctx.codeSize),
+      entry(ctx.entry), imageSize(ctx.imageSize) {
+    if (ctx.imageSize == 0) {
+        return;
+    }
+    auto page   = hostPageSize();
+    this->bytes = (ctx.imageSize + page - 1) / page * page;
+    this->fd    = createMemoryFile(this->bytes);
+
+    // Copy whole pages, the last one may extend past the end of memory.
+    const auto* data = ctx.mmu.memory.data();
+    auto size        = std::min<size_t>(this->bytes, ctx.mmu.memorySize());
+    for (size_t done = 0; done < size;) {
+        auto n = pwrite(this->fd, data + done, size - done,
+                        static_cast<off_t>(done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            auto error = errno;
+            close(this->fd);
+            throw std::system_error(error, std::generic_category(),
+                                    "snapshot");
+        }
+        done += n;
+    }
+}
+
+Snapshot::~Snapshot() {
+    if (this->fd >= 0) {
+        close(this->fd);
+    }
+}
+
+Snapshot::Snapshot(Snapshot&& other) noexcept
+    : fd(std::exchange(other.fd, -1)), bytes(other.bytes),
+      memorySize(other.memorySize), codeSize(other.codeSize),
+      entry(other.entry), imageSize(other.imageSize) {}
+
+auto Snapshot::operator=(Snapshot&& other) noexcept -> Snapshot& {
+    std::swap(this->fd, other.fd);
+    std::swap(this->bytes, other.bytes);
+    std::swap(this->memorySize, other.memorySize);
+    std::swap(this->codeSize, other.codeSize);
+    std::swap(this->entry, other.entry);
+    std::swap(this->imageSize, other.imageSize);
+    return *this;
+}
+
+/// @brief Create a context in the state the snapshot was taken in, the
+/// image pages are shared with the snapshot until written to.
+/// @return VMContext
+auto Snapshot::clone() const -> VMContext {
+    auto ctx      = VMContext(this->memorySize);
+    ctx.codeSize  = this->codeSize;
+    ctx.entry     = this->entry;
+    ctx.imageSize = this->imageSize;
+    if (this->fd >= 0 &&
+        !mapFile(ctx.mmu.memory.data(), this->fd, 0, this->bytes)) {
+        throw std::system_error(errno, std::generic_category(), "snapshot");
+    }
+    return ctx;
+}
+
+} // namespace riscvemu
@@ -0,0 +1,448 @@
+#include "Syscalls.h"
+#include "Elf.h"
+#include "Machine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace riscvemu {
+
+// asm-generic open flags used by RISC-V Linux, translated to the host ones.
+static constexpr uint64_t GuestWriteOnly = 01;
+static constexpr uint64_t GuestReadWrite = 02;
+static constexpr uint64_t GuestCreate    = 0100;
+static constexpr uint64_t GuestExclusive = 0200;
+static constexpr uint64_t GuestNoCtty    = 0400;
+static constexpr uint64_t GuestTruncate  = 01000;
+static constexpr uint64_t GuestAppend    = 02000;
+static constexpr uint64_t GuestNonBlock  = 04000;
+static constexpr uint64_t GuestDirectory = 0200000;
+static constexpr uint64_t GuestNoFollow  = 0400000;
+static constexpr uint64_t GuestCloseExec = 02000000;
+
+// mmap flags.
+static constexpr uint64_t GuestMapFixed     = 0x10;
+static constexpr uint64_t GuestMapAnonymous = 0x20;
+
+// Directory descriptor of openat resolving paths from the working
+// directory.
+static constexpr int GuestAtCwd = -100;
+
+// Auxiliary vector entry types.
+static constexpr uint64_t AtNull   = 0;
+static constexpr uint64_t AtPhdr   = 3;
+static constexpr uint64_t AtPhent  = 4;
+static constexpr uint64_t AtPhnum  = 5;
+static constexpr uint64_t AtPagesz = 6;
+static constexpr uint64_t AtEntry  = 9;
+static constexpr uint64_t AtSecure = 23;
+static constexpr uint64_t AtRandom = 25;
+
+/// @brief Longest path accepted by openat, including the terminator.
+static constexpr uint64_t MaxPath = 4096;
+
+/// @brief Most iovecs accepted by writev.
+static constexpr uint64_t MaxIovecs = 1024;
+
+/// @brief Result of a host system call as returned to the guest.
+/// @param result
+/// @return result or the negated errno on failure.
+static auto hostResult(int64_t result) -> int64_t {
+    return result < 0 ? -errno : result;
+}
+
+/// @brief Host open flags of the guest flags.
+/// @param flags
+/// @return int
+static auto hostOpenFlags(uint64_t flags) -> int {
+    static constexpr struct {
+        uint64_t guest;
+        int host;
+    } table[] = {
+        {GuestWriteOnly, O_WRONLY},   {GuestReadWrite, O_RDWR},
+        {GuestCreate, O_CREAT},       {GuestExclusive, O_EXCL},
+        {GuestNoCtty, O_NOCTTY},      {GuestTruncate, O_TRUNC},
+        {GuestAppend, O_APPEND},      {GuestNonBlock, O_NONBLOCK},
+        {GuestDirectory, O_DIRECTORY}, {GuestNoFollow, O_NOFOLLOW},
+        {GuestCloseExec, O_CLOEXEC},
+    };
+    int host = 0;
+    for (const auto& flag : table) {
+        if ((flags & flag.guest) != 0) {
+            host |= flag.host;
+        }
+    }
+    return host;
+}
+
+//=== SyscallProxy Methods Implementations ====//
+
+SyscallProxy::SyscallProxy(const VMContext& ctx)
+    : heapStart((MemoryBaseAddr + ctx.dataSize + PageSize - 1) &
+                ~(PageSize - 1)),
+      heapEnd(heapStart), heapMax(heapStart) {
+    auto top       = MemoryBaseAddr + ctx.mmu.memorySize();
+    this->mappings = std::max(this->heapStart,
+                              top > UserStackSize + this->heapStart
+                                  ? (top - UserStackSize) & ~(PageSize - 1)
+                                  : this->heapStart);
+}
+
+SyscallProxy::~SyscallProxy() {
+    for (auto fd : this->fds) {
+        if (fd > 2) {
+            ::close(fd);
+        }
+    }
+}
+
+/// @brief Lay out argc, argv, envp, the auxiliary vector and the strings
+/// they point to below the stack pointer of cpu, which is left pointing
+/// at argc aligned to 16 bytes.
+/// @param cpu
+/// @param args
+/// @param env
+auto SyscallProxy::start(CPU& cpu, const std::vector<std::string>& args,
+                         const std::vector<std::string>& env) -> void {
+    auto& mmu = cpu.ctx->mmu;
+    auto sp   = cpu.registers[2];
+    auto push = [&](const std::string& string) {
+        sp -= string.size() + 1;
+        for (size_t i = 0; i <= string.size(); i++) {
+            mmu.store<uint8_t>(sp + i, string.c_str()[i]);
+        }
+        return sp;
+    };
+    std::vector<uint64_t> words = {args.size()};
+    for (const auto& arg : args) {
+        words.push_back(push(arg));
+    }
+    words.push_back(0);
+    for (const auto& var : env) {
+        words.push_back(push(var));
+    }
+    words.push_back(0);
+
+    // Seed of the stack protector and pointer guards, fixed so runs are
+    // reproducible.
+    sp = (sp - 16) & ~static_cast<uint64_t>(15);
+    for (uint64_t i = 0; i < 16; i++) {
+        mmu.store<uint8_t>(sp + i, (uint8_t)(0x5a ^ (i * 37)));
+    }
+    if (cpu.ctx->phdr != 0) {
+        words.insert(words.end(), {AtPhdr, cpu.ctx->phdr, AtPhent,
+                                   sizeof(Elf64ProgramHeader), AtPhnum,
+                                   cpu.ctx->phnum});
+    }
+    words.insert(words.end(), {AtPagesz, PageSize, AtEntry, cpu.ctx->entry,
+                               AtSecure, 0, AtRandom, sp, AtNull, 0});
+
+    sp = (sp - words.size() * 8) & ~static_cast<uint64_t>(15);
+    for (size_t i = 0; i < words.size(); i++) {
+        mmu.store<uint64_t>(sp + i * 8, words[i]);
+    }
+    cpu.registers[2] = sp;
+}
+
+/// @brief Serve the system call numbered a7, the result is written to a0.
+/// Unknown system calls fail with ENOSYS.
+/// @param cpu
+/// @return true
+auto SyscallProxy::handle(CPU& cpu) -> bool {
+    const auto& x  = cpu.registers;
+    int64_t result = -ENOSYS;
+    switch ((Syscall)x[17]) {
+    case Syscall::Openat:
+        result = openat(cpu, (int)x[10], x[11], x[12], x[13]);
+        break;
+    case Syscall::Close:
+        result = close(x[10]);
+        break;
+    case Syscall::Lseek:
+        result =
+            hostResult(::lseek(hostFd(x[10]), (off_t)x[11], (int)x[12]));
+        break;
+    case Syscall::Read: {
+        auto* host = buffer(cpu, x[11], x[12], true);
+        result     = host == nullptr
+                         ? -EFAULT
+                         : hostResult(::read(hostFd(x[10]), host, x[12]));
+        break;
+    }
+    case Syscall::Write: {
+        const auto* host = buffer(cpu, x[11], x[12], false);
+        result           = host == nullptr
+                               ? -EFAULT
+                               : hostResult(::write(hostFd(x[10]), host,
+                                                    x[12]));
+        break;
+    }
+    case Syscall::Writev:
+        result = writev(cpu, x[10], x[11], x[12]);
+        break;
+    case Syscall::Exit:
+    case Syscall::ExitGroup:
+        this->status = (int)(x[10] & 0xff);
+        cpu.pc       = 0;
+        return true;
+    case Syscall::ClockGettime:
+        result = clockGettime(cpu, x[10], x[11]);
+        break;
+    case Syscall::Brk:
+        result = brk(cpu, x[10]);
+        break;
+    case Syscall::Munmap:
+        // Mappings are never reused, unmapping releases nothing.
+        result = 0;
+        break;
+    case Syscall::Mmap:
+        result = mmap(cpu, x[10], x[11], x[13], x[14], x[15]);
+        break;
+    }
+    cpu.registers[10] = (uint64_t)result;
+    return true;
+}
+
+/// @brief Host descriptor of the guest descriptor fd.
+/// @param fd
+/// @return int, -1 if fd isn't open.
+auto SyscallProxy::hostFd(uint64_t fd) -> int {
+    auto guard = std::lock_guard(this->lock);
+    return fd < this->fds.size() ? this->fds[fd] : -1;
+}
+
+/// @brief Host address of the bytes guest bytes at addr, buffers written
+/// by the host invalidate the code decoded from them.
+/// @param cpu
+/// @param addr
+/// @param bytes
+/// @param write
+/// @return uint8_t* or nullptr if the buffer isn't within memory.
+auto SyscallProxy::buffer(CPU& cpu, uint64_t addr, uint64_t bytes, bool write)
+    -> uint8_t* {
+    auto& mmu   = cpu.ctx->mmu;
+    auto offset = addr - MemoryBaseAddr;
+    if (cpu.paging.data || offset > mmu.memorySize() ||
+        bytes > mmu.memorySize() - offset) {
+        return nullptr;
+    }
+    if (write && bytes != 0) {
+        mmu.invalidateCode(addr, bytes);
+    }
+    return mmu.memory.data() + offset;
+}
+
+/// @brief Open the file at the guest string path, the descriptor is the
+/// lowest one free.
+/// @param cpu
+/// @param dirfd
+/// @param path
+/// @param flags
+/// @param mode
+/// @return int64_t
+auto SyscallProxy::openat(CPU& cpu, int dirfd, uint64_t path, uint64_t flags,
+                          uint64_t mode) -> int64_t {
+    auto limit = std::min<uint64_t>(
+        MaxPath, MemoryBaseAddr + cpu.ctx->mmu.memorySize() - path);
+    const auto* name = buffer(cpu, path, limit, false);
+    if (name == nullptr || std::memchr(name, 0, limit) == nullptr) {
+        return -EFAULT;
+    }
+    auto dir = dirfd == GuestAtCwd ? AT_FDCWD : hostFd((uint64_t)dirfd);
+    auto fd  = ::openat(dir, (const char*)name, hostOpenFlags(flags),
+                        (mode_t)mode);
+    if (fd < 0) {
+        return -errno;
+    }
+    auto guard = std::lock_guard(this->lock);
+    auto free  = std::find(this->fds.begin(), this->fds.end(), -1);
+    if (free == this->fds.end()) {
+        this->fds.push_back(fd);
+        return (int64_t)this->fds.size() - 1;
+    }
+    *free = fd;
+    return free - this->fds.begin();
+}
+
+/// @brief Close the guest descriptor fd, the host standard streams stay
+/// open.
+/// @param fd
+/// @return int64_t
+auto SyscallProxy::close(uint64_t fd) -> int64_t {
+    auto guard = std::lock_guard(this->lock);
+    if (fd >= this->fds.size() || this->fds[fd] < 0) {
+        return -EBADF;
+    }
+    auto host      = this->fds[fd];
+    this->fds[fd] = -1;
+    return host > 2 ? hostResult(::close(host)) : 0;
+}
+
+/// @brief Write the guest buffers described by the count iovecs at iov.
+/// @param cpu
+/// @param fd
+/// @param iov
+/// @param count
+/// @return int64_t
+auto SyscallProxy::writev(CPU& cpu, uint64_t fd, uint64_t iov, uint64_t count)
+    -> int64_t {
+    if (count > MaxIovecs) {
+        return -EINVAL;
+    }
+    const auto* guest = buffer(cpu, iov, count * 16, false);
+    if (guest == nullptr) {
+        return -EFAULT;
+    }
+    std::vector<iovec> vectors(count);
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t base = 0;
+        uint64_t len  = 0;
+        std::memcpy(&base, guest + i * 16, 8);
+        std::memcpy(&len, guest + i * 16 + 8, 8);
+        vectors[i].iov_base = buffer(cpu, base, len, false);
+        vectors[i].iov_len  = len;
+        if (vectors[i].iov_base == nullptr) {
+            return -EFAULT;
+        }
+    }
+    return hostResult(::writev(hostFd(fd), vectors.data(), (int)count));
+}
+
+/// @brief Write the host time of clock to the guest timespec at addr.
+/// @param cpu
+/// @param clock
+/// @param addr
+/// @return int64_t
+auto SyscallProxy::clockGettime(CPU& cpu, uint64_t clock, uint64_t addr)
+    -> int64_t {
+    auto* guest = buffer(cpu, addr, 16, true);
+    if (guest == nullptr) {
+        return -EFAULT;
+    }
+    timespec time{};
+    if (::clock_gettime((clockid_t)clock, &time) != 0) {
+        return -errno;
+    }
+    auto seconds     = (int64_t)time.tv_sec;
+    auto nanoseconds = (int64_t)time.tv_nsec;
+    std::memcpy(guest, &seconds, 8);
+    std::memcpy(guest + 8, &nanoseconds, 8);
+    return 0;
+}
+
+/// @brief Move the end of the heap to addr, the heap can't shrink below its
+/// start or reach the mappings. Memory the heap grows back into is zeroed.
+/// @param cpu
+/// @param addr
+/// @return New end of the heap, the current one if addr is rejected.
+auto SyscallProxy::brk(CPU& cpu, uint64_t addr) -> int64_t {
+    auto guard = std::lock_guard(this->lock);
+    if (addr < this->heapStart || addr > this->mappings) {
+        return (int64_t)this->heapEnd;
+    }
+    // Memory past the highest end was never handed out and reads as zero.
+    if (addr > this->heapEnd && this->heapEnd < this->heapMax) {
+        auto end = std::min(addr, this->heapMax);
+        std::memset(buffer(cpu, this->heapEnd, end - this->heapEnd, true), 0,
+                    end - this->heapEnd);
+    }
+    this->heapEnd = addr;
+    this->heapMax = std::max(this->heapMax, addr);
+    return (int64_t)addr;
+}
+
+/// @brief Read length bytes of the host file at offset into host, bytes
+/// past the end of the file are left untouched.
+/// @param file
+/// @param host
+/// @param length
+/// @param offset
+/// @return 0 or the negated errno.
+static auto readMapping(int file, uint8_t* host, uint64_t length,
+                        uint64_t offset) -> int64_t {
+    for (uint64_t done = 0; done < length;) {
+        auto n = ::pread(file, host + done, length - done,
+                         (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -errno;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+/// @brief Map length bytes of zeroed memory, or of the file fd at offset,
+/// below the previous mappings or at addr with MAP_FIXED. Protections are
+/// ignored and shared mappings are private. A failed mapping leaves the
+/// mappings below the stack as they were.
+/// @param cpu
+/// @param addr
+/// @param length
+/// @param flags
+/// @param fd
+/// @param offset
+/// @return Address of the mapping or the negated errno.
+auto SyscallProxy::mmap(CPU& cpu, uint64_t addr, uint64_t length,
+                        uint64_t flags, uint64_t fd, uint64_t offset)
+    -> int64_t {
+    auto bytes = (length + PageSize - 1) & ~(PageSize - 1);
+    if (length == 0 || bytes < length) {
+        return -EINVAL;
+    }
+    auto file = -1;
+    if ((flags & GuestMapAnonymous) == 0) {
+        file = hostFd(fd);
+        if (file < 0) {
+            return -EBADF;
+        }
+    }
+    if ((flags & GuestMapFixed) != 0) {
+        if ((addr & (PageSize - 1)) != 0) {
+            return -EINVAL;
+        }
+        auto* host = buffer(cpu, addr, bytes, true);
+        if (host == nullptr) {
+            return -ENOMEM;
+        }
+        std::memset(host, 0, bytes);
+        auto error = file < 0 ? 0 : readMapping(file, host, length, offset);
+        return error != 0 ? error : (int64_t)addr;
+    }
+
+    auto guard = std::lock_guard(this->lock);
+    if (bytes > this->mappings - this->heapEnd) {
+        return -ENOMEM;
+    }
+    // Fresh mappings were never handed out and read as zero, they are
+    // zeroed again if the file can't be read.
+    addr       = this->mappings - bytes;
+    auto* host = buffer(cpu, addr, bytes, true);
+    if (file >= 0) {
+        auto error = readMapping(file, host, length, offset);
+        if (error != 0) {
+            std::memset(host, 0, bytes);
+            return error;
+        }
+    }
+    this->mappings = addr;
+    return (int64_t)addr;
+}
+
+} // namespace riscvemu
@@ -0,0 +1,717 @@
+#include <cstddef>
+#include <cstdint>
+
+#include "Decoder.h"
+#include "Instructions.h"
+#include "Jit.h"
+#include "Machine.h"
+#include "Semantics.h"
+#include "Translator.h"
+
+namespace riscvemu {
+
+//==== Threaded Engine ====//
+// The threaded engine executes translated basic blocks, each op carries
+// the address of the label executing it (direct threading) so moving to
+// the next instruction is a single indirect jump instead of a trip through
+// the opcode and funct switches.
+// Within a block the program counter is only materialized for the
+// instructions that observe it (AUIPC, control flow, faults), blocks are
+// chained to their successors to skip the block lookup on hot edges.
+// Common instruction pairs (see Fusion) are dispatched once for both.
+// When tiered, blocks entered JitThreshold times are compiled to native
+// code and run natively from then on, the threaded ops remain the fallback
+// for blocks (or block suffixes) the compiler doesn't handle.
+//
+// Labels as values are a GNU extension supported by GCC and Clang, other
+// compilers fall back to calling the op handlers in a loop.
+#if defined(__GNUC__)
+#define RISCVEMU_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+auto CPU::runThreaded(bool tiered) -> void {
+#ifdef RISCVEMU_COMPUTED_GOTO
+    // Dispatch targets indexed by Mnemonic, the exit sentinel is last.
+    static const void* const dispatch[] = {
+        &&op_ILLEGAL,    &&op_LUI,        &&op_AUIPC,      &&op_JAL,
+        &&op_JALR,       &&op_BEQ,        &&op_BNE,        &&op_BLT,
+        &&op_BGE,        &&op_BLTU,       &&op_BGEU,       &&op_LB,
+        &&op_LH,         &&op_LW,         &&op_LD,         &&op_LBU,
+        &&op_LHU,        &&op_LWU,        &&op_SB,         &&op_SH,
+        &&op_SW,         &&op_SD,         &&op_ADDI,       &&op_SLTI,
+        &&op_SLTIU,      &&op_XORI,       &&op_ORI,        &&op_ANDI,
+        &&op_SLLI,       &&op_SRLI,       &&op_SRAI,       &&op_ADDIW,
+        &&op_SLLIW,      &&op_SRLIW,      &&op_SRAIW,      &&op_ADD,
+        &&op_SUB,        &&op_SLL,        &&op_SLT,        &&op_SLTU,
+        &&op_XOR,        &&op_SRL,        &&op_SRA,        &&op_OR,
+        &&op_AND,        &&op_ADDW,       &&op_SUBW,       &&op_SLLW,
+        &&op_SRLW,       &&op_SRAW,       &&op_ECALL,      &&op_EBREAK,
+        &&op_MRET,       &&op_SRET,       &&op_SFENCE_VMA, &&op_WFI,
+        &&op_CSRRW,      &&op_CSRRS,      &&op_CSRRC,      &&op_CSRRWI,
+        &&op_CSRRSI,     &&op_CSRRCI,     &&op_FENCE,      &&op_FENCE_I,
+        &&op_LR_W,       &&op_SC_W,       &&op_AMOSWAP_W,  &&op_AMOADD_W,
+        &&op_AMOXOR_W,   &&op_AMOAND_W,   &&op_AMOOR_W,    &&op_AMOMIN_W,
+        &&op_AMOMAX_W,   &&op_AMOMINU_W,  &&op_AMOMAXU_W,  &&op_LR_D,
+        &&op_SC_D,       &&op_AMOSWAP_D,  &&op_AMOADD_D,   &&op_AMOXOR_D,
+        &&op_AMOAND_D,   &&op_AMOOR_D,    &&op_AMOMIN_D,   &&op_AMOMAX_D,
+        &&op_AMOMINU_D,  &&op_AMOMAXU_D,  &&op_MUL,        &&op_MULH,
+        &&op_MULHSU,     &&op_MULHU,      &&op_DIV,        &&op_DIVU,
+        &&op_REM,        &&op_REMU,       &&op_MULW,       &&op_DIVW,
+        &&op_DIVUW,      &&op_REMW,       &&op_REMUW,      &&op_FSW,
+        &&op_FSD,        &&op_FLW,        &&op_FLD,        &&op_FMADD_S,
+        &&op_FMSUB_S,    &&op_FNMSUB_S,   &&op_FNMADD_S,   &&op_FADD_S,
+        &&op_FSUB_S,     &&op_FMUL_S,     &&op_FDIV_S,     &&op_FSQRT_S,
+        &&op_FSGNJ_S,    &&op_FSGNJN_S,   &&op_FSGNJX_S,   &&op_FMIN_S,
+        &&op_FMAX_S,     &&op_FCVT_S_W,   &&op_FCVT_S_WU,  &&op_FCVT_S_L,
+        &&op_FCVT_S_LU,  &&op_FMV_W_X,    &&op_FCVT_S_D,   &&op_FMADD_D,
+        &&op_FMSUB_D,    &&op_FNMSUB_D,   &&op_FNMADD_D,   &&op_FADD_D,
+        &&op_FSUB_D,     &&op_FMUL_D,     &&op_FDIV_D,     &&op_FSQRT_D,
+        &&op_FSGNJ_D,    &&op_FSGNJN_D,   &&op_FSGNJX_D,   &&op_FMIN_D,
+        &&op_FMAX_D,     &&op_FCVT_D_W,   &&op_FCVT_D_WU,  &&op_FCVT_D_L,
+        &&op_FCVT_D_LU,  &&op_FMV_D_X,    &&op_FCVT_D_S,   &&op_FCVT_W_S,
+        &&op_FCVT_WU_S,  &&op_FCVT_L_S,   &&op_FCVT_LU_S,  &&op_FMV_X_W,
+        &&op_FEQ_S,      &&op_FLT_S,      &&op_FLE_S,      &&op_FCLASS_S,
+        &&op_FCVT_W_D,   &&op_FCVT_WU_D,  &&op_FCVT_L_D,   &&op_FCVT_LU_D,
+        &&op_FMV_X_D,    &&op_FEQ_D,      &&op_FLT_D,      &&op_FLE_D,
+        &&op_FCLASS_D,   &&op_VSETVLI,    &&op_VSETIVLI,   &&op_VSETVL,
+        &&op_VMV_X_S,    &&op_VFMV_F_S,   &&op_VLE,        &&op_VLSE,
+        &&op_VSE,        &&op_VSSE,       &&op_VADD,       &&op_VSUB,
+        &&op_VRSUB,      &&op_VMINU,      &&op_VMIN,       &&op_VMAXU,
+        &&op_VMAX,       &&op_VAND,       &&op_VOR,        &&op_VXOR,
+        &&op_VSLL,       &&op_VSRL,       &&op_VSRA,       &&op_VMSEQ,
+        &&op_VMSNE,      &&op_VMSLTU,     &&op_VMSLT,      &&op_VMSLEU,
+        &&op_VMSLE,      &&op_VMSGTU,     &&op_VMSGT,      &&op_VMERGE,
+        &&op_VMUL,       &&op_VMACC,      &&op_VREDSUM,    &&op_VMV_S_X,
+        &&op_VFADD,      &&op_VFSUB,      &&op_VFMUL,      &&op_VFDIV,
+        &&op_VFMACC,     &&op_VFREDUSUM,  &&op_VFMERGE,    &&op_VFMV_S_F,
+        &&op_EXIT,       &&op_LUI_ADDI,   &&op_LUI_ADDIW,  &&op_AUIPC_JALR,
+        &&op_AUIPC_LD,   &&op_SLLI_SRLI,
+    };
+    static_assert(sizeof(dispatch) / sizeof(dispatch[0]) ==
+                      (size_t)Mnemonic::Count + 1 + (size_t)Fusion::Count,
+                  "dispatch table must cover every mnemonic and pair");
+#else
+    const void* const* dispatch = nullptr;
+#endif
+
+    TranslatedBlock* block = nullptr;
+    const ThreadedOp* op   = nullptr;
+    auto state             = JitState{
+                    .registers  = this->registers.data(),
+                    .memory     = this->ctx->mmu.memory.data(),
+                    .memorySize = this->ctx->mmu.memory.size(),
+                    .codePages  = this->ctx->mmu.codePages.data(),
+                    .mmu        = &this->ctx->mmu,
+                    .status     = JitStatus::Continue,
+                    .retired    = 0,
+    };
+
+    // Address of the instruction executed by op and of the following one.
+    auto opPC = [&]() -> uint64_t {
+        return block->pc + block->offsets[op - block->ops.data()];
+    };
+    auto nextPC = [&]() -> uint64_t {
+        return block->pc + block->offsets[op - block->ops.data() + 1];
+    };
+
+    while (true) {
+        if (outsideCode()) {
+            break;
+        }
+        // Interrupts are only taken between blocks.
+        if (this->instret >= this->pollAt) [[unlikely]] {
+            if (this->instret >= this->stopAt) {
+                break;
+            }
+            if (pollInterrupts()) {
+                continue;
+            }
+        }
+        uint64_t paddr = 0;
+        if (!fetchAddress(paddr)) [[unlikely]] {
+            takeTrap(this->pc);
+            continue;
+        }
+        // Follow the chained successor if it starts at pc, otherwise
+        // look the block up and chain it to the previous block.
+        op             = nullptr;
+        auto slot      = (block != nullptr && this->pc == block->end) ? 0
+                                                                      : 1;
+        auto* next     = block != nullptr ? block->successors[slot]
+                                          : nullptr;
+        if (next == nullptr || next->pc != this->pc || next->paddr != paddr) {
+            next = this->blocks.lookup(this->pc, paddr, fetchLimit(),
+                                       dispatch);
+            if (block != nullptr) {
+                block->successors[slot] = next;
+            }
+        } else if (this->blocks.isStale(*next)) {
+            this->blocks.retranslate(*next, fetchLimit(), dispatch);
+        }
+        block = next;
+
+        // A block longer than the instructions left before stopAt runs one
+        // instruction at a time out of the decode cache.
+        if (this->stopAt - this->instret < block->ops.size() - 1)
+            [[unlikely]] {
+            const auto& inst = this->icache.lookup(paddr);
+            auto addr        = this->pc;
+            this->pc += inst.size;
+            if (!inst.handler(*this, inst)) {
+                takeTrap(addr);
+            } else {
+                this->instret++;
+            }
+            continue;
+        }
+
+        // Compiled code accesses guest memory directly, it only runs while
+        // loads and stores are untranslated.
+        if (tiered && !this->paging.data) {
+            if (block->native != nullptr) {
+                this->pc = block->native(&state);
+                this->instret += state.retired;
+                if (state.status == JitStatus::AccessFault) {
+                    // Replay the access outside of memory, it either
+                    // reaches a device or raises its trap, compiled code
+                    // only reports where it stopped.
+                    state.status     = JitStatus::Continue;
+                    auto addr        = this->pc;
+                    const auto& inst = this->icache.lookup(addr);
+                    this->pc += inst.size;
+                    if (!inst.handler(*this, inst)) {
+                        takeTrap(addr);
+                    } else {
+                        this->instret++;
+                    }
+                }
+                continue;
+            }
+            if (++block->executions == JitThreshold) {
+                block->native = this->jit.compile(*block);
+            }
+        }
+        op = block->ops.data();
+
+#ifdef RISCVEMU_COMPUTED_GOTO
+        // Instructions are counted once per block: every instruction but
+        // the last is counted on entry so a CSR read, always last, sees the
+        // instructions before it, the count is corrected on exit.
+        auto retired = this->instret;
+        this->instret += block->ops.size() - 2;
+        // Number of instructions executed before op.
+        auto executed = [&]() -> uint64_t { return op - block->ops.data(); };
+
+#define NEXT() goto*(++op)->dispatch
+// Execute op, traps leave the block to take them.
+#define RUN(handler)                                                           \
+    if (!handler(*this, op->decoded)) [[unlikely]] {                           \
+        goto trap;                                                             \
+    }
+// Straight-line instruction.
+#define EXEC(handler)                                                          \
+    RUN(handler)                                                               \
+    NEXT()
+// Straight-line instruction observing the program counter.
+#define EXEC_PC(handler)                                                       \
+    this->pc = nextPC();                                                       \
+    RUN(handler)                                                               \
+    NEXT()
+// Store, leaves the block if it wrote to the code being executed.
+#define EXEC_STORE(handler)                                                    \
+    RUN(handler)                                                               \
+    if (this->blocks.isStale(*block)) {                                        \
+        this->pc = nextPC();                                                   \
+        goto blockEnd;                                                         \
+    }                                                                          \
+    NEXT()
+// Block terminator.
+#define EXEC_EXIT(handler)                                                     \
+    this->pc = nextPC();                                                       \
+    RUN(handler)                                                               \
+    goto blockEnd
+// Fused pair, op moves to the second instruction first so a trap it raises
+// is taken at its address with the first instruction counted as retired.
+#define RUN_PAIR(handler)                                                      \
+    ++op;                                                                      \
+    this->pc = nextPC();                                                       \
+    if (!handler(*this, op[-1].decoded, op->decoded)) [[unlikely]] {           \
+        goto trap;                                                             \
+    }
+#define EXEC_PAIR(handler)                                                     \
+    RUN_PAIR(handler)                                                          \
+    NEXT()
+#define EXEC_PAIR_EXIT(handler)                                                \
+    RUN_PAIR(handler)                                                          \
+    goto blockEnd
+
+        goto* op->dispatch;
+
+    op_LUI:
+        EXEC(Semantics::lui);
+    op_AUIPC:
+        EXEC_PC(Semantics::auipc);
+    op_LB:
+        EXEC(Semantics::load<int8_t>);
+    op_LH:
+        EXEC(Semantics::load<int16_t>);
+    op_LW:
+        EXEC(Semantics::load<int32_t>);
+    op_LD:
+        EXEC(Semantics::load<int64_t>);
+    op_LBU:
+        EXEC(Semantics::load<uint8_t>);
+    op_LHU:
+        EXEC(Semantics::load<uint16_t>);
+    op_LWU:
+        EXEC(Semantics::load<uint32_t>);
+    op_SB:
+        EXEC_STORE(Semantics::store<uint8_t>);
+    op_SH:
+        EXEC_STORE(Semantics::store<uint16_t>);
+    op_SW:
+        EXEC_STORE(Semantics::store<uint32_t>);
+    op_SD:
+        EXEC_STORE(Semantics::store<uint64_t>);
+    op_ADDI:
+        EXEC(Semantics::addi);
+    op_SLTI:
+        EXEC(Semantics::slti);
+    op_SLTIU:
+        EXEC(Semantics::sltiu);
+    op_XORI:
+        EXEC(Semantics::xori);
+    op_ORI:
+        EXEC(Semantics::ori);
+    op_ANDI:
+        EXEC(Semantics::andi);
+    op_SLLI:
+        EXEC(Semantics::slli);
+    op_SRLI:
+        EXEC(Semantics::srli);
+    op_SRAI:
+        EXEC(Semantics::srai);
+    op_ADDIW:
+        EXEC(Semantics::addiw);
+    op_SLLIW:
+        EXEC(Semantics::slliw);
+    op_SRLIW:
+        EXEC(Semantics::srliw);
+    op_SRAIW:
+        EXEC(Semantics::sraiw);
+    op_ADD:
+        EXEC(Semantics::add);
+    op_SUB:
+        EXEC(Semantics::sub);
+    op_SLL:
+        EXEC(Semantics::sll);
+    op_SLT:
+        EXEC(Semantics::slt);
+    op_SLTU:
+        EXEC(Semantics::sltu);
+    op_XOR:
+        EXEC(Semantics::xor_);
+    op_SRL:
+        EXEC(Semantics::srl);
+    op_SRA:
+        EXEC(Semantics::sra);
+    op_OR:
+        EXEC(Semantics::or_);
+    op_AND:
+        EXEC(Semantics::and_);
+    op_ADDW:
+        EXEC(Semantics::addw);
+    op_SUBW:
+        EXEC(Semantics::subw);
+    op_SLLW:
+        EXEC(Semantics::sllw);
+    op_SRLW:
+        EXEC(Semantics::srlw);
+    op_SRAW:
+        EXEC(Semantics::sraw);
+    op_JAL:
+        EXEC_EXIT(Semantics::jal);
+    op_JALR:
+        EXEC_EXIT(Semantics::jalr);
+    op_BEQ:
+        EXEC_EXIT(Semantics::beq);
+    op_BNE:
+        EXEC_EXIT(Semantics::bne);
+    op_BLT:
+        EXEC_EXIT(Semantics::blt);
+    op_BGE:
+        EXEC_EXIT(Semantics::bge);
+    op_BLTU:
+        EXEC_EXIT(Semantics::bltu);
+    op_BGEU:
+        EXEC_EXIT(Semantics::bgeu);
+    op_ECALL:
+        EXEC_EXIT(Semantics::ecall);
+    op_EBREAK:
+        EXEC_EXIT(Semantics::ebreak);
+    op_MRET:
+        EXEC_EXIT(Semantics::mret);
+    op_SRET:
+        EXEC_EXIT(Semantics::sret);
+    op_SFENCE_VMA:
+        EXEC_EXIT(Semantics::sfence);
+    op_WFI:
+        EXEC_EXIT(Semantics::wfi);
+    op_CSRRW:
+        EXEC_EXIT(Semantics::csrrw);
+    op_CSRRS:
+        EXEC_EXIT(Semantics::csrrs);
+    op_CSRRC:
+        EXEC_EXIT(Semantics::csrrc);
+    op_CSRRWI:
+        EXEC_EXIT(Semantics::csrrwi);
+    op_CSRRSI:
+        EXEC_EXIT(Semantics::csrrsi);
+    op_CSRRCI:
+        EXEC_EXIT(Semantics::csrrci);
+    op_FENCE:
+        EXEC(Semantics::fence);
+    op_FENCE_I:
+        EXEC(Semantics::fence);
+    op_LR_W:
+        EXEC(Semantics::lr<uint32_t>);
+    op_SC_W:
+        EXEC_STORE(Semantics::sc<uint32_t>);
+    op_AMOSWAP_W:
+        EXEC_STORE(Semantics::amoswap<uint32_t>);
+    op_AMOADD_W:
+        EXEC_STORE(Semantics::amoadd<uint32_t>);
+    op_AMOXOR_W:
+        EXEC_STORE(Semantics::amoxor<uint32_t>);
+    op_AMOAND_W:
+        EXEC_STORE(Semantics::amoand<uint32_t>);
+    op_AMOOR_W:
+        EXEC_STORE(Semantics::amoor<uint32_t>);
+    op_AMOMIN_W:
+        EXEC_STORE(Semantics::amomin<uint32_t>);
+    op_AMOMAX_W:
+        EXEC_STORE(Semantics::amomax<uint32_t>);
+    op_AMOMINU_W:
+        EXEC_STORE(Semantics::amominu<uint32_t>);
+    op_AMOMAXU_W:
+        EXEC_STORE(Semantics::amomaxu<uint32_t>);
+    op_LR_D:
+        EXEC(Semantics::lr<uint64_t>);
+    op_SC_D:
+        EXEC_STORE(Semantics::sc<uint64_t>);
+    op_AMOSWAP_D:
+        EXEC_STORE(Semantics::amoswap<uint64_t>);
+    op_AMOADD_D:
+        EXEC_STORE(Semantics::amoadd<uint64_t>);
+    op_AMOXOR_D:
+        EXEC_STORE(Semantics::amoxor<uint64_t>);
+    op_AMOAND_D:
+        EXEC_STORE(Semantics::amoand<uint64_t>);
+    op_AMOOR_D:
+        EXEC_STORE(Semantics::amoor<uint64_t>);
+    op_AMOMIN_D:
+        EXEC_STORE(Semantics::amomin<uint64_t>);
+    op_AMOMAX_D:
+        EXEC_STORE(Semantics::amomax<uint64_t>);
+    op_AMOMINU_D:
+        EXEC_STORE(Semantics::amominu<uint64_t>);
+    op_AMOMAXU_D:
+        EXEC_STORE(Semantics::amomaxu<uint64_t>);
+    op_MUL:
+        EXEC(Semantics::mul);
+    op_MULH:
+        EXEC(Semantics::mulh);
+    op_MULHSU:
+        EXEC(Semantics::mulhsu);
+    op_MULHU:
+        EXEC(Semantics::mulhu);
+    op_DIV:
+        EXEC(Semantics::div);
+    op_DIVU:
+        EXEC(Semantics::divu);
+    op_REM:
+        EXEC(Semantics::rem);
+    op_REMU:
+        EXEC(Semantics::remu);
+    op_MULW:
+        EXEC(Semantics::mulw);
+    op_DIVW:
+        EXEC(Semantics::divw);
+    op_DIVUW:
+        EXEC(Semantics::divuw);
+    op_REMW:
+        EXEC(Semantics::remw);
+    op_REMUW:
+        EXEC(Semantics::remuw);
+    op_FSW:
+        EXEC_STORE(Semantics::fstore<float>);
+    op_FSD:
+        EXEC_STORE(Semantics::fstore<double>);
+    op_FLW:
+        EXEC(Semantics::fload<float>);
+    op_FLD:
+        EXEC(Semantics::fload<double>);
+    op_FMADD_S:
+        EXEC(Semantics::fmadd<float>);
+    op_FMSUB_S:
+        EXEC(Semantics::fmsub<float>);
+    op_FNMSUB_S:
+        EXEC(Semantics::fnmsub<float>);
+    op_FNMADD_S:
+        EXEC(Semantics::fnmadd<float>);
+    op_FADD_S:
+        EXEC(Semantics::fadd<float>);
+    op_FSUB_S:
+        EXEC(Semantics::fsub<float>);
+    op_FMUL_S:
+        EXEC(Semantics::fmul<float>);
+    op_FDIV_S:
+        EXEC(Semantics::fdiv<float>);
+    op_FSQRT_S:
+        EXEC(Semantics::fsqrt<float>);
+    op_FSGNJ_S:
+        EXEC(Semantics::fsgnj<float>);
+    op_FSGNJN_S:
+        EXEC(Semantics::fsgnjn<float>);
+    op_FSGNJX_S:
+        EXEC(Semantics::fsgnjx<float>);
+    op_FMIN_S:
+        EXEC(Semantics::fmin<float>);
+    op_FMAX_S:
+        EXEC(Semantics::fmax<float>);
+    op_FCVT_S_W:
+        EXEC((Semantics::fcvtFromInt<float, int32_t>));
+    op_FCVT_S_WU:
+        EXEC((Semantics::fcvtFromInt<float, uint32_t>));
+    op_FCVT_S_L:
+        EXEC((Semantics::fcvtFromInt<float, int64_t>));
+    op_FCVT_S_LU:
+        EXEC((Semantics::fcvtFromInt<float, uint64_t>));
+    op_FMV_W_X:
+        EXEC(Semantics::fmvFromInt<float>);
+    op_FCVT_S_D:
+        EXEC((Semantics::fcvtFloat<float, double>));
+    op_FMADD_D:
+        EXEC(Semantics::fmadd<double>);
+    op_FMSUB_D:
+        EXEC(Semantics::fmsub<double>);
+    op_FNMSUB_D:
+        EXEC(Semantics::fnmsub<double>);
+    op_FNMADD_D:
+        EXEC(Semantics::fnmadd<double>);
+    op_FADD_D:
+        EXEC(Semantics::fadd<double>);
+    op_FSUB_D:
+        EXEC(Semantics::fsub<double>);
+    op_FMUL_D:
+        EXEC(Semantics::fmul<double>);
+    op_FDIV_D:
+        EXEC(Semantics::fdiv<double>);
+    op_FSQRT_D:
+        EXEC(Semantics::fsqrt<double>);
+    op_FSGNJ_D:
+        EXEC(Semantics::fsgnj<double>);
+    op_FSGNJN_D:
+        EXEC(Semantics::fsgnjn<double>);
+    op_FSGNJX_D:
+        EXEC(Semantics::fsgnjx<double>);
+    op_FMIN_D:
+        EXEC(Semantics::fmin<double>);
+    op_FMAX_D:
+        EXEC(Semantics::fmax<double>);
+    op_FCVT_D_W:
+        EXEC((Semantics::fcvtFromInt<double, int32_t>));
+    op_FCVT_D_WU:
+        EXEC((Semantics::fcvtFromInt<double, uint32_t>));
+    op_FCVT_D_L:
+        EXEC((Semantics::fcvtFromInt<double, int64_t>));
+    op_FCVT_D_LU:
+        EXEC((Semantics::fcvtFromInt<double, uint64_t>));
+    op_FMV_D_X:
+        EXEC(Semantics::fmvFromInt<double>);
+    op_FCVT_D_S:
+        EXEC((Semantics::fcvtFloat<double, float>));
+    op_FCVT_W_S:
+        EXEC((Semantics::fcvtToInt<int32_t, float>));
+    op_FCVT_WU_S:
+        EXEC((Semantics::fcvtToInt<uint32_t, float>));
+    op_FCVT_L_S:
+        EXEC((Semantics::fcvtToInt<int64_t, float>));
+    op_FCVT_LU_S:
+        EXEC((Semantics::fcvtToInt<uint64_t, float>));
+    op_FMV_X_W:
+        EXEC(Semantics::fmvToInt<float>);
+    op_FEQ_S:
+        EXEC(Semantics::feq<float>);
+    op_FLT_S:
+        EXEC(Semantics::flt<float>);
+    op_FLE_S:
+        EXEC(Semantics::fle<float>);
+    op_FCLASS_S:
+        EXEC(Semantics::fclass<float>);
+    op_FCVT_W_D:
+        EXEC((Semantics::fcvtToInt<int32_t, double>));
+    op_FCVT_WU_D:
+        EXEC((Semantics::fcvtToInt<uint32_t, double>));
+    op_FCVT_L_D:
+        EXEC((Semantics::fcvtToInt<int64_t, double>));
+    op_FCVT_LU_D:
+        EXEC((Semantics::fcvtToInt<uint64_t, double>));
+    op_FMV_X_D:
+        EXEC(Semantics::fmvToInt<double>);
+    op_FEQ_D:
+        EXEC(Semantics::feq<double>);
+    op_FLT_D:
+        EXEC(Semantics::flt<double>);
+    op_FLE_D:
+        EXEC(Semantics::fle<double>);
+    op_FCLASS_D:
+        EXEC(Semantics::fclass<double>);
+    op_VSETVLI:
+        EXEC(Semantics::vsetvli);
+    op_VSETIVLI:
+        EXEC(Semantics::vsetivli);
+    op_VSETVL:
+        EXEC(Semantics::vsetvl);
+    op_VMV_X_S:
+        EXEC(Semantics::vmvXS);
+    op_VFMV_F_S:
+        EXEC(Semantics::vfmvFS);
+    op_VLE:
+        EXEC(Semantics::vle);
+    op_VLSE:
+        EXEC(Semantics::vlse);
+    op_VSE:
+        EXEC_STORE(Semantics::vse);
+    op_VSSE:
+        EXEC_STORE(Semantics::vsse);
+    op_VADD:
+        EXEC(Semantics::vadd);
+    op_VSUB:
+        EXEC(Semantics::vsub);
+    op_VRSUB:
+        EXEC(Semantics::vrsub);
+    op_VMINU:
+        EXEC(Semantics::vminu);
+    op_VMIN:
+        EXEC(Semantics::vmin);
+    op_VMAXU:
+        EXEC(Semantics::vmaxu);
+    op_VMAX:
+        EXEC(Semantics::vmax);
+    op_VAND:
+        EXEC(Semantics::vand);
+    op_VOR:
+        EXEC(Semantics::vor);
+    op_VXOR:
+        EXEC(Semantics::vxor);
+    op_VSLL:
+        EXEC(Semantics::vsll);
+    op_VSRL:
+        EXEC(Semantics::vsrl);
+    op_VSRA:
+        EXEC(Semantics::vsra);
+    op_VMSEQ:
+        EXEC(Semantics::vmseq);
+    op_VMSNE:
+        EXEC(Semantics::vmsne);
+    op_VMSLTU:
+        EXEC(Semantics::vmsltu);
+    op_VMSLT:
+        EXEC(Semantics::vmslt);
+    op_VMSLEU:
+        EXEC(Semantics::vmsleu);
+    op_VMSLE:
+        EXEC(Semantics::vmsle);
+    op_VMSGTU:
+        EXEC(Semantics::vmsgtu);
+    op_VMSGT:
+        EXEC(Semantics::vmsgt);
+    op_VMERGE:
+        EXEC(Semantics::vmerge);
+    op_VMUL:
+        EXEC(Semantics::vmul);
+    op_VMACC:
+        EXEC(Semantics::vmacc);
+    op_VREDSUM:
+        EXEC(Semantics::vredsum);
+    op_VMV_S_X:
+        EXEC(Semantics::vmvSX);
+    op_VFADD:
+        EXEC(Semantics::vfadd);
+    op_VFSUB:
+        EXEC(Semantics::vfsub);
+    op_VFMUL:
+        EXEC(Semantics::vfmul);
+    op_VFDIV:
+        EXEC(Semantics::vfdiv);
+    op_VFMACC:
+        EXEC(Semantics::vfmacc);
+    op_VFREDUSUM:
+        EXEC(Semantics::vfredusum);
+    op_VFMERGE:
+        EXEC(Semantics::vfmerge);
+    op_VFMV_S_F:
+        EXEC(Semantics::vfmvSF);
+    op_ILLEGAL:
+        // Illegal instructions and instructions crossing a page boundary,
+        // see DecodeCache::decode.
+        EXEC_EXIT(op->decoded.handler);
+    op_LUI_ADDI:
+        EXEC_PAIR(Semantics::luiAddi);
+    op_LUI_ADDIW:
+        EXEC_PAIR(Semantics::luiAddiw);
+    op_AUIPC_JALR:
+        EXEC_PAIR_EXIT(Semantics::auipcJalr);
+    op_AUIPC_LD:
+        EXEC_PAIR(Semantics::auipcLd);
+    op_SLLI_SRLI:
+        EXEC_PAIR(Semantics::slliSrli);
+    op_EXIT:
+        this->instret = retired + executed();
+        this->pc      = block->end;
+        continue;
+    blockEnd:
+        this->instret = retired + executed() + 1;
+        continue;
+    trap:
+        this->instret = retired + executed();
+        takeTrap(opPC());
+        continue;
+
+#undef EXEC_PAIR_EXIT
+#undef EXEC_PAIR
+#undef RUN_PAIR
+#undef EXEC_EXIT
+#undef EXEC_STORE
+#undef EXEC_PC
+#undef EXEC
+#undef RUN
+#undef NEXT
+#else
+        for (; op->decoded.handler != nullptr; ++op) {
+            this->pc = nextPC();
+            if (!op->decoded.handler(*this, op->decoded)) {
+                takeTrap(opPC());
+                break;
+            }
+            this->instret++;
+            if (isBlockTerminator(op->decoded.mnemonic) ||
+                this->blocks.isStale(*block)) {
+                break;
+            }
+        }
+        if (op->decoded.handler == nullptr) {
+            this->pc = block->end;
+        }
+#endif
+    }
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+} // namespace riscvemu
@@ -0,0 +1,271 @@
+#include "Trace.h"
+#include "Decoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace riscvemu {
+
+// Delta encoding header bits, the low bits are the record flags.
+// The instruction doesn't follow the previous one.
+static constexpr uint8_t DeltaJump = 1 << 2;
+// The instruction wrote a register.
+static constexpr uint8_t DeltaRd = 1 << 3;
+
+/// @brief Records moved from the ring per write.
+static constexpr size_t DrainBatch = 4096;
+
+/// @brief Append value as a LEB128 variable length integer.
+static auto putVarint(std::vector<uint8_t>& out, uint64_t value) -> void {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+/// @brief Append the zigzag encoding of the signed delta, small deltas in
+/// either direction take few bytes.
+static auto putDelta(std::vector<uint8_t>& out, uint64_t delta) -> void {
+    putVarint(out, (delta << 1) ^ (uint64_t)((int64_t)delta >> 63));
+}
+
+/// @brief Read a single byte from in.
+static auto getByte(std::istream& in) -> uint8_t {
+    auto c = in.get();
+    if (c == std::istream::traits_type::eof()) {
+        throw TraceError("trace: truncated record");
+    }
+    return (uint8_t)c;
+}
+
+/// @brief Read a LEB128 variable length integer.
+static auto getVarint(std::istream& in) -> uint64_t {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        auto byte = getByte(in);
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw TraceError("trace: malformed integer");
+}
+
+/// @brief Read a zigzag encoded delta.
+static auto getDelta(std::istream& in) -> uint64_t {
+    auto value = getVarint(in);
+    return (value >> 1) ^ (~(value & 1) + 1);
+}
+
+//=== TraceRing Methods Implementations ====//
+
+TraceRing::TraceRing(size_t capacity)
+    : records(std::bit_ceil(std::max<size_t>(capacity, 2))),
+      mask(records.size() - 1) {}
+
+/// @brief Wait for the consumer to free the slot of head.
+/// @param head
+auto TraceRing::waitForSpace(uint64_t head) -> void {
+    while (true) {
+        this->cachedTail = this->tail.load(std::memory_order_acquire);
+        if (head - this->cachedTail != this->records.size()) {
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+/// @brief Move up to max queued records to out.
+/// @param out
+/// @param max
+/// @return Number of records moved.
+auto TraceRing::pop(TraceRecord* out, size_t max) -> size_t {
+    auto tail  = this->tail.load(std::memory_order_relaxed);
+    auto head  = this->head.load(std::memory_order_acquire);
+    auto count = std::min<uint64_t>(head - tail, max);
+    for (uint64_t i = 0; i < count; i++) {
+        out[i] = this->records[(tail + i) & this->mask];
+    }
+    this->tail.store(tail + count, std::memory_order_release);
+    return count;
+}
+
+//=== TraceEncoder Methods Implementations ====//
+
+/// @brief Append the delta encoding of record: a header byte, the pc delta
+/// unless the instruction follows the previous one, the instruction bits
+/// (two bytes for compressed instructions), rd and the delta of its value
+/// to the previous value of rd, the trap cause and the delta of the
+/// address to the previous one.
+/// @param record
+/// @param out
+auto TraceEncoder::encode(const TraceRecord& record, std::vector<uint8_t>& out)
+    -> void {
+    auto jump   = record.pc != this->sequential;
+    auto header = (uint8_t)(record.flags | (jump ? DeltaJump : 0) |
+                            (record.rd != 0 ? DeltaRd : 0));
+    out.push_back(header);
+    if (jump) {
+        putDelta(out, record.pc - this->sequential);
+    }
+    auto size  = instructionSize(record.inst);
+    this->sequential = record.pc + size;
+    for (unsigned shift = 0; shift < size * 8U; shift += 8) {
+        out.push_back((uint8_t)(record.inst >> shift));
+    }
+    if (record.rd != 0) {
+        auto rd = record.rd & 0x1f;
+        out.push_back((uint8_t)rd);
+        putDelta(out, record.value - this->values[rd]);
+        this->values[rd] = record.value;
+    }
+    if ((record.flags & TraceTrap) != 0) {
+        putVarint(out, record.value);
+    }
+    if ((record.flags & (TraceMemory | TraceTrap)) != 0) {
+        putDelta(out, record.addr - this->addr);
+        this->addr = record.addr;
+    }
+}
+
+//=== Tracer Methods Implementations ====//
+
+Tracer::Tracer(const std::string& path, TraceFormat format, size_t capacity)
+    : ring(capacity), format(format),
+      out(path, std::ios::binary | std::ios::trunc) {
+    if (!this->out) {
+        throw TraceError("trace: can't create " + path);
+    }
+    auto version = Version;
+    auto encoded = (uint32_t)format;
+    this->out.write(reinterpret_cast<const char*>(&Magic), sizeof(Magic));
+    this->out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    this->out.write(reinterpret_cast<const char*>(&encoded), sizeof(encoded));
+    this->writer = std::thread([this] { drain(); });
+}
+
+Tracer::~Tracer() {
+    try {
+        close();
+    } catch (TraceError&) {
+        // Reported by close, a destructor can't.
+    }
+}
+
+/// @brief Stop the writer thread once it wrote every queued record.
+auto Tracer::close() -> void {
+    if (this->writer.joinable()) {
+        this->stopping.store(true, std::memory_order_release);
+        this->writer.join();
+        this->out.close();
+        if (this->failed || !this->out) {
+            throw TraceError("trace: write failed");
+        }
+    }
+}
+
+/// @brief Move records out of the ring and write them until stopped, the
+/// thread sleeps while the ring is empty.
+auto Tracer::drain() -> void {
+    std::vector<TraceRecord> batch(DrainBatch);
+    std::vector<uint8_t> bytes;
+    TraceEncoder encoder;
+    while (true) {
+        // Read the flag first so records queued before close are drained.
+        auto stop  = this->stopping.load(std::memory_order_acquire);
+        auto count = this->ring.pop(batch.data(), batch.size());
+        if (count == 0) {
+            if (stop) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        if (this->format == TraceFormat::Raw) {
+            this->out.write(reinterpret_cast<const char*>(batch.data()),
+                            (std::streamsize)(count * sizeof(TraceRecord)));
+        } else {
+            bytes.clear();
+            for (size_t i = 0; i < count; i++) {
+                encoder.encode(batch[i], bytes);
+            }
+            this->out.write(reinterpret_cast<const char*>(bytes.data()),
+                            (std::streamsize)bytes.size());
+        }
+        this->failed = this->failed || !this->out;
+    }
+}
+
+//=== TraceReader Methods Implementations ====//
+
+TraceReader::TraceReader(std::istream& in) : in(&in) {
+    uint64_t magic   = 0;
+    uint32_t version = 0;
+    uint32_t format  = 0;
+    in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&format), sizeof(format));
+    if (!in || magic != Tracer::Magic || version != Tracer::Version ||
+        format > (uint32_t)TraceFormat::Delta) {
+        throw TraceError("trace: not a trace of this version");
+    }
+    this->encoding = (TraceFormat)format;
+}
+
+/// @brief Decode the next record, see TraceEncoder::encode.
+/// @param record
+/// @return false at the end of the trace.
+auto TraceReader::next(TraceRecord& record) -> bool {
+    if (this->in->peek() == std::istream::traits_type::eof()) {
+        return false;
+    }
+    if (this->encoding == TraceFormat::Raw) {
+        if (!this->in->read(reinterpret_cast<char*>(&record),
+                            sizeof(record))) {
+            throw TraceError("trace: truncated record");
+        }
+        return true;
+    }
+    auto header = getByte(*this->in);
+    record      = TraceRecord{};
+    record.flags = header & (TraceMemory | TraceTrap);
+    record.pc    = this->sequential;
+    if ((header & DeltaJump) != 0) {
+        record.pc += getDelta(*this->in);
+    }
+    for (unsigned shift = 0; shift < 16; shift += 8) {
+        record.inst |= (uint32_t)getByte(*this->in) << shift;
+    }
+    if (instructionSize(record.inst) == 4) {
+        for (unsigned shift = 16; shift < 32; shift += 8) {
+            record.inst |= (uint32_t)getByte(*this->in) << shift;
+        }
+    }
+    this->sequential = record.pc + instructionSize(record.inst);
+    if ((header & DeltaRd) != 0) {
+        record.rd = getByte(*this->in) & 0x1f;
+        record.value = this->values[record.rd] + getDelta(*this->in);
+        this->values[record.rd] = record.value;
+    }
+    if ((header & TraceTrap) != 0) {
+        record.value = getVarint(*this->in);
+    }
+    if ((header & (TraceMemory | TraceTrap)) != 0) {
+        record.addr = this->addr + getDelta(*this->in);
+        this->addr  = record.addr;
+    }
+    return true;
+}
+
+} // namespace riscvemu
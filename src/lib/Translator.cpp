@@ -0,0 +1,151 @@
+#include "Translator.h"
+#include "Decoder.h"
+#include "Instructions.h"
+#include "Machine.h"
+
+#include <cstdint>
+#include <memory>
+
+namespace riscvemu {
+
+/// @brief Returns true if first and second form a pair executed as one.
+/// @param first
+/// @param second
+/// @param fusion Set to the pair.
+/// @return bool
+static auto fuse(const DecodedInstruction& first,
+                 const DecodedInstruction& second, Fusion& fusion) -> bool {
+    // The second instruction reads the result of the first one.
+    if (first.rd == 0 || second.rs1 != first.rd) {
+        return false;
+    }
+    switch (first.mnemonic) {
+    case Mnemonic::LUI:
+        if (second.rd != first.rd) {
+            return false;
+        }
+        if (second.mnemonic == Mnemonic::ADDI) {
+            fusion = Fusion::LuiAddi;
+            return true;
+        }
+        if (second.mnemonic == Mnemonic::ADDIW) {
+            fusion = Fusion::LuiAddiw;
+            return true;
+        }
+        return false;
+    case Mnemonic::AUIPC:
+        if (second.mnemonic == Mnemonic::JALR) {
+            fusion = Fusion::AuipcJalr;
+            return true;
+        }
+        if (second.mnemonic == Mnemonic::LD) {
+            fusion = Fusion::AuipcLd;
+            return true;
+        }
+        return false;
+    case Mnemonic::SLLI:
+        if (second.mnemonic == Mnemonic::SRLI && second.rd == first.rd) {
+            fusion = Fusion::SlliSrli;
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+//=== BlockCache Methods Implementations ====//
+
+BlockCache::BlockCache(MMU& mmu)
+    : mmu(&mmu), generations(mmu.codeGenerations.data()) {}
+
+/// @brief Return the block starting at pc, translating it on a miss, when
+/// the cached translation is stale or was entered from another virtual
+/// address.
+/// @param pc
+/// @param paddr
+/// @param limit
+/// @param dispatch
+/// @return TranslatedBlock*
+auto BlockCache::lookup(uint64_t pc, uint64_t paddr, uint64_t limit,
+                        const void* const* dispatch) -> TranslatedBlock* {
+    auto& block = this->blocks[paddr];
+    if (block == nullptr) {
+        block = std::make_unique<TranslatedBlock>();
+        translate(*block, pc, paddr, limit, dispatch);
+    } else if (block->pc != pc || isStale(*block)) {
+        translate(*block, pc, paddr, limit, dispatch);
+    }
+    return block.get();
+}
+
+/// @brief Translate block again from the current memory contents.
+/// @param block
+/// @param limit
+/// @param dispatch
+auto BlockCache::retranslate(TranslatedBlock& block, uint64_t limit,
+                             const void* const* dispatch) -> void {
+    translate(block, block.pc, block.paddr, limit, dispatch);
+}
+
+/// @brief Drop every translated block.
+auto BlockCache::flush() -> void { this->blocks.clear(); }
+
+/// @brief Decode instructions starting at pc until a block terminator,
+/// the end of the page, the end of the code or MaxBlockInstructions is
+/// reached. Instructions are fetched from the physical page at paddr, the
+/// page is flagged in the MMU so stores to it are reported.
+/// @param block
+/// @param pc
+/// @param paddr
+/// @param limit
+/// @param dispatch
+auto BlockCache::translate(TranslatedBlock& block, uint64_t pc,
+                           uint64_t paddr, uint64_t limit,
+                           const void* const* dispatch) -> void {
+    block.pc         = pc;
+    block.paddr      = paddr;
+    block.page       = (paddr - MemoryBaseAddr) >> PageShift;
+    block.generation = this->mmu->watchCode(paddr);
+    block.successors = {nullptr, nullptr};
+    block.executions = 0;
+    block.native     = nullptr;
+    block.ops.clear();
+    block.offsets.clear();
+
+    auto next = pc;
+    while (next < limit && block.ops.size() < MaxBlockInstructions) {
+        auto decoded = DecodeCache::decode(*this->mmu, paddr + (next - pc));
+        block.ops.push_back(
+            ThreadedOp{.dispatch = dispatch != nullptr
+                                       ? dispatch[(size_t)decoded.mnemonic]
+                                       : nullptr,
+                       .decoded  = decoded});
+        block.offsets.push_back((uint16_t)(next - pc));
+        next += decoded.size;
+        if (isBlockTerminator(decoded.mnemonic) ||
+            (next & (PageSize - 1)) == 0) {
+            break;
+        }
+    }
+    block.end = next;
+    block.offsets.push_back((uint16_t)(next - pc));
+
+    // Fuse pairs, the second op of a pair never starts another one.
+    for (size_t i = 0; dispatch != nullptr && i + 1 < block.ops.size(); i++) {
+        auto fusion = Fusion::Count;
+        if (fuse(block.ops[i].decoded, block.ops[i + 1].decoded, fusion)) {
+            block.ops[i].dispatch =
+                dispatch[(size_t)Mnemonic::Count + 1 + (size_t)fusion];
+            i++;
+        }
+    }
+
+    // Exit sentinel, continues execution at block.end.
+    block.ops.push_back(ThreadedOp{
+        .dispatch = dispatch != nullptr ? dispatch[(size_t)Mnemonic::Count]
+                                        : nullptr,
+        .decoded  = DecodedInstruction{}});
+}
+
+} // namespace riscvemu
@@ -1,26 +1,49 @@
+#include "Batch.h"
 #include "CSR.h"
+#include "Checkpoint.h"
+#include "Conformance.h"
 #include "Machine.h"
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
 #include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
 #include <vector>
 
 #include "Decoder.h"
+#include "Elf.h"
+#include "Float.h"
 #include "Instructions.h"
+#include "Profiler.h"
+#include "Snapshot.h"
+#include "Syscalls.h"
+#include "Trace.h"
+#include "Vector.h"
 #include "doctest.h"
 
 auto setupTestContext(const char* filename) -> riscvemu::CPU {
-    std::ifstream input(filename, std::ios::binary);
-    std::vector<uint8_t> const buffer(std::istreambuf_iterator<char>(input),
-                                      {});
-    auto ctx = riscvemu::VMContext(buffer);
-    auto cpu = riscvemu::CPU(ctx);
+    auto ctx = riscvemu::VMContext::fromImage(filename);
+    auto cpu = riscvemu::CPU(std::move(ctx));
 
     return cpu;
 }
 
+// Engines the engine parity tests run their programs on.
+constexpr riscvemu::Engine AllEngines[] = {riscvemu::Engine::Interpreter,
+                                           riscvemu::Engine::Threaded,
+                                           riscvemu::Engine::Jit};
+
 TEST_CASE("testing instruction decoding") {
     // addi x1, x2, 48
     uint32_t instruction = 0x03010093;
@@ -36,6 +59,246 @@ TEST_CASE("testing instruction decoding") {
     CHECK(decodedT.Imm == 0x30);
 }
 
+TEST_CASE("testing sized memory accesses") {
+    auto mmu = riscvemu::MMU();
+
+    // Unaligned little endian round trip.
+    mmu.store<uint64_t>(riscvemu::MemoryBaseAddr + 3, 0x1122334455667788);
+    CHECK(mmu.load<uint64_t>(riscvemu::MemoryBaseAddr + 3) ==
+          0x1122334455667788);
+    CHECK(mmu.load<uint8_t>(riscvemu::MemoryBaseAddr + 3) == 0x88);
+    CHECK(mmu.load<uint16_t>(riscvemu::MemoryBaseAddr + 4) == 0x6677);
+    CHECK(mmu.load(riscvemu::MemoryBaseAddr + 7, 32) == 0x11223344);
+
+    // Accesses must fit entirely within memory.
+    CHECK(mmu.load<uint64_t>(riscvemu::MemoryEndAddr - 7) == 0);
+    CHECK_THROWS_AS(mmu.load<uint64_t>(riscvemu::MemoryEndAddr - 6),
+                    riscvemu::LoadAccessFault);
+    CHECK_THROWS_AS(mmu.store<uint16_t>(riscvemu::MemoryEndAddr, 1),
+                    riscvemu::LoadAccessFault);
+    CHECK_THROWS_AS(mmu.load<uint8_t>(riscvemu::MemoryBaseAddr - 1),
+                    riscvemu::LoadAccessFault);
+}
+
+TEST_CASE("testing host page cache") {
+    auto cache = riscvemu::PageCache();
+    uint8_t page[4096] = {};
+    uint8_t code       = 0;
+    CHECK(cache.lookup<uint32_t>(0x1000) == nullptr);
+
+    cache.insert(0x1ff8, page, &code);
+    CHECK(cache.lookup<uint64_t>(0x1000)->host == page);
+    CHECK(cache.lookup<uint64_t>(0x1ff8) != nullptr);
+    CHECK(cache.lookup<uint8_t>(0x1fff) != nullptr);
+    // Values spanning into the next page miss.
+    CHECK(cache.lookup<uint64_t>(0x1ffc) == nullptr);
+    CHECK(cache.lookup<uint16_t>(0x1fff) == nullptr);
+    // Pages mapping to the same entry evict each other.
+    cache.insert(0x1000 + riscvemu::PageCache::Entries * 4096, page, &code);
+    CHECK(cache.lookup<uint8_t>(0x1000) == nullptr);
+    cache.flush();
+    CHECK(cache.lookup<uint8_t>(0x1000 + riscvemu::PageCache::Entries *
+                                             4096) == nullptr);
+}
+
+TEST_CASE("testing configurable guest memory") {
+    constexpr uint64_t size = static_cast<uint64_t>(4) << 30;
+    // addi a0, zero, 1
+    auto ctx = riscvemu::VMContext({0x13, 0x05, 0x10, 0x00}, size);
+    auto cpu = riscvemu::CPU(std::move(ctx));
+    cpu.run();
+
+    CHECK(cpu.getRegister(riscvemu::Register::A0) == 1);
+    CHECK(cpu.getRegister(riscvemu::Register::Sp) ==
+          riscvemu::MemoryBaseAddr + size - 4);
+
+    // The top of a 4 GiB memory is addressable.
+    auto top = riscvemu::MemoryBaseAddr + size - 8;
+    cpu.store<uint64_t>(top, 0xdeadbeef);
+    CHECK(cpu.load<uint64_t>(top) == 0xdeadbeef);
+    CHECK_THROWS_AS(cpu.load<uint64_t>(top + 8), riscvemu::LoadAccessFault);
+
+    CHECK_THROWS_AS(riscvemu::VMContext(std::vector<uint8_t>(16), 8),
+                    std::length_error);
+}
+
+TEST_CASE("testing program images are mapped copy-on-write") {
+    const auto* fp = "loop.bin";
+    std::ifstream input(fp, std::ios::binary);
+    std::vector<uint8_t> const buffer(std::istreambuf_iterator<char>(input),
+                                      {});
+
+    auto cpu = setupTestContext(fp);
+    uint32_t first = buffer[0] | buffer[1] << 8 | buffer[2] << 16 |
+                     buffer[3] << 24;
+    CHECK(cpu.load<uint32_t>(riscvemu::MemoryBaseAddr) == first);
+    // Guest writes don't reach the image.
+    cpu.store<uint32_t>(riscvemu::MemoryBaseAddr, 0);
+    auto other = setupTestContext(fp);
+    CHECK(other.load<uint32_t>(riscvemu::MemoryBaseAddr) != 0);
+    other.run();
+    CHECK(other.getRegister(riscvemu::Register::A0) == 5050);
+
+    CHECK_THROWS_AS(riscvemu::VMContext::fromImage("missing.bin"),
+                    std::system_error);
+    CHECK_THROWS_AS(riscvemu::VMContext::fromImage(fp, 8), std::length_error);
+}
+
+TEST_CASE("testing elf loading") {
+    // Text spans a whole page and is mapped, data isn't page aligned in the
+    // file and is copied, its .bss half must read as zero.
+    constexpr uint64_t textAddr = riscvemu::MemoryBaseAddr + 0x1000;
+    constexpr uint64_t dataAddr = riscvemu::MemoryBaseAddr + 0x3000;
+    std::vector<uint32_t> text(1024 + 2, 0x00000013); // nop
+    text[0]    = 0x00002597;                          // auipc a1, 2
+    text[1023] = 0x0005b503;                          // ld a0, 0(a1)
+    text[1024] = 0x0085b603;                          // ld a2, 8(a1)
+    text[1025] = 0x00150513;                          // addi a0, a0, 1
+    const uint64_t data[2] = {41, ~0ULL};
+
+    riscvemu::Elf64Header header{};
+    std::memcpy(header.ident, riscvemu::ElfMagic, sizeof(riscvemu::ElfMagic));
+    header.ident[4]  = riscvemu::ElfClass64;
+    header.ident[5]  = riscvemu::ElfDataLSB;
+    header.type      = riscvemu::ElfTypeExec;
+    header.machine   = riscvemu::ElfMachineRISCV;
+    header.entry     = textAddr;
+    header.phoff     = sizeof(header);
+    header.phentsize = sizeof(riscvemu::Elf64ProgramHeader);
+    header.phnum     = 2;
+    riscvemu::Elf64ProgramHeader segments[2] = {
+        {.type   = riscvemu::ElfSegmentLoad,
+         .flags  = riscvemu::ElfSegmentExec,
+         .offset = 0x1000,
+         .vaddr  = textAddr,
+         .paddr  = textAddr,
+         .filesz = text.size() * 4,
+         .memsz  = text.size() * 4,
+         .align  = 0x1000},
+        {.type   = riscvemu::ElfSegmentLoad,
+         .flags  = 0,
+         .offset = 0x1000 + text.size() * 4,
+         .vaddr  = dataAddr,
+         .paddr  = dataAddr,
+         .filesz = 8,
+         .memsz  = 16,
+         .align  = 8},
+    };
+    std::vector<uint8_t> file(0x1000);
+    std::memcpy(file.data(), &header, sizeof(header));
+    std::memcpy(file.data() + sizeof(header), segments, sizeof(segments));
+    file.resize(0x1000 + text.size() * 4);
+    std::memcpy(file.data() + 0x1000, text.data(), text.size() * 4);
+    file.insert(file.end(), (const uint8_t*)data, (const uint8_t*)(data + 2));
+    const auto* fp = "elf_program.elf";
+    std::ofstream(fp, std::ios::binary)
+        .write((const char*)file.data(), (std::streamsize)file.size());
+
+    REQUIRE(riscvemu::isElf(fp));
+    auto cpu = riscvemu::CPU(riscvemu::VMContext::fromElf(fp));
+    CHECK(cpu.getPC() == textAddr);
+    cpu.run();
+
+    CHECK(cpu.getRegister(riscvemu::Register::A0) == 42);
+    CHECK(cpu.getRegister(riscvemu::Register::A2) == 0);
+    CHECK(cpu.getPC() == textAddr + text.size() * 4);
+
+    CHECK_FALSE(riscvemu::isElf("loop.bin"));
+    CHECK_THROWS_AS(riscvemu::VMContext::fromElf("loop.bin"),
+                    riscvemu::ElfError);
+
+    // A truncated file is rejected before the text page past its end is
+    // mapped, the guest would fault on the host when reaching it.
+    header.phnum       = 1;
+    segments[0].filesz = 0x1000;
+    segments[0].memsz  = 0x1000;
+    std::memcpy(file.data(), &header, sizeof(header));
+    std::memcpy(file.data() + sizeof(header), segments, sizeof(segments));
+    file.resize(0x1000 + 8);
+    const auto* truncated = "elf_truncated.elf";
+    std::ofstream(truncated, std::ios::binary)
+        .write((const char*)file.data(), (std::streamsize)file.size());
+    CHECK_THROWS_AS(riscvemu::VMContext::fromElf(truncated),
+                    riscvemu::ElfError);
+}
+
+TEST_CASE("testing instruction predecoding") {
+    // addi x1, x2, 48
+    auto decoded = riscvemu::predecode(0x03010093);
+    CHECK(decoded.mnemonic == riscvemu::Mnemonic::ADDI);
+    CHECK(decoded.rd == 1);
+    CHECK(decoded.rs1 == 2);
+    CHECK(decoded.imm == 0x30);
+
+    // sub x3, x4, x5
+    decoded = riscvemu::predecode(0x405201b3);
+    CHECK(decoded.mnemonic == riscvemu::Mnemonic::SUB);
+    CHECK(decoded.rd == 3);
+    CHECK(decoded.rs1 == 4);
+    CHECK(decoded.rs2 == 5);
+
+    // srai x1, x1, 3
+    decoded = riscvemu::predecode(0x4030d093);
+    CHECK(decoded.mnemonic == riscvemu::Mnemonic::SRAI);
+    CHECK((decoded.imm & 0x3f) == 3);
+
+    // Unallocated opcode.
+    decoded = riscvemu::predecode(0x00000000);
+    CHECK(decoded.mnemonic == riscvemu::Mnemonic::ILLEGAL);
+}
+
+TEST_CASE("testing compressed instruction decoding") {
+    // c.addi a0, 3 expands to addi a0, a0, 3.
+    CHECK(riscvemu::expandCompressed(0x050d) == 0x00350513);
+    auto decoded = riscvemu::predecode(0x050d);
+    CHECK(decoded.mnemonic == riscvemu::Mnemonic::ADDI);
+    CHECK(decoded.rd == 10);
+    CHECK(decoded.rs1 == 10);
+    CHECK(decoded.imm == 3);
+    CHECK(decoded.raw == 0x050d);
+    CHECK(decoded.size == 2);
+    // Only the low half of a compressed instruction is decoded.
+    CHECK(riscvemu::predecode(0x1234050d).imm == 3);
+
+    // c.addi16sp sp, -64
+    decoded = riscvemu::predecode(0x7139);
+    CHECK(decoded.mnemonic == riscvemu::Mnemonic::ADDI);
+    CHECK(decoded.rd == 2);
+    CHECK(decoded.imm == -64);
+    // c.ld s0, 0(a5)
+    decoded = riscvemu::predecode(0x6380);
+    CHECK(decoded.mnemonic == riscvemu::Mnemonic::LD);
+    CHECK(decoded.rd == 8);
+    CHECK(decoded.rs1 == 15);
+    // c.sdsp s0, 0(sp)
+    decoded = riscvemu::predecode(0xe022);
+    CHECK(decoded.mnemonic == riscvemu::Mnemonic::SD);
+    CHECK(decoded.rs1 == 2);
+    CHECK(decoded.rs2 == 8);
+    // c.bnez a1, -4
+    decoded = riscvemu::predecode(0xfdf5);
+    CHECK(decoded.mnemonic == riscvemu::Mnemonic::BNE);
+    CHECK(decoded.rs1 == 11);
+    CHECK(decoded.rs2 == 0);
+    CHECK(decoded.imm == -4);
+    // c.jr ra and c.ebreak
+    CHECK(riscvemu::expandCompressed(0x8082) == 0x00008067);
+    CHECK(riscvemu::predecode(0x9002).mnemonic ==
+          riscvemu::Mnemonic::EBREAK);
+
+    // The all zero instruction and reserved encodings are illegal.
+    CHECK(riscvemu::predecode(0x0000).mnemonic ==
+          riscvemu::Mnemonic::ILLEGAL);
+    CHECK(riscvemu::predecode(0x0000).size == 2);
+    // c.lwsp zero, 0(sp)
+    CHECK(riscvemu::predecode(0x4002).mnemonic ==
+          riscvemu::Mnemonic::ILLEGAL);
+    // c.addi16sp sp, 0
+    CHECK(riscvemu::predecode(0x6101).mnemonic ==
+          riscvemu::Mnemonic::ILLEGAL);
+    CHECK(riscvemu::predecode(0x03010093).size == 4);
+}
+
 TEST_CASE("testing addi instruction") {
     const auto* fp = "addi.bin";
     auto cpu       = setupTestContext(fp);
@@ -220,8 +483,1247 @@ TEST_CASE("testing csrs instructions") {
 
     CHECK(cpu.getCSR(riscvemu::MStatus) == 1);
     CHECK(cpu.getCSR(riscvemu::MTVec) == 2);
-    CHECK(cpu.getCSR(riscvemu::MEPc) == 3);
+    // Bit 0 of mepc is always clear.
+    CHECK(cpu.getCSR(riscvemu::MEPc) == 2);
     CHECK(cpu.getCSR(riscvemu::SStatus) == 4);
     CHECK(cpu.getCSR(riscvemu::STVec) == 5);
     CHECK(cpu.getCSR(riscvemu::Sepc) == 6);
 }
+
+TEST_CASE("testing exception program counters are aligned") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu = setupTestContext("epc.bin");
+        cpu.run(engine);
+        CHECK(cpu.getRegister(riscvemu::Register::A0) ==
+              riscvemu::MemoryBaseAddr + 48);
+        CHECK(cpu.getRegister(riscvemu::Register::A1) ==
+              riscvemu::MemoryBaseAddr + 48);
+        CHECK(cpu.getRegister(riscvemu::Register::A2) == 0);
+        CHECK(cpu.getRegister(riscvemu::Register::A3) == 1);
+    }
+}
+
+TEST_CASE("testing csr table") {
+    using riscvemu::CSR;
+    using riscvemu::CSRKind;
+    CHECK(CSR::entry(riscvemu::MStatus).kind == CSRKind::Register);
+    CHECK(CSR::entry(riscvemu::SStatus).kind == CSRKind::SStatus);
+    CHECK(CSR::entry(riscvemu::InstRet).kind == CSRKind::Counter);
+    CHECK(CSR::entry(riscvemu::HpmCounter3).slot ==
+          CSR::entry(riscvemu::MHpmCounter3).slot);
+    CHECK(CSR::entry(0x7c0).kind == CSRKind::Unimplemented);
+    CHECK(CSR::entry(riscvemu::Satp).paging);
+    CHECK(sizeof(CSR) == riscvemu::CSRSlots * sizeof(uint64_t));
+
+    auto cpu = setupTestContext("csrtable.bin");
+    cpu.run();
+    CHECK(cpu.getRegister(riscvemu::Register::A0) == 2);
+    CHECK(cpu.getRegister(riscvemu::Register::A1) == 4);
+    CHECK(cpu.getRegister(riscvemu::Register::A2) == 0);
+    CHECK(cpu.getRegister(riscvemu::Register::A3) == 2);
+    CHECK(cpu.getRegister(riscvemu::Register::A4) == 2);
+    CHECK(cpu.getRegister(riscvemu::Register::A5) == 5);
+    CHECK(cpu.getRegister(riscvemu::Register::A6) == 1);
+    CHECK(cpu.getCSR(0x7c0) == 0);
+}
+
+TEST_CASE("testing checkpoints") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu     = setupTestContext("checkpoint.bin");
+        auto history = std::stringstream();
+        // The first checkpoint saves the code page, the second only the
+        // pages the run stored to.
+        CHECK(riscvemu::Checkpoint::write(cpu, history) == 1);
+        cpu.run(engine);
+        CHECK(riscvemu::Checkpoint::write(cpu, history) == 2);
+        CHECK(riscvemu::Checkpoint::write(cpu, history) == 0);
+        cpu.store<uint64_t>(0x80030000, 5);
+        CHECK(riscvemu::Checkpoint::write(cpu, history) == 1);
+
+        // Rewind to the start and run again.
+        auto start = riscvemu::Checkpoint::read(history, 1);
+        CHECK(start.getPC() == 0x80000000);
+        CHECK(start.load<uint64_t>(0x80010000) == 0);
+        CHECK(start.getCSR(riscvemu::MInstRet) == 0);
+        start.run(engine);
+        CHECK(start.getRegister(riscvemu::Register::A0) == 42);
+        CHECK(start.load<uint64_t>(0x80010000) == 1);
+        CHECK(start.load<uint32_t>(0x80012004) == 1);
+
+        history.clear();
+        history.seekg(0);
+        auto end = riscvemu::Checkpoint::read(history);
+        CHECK(end.getPC() == cpu.getPC());
+        for (uint64_t i = 0; i < 32; i++) {
+            auto reg = riscvemu::getRegisterFromIndex(i);
+            CHECK(end.getRegister(reg) == cpu.getRegister(reg));
+        }
+        CHECK(end.getCSR(riscvemu::MInstRet) ==
+              cpu.getCSR(riscvemu::MInstRet));
+        CHECK(start.getCSR(riscvemu::MInstRet) ==
+              cpu.getCSR(riscvemu::MInstRet));
+        CHECK(end.load<uint64_t>(0x80010000) == 1);
+        CHECK(end.load<uint64_t>(0x80030000) == 5);
+        // The restored context continues the history.
+        auto next = std::stringstream();
+        CHECK(riscvemu::Checkpoint::write(end, next) == 0);
+    }
+
+    auto garbage = std::stringstream("not a checkpoint");
+    CHECK_THROWS_AS(riscvemu::Checkpoint::read(garbage),
+                    riscvemu::CheckpointError);
+}
+
+TEST_CASE("testing checkpoints of devices") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto ctx  = riscvemu::VMContext::fromImage("checkpoint_devices.bin");
+        auto uart = ctx.uart;
+        auto cpu  = riscvemu::CPU(std::move(ctx));
+        // Stop on the wfi with the timer armed.
+        CHECK(cpu.step(engine, 15).status == riscvemu::RunStatus::Budget);
+        uart->receive('x');
+        auto history = std::stringstream();
+        riscvemu::Checkpoint::write(cpu, history);
+
+        auto restored = riscvemu::Checkpoint::read(history);
+        restored.run(engine);
+        // The restored timer is still armed, wfi skipped to its deadline.
+        CHECK((int64_t)restored.getRegister(riscvemu::Register::A0) >= 0);
+        CHECK(restored.getRegister(riscvemu::Register::A0) <
+              riscvemu::TimeFrequency);
+        CHECK(restored.getRegister(riscvemu::Register::A1) ==
+              (riscvemu::MaskMTIP | riscvemu::MaskMSIP));
+        CHECK(restored.getRegister(riscvemu::Register::A2) == 0x5a);
+        CHECK(restored.getRegister(riscvemu::Register::A3) == 'x');
+        CHECK(restored.getRegister(riscvemu::Register::A4) == 3);
+        CHECK(restored.getRegister(riscvemu::Register::A5) == 1);
+    }
+}
+
+TEST_CASE("testing compressed instructions") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu = setupTestContext("rvc.bin");
+        cpu.run(engine);
+        CHECK(cpu.getRegister(riscvemu::Register::A0) == 300);
+        CHECK(cpu.getRegister(riscvemu::Register::A2) == (uint64_t)-4);
+        CHECK(cpu.getRegister(riscvemu::Register::S2) == 196);
+        CHECK(cpu.getRegister(riscvemu::Register::S3) == 244);
+        CHECK(cpu.getRegister(riscvemu::Register::S0) == 12289);
+        CHECK(cpu.getRegister(riscvemu::Register::S1) == 244);
+        // c.jalr links to the instruction 2 bytes past it.
+        CHECK(cpu.getRegister(riscvemu::Register::S6) ==
+              riscvemu::MemoryBaseAddr + 0x5a);
+        CHECK(cpu.getRegister(riscvemu::Register::S7) ==
+              riscvemu::MemoryBaseAddr + 0x5a);
+        // The instruction crossing into the second page ran 100 times,
+        // then once more after its upper half was patched.
+        CHECK(cpu.getRegister(riscvemu::Register::A3) == 101);
+        CHECK(cpu.getRegister(riscvemu::Register::A5) == 800);
+
+        // A trap raised by a crossing instruction is taken at its first
+        // half, jal zero, 0xffe jumps to an illegal instruction.
+        std::vector<uint8_t> image(0x1002);
+        image[0] = 0x6f;
+        image[1] = 0x00;
+        image[2] = 0xf0;
+        image[3] = 0x7f;
+        std::fill(image.begin() + 0xffe, image.end(), 0xff);
+        auto crossing = riscvemu::CPU(riscvemu::VMContext(image));
+        crossing.run(engine);
+        CHECK(crossing.getCSR(riscvemu::MCause) ==
+              (uint64_t)riscvemu::TrapCause::IllegalInstruction);
+        CHECK(crossing.getCSR(riscvemu::MEPc) ==
+              riscvemu::MemoryBaseAddr + 0xffe);
+        CHECK(crossing.getCSR(riscvemu::MTVal) == 0xffffffff);
+    }
+
+    // Compressed instructions take 2 bytes in delta encoded traces.
+    std::vector<std::vector<riscvemu::TraceRecord>> traces;
+    for (auto format :
+         {riscvemu::TraceFormat::Raw, riscvemu::TraceFormat::Delta}) {
+        auto cpu = setupTestContext("rvc.bin");
+        {
+            auto tracer = riscvemu::Tracer("trace.out", format);
+            cpu.setTracer(&tracer);
+            cpu.run();
+        }
+        auto file   = std::ifstream("trace.out", std::ios::binary);
+        auto reader = riscvemu::TraceReader(file);
+        std::vector<riscvemu::TraceRecord> records;
+        for (riscvemu::TraceRecord record; reader.next(record);) {
+            records.push_back(record);
+        }
+        REQUIRE(records.size() == cpu.getCSR(riscvemu::MInstRet));
+        // c.li a0, 0
+        CHECK(records[1].pc == riscvemu::MemoryBaseAddr + 4);
+        CHECK(records[1].inst == 0x4501);
+        CHECK(records[2].pc == riscvemu::MemoryBaseAddr + 6);
+        traces.push_back(std::move(records));
+    }
+    CHECK(traces[0] == traces[1]);
+    std::remove("trace.out");
+}
+
+TEST_CASE("testing traps") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        // Load, store, illegal instruction, ecall, ebreak and misaligned
+        // AMO traps handled and returned from.
+        auto cpu = setupTestContext("trap.bin");
+        cpu.run(engine);
+        CHECK(cpu.getRegister(riscvemu::Register::A0) == 6);
+        CHECK(cpu.getRegister(riscvemu::Register::A1) ==
+              5 + 7 + 2 + 11 + 3 + 6);
+        CHECK(cpu.getRegister(riscvemu::Register::A2) == 1);
+        CHECK(cpu.getCSR(riscvemu::MCause) ==
+              (uint64_t)riscvemu::TrapCause::StoreAddressMisaligned);
+        // The handler moved mepc past the AMO.
+        CHECK(cpu.getCSR(riscvemu::MEPc) == riscvemu::MemoryBaseAddr + 48);
+        CHECK(cpu.getCSR(riscvemu::MTVal) ==
+              cpu.getRegister(riscvemu::Register::T2));
+
+        // Fault raised by a compiled block.
+        auto hot = setupTestContext("trap_loop.bin");
+        hot.run(engine);
+        CHECK(hot.getRegister(riscvemu::Register::A0) == 202);
+        CHECK(hot.getRegister(riscvemu::Register::A1) ==
+              (uint64_t)riscvemu::TrapCause::LoadAccessFault);
+        CHECK(hot.getRegister(riscvemu::Register::A2) ==
+              riscvemu::MemoryBaseAddr - 8);
+        CHECK(hot.getRegister(riscvemu::Register::A3) ==
+              riscvemu::MemoryBaseAddr + 24);
+
+        // Without a trap handler the hart stops at the fault.
+        auto stopped = setupTestContext("fault.bin");
+        stopped.run(engine);
+        CHECK(stopped.getRegister(riscvemu::Register::A0) == 1);
+        CHECK(stopped.getPC() == 0);
+        CHECK(stopped.getCSR(riscvemu::MEPc) == riscvemu::MemoryBaseAddr + 4);
+        CHECK(stopped.getCSR(riscvemu::MTVal) == 0);
+    }
+}
+
+TEST_CASE("testing trapped sret and virtual memory management") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        // sret, sfence.vma and the two satp accesses trap in supervisor
+        // mode while mstatus.TSR and TVM are set, then run once cleared.
+        auto cpu = setupTestContext("trap_virtual.bin");
+        cpu.run(engine);
+        CHECK(cpu.getRegister(riscvemu::Register::A0) == 4);
+        CHECK(cpu.getRegister(riscvemu::Register::A1) == 0);
+        CHECK(cpu.getRegister(riscvemu::Register::A2) == 1);
+    }
+}
+
+TEST_CASE("testing steps") {
+    using riscvemu::MemoryBaseAddr;
+    using riscvemu::RunStatus;
+    const uint32_t events = riscvemu::EventBreakpoint |
+                            riscvemu::EventECall | riscvemu::EventMmio;
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu = setupTestContext("step.bin");
+        CHECK(cpu.step(engine, 0, events).status == RunStatus::Budget);
+
+        // Every slice retires exactly its budget, blocks included.
+        size_t slices = 0;
+        auto result   = cpu.step(engine, 100, events);
+        while (result.status == RunStatus::Budget) {
+            CHECK(result.retired == 100);
+            slices++;
+            result = cpu.step(engine, 100, events);
+        }
+        CHECK(slices == 30);
+        CHECK(result.status == RunStatus::Breakpoint);
+        CHECK(result.retired == 3);
+        CHECK(result.addr == MemoryBaseAddr + 20);
+        CHECK(cpu.getPC() == MemoryBaseAddr + 24);
+        CHECK(cpu.getRegister(riscvemu::Register::A0) == 3000);
+
+        // The host serves the call and resumes past it.
+        result = cpu.step(engine, riscvemu::Unbounded, events);
+        CHECK(result.status == RunStatus::ECall);
+        CHECK(result.retired == 2);
+        CHECK(result.addr == MemoryBaseAddr + 28);
+        CHECK(cpu.getRegister(riscvemu::Register::A7) == 64);
+        cpu.setRegister(riscvemu::Register::A0, 7);
+
+        // Accesses outside of memory stop before they execute and are
+        // performed by the next step.
+        result = cpu.step(engine, riscvemu::Unbounded, events);
+        CHECK(result.status == RunStatus::Mmio);
+        CHECK(result.retired == 2);
+        CHECK(result.addr == MemoryBaseAddr + 40);
+        CHECK(result.cause == riscvemu::TrapCause::LoadAccessFault);
+        CHECK(result.value == riscvemu::UartBaseAddr + 5);
+        CHECK(cpu.getPC() == MemoryBaseAddr + 40);
+        CHECK(cpu.getRegister(riscvemu::Register::A1) == 7);
+        CHECK(cpu.getRegister(riscvemu::Register::A2) == 0);
+
+        result = cpu.step(engine, riscvemu::Unbounded, events);
+        CHECK(result.status == RunStatus::Mmio);
+        CHECK(result.retired == 1);
+        CHECK(result.cause == riscvemu::TrapCause::StoreAccessFault);
+        CHECK(result.value == 0);
+        CHECK(cpu.getRegister(riscvemu::Register::A2) == 0x60);
+
+        // No device handles the store, the hart stops on the fault.
+        result = cpu.step(engine, riscvemu::Unbounded, events);
+        CHECK(result.status == RunStatus::Trapped);
+        CHECK(result.retired == 0);
+        CHECK(result.addr == MemoryBaseAddr + 44);
+        CHECK(result.cause == riscvemu::TrapCause::StoreAccessFault);
+        CHECK(cpu.getRegister(riscvemu::Register::A3) == 0);
+        CHECK(cpu.step(engine, riscvemu::Unbounded, events).status ==
+              RunStatus::Exited);
+
+        // Without events the breakpoint is a trap.
+        auto plain = setupTestContext("step.bin");
+        result     = plain.step(engine, riscvemu::Unbounded);
+        CHECK(result.status == RunStatus::Trapped);
+        CHECK(result.retired == 3002);
+        CHECK(result.cause == riscvemu::TrapCause::Breakpoint);
+        CHECK(result.value == MemoryBaseAddr + 20);
+    }
+}
+
+TEST_CASE("testing sv39 translation") {
+    using riscvemu::MemoryBaseAddr;
+    constexpr uint64_t root    = MemoryBaseAddr + 0x10000;
+    constexpr uint64_t level1  = MemoryBaseAddr + 0x11000;
+    constexpr uint64_t level0  = MemoryBaseAddr + 0x12000;
+    constexpr uint64_t pointer = riscvemu::PteValid;
+    constexpr uint64_t leaf    = riscvemu::PteValid | riscvemu::PteRead |
+                                 riscvemu::PteWrite;
+    constexpr uint64_t accessed = riscvemu::PteAccessed | riscvemu::PteDirty;
+    auto pte = [](uint64_t paddr, uint64_t flags) -> uint64_t {
+        return ((paddr >> 12) << 10) | flags;
+    };
+
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu = setupTestContext("vm.bin");
+        // 0x40000000 is a gigapage mapping the code, 0x1000 a 4 KiB page.
+        cpu.store<uint64_t>(root + 8, pte(MemoryBaseAddr,
+                                           leaf | riscvemu::PteExecute));
+        cpu.store<uint64_t>(root, pte(level1, pointer));
+        cpu.store<uint64_t>(level1, pte(level0, pointer));
+        cpu.store<uint64_t>(level0 + 8, pte(MemoryBaseAddr + 0x3000, leaf));
+        cpu.store<uint64_t>(MemoryBaseAddr + 0x3000, 41);
+        cpu.store<uint64_t>(MemoryBaseAddr + 0x4000, 100);
+
+        cpu.setRegister(riscvemu::Register::A0,
+                        (riscvemu::SatpModeSv39 << 60) | (root >> 12));
+        cpu.setRegister(riscvemu::Register::A1, 0x40000024);
+        cpu.setRegister(riscvemu::Register::A2, 0x1000);
+        cpu.setRegister(riscvemu::Register::A4, 0x200000);
+        cpu.setRegister(riscvemu::Register::A6, 0x40012008);
+        cpu.setRegister(riscvemu::Register::A7,
+                        pte(MemoryBaseAddr + 0x4000, leaf | accessed));
+        cpu.run(engine);
+
+        CHECK(cpu.getRegister(riscvemu::Register::A3) == 42);
+        CHECK(cpu.load<uint64_t>(MemoryBaseAddr + 0x3008) == 42);
+        // The remapped page is only seen after SFENCE.VMA.
+        CHECK(cpu.getRegister(riscvemu::Register::T3) == 41);
+        CHECK(cpu.getRegister(riscvemu::Register::T4) == 100);
+        // Load page fault on the unmapped address, taken to M-mode.
+        CHECK(cpu.getRegister(riscvemu::Register::S2) ==
+              (uint64_t)riscvemu::TrapCause::LoadPageFault);
+        CHECK(cpu.getRegister(riscvemu::Register::S3) == 0x40000040);
+        CHECK(cpu.getRegister(riscvemu::Register::S4) == 0x200000);
+        CHECK(cpu.getPrivilege() == riscvemu::Privilege::Machine);
+        // Accessed and dirty bits are set by the page walk, the gigapage
+        // was written through when remapping.
+        CHECK((cpu.load<uint64_t>(root + 8) & accessed) == accessed);
+        CHECK((cpu.load<uint64_t>(level0 + 8) & accessed) == accessed);
+        CHECK((cpu.load<uint64_t>(root) & accessed) == 0);
+    }
+}
+
+TEST_CASE("testing profiler") {
+    using riscvemu::MemoryBaseAddr;
+    auto cpu      = setupTestContext("profile.bin");
+    auto profiler = riscvemu::Profiler(cpu.getPC());
+    cpu.setProfiler(&profiler);
+    // Profiled runs always use the interpreter.
+    cpu.run(riscvemu::Engine::Jit);
+
+    CHECK(cpu.getRegister(riscvemu::Register::A0) == 30);
+    CHECK(profiler.instructions() == 2 + 10 * 5 + 1);
+    CHECK(profiler.count(riscvemu::Mnemonic::ADDI) == 22);
+    CHECK(profiler.count(riscvemu::Mnemonic::JALR) == 10);
+    CHECK(profiler.at(MemoryBaseAddr + 8).executed == 10);
+    auto branch = profiler.at(MemoryBaseAddr + 16);
+    CHECK(branch.mnemonic == riscvemu::Mnemonic::BNE);
+    CHECK(branch.executed == 10);
+    CHECK(branch.taken == 9);
+    CHECK(profiler.at(MemoryBaseAddr + 32).executed == 0);
+
+    std::ostringstream stacks;
+    profiler.writeCollapsedStacks(stacks);
+    CHECK(stacks.str() == "0x80000000 33\n0x80000000;0x80000018 20\n");
+    std::ostringstream report;
+    profiler.writeReport(report, 3);
+    CHECK(report.str().starts_with("instructions: 53\n"
+                                   "branches: 10, 9 taken (90.00%), 1 not "
+                                   "taken\n"));
+    CHECK(report.str().find("bne") != std::string::npos);
+}
+
+TEST_CASE("testing profiler on compressed branches") {
+    using riscvemu::MemoryBaseAddr;
+    auto cpu      = setupTestContext("profile_rvc.bin");
+    auto profiler = riscvemu::Profiler(cpu.getPC());
+    cpu.setProfiler(&profiler);
+    cpu.run(riscvemu::Engine::Interpreter);
+
+    CHECK(profiler.instructions() == 1 + 10 * 2 + 1);
+    // Falling through a 2-byte branch isn't taken.
+    auto bnez = profiler.at(MemoryBaseAddr + 4);
+    CHECK(bnez.mnemonic == riscvemu::Mnemonic::BNE);
+    CHECK(bnez.executed == 10);
+    CHECK(bnez.taken == 9);
+    auto beqz = profiler.at(MemoryBaseAddr + 6);
+    CHECK(beqz.mnemonic == riscvemu::Mnemonic::BEQ);
+    CHECK(beqz.executed == 1);
+    CHECK(beqz.taken == 1);
+    CHECK(cpu.getRegister(riscvemu::Register::A1) == 0);
+}
+
+TEST_CASE("testing sampled profiling") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu      = setupTestContext("profile.bin");
+        auto profiler = riscvemu::Profiler(cpu.getPC());
+        cpu.setProfiler(&profiler);
+        cpu.setSampling({.interval = 10, .window = 5});
+        cpu.run(engine);
+
+        CHECK(cpu.getRegister(riscvemu::Register::A0) == 30);
+        CHECK(cpu.getCSR(riscvemu::MInstRet) == 53);
+        CHECK(profiler.instructions() + profiler.unprofiled() == 53);
+        CHECK(profiler.instructions() > 0);
+        if (engine == riscvemu::Engine::Interpreter) {
+            // Windows over instructions [5, 10), [15, 20) ... [45, 50).
+            CHECK(profiler.instructions() == 25);
+        }
+        std::ostringstream report;
+        profiler.writeReport(report);
+        CHECK(report.str().find("fast-forwarded: ") != std::string::npos);
+    }
+}
+
+TEST_CASE("testing traces") {
+    const riscvemu::TraceFormat formats[] = {riscvemu::TraceFormat::Raw,
+                                             riscvemu::TraceFormat::Delta};
+    std::vector<std::vector<riscvemu::TraceRecord>> traces;
+    for (auto format : formats) {
+        CAPTURE(static_cast<int>(format));
+        auto cpu = setupTestContext("trap.bin");
+        {
+            // A small ring makes the hart wait for the writer.
+            auto tracer = riscvemu::Tracer("trace.out", format, 4);
+            cpu.setTracer(&tracer);
+            cpu.run(riscvemu::Engine::Jit);
+            tracer.close();
+            // Every retired instruction and the 6 traps.
+            CHECK(tracer.records() == cpu.getCSR(riscvemu::MInstRet) + 6);
+        }
+        CHECK(cpu.getRegister(riscvemu::Register::A0) == 6);
+
+        auto file   = std::ifstream("trace.out", std::ios::binary);
+        auto reader = riscvemu::TraceReader(file);
+        CHECK(reader.format() == format);
+        std::vector<riscvemu::TraceRecord> records;
+        for (riscvemu::TraceRecord record; reader.next(record);) {
+            records.push_back(record);
+        }
+        REQUIRE(records.size() == cpu.getCSR(riscvemu::MInstRet) + 6);
+        // auipc t0, 0
+        CHECK(records[0].pc == riscvemu::MemoryBaseAddr);
+        CHECK(records[0].rd == 5);
+        CHECK(records[0].value == riscvemu::MemoryBaseAddr);
+        // ld t1, 0(zero) faults.
+        CHECK(records[5].pc == riscvemu::MemoryBaseAddr + 20);
+        CHECK(records[5].flags == riscvemu::TraceTrap);
+        CHECK(records[5].value ==
+              (uint64_t)riscvemu::TrapCause::LoadAccessFault);
+        CHECK(records[5].addr == 0);
+        // The handler runs next, addi a0, a0, 1.
+        CHECK(records[6].pc == riscvemu::MemoryBaseAddr + 52);
+        CHECK(records[6].rd == 10);
+        CHECK(records[6].value == 1);
+        // amoadd.w t3, t1, (t2) faults on its misaligned address.
+        auto amo = std::find_if(records.begin(), records.end(),
+                                [](const auto& r) {
+                                    return r.pc ==
+                                           riscvemu::MemoryBaseAddr + 44;
+                                });
+        REQUIRE(amo != records.end());
+        CHECK(amo->addr == cpu.getRegister(riscvemu::Register::T2));
+        traces.push_back(std::move(records));
+    }
+    CHECK(traces[0] == traces[1]);
+
+    // Memory accesses are recorded with their address.
+    auto cpu = setupTestContext("load_store.bin");
+    {
+        auto tracer = riscvemu::Tracer("trace.out");
+        cpu.setTracer(&tracer);
+        cpu.run();
+    }
+    auto file   = std::ifstream("trace.out", std::ios::binary);
+    auto reader = riscvemu::TraceReader(file);
+    size_t accesses = 0;
+    for (riscvemu::TraceRecord record; reader.next(record);) {
+        if ((record.flags & riscvemu::TraceMemory) != 0) {
+            CHECK(record.addr >= riscvemu::MemoryBaseAddr);
+            accesses++;
+        }
+    }
+    CHECK(accesses > 0);
+
+    auto truncated = std::istringstream("RVEM");
+    CHECK_THROWS_AS(riscvemu::TraceReader{truncated}, riscvemu::TraceError);
+    std::remove("trace.out");
+}
+
+TEST_CASE("testing devices") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto ctx = riscvemu::VMContext::fromImage("devices.bin");
+        std::ostringstream console;
+        ctx.uart->setOutput(console);
+        auto cpu = riscvemu::CPU(std::move(ctx));
+        cpu.run(engine);
+
+        CHECK(console.str() == "ok\n");
+        // Transmitter empty, nothing received.
+        CHECK(cpu.getRegister(riscvemu::Register::A0) == 0x60);
+        CHECK(cpu.getRegister(riscvemu::Register::A1) == 42);
+        // mtimecmp 0 raises the timer interrupt, msip the software one.
+        CHECK(cpu.getRegister(riscvemu::Register::A3) == riscvemu::MaskMTIP);
+        CHECK(cpu.getRegister(riscvemu::Register::A4) ==
+              (riscvemu::MaskMTIP | riscvemu::MaskMSIP));
+        CHECK(cpu.getRegister(riscvemu::Register::A5) == 0);
+        // High word of mtimecmp, sign extended.
+        CHECK(cpu.getRegister(riscvemu::Register::A6) == ~(uint64_t)0);
+        // The time CSR reads mtime.
+        auto time = cpu.getRegister(riscvemu::Register::A7);
+        CHECK(time >= (uint64_t)1 << 40);
+        CHECK(time < ((uint64_t)1 << 40) + riscvemu::TimeFrequency);
+        CHECK(cpu.getCSR(riscvemu::Time) >= time);
+        CHECK(cpu.getRegister(riscvemu::Register::S3) == 1);
+        CHECK(cpu.getCSR(riscvemu::MInstRet) == 31 + 3 * 100);
+        // Halfword UART accesses fault.
+        CHECK(cpu.getCSR(riscvemu::MCause) ==
+              (uint64_t)riscvemu::TrapCause::LoadAccessFault);
+        CHECK(cpu.getCSR(riscvemu::MTVal) == riscvemu::UartBaseAddr + 5);
+        CHECK(cpu.getCSR(riscvemu::MEPc) == riscvemu::MemoryBaseAddr + 136);
+    }
+}
+
+TEST_CASE("testing interrupts") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu     = setupTestContext("timer.bin");
+        auto started = std::chrono::steady_clock::now();
+        cpu.run(engine);
+        // The idle hart didn't wait for the deadline 10 s ahead.
+        CHECK(std::chrono::steady_clock::now() - started <
+              std::chrono::seconds(5));
+
+        CHECK(cpu.getRegister(riscvemu::Register::A0) == 3);
+        CHECK(cpu.getRegister(riscvemu::Register::A5) == 1);
+        // The timer interrupt returned past the wfi, once mtime reached
+        // the deadline.
+        CHECK(cpu.getRegister(riscvemu::Register::A6) ==
+              riscvemu::MemoryBaseAddr + 56);
+        CHECK((int64_t)cpu.getRegister(riscvemu::Register::A3) >= 0);
+        CHECK(cpu.getRegister(riscvemu::Register::A3) <
+              riscvemu::TimeFrequency);
+        CHECK(cpu.getRegister(riscvemu::Register::S5) > 0);
+        // The software interrupt interrupted the wait loop.
+        CHECK(cpu.getRegister(riscvemu::Register::A1) ==
+              (riscvemu::CauseInterrupt | 3));
+        CHECK(cpu.getRegister(riscvemu::Register::A2) ==
+              riscvemu::MemoryBaseAddr + 104);
+        CHECK((cpu.getCSR(riscvemu::MStatus) & riscvemu::MaskMIE) != 0);
+    }
+}
+
+TEST_CASE("testing idle harts") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto ctx   = riscvemu::VMContext::fromImage("idle.bin");
+        auto clint = ctx.clint;
+        auto cpu   = riscvemu::CPU(std::move(ctx));
+        // The wait doesn't complete, the step returns on the wfi.
+        auto result = cpu.step(engine, 1000);
+        CHECK(result.status == riscvemu::RunStatus::Idle);
+        CHECK(result.retired == 1);
+        CHECK(result.addr == riscvemu::MemoryBaseAddr + 4);
+        CHECK(cpu.getPC() == riscvemu::MemoryBaseAddr + 4);
+        result = cpu.step(engine, 1000);
+        CHECK(result.status == riscvemu::RunStatus::Idle);
+        CHECK(result.retired == 0);
+        // Raising msip completes the wfi, the interrupt is masked in
+        // mstatus and isn't taken.
+        clint->write(riscvemu::Clint::MSip, 4, 1);
+        result = cpu.step(engine, 1000);
+        CHECK(result.status == riscvemu::RunStatus::Exited);
+        CHECK(result.retired == 2);
+        CHECK(cpu.getRegister(riscvemu::Register::A0) == 1);
+    }
+}
+
+TEST_CASE("testing system call emulation") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto ctx      = riscvemu::VMContext::fromImage("syscalls.bin");
+        auto syscalls = std::make_shared<riscvemu::SyscallProxy>(ctx);
+        ctx.syscalls  = syscalls;
+        auto cpu      = riscvemu::CPU(std::move(ctx));
+        cpu.run(engine);
+
+        // The heap starts on the page following the program.
+        auto heap = cpu.getRegister(riscvemu::Register::S0);
+        CHECK(heap == riscvemu::MemoryBaseAddr + riscvemu::PageSize);
+        CHECK(cpu.getRegister(riscvemu::Register::S1) == 8192);
+        CHECK(cpu.load<uint64_t>(heap) == 8192);
+        // The mapping is taken below the stack.
+        auto mapping = cpu.getRegister(riscvemu::Register::S2);
+        CHECK(mapping == riscvemu::MemoryEndAddr + 1 -
+                             riscvemu::UserStackSize - riscvemu::PageSize);
+        CHECK(cpu.getRegister(riscvemu::Register::S3) == 0);
+        CHECK(cpu.getRegister(riscvemu::Register::S4) < 1000000000);
+        // Descriptors start at 3 and are reused once closed.
+        CHECK(cpu.getRegister(riscvemu::Register::S5) == 3);
+        CHECK(cpu.getRegister(riscvemu::Register::S6) == 13);
+        CHECK(cpu.getRegister(riscvemu::Register::S7) == 3);
+        CHECK(cpu.getRegister(riscvemu::Register::S8) == 13);
+        uint64_t hello = 0;
+        std::memcpy(&hello, "hello, w", 8);
+        CHECK(cpu.getRegister(riscvemu::Register::S9) == hello);
+        CHECK((int64_t)cpu.getRegister(riscvemu::Register::S10) == -EBADF);
+        CHECK((int64_t)cpu.getRegister(riscvemu::Register::S11) == -ENOSYS);
+        // exit stopped the hart.
+        CHECK(cpu.getPC() == 0);
+        CHECK(cpu.getRegister(riscvemu::Register::T6) == 0);
+        CHECK(syscalls->exitStatus() == 7);
+        CHECK(cpu.getCSR(riscvemu::MInstRet) == 73);
+
+        std::ifstream file("syscalls.txt");
+        std::string contents((std::istreambuf_iterator<char>(file)), {});
+        CHECK(contents == "hello, world\n");
+    }
+
+    // A failed file mapping leaves the mappings as they were.
+    auto mmapCtx     = riscvemu::VMContext::fromImage("syscalls_mmap.bin");
+    mmapCtx.syscalls = std::make_shared<riscvemu::SyscallProxy>(mmapCtx);
+    auto mapper      = riscvemu::CPU(std::move(mmapCtx));
+    mapper.run();
+    CHECK((int64_t)mapper.getRegister(riscvemu::Register::S0) == -EBADF);
+    CHECK(mapper.getRegister(riscvemu::Register::S1) ==
+          riscvemu::MemoryEndAddr + 1 - riscvemu::UserStackSize -
+              riscvemu::PageSize);
+
+    // Without emulation ECALL traps.
+    auto cpu = setupTestContext("syscalls.bin");
+    cpu.run();
+    CHECK(cpu.getCSR(riscvemu::MCause) ==
+          (uint64_t)riscvemu::TrapCause::ECallFromM);
+
+    // The initial stack holds argc, argv, envp and the auxiliary vector.
+    auto ctx      = riscvemu::VMContext({0x13, 0x00, 0x00, 0x00});
+    auto syscalls = std::make_shared<riscvemu::SyscallProxy>(ctx);
+    ctx.syscalls  = syscalls;
+    auto process  = riscvemu::CPU(std::move(ctx));
+    syscalls->start(process, {"prog", "arg"}, {"HOME=/"});
+    auto sp = process.getRegister(riscvemu::Register::Sp);
+    CHECK(sp % 16 == 0);
+    auto string = [&](uint64_t addr) {
+        std::string value;
+        while (process.load<uint8_t>(addr) != 0) {
+            value += (char)process.load<uint8_t>(addr++);
+        }
+        return value;
+    };
+    CHECK(process.load<uint64_t>(sp) == 2);
+    CHECK(string(process.load<uint64_t>(sp + 8)) == "prog");
+    CHECK(string(process.load<uint64_t>(sp + 16)) == "arg");
+    CHECK(process.load<uint64_t>(sp + 24) == 0);
+    CHECK(string(process.load<uint64_t>(sp + 32)) == "HOME=/");
+    CHECK(process.load<uint64_t>(sp + 40) == 0);
+    // AT_PAGESZ leads the auxiliary vector of raw images.
+    CHECK(process.load<uint64_t>(sp + 48) == 6);
+    CHECK(process.load<uint64_t>(sp + 56) == riscvemu::PageSize);
+}
+
+TEST_CASE("testing performance counters") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu = setupTestContext("counters.bin");
+        cpu.run(engine);
+        // Counters read the instructions retired before the read.
+        CHECK(cpu.getRegister(riscvemu::Register::S0) == 0);
+        CHECK(cpu.getRegister(riscvemu::Register::S1) == 3);
+        CHECK(cpu.getRegister(riscvemu::Register::S2) == 4);
+        // Writes are seen by the next instruction.
+        CHECK(cpu.getRegister(riscvemu::Register::S3) == 0x100000);
+        CHECK(cpu.getCSR(riscvemu::Time) >=
+              cpu.getRegister(riscvemu::Register::S4));
+        CHECK(cpu.getRegister(riscvemu::Register::S5) == 0x100000);
+        CHECK(cpu.getRegister(riscvemu::Register::S6) == 0);
+        // 24 instructions in M-mode, then only cycle is readable in U-mode
+        // and counters are read-only.
+        CHECK(cpu.getRegister(riscvemu::Register::S7) == 24);
+        CHECK(cpu.getRegister(riscvemu::Register::A0) == 4);
+        CHECK(cpu.getRegister(riscvemu::Register::S8) == 0);
+        CHECK(cpu.getCSR(riscvemu::MCause) ==
+              (uint64_t)riscvemu::TrapCause::IllegalInstruction);
+        CHECK(cpu.getCSR(riscvemu::MInstRet) == 0x100000 + 45 - 7);
+        CHECK(cpu.getCSR(riscvemu::MCycle) == 45);
+    }
+
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu = setupTestContext("counters_inhibit.bin");
+        cpu.run(engine);
+        auto reg = [&](riscvemu::Register r) { return cpu.getRegister(r); };
+        CHECK(reg(riscvemu::Register::S0) ==
+              (riscvemu::MaskCY | riscvemu::MaskIR));
+        // Stopped once the first instruction retired.
+        CHECK(reg(riscvemu::Register::S1) == 1);
+        CHECK(reg(riscvemu::Register::S2) == 1);
+        CHECK(reg(riscvemu::Register::S3) == 9);
+        // Counting again from the instruction after the write.
+        CHECK(reg(riscvemu::Register::S4) == 9);
+        CHECK(reg(riscvemu::Register::S5) == 2);
+        CHECK(cpu.getCSR(riscvemu::MInstRet) == 3);
+    }
+
+    // Hot loops counted by compiled blocks.
+    auto hot = setupTestContext("loop.bin");
+    hot.run(riscvemu::Engine::Jit);
+    auto interpreted = setupTestContext("loop.bin");
+    interpreted.run();
+    CHECK(hot.getCSR(riscvemu::MInstRet) ==
+          interpreted.getCSR(riscvemu::MInstRet));
+    CHECK(hot.getCSR(riscvemu::MInstRet) > 100);
+}
+
+TEST_CASE("testing decode cache on hot loops") {
+    const auto* fp = "loop.bin";
+    auto cpu       = setupTestContext(fp);
+    cpu.run();
+
+    CHECK(cpu.getRegister(riscvemu::Register::A0) == 5050);
+    CHECK(cpu.getRegister(riscvemu::Register::T0) == 0);
+}
+
+TEST_CASE("testing decode cache invalidation on stores") {
+    const auto* fp = "smc.bin";
+    auto cpu       = setupTestContext(fp);
+    cpu.run();
+
+    CHECK(cpu.getRegister(riscvemu::Register::A0) == 101);
+}
+
+TEST_CASE("testing threaded and jit engines match the interpreter") {
+    const char* programs[] = {
+        "addi.bin",       "lui.bin",      "auipc.bin",      "jal.bin",
+        "jalr.bin",       "beq.bin",      "bne.bin",        "blt.bin",
+        "bge.bin",        "bltu.bin",     "bgeu.bin",       "slt.bin",
+        "xor.bin",        "or.bin",       "and.bin",        "sll.bin",
+        "sra.bin",        "addw.bin",     "sub.bin",        "csrs.bin",
+        "lb.bin",         "loop.bin",     "smc.bin",        "smc_next.bin",
+        "load_store.bin", "smc_hot.bin",  "jit_memory.bin", "amo.bin",
+        "trap.bin",       "trap_loop.bin", "fault.bin",    "profile.bin",
+        "rvc.bin",        "muldiv.bin",   "float.bin",      "vector.bin",
+        "fusion.bin",
+    };
+    const riscvemu::Engine engines[] = {riscvemu::Engine::Threaded,
+                                        riscvemu::Engine::Jit};
+    for (const auto* fp : programs) {
+        for (auto engine : engines) {
+            CAPTURE(fp);
+            CAPTURE(static_cast<int>(engine));
+            auto interpreted = setupTestContext(fp);
+            auto translated  = setupTestContext(fp);
+            interpreted.run(riscvemu::Engine::Interpreter);
+            translated.run(engine);
+
+            CHECK(translated.getPC() == interpreted.getPC());
+            for (uint64_t i = 0; i < 32; i++) {
+                auto reg = riscvemu::getRegisterFromIndex(i);
+                CHECK(translated.getRegister(reg) ==
+                      interpreted.getRegister(reg));
+            }
+            for (auto csr : {riscvemu::MCause, riscvemu::MEPc,
+                             riscvemu::MTVal, riscvemu::MStatus,
+                             riscvemu::MInstRet, riscvemu::MCycle}) {
+                CHECK(translated.getCSR(csr) == interpreted.getCSR(csr));
+            }
+        }
+    }
+}
+
+TEST_CASE("testing fused instruction pairs") {
+    using riscvemu::MemoryBaseAddr;
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu = setupTestContext("fusion.bin");
+        cpu.run(engine);
+
+        CHECK(cpu.getRegister(riscvemu::Register::A0) == 0x12345678);
+        CHECK(cpu.getRegister(riscvemu::Register::A1) == 0x7fffffff);
+        CHECK(cpu.getRegister(riscvemu::Register::A2) == 0xffffffff7fffffff);
+        CHECK(cpu.getRegister(riscvemu::Register::A3) == 0xffffffff);
+        CHECK(cpu.getRegister(riscvemu::Register::A4) == 0x0007370300000717);
+        CHECK(cpu.getRegister(riscvemu::Register::Ra) == MemoryBaseAddr + 64);
+        CHECK(cpu.getRegister(riscvemu::Register::A5) == 0);
+        // The load faulted after the AUIPC retired.
+        CHECK(cpu.getRegister(riscvemu::Register::A6) == MemoryBaseAddr + 68);
+        CHECK(cpu.getRegister(riscvemu::Register::S0) == MemoryBaseAddr + 72);
+        CHECK(cpu.getRegister(riscvemu::Register::S1) ==
+              MemoryBaseAddr + 68 - 2048);
+        CHECK(cpu.getRegister(riscvemu::Register::S2) ==
+              (uint64_t)riscvemu::TrapCause::LoadAccessFault);
+        CHECK(cpu.getRegister(riscvemu::Register::A7) == 1);
+        CHECK(cpu.getCSR(riscvemu::MInstRet) == 25);
+    }
+}
+
+TEST_CASE("testing threaded engine stores to the running block") {
+    const auto* fp = "smc_next.bin";
+    auto cpu       = setupTestContext(fp);
+    cpu.run(riscvemu::Engine::Threaded);
+
+    CHECK(cpu.getRegister(riscvemu::Register::A0) == 100);
+}
+
+TEST_CASE("testing jit engine on hot loops") {
+    auto cpu = setupTestContext("jit_memory.bin");
+    cpu.run(riscvemu::Engine::Jit);
+
+    CHECK(cpu.getRegister(riscvemu::Register::A0) == 8256);
+}
+
+TEST_CASE("testing jit engine invalidation of compiled blocks") {
+    auto cpu = setupTestContext("smc_hot.bin");
+    cpu.run(riscvemu::Engine::Jit);
+
+    CHECK(cpu.getRegister(riscvemu::Register::A0) == 10100);
+}
+
+TEST_CASE("testing harts share memory") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto machine =
+            riscvemu::Machine(riscvemu::VMContext::fromImage("harts.bin"), 4);
+        machine.run(engine);
+
+        // Table written by the harts, one page after the auipc at 24.
+        auto table = riscvemu::MemoryBaseAddr + 24 + 0x1000;
+        for (uint64_t id = 0; id < machine.harts(); id++) {
+            auto& hart = machine.hart(id);
+            CHECK(hart.getRegister(riscvemu::Register::A0) == id);
+            CHECK(hart.getRegister(riscvemu::Register::A1) == 1000 * id);
+            CHECK(machine.hart(0).load<uint64_t>(table + 8 * id) == 1000 * id);
+            CHECK(hart.getRegister(riscvemu::Register::Sp) ==
+                  machine.hart(0).getRegister(riscvemu::Register::Sp) -
+                      id * riscvemu::HartStackSize);
+        }
+    }
+}
+
+TEST_CASE("testing idle harts stop the machine") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        // Both harts wait for a software interrupt no one can raise.
+        auto machine =
+            riscvemu::Machine(riscvemu::VMContext::fromImage("idle.bin"), 2);
+        auto results = machine.run(engine);
+        for (uint64_t id = 0; id < machine.harts(); id++) {
+            CHECK(results[id].status == riscvemu::RunStatus::Idle);
+            CHECK(results[id].retired == 1);
+            CHECK(machine.hart(id).getRegister(riscvemu::Register::A0) == 0);
+        }
+
+        // A hart woken by another runs on, the other one then idles.
+        auto woken = riscvemu::Machine(
+            riscvemu::VMContext::fromImage("harts_idle.bin"), 2);
+        results = woken.run(engine);
+        CHECK(results[0].status == riscvemu::RunStatus::Idle);
+        CHECK(woken.hart(0).getRegister(riscvemu::Register::A0) == 0);
+        CHECK(results[1].status == riscvemu::RunStatus::Exited);
+        CHECK(woken.hart(1).getRegister(riscvemu::Register::A0) == 1);
+    }
+}
+
+TEST_CASE("testing atomic instructions") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu = setupTestContext("amo.bin");
+        cpu.run(engine);
+
+        auto reg = [&](riscvemu::Register r) { return cpu.getRegister(r); };
+        CHECK(reg(riscvemu::Register::A0) == 5);
+        CHECK(reg(riscvemu::Register::A1) == 8);
+        CHECK(reg(riscvemu::Register::A2) == 3);
+        CHECK(reg(riscvemu::Register::A3) == 3);
+        // Words are sign extended.
+        CHECK(reg(riscvemu::Register::A4) == ~0ULL);
+        CHECK(reg(riscvemu::Register::A5) == ~0ULL);
+        CHECK(reg(riscvemu::Register::A6) == 3);
+        CHECK(reg(riscvemu::Register::A7) == 7);
+        CHECK(reg(riscvemu::Register::S2) == 3);
+        CHECK(reg(riscvemu::Register::S3) == 0xffffffff00000006);
+        // The first SC consumes the reservation, the second one fails.
+        CHECK(reg(riscvemu::Register::S4) == 0);
+        CHECK(reg(riscvemu::Register::S5) == 1);
+        CHECK(reg(riscvemu::Register::S6) == 3);
+        CHECK(reg(riscvemu::Register::S7) == 3);
+        CHECK(reg(riscvemu::Register::S8) == 0);
+        CHECK(reg(riscvemu::Register::S9) == 5);
+    }
+}
+
+TEST_CASE("testing atomic instructions across harts") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto machine = riscvemu::Machine(
+            riscvemu::VMContext::fromImage("harts_atomic.bin"), 4);
+        machine.run(engine);
+
+        auto shared = riscvemu::MemoryBaseAddr + 0x1000;
+        CHECK(machine.hart(0).load<uint64_t>(shared) == 4000);
+        CHECK(machine.hart(0).load<uint64_t>(shared + 8) == 0);
+        CHECK(machine.hart(0).load<uint64_t>(shared + 16) == 4000);
+    }
+}
+
+TEST_CASE("testing multiplication and division instructions") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu = setupTestContext("muldiv.bin");
+        cpu.run(engine);
+
+        auto reg = [&](riscvemu::Register r) { return cpu.getRegister(r); };
+        CHECK(reg(riscvemu::Register::Ra) == 0xe40d6667f4b110cd);
+        CHECK(reg(riscvemu::Register::Tp) == 0xa5d16ae493560945);
+        CHECK(reg(riscvemu::Register::A0) == (uint64_t)-21);
+        CHECK(reg(riscvemu::Register::A1) == 0x4000000000000000);
+        CHECK(reg(riscvemu::Register::A2) == 0xfffffffffffffffe);
+        CHECK(reg(riscvemu::Register::A3) == ~0ULL);
+        // Quotients round towards zero.
+        CHECK(reg(riscvemu::Register::A4) == (uint64_t)-2);
+        CHECK(reg(riscvemu::Register::A5) == (uint64_t)-1);
+        CHECK(reg(riscvemu::Register::A6) == 0x5555555555555553);
+        CHECK(reg(riscvemu::Register::A7) == 0);
+        CHECK(reg(riscvemu::Register::S2) == ~0ULL);
+        CHECK(reg(riscvemu::Register::S3) == ~0ULL);
+        CHECK(reg(riscvemu::Register::S4) == (uint64_t)-7);
+        CHECK(reg(riscvemu::Register::S5) == (uint64_t)-7);
+        CHECK(reg(riscvemu::Register::S6) == 0x8000000000000000);
+        CHECK(reg(riscvemu::Register::S7) == 0);
+        CHECK(reg(riscvemu::Register::S8) == 9);
+        CHECK(reg(riscvemu::Register::S9) == (uint64_t)-2);
+        CHECK(reg(riscvemu::Register::S10) == 0x55555553);
+        CHECK(reg(riscvemu::Register::S11) == (uint64_t)-1);
+        CHECK(reg(riscvemu::Register::T6) == (uint64_t)-7);
+        CHECK(reg(riscvemu::Register::T5) == ~0ULL);
+        CHECK(reg(riscvemu::Register::S0) == 0xffffffff80000000);
+        CHECK(reg(riscvemu::Register::S1) == 0);
+    }
+}
+
+TEST_CASE("testing floating point instructions") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu = setupTestContext("float.bin");
+        cpu.run(engine);
+
+        auto reg = [&](riscvemu::Register r) { return cpu.getRegister(r); };
+        CHECK(reg(riscvemu::Register::A0) == 75);
+        CHECK(reg(riscvemu::Register::A1) == 0x41500000);
+        CHECK(reg(riscvemu::Register::A2) == 0xffffffff41500000);
+        CHECK(reg(riscvemu::Register::A3) == 13);
+        CHECK(reg(riscvemu::Register::A4) == 0x4052c00000000000);
+        CHECK(cpu.getFloatRegister(0) == 0x4052c00000000000);
+        // Rounding 2.5 and -2.5.
+        CHECK(reg(riscvemu::Register::A5) == 2);
+        CHECK(reg(riscvemu::Register::A6) == 3);
+        CHECK(reg(riscvemu::Register::A7) == (uint64_t)-3);
+        CHECK(reg(riscvemu::Register::S2) == (uint64_t)-2);
+        CHECK(reg(riscvemu::Register::S3) == 1);
+        CHECK(reg(riscvemu::Register::S4) == riscvemu::FlagInexact);
+        CHECK(reg(riscvemu::Register::S5) == 0x7ff0000000000000);
+        CHECK(reg(riscvemu::Register::S6) == riscvemu::FlagDivByZero);
+        CHECK(reg(riscvemu::Register::S7) == 0x7ff8000000000000);
+        CHECK(reg(riscvemu::Register::S8) == 0);
+        CHECK(reg(riscvemu::Register::S9) == 0x7fffffffffffffff);
+        CHECK(reg(riscvemu::Register::S10) == riscvemu::FlagInvalid);
+        CHECK(reg(riscvemu::Register::S11) == 2);
+        CHECK(reg(riscvemu::Register::T2) == 1 << 9);
+        CHECK(reg(riscvemu::Register::T3) == 1 << 1);
+        CHECK(reg(riscvemu::Register::T4) == 0);
+        CHECK(reg(riscvemu::Register::T5) == 1);
+        CHECK(reg(riscvemu::Register::T6) == 1);
+        CHECK(reg(riscvemu::Register::S0) == 0);
+        CHECK(reg(riscvemu::Register::S1) ==
+              (riscvemu::FlagInvalid | riscvemu::FlagInexact));
+        // The flags raised by the last instructions are folded into fflags
+        // when the run returns.
+        CHECK(cpu.getCSR(riscvemu::FFlags) ==
+              (riscvemu::FlagInvalid | riscvemu::FlagInexact));
+    }
+
+    // Floating point instructions are illegal while mstatus.FS is Off.
+    auto cpu = setupTestContext("float.bin");
+    cpu.store<uint32_t>(riscvemu::MemoryBaseAddr + 4, 0x30001073);
+    cpu.run();
+    CHECK(cpu.getCSR(riscvemu::MCause) ==
+          (uint64_t)riscvemu::TrapCause::IllegalInstruction);
+}
+
+TEST_CASE("testing rounding ties to max magnitude") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu = setupTestContext("float_rmm.bin");
+        cpu.run(engine);
+
+        auto reg = [&](riscvemu::Register r) { return cpu.getRegister(r); };
+        CHECK(reg(riscvemu::Register::A0) == 0x3f800000);
+        CHECK(reg(riscvemu::Register::A1) == 0x3f800001);
+        CHECK(reg(riscvemu::Register::A2) == 0xffffffffbf800001);
+        CHECK(reg(riscvemu::Register::A3) == 0x3f800000);
+        CHECK(reg(riscvemu::Register::A4) == 0x3f801001);
+        CHECK(reg(riscvemu::Register::A5) == 0x3f801001);
+        CHECK(reg(riscvemu::Register::A6) == 0x4b800001);
+        CHECK(reg(riscvemu::Register::A7) == 0x3ff0000000000001);
+        CHECK(reg(riscvemu::Register::S2) == 0x3f800001);
+        CHECK(reg(riscvemu::Register::S3) == 0x3f800001);
+        CHECK(reg(riscvemu::Register::S4) == 0x3f801001);
+        CHECK(reg(riscvemu::Register::S5) == 0x3f800000);
+    }
+}
+
+TEST_CASE("testing vector instructions") {
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto cpu = setupTestContext("vector.bin");
+        cpu.run(engine);
+
+        auto reg = [&](riscvemu::Register r) { return cpu.getRegister(r); };
+        CHECK(reg(riscvemu::Register::A0) == 16);
+        CHECK(reg(riscvemu::Register::A1) == 1360);
+        CHECK(reg(riscvemu::Register::S10) == 240);
+        // Strided load, masked add and strided store.
+        CHECK(reg(riscvemu::Register::A2) == 8);
+        CHECK(reg(riscvemu::Register::A3) == 56);
+        CHECK(reg(riscvemu::Register::A4) == 456);
+        CHECK(reg(riscvemu::Register::A5) == 112);
+        CHECK(reg(riscvemu::Register::S9) == 1);
+        // Fractional LMUL.
+        CHECK(reg(riscvemu::Register::A6) == 4);
+        CHECK(reg(riscvemu::Register::A7) == (uint64_t)-4);
+        CHECK(reg(riscvemu::Register::S11) == 3);
+        // Doubles.
+        CHECK(reg(riscvemu::Register::S2) == 18);
+        CHECK(reg(riscvemu::Register::S3) == 0x401b000000000000);
+        CHECK(reg(riscvemu::Register::S4) == 4);
+        CHECK(reg(riscvemu::Register::S5) == 0xd8);
+        CHECK(reg(riscvemu::Register::S6) == riscvemu::VectorBytes);
+        // Unsupported vtype.
+        CHECK(reg(riscvemu::Register::S7) == 0);
+        CHECK(reg(riscvemu::Register::S8) == riscvemu::MaskVIll);
+    }
+
+    // Vector arithmetic is illegal until vtype is configured.
+    auto cpu = setupTestContext("vector.bin");
+    cpu.store<uint32_t>(riscvemu::MemoryBaseAddr, 0x02000057);
+    cpu.run();
+    CHECK(cpu.getCSR(riscvemu::MCause) ==
+          (uint64_t)riscvemu::TrapCause::IllegalInstruction);
+}
+
+TEST_CASE("testing snapshots are cloned copy-on-write") {
+    auto snapshot =
+        riscvemu::Snapshot(riscvemu::VMContext::fromImage("loop.bin"));
+    auto first  = riscvemu::CPU(snapshot.clone());
+    auto second = riscvemu::CPU(snapshot.clone());
+    auto word   = second.load<uint32_t>(riscvemu::MemoryBaseAddr);
+
+    // Writes to a clone are private to it.
+    first.store<uint32_t>(riscvemu::MemoryBaseAddr, 0);
+    CHECK(second.load<uint32_t>(riscvemu::MemoryBaseAddr) == word);
+    second.run();
+    CHECK(second.getRegister(riscvemu::Register::A0) == 5050);
+    auto third = riscvemu::CPU(snapshot.clone());
+    CHECK(third.load<uint32_t>(riscvemu::MemoryBaseAddr) == word);
+    third.run();
+    CHECK(third.getRegister(riscvemu::Register::A0) == 5050);
+}
+
+TEST_CASE("testing batch runs") {
+    std::vector<std::vector<uint8_t>> inputs;
+    std::vector<uint64_t> sums;
+    for (size_t i = 0; i < 200; i++) {
+        // Uneven input sizes so workers run out of work at different times.
+        std::vector<uint8_t> input(i * 37 % 1000);
+        uint64_t sum = 0;
+        for (size_t j = 0; j < input.size(); j++) {
+            input[j] = static_cast<uint8_t>(i + j);
+            sum += input[j];
+        }
+        inputs.push_back(std::move(input));
+        sums.push_back(sum);
+    }
+
+    auto runner = riscvemu::BatchRunner(
+        riscvemu::VMContext::fromImage("batch_sum.bin"), 4);
+    CHECK(runner.threads() == 4);
+    for (auto engine : AllEngines) {
+        CAPTURE(static_cast<int>(engine));
+        auto results = runner.run(inputs, engine);
+        REQUIRE(results.size() == inputs.size());
+        for (size_t i = 0; i < results.size(); i++) {
+            CAPTURE(i);
+            CHECK(results[i].error.empty());
+            CHECK(results[i].registers[(size_t)riscvemu::Register::A0] ==
+                  sums[i]);
+        }
+    }
+
+    // Inputs that don't fit below the stack are reported per run.
+    auto small = riscvemu::BatchRunner(
+        riscvemu::VMContext(std::vector<uint8_t>{0x13, 0, 0, 0}, 4096), 1);
+    auto results = small.run({std::vector<uint8_t>(8192)}, AllEngines[0]);
+    REQUIRE(results.size() == 1);
+    CHECK(!results[0].error.empty());
+    CHECK(small.run({}, AllEngines[0]).empty());
+}
+
+/// @brief Write a riscv-tests like ELF executable at path: code at
+/// MemoryBaseAddr followed by the tohost word, named in the symbol table.
+/// @param path
+/// @param code
+static auto writeTohostProgram(const char* path,
+                               const std::vector<uint32_t>& code) -> void {
+    constexpr uint64_t tohost = 0x40;
+    constexpr char names[]    = "\0tohost";
+    riscvemu::Elf64Header header{};
+    std::memcpy(header.ident, riscvemu::ElfMagic, sizeof(riscvemu::ElfMagic));
+    header.ident[4]  = riscvemu::ElfClass64;
+    header.ident[5]  = riscvemu::ElfDataLSB;
+    header.type      = riscvemu::ElfTypeExec;
+    header.machine   = riscvemu::ElfMachineRISCV;
+    header.entry     = riscvemu::MemoryBaseAddr;
+    header.phoff     = sizeof(header);
+    header.phentsize = sizeof(riscvemu::Elf64ProgramHeader);
+    header.phnum     = 1;
+    header.shoff     = 0x1100;
+    header.shentsize = sizeof(riscvemu::Elf64SectionHeader);
+    header.shnum     = 3;
+    riscvemu::Elf64ProgramHeader segment{.type   = riscvemu::ElfSegmentLoad,
+                                         .flags  = riscvemu::ElfSegmentExec,
+                                         .offset = 0x1000,
+                                         .vaddr  = riscvemu::MemoryBaseAddr,
+                                         .paddr  = riscvemu::MemoryBaseAddr,
+                                         .filesz = tohost + 8,
+                                         .memsz  = tohost + 8,
+                                         .align  = 0x1000};
+    riscvemu::Elf64Symbol symbols[2]{};
+    symbols[1].name  = 1;
+    symbols[1].value = riscvemu::MemoryBaseAddr + tohost;
+    riscvemu::Elf64SectionHeader sections[3]{};
+    sections[1].type   = riscvemu::ElfSectionSymbols;
+    sections[1].offset = 0x1200;
+    sections[1].size   = sizeof(symbols);
+    sections[1].link   = 2;
+    // String table.
+    sections[2].type   = 3;
+    sections[2].offset = 0x1240;
+    sections[2].size   = sizeof(names);
+    std::vector<uint8_t> file(0x1300);
+    std::memcpy(file.data(), &header, sizeof(header));
+    std::memcpy(file.data() + sizeof(header), &segment, sizeof(segment));
+    std::memcpy(file.data() + 0x1000, code.data(), code.size() * 4);
+    std::memcpy(file.data() + 0x1100, sections, sizeof(sections));
+    std::memcpy(file.data() + 0x1200, symbols, sizeof(symbols));
+    std::memcpy(file.data() + 0x1240, names, sizeof(names));
+    std::ofstream(path, std::ios::binary)
+        .write((const char*)file.data(), (std::streamsize)file.size());
+}
+
+TEST_CASE("testing riscv-tests runs") {
+    // auipc t0, 0; addi t1, zero, 1 or 7; sd t1, 64(t0) (tohost); j .
+    writeTohostProgram("tohost_pass.elf",
+                       {0x00000297, 0x00100313, 0x0462b023, 0x0000006f});
+    writeTohostProgram("tohost_fail.elf",
+                       {0x00000297, 0x00700313, 0x0462b023, 0x0000006f});
+    // Falls into zeroes, an illegal instruction without trap handler.
+    writeTohostProgram("tohost_stop.elf", {0x00000013});
+    writeTohostProgram("tohost_spin.elf", {0x0000006f});
+    uint64_t tohost = 0;
+    REQUIRE(riscvemu::findElfSymbol("tohost_pass.elf", "tohost", tohost));
+    CHECK(tohost == riscvemu::MemoryBaseAddr + 0x40);
+    CHECK_FALSE(riscvemu::findElfSymbol("tohost_pass.elf", "fromhost",
+                                        tohost));
+
+    riscvemu::ConformanceOptions options;
+    options.threads = 4;
+    options.slice   = 1;
+    options.limit   = 5000;
+    auto runner     = riscvemu::ConformanceRunner(options);
+    CHECK(runner.threads() == 4);
+    const std::vector<riscvemu::Engine> engines(std::begin(AllEngines),
+                                                std::end(AllEngines));
+    auto results = runner.run({"tohost_pass.elf", "tohost_fail.elf",
+                               "tohost_stop.elf", "tohost_spin.elf",
+                               "loop.bin"},
+                              engines);
+    REQUIRE(results.size() == 5 * engines.size());
+    for (size_t i = 0; i < engines.size(); i++) {
+        CAPTURE(i);
+        const auto* result = &results[i];
+        CHECK(result->engine == engines[i]);
+        CHECK(result->status == riscvemu::ConformanceStatus::Pass);
+        // Polled after every instruction, the count is exact.
+        CHECK(result->instructions == 3);
+
+        result = &results[engines.size() + i];
+        CHECK(result->path == "tohost_fail.elf");
+        CHECK(result->status == riscvemu::ConformanceStatus::Fail);
+        CHECK(result->test == 3);
+
+        result = &results[2 * engines.size() + i];
+        CHECK(result->status == riscvemu::ConformanceStatus::Stopped);
+        CHECK(result->instructions == 1);
+
+        result = &results[3 * engines.size() + i];
+        CHECK(result->status == riscvemu::ConformanceStatus::Timeout);
+        CHECK(result->instructions == 5000);
+
+        result = &results[4 * engines.size() + i];
+        CHECK(result->status == riscvemu::ConformanceStatus::Error);
+        CHECK(!result->error.empty());
+    }
+
+    // Coarser slices round the counts up, the same on every engine.
+    options.slice = 100;
+    auto counted  = riscvemu::ConformanceRunner(options).run(
+        {"tohost_pass.elf"}, engines);
+    for (const auto& result : counted) {
+        CHECK(result.status == riscvemu::ConformanceStatus::Pass);
+        CHECK(result.instructions == 100);
+    }
+}